@@ -0,0 +1,849 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file
+ *
+ * Session-owned storage of annotations, with range queries.
+ */
+
+/**
+ * @defgroup grp_annstore Annotation store
+ *
+ * Session-owned storage of annotations, with range queries.
+ *
+ * The store keeps one track per decoder instance and annotation row.
+ * A track holds its annotations in columns (start, end, class, text),
+ * sorted by start sample. Texts are interned in a string table of the
+ * store. For overlap queries, every block of ANNSTORE_BLOCK annotations
+ * records the maximum end sample in the block, and the running maximum
+ * over all blocks up to it. Counts use a sorted copy of the end samples.
+ *
+ * Annotations are appended as they arrive. The next query sorts them
+ * into the indexed part of the track. Since decoders put annotations in
+ * nearly ascending order, this merge usually only touches the tail.
+ *
+ * For zoomed-out views, every track also keeps a pyramid of summaries.
+ * Level L groups annotations by start sample into buckets of
+ * 2^(LOD_BASE_SHIFT + L * LOD_LEVEL_SHIFT) samples, and is updated as
+ * annotations arrive. Only buckets which hold annotations are stored.
+ * Buckets count the annotations per class of the decoder.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+/* Number of annotations per index block. */
+#define ANNSTORE_BLOCK 64
+
+/* Summary levels: 256 samples per bucket at level 0, 16x per level. */
+#define LOD_BASE_SHIFT 8
+#define LOD_LEVEL_SHIFT 4
+#define LOD_LEVELS 14
+
+struct lod_bucket {
+	/* Start sample >> level shift. */
+	uint64_t index;
+	uint64_t count;
+	uint64_t first_start, first_end;
+	uint64_t last_start, last_end;
+	int first_class, last_class;
+	guint32 first_text, last_text;
+};
+
+struct annstore_track {
+	/* Columns. Entries before 'indexed' are sorted by start. */
+	GArray *start;
+	GArray *end;
+	GArray *ann_class;
+	GArray *text_id;
+	guint indexed;
+	/* End samples of the indexed entries, in ascending order. */
+	GArray *end_sorted;
+	/* Per block: maximum end, and maximum end of all blocks so far. */
+	GArray *block_max;
+	GArray *block_pmax;
+	/* Summary buckets per level, sorted by index. */
+	GArray *lod[LOD_LEVELS];
+	/* Per level, num_classes counts for each bucket, in bucket order. */
+	GArray *lod_counts[LOD_LEVELS];
+	guint num_classes;
+};
+
+struct annstore_inst {
+	/* Tracks by ann_row + 1, index 0 holds annotations without a row. */
+	GPtrArray *tracks;
+};
+
+struct srd_annstore {
+	GMutex mutex;
+	/* Instance ID -> struct annstore_inst. */
+	GHashTable *insts;
+	/* Joined text -> text ID + 1. */
+	GHashTable *text_ids;
+	/* Text ID -> NULL-terminated string array. */
+	GPtrArray *texts;
+};
+
+/** @endcond */
+
+static struct annstore_track *track_new(guint num_classes)
+{
+	struct annstore_track *t;
+	int i;
+
+	t = g_malloc0(sizeof(*t));
+	t->start = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	t->end = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	t->ann_class = g_array_new(FALSE, FALSE, sizeof(int));
+	t->text_id = g_array_new(FALSE, FALSE, sizeof(guint32));
+	t->end_sorted = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	t->block_max = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	t->block_pmax = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	for (i = 0; i < LOD_LEVELS; i++) {
+		t->lod[i] = g_array_new(FALSE, FALSE, sizeof(struct lod_bucket));
+		t->lod_counts[i] = g_array_new(FALSE, TRUE, sizeof(uint64_t));
+	}
+	t->num_classes = num_classes;
+
+	return t;
+}
+
+static void track_free(gpointer data)
+{
+	struct annstore_track *t;
+	int i;
+
+	if (!(t = data))
+		return;
+
+	for (i = 0; i < LOD_LEVELS; i++) {
+		g_array_free(t->lod[i], TRUE);
+		g_array_free(t->lod_counts[i], TRUE);
+	}
+	g_array_free(t->start, TRUE);
+	g_array_free(t->end, TRUE);
+	g_array_free(t->ann_class, TRUE);
+	g_array_free(t->text_id, TRUE);
+	g_array_free(t->end_sorted, TRUE);
+	g_array_free(t->block_max, TRUE);
+	g_array_free(t->block_pmax, TRUE);
+	g_free(t);
+}
+
+static void inst_free(gpointer data)
+{
+	struct annstore_inst *inst;
+
+	inst = data;
+	g_ptr_array_free(inst->tracks, TRUE);
+	g_free(inst);
+}
+
+static struct srd_annstore *annstore_new(void)
+{
+	struct srd_annstore *store;
+
+	store = g_malloc0(sizeof(*store));
+	g_mutex_init(&store->mutex);
+	store->insts = g_hash_table_new_full(g_str_hash, g_str_equal,
+		g_free, inst_free);
+	store->text_ids = g_hash_table_new_full(g_str_hash, g_str_equal,
+		g_free, NULL);
+	store->texts = g_ptr_array_new_with_free_func(
+		(GDestroyNotify)g_strfreev);
+
+	return store;
+}
+
+static void annstore_destroy(struct srd_annstore *store)
+{
+	g_hash_table_destroy(store->insts);
+	g_hash_table_destroy(store->text_ids);
+	g_ptr_array_free(store->texts, TRUE);
+	g_mutex_clear(&store->mutex);
+	g_free(store);
+}
+
+/* Creates a missing track for the decoder's classes, unless dec is NULL. */
+static struct annstore_track *track_get(struct srd_annstore *store,
+		const char *inst_id, int ann_row, const struct srd_decoder *dec)
+{
+	gboolean create;
+	struct annstore_inst *inst;
+	guint idx;
+
+	if (ann_row < -1)
+		ann_row = -1;
+	idx = ann_row + 1;
+	create = dec != NULL;
+
+	if (!(inst = g_hash_table_lookup(store->insts, inst_id))) {
+		if (!create)
+			return NULL;
+		inst = g_malloc0(sizeof(*inst));
+		inst->tracks = g_ptr_array_new_with_free_func(track_free);
+		g_hash_table_insert(store->insts, g_strdup(inst_id), inst);
+	}
+
+	if (idx >= inst->tracks->len) {
+		if (!create)
+			return NULL;
+		g_ptr_array_set_size(inst->tracks, idx + 1);
+	}
+	if (!g_ptr_array_index(inst->tracks, idx) && create)
+		g_ptr_array_index(inst->tracks, idx) =
+			track_new(g_slist_length(dec->annotations));
+
+	return g_ptr_array_index(inst->tracks, idx);
+}
+
+static guint32 text_id_get(struct srd_annstore *store, char **ann_text)
+{
+	static char *no_text[] = { NULL };
+	char *key;
+	gpointer val;
+	guint32 id;
+
+	if (!ann_text)
+		ann_text = no_text;
+
+	/* Unit separator, as texts may contain about anything else. */
+	key = g_strjoinv("\x1f", ann_text);
+	if ((val = g_hash_table_lookup(store->text_ids, key))) {
+		g_free(key);
+		return GPOINTER_TO_UINT(val) - 1;
+	}
+
+	id = store->texts->len;
+	g_ptr_array_add(store->texts, g_strdupv(ann_text));
+	g_hash_table_insert(store->text_ids, key, GUINT_TO_POINTER(id + 1));
+
+	return id;
+}
+
+static gint cmp_perm_start(gconstpointer a, gconstpointer b, gpointer data)
+{
+	const uint64_t *start;
+	uint64_t sa, sb;
+
+	start = data;
+	sa = start[*(const guint *)a];
+	sb = start[*(const guint *)b];
+
+	return (sa > sb) - (sa < sb);
+}
+
+static gint cmp_u64(gconstpointer a, gconstpointer b, gpointer data)
+{
+	uint64_t va, vb;
+
+	(void)data;
+	va = *(const uint64_t *)a;
+	vb = *(const uint64_t *)b;
+
+	return (va > vb) - (va < vb);
+}
+
+/*
+ * Merge the sorted values tail[0..count) into the sorted values of the
+ * first 'len' entries of arr, which has room for len + count entries.
+ * Works from the back, such that only displaced entries get moved.
+ */
+static void merge_sorted_u64(uint64_t *arr, guint len, const uint64_t *tail,
+		guint count)
+{
+	gint64 i, j, w;
+
+	i = (gint64)len - 1;
+	j = (gint64)count - 1;
+	w = (gint64)len + count - 1;
+	while (j >= 0) {
+		if (i >= 0 && arr[i] > tail[j])
+			arr[w--] = arr[i--];
+		else
+			arr[w--] = tail[j--];
+	}
+}
+
+/* Sort the entries appended since the last query into the index. */
+static void track_index(struct annstore_track *t)
+{
+	uint64_t *start, *end, *tmp_start, *tmp_end, *ends, bmax, pmax;
+	int *cls, *tmp_cls;
+	guint32 *text, *tmp_text;
+	guint n, m, count, first, *perm, b, i;
+	gint64 si, sj, sw;
+	gboolean in_order;
+
+	n = t->start->len;
+	m = t->indexed;
+	if (n == m)
+		return;
+	count = n - m;
+
+	start = (uint64_t *)t->start->data;
+	end = (uint64_t *)t->end->data;
+	cls = (int *)t->ann_class->data;
+	text = (guint32 *)t->text_id->data;
+
+	/* Ends of the new entries, for the sorted end column. */
+	ends = g_malloc(count * sizeof(uint64_t));
+	memcpy(ends, end + m, count * sizeof(uint64_t));
+	g_qsort_with_data(ends, count, sizeof(uint64_t), cmp_u64, NULL);
+	g_array_set_size(t->end_sorted, n);
+	merge_sorted_u64((uint64_t *)t->end_sorted->data, m, ends, count);
+	g_free(ends);
+
+	in_order = !m || start[m] >= start[m - 1];
+	for (i = m + 1; in_order && i < n; i++) {
+		if (start[i] < start[i - 1])
+			in_order = FALSE;
+	}
+
+	if (in_order) {
+		first = m;
+	} else {
+		/* Sort the new entries (stable), then merge from the back. */
+		perm = g_malloc(count * sizeof(guint));
+		for (i = 0; i < count; i++)
+			perm[i] = m + i;
+		g_qsort_with_data(perm, count, sizeof(guint), cmp_perm_start,
+			start);
+		tmp_start = g_malloc(count * sizeof(uint64_t));
+		tmp_end = g_malloc(count * sizeof(uint64_t));
+		tmp_cls = g_malloc(count * sizeof(int));
+		tmp_text = g_malloc(count * sizeof(guint32));
+		for (i = 0; i < count; i++) {
+			tmp_start[i] = start[perm[i]];
+			tmp_end[i] = end[perm[i]];
+			tmp_cls[i] = cls[perm[i]];
+			tmp_text[i] = text[perm[i]];
+		}
+		g_free(perm);
+
+		si = (gint64)m - 1;
+		sj = (gint64)count - 1;
+		sw = (gint64)n - 1;
+		while (sj >= 0) {
+			if (si >= 0 && start[si] > tmp_start[sj]) {
+				start[sw] = start[si];
+				end[sw] = end[si];
+				cls[sw] = cls[si];
+				text[sw] = text[si];
+				si--;
+			} else {
+				start[sw] = tmp_start[sj];
+				end[sw] = tmp_end[sj];
+				cls[sw] = tmp_cls[sj];
+				text[sw] = tmp_text[sj];
+				sj--;
+			}
+			sw--;
+		}
+		first = (guint)(si + 1);
+
+		g_free(tmp_start);
+		g_free(tmp_end);
+		g_free(tmp_cls);
+		g_free(tmp_text);
+	}
+
+	/* Rebuild the block maxima from the first changed block on. */
+	b = first / ANNSTORE_BLOCK;
+	g_array_set_size(t->block_max, b);
+	g_array_set_size(t->block_pmax, b);
+	pmax = b ? g_array_index(t->block_pmax, uint64_t, b - 1) : 0;
+	for (; b * ANNSTORE_BLOCK < n; b++) {
+		bmax = 0;
+		for (i = b * ANNSTORE_BLOCK; i < n && i < (b + 1) * ANNSTORE_BLOCK; i++)
+			bmax = MAX(bmax, end[i]);
+		pmax = MAX(pmax, bmax);
+		g_array_append_val(t->block_max, bmax);
+		g_array_append_val(t->block_pmax, pmax);
+	}
+
+	t->indexed = n;
+}
+
+static unsigned int lod_shift(int level)
+{
+	return LOD_BASE_SHIFT + level * LOD_LEVEL_SHIFT;
+}
+
+/* Position of the first bucket with an index >= idx. */
+static guint lod_find(GArray *level, uint64_t idx)
+{
+	const struct lod_bucket *b;
+	guint lo, hi, mid;
+
+	b = (const struct lod_bucket *)level->data;
+	lo = 0;
+	hi = level->len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (b[mid].index < idx)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Account an annotation in the summary bucket of every level. */
+static void lod_add(struct annstore_track *t, uint64_t start, uint64_t end,
+		int ann_class, guint32 text)
+{
+	struct lod_bucket *b, nb;
+	GArray *level, *counts;
+	uint64_t idx;
+	guint pos, n;
+	int l;
+
+	n = t->num_classes;
+	for (l = 0; l < LOD_LEVELS; l++) {
+		level = t->lod[l];
+		counts = t->lod_counts[l];
+		idx = start >> lod_shift(l);
+
+		/* Annotations mostly arrive in order, try the last bucket. */
+		pos = level->len;
+		if (pos && g_array_index(level, struct lod_bucket, pos - 1).index >= idx) {
+			pos--;
+			if (g_array_index(level, struct lod_bucket, pos).index != idx)
+				pos = lod_find(level, idx);
+		}
+		if (pos == level->len ||
+				g_array_index(level, struct lod_bucket, pos).index != idx) {
+			memset(&nb, 0, sizeof(nb));
+			nb.index = idx;
+			g_array_insert_val(level, pos, nb);
+			/* Make room for the new bucket's counts. */
+			g_array_set_size(counts, counts->len + n);
+			memmove(&g_array_index(counts, uint64_t, (pos + 1) * n),
+				&g_array_index(counts, uint64_t, pos * n),
+				(counts->len - (pos + 1) * n) * sizeof(uint64_t));
+			memset(&g_array_index(counts, uint64_t, pos * n), 0,
+				n * sizeof(uint64_t));
+		}
+		b = &g_array_index(level, struct lod_bucket, pos);
+
+		if (!b->count || start < b->first_start) {
+			b->first_start = start;
+			b->first_end = end;
+			b->first_class = ann_class;
+			b->first_text = text;
+		}
+		if (!b->count || start >= b->last_start) {
+			b->last_start = start;
+			b->last_end = end;
+			b->last_class = ann_class;
+			b->last_text = text;
+		}
+		if (ann_class >= 0 && (guint)ann_class < n)
+			g_array_index(counts, uint64_t, pos * n + ann_class)++;
+		b->count++;
+	}
+}
+
+/* Index of the first value > v. */
+static guint upper_bound_u64(const uint64_t *arr, guint len, uint64_t v)
+{
+	guint lo, hi, mid;
+
+	lo = 0;
+	hi = len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (arr[mid] <= v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Index of the first value >= v. */
+static guint lower_bound_u64(const uint64_t *arr, guint len, uint64_t v)
+{
+	guint lo, hi, mid;
+
+	lo = 0;
+	hi = len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (arr[mid] < v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/**
+ * Add an annotation to the session's store, if it has one. The caller
+ * must hold the session's sinks_lock.
+ *
+ * @private
+ */
+SRD_PRIV void srd_annstore_add(struct srd_session *sess,
+		const struct srd_proto_data *pdata)
+{
+	struct srd_annstore *store;
+	struct srd_proto_data_annotation *pda;
+	struct annstore_track *t;
+	uint64_t start, end;
+	guint32 id;
+
+	if (!(store = sess->annstore))
+		return;
+
+	pda = pdata->data;
+	start = pdata->start_sample;
+	/* Counts rely on end >= start. */
+	end = MAX(pdata->end_sample, start);
+
+	g_mutex_lock(&store->mutex);
+	t = track_get(store, pdata->pdo->di->inst_id, pda->ann_row,
+		pdata->pdo->di->decoder);
+	id = text_id_get(store, pda->ann_text);
+	g_array_append_val(t->start, start);
+	g_array_append_val(t->end, end);
+	g_array_append_val(t->ann_class, pda->ann_class);
+	g_array_append_val(t->text_id, id);
+	lod_add(t, start, end, pda->ann_class, id);
+	g_mutex_unlock(&store->mutex);
+}
+
+/** @private */
+SRD_PRIV void srd_annstore_free(struct srd_session *sess)
+{
+	if (!sess->annstore)
+		return;
+
+	annstore_destroy(sess->annstore);
+	sess->annstore = NULL;
+}
+
+/**
+ * Enable or disable the session's annotation store.
+ *
+ * When enabled, the session keeps all annotations of its decoder
+ * instances, for srd_annstore_query() and srd_annstore_count(). This
+ * works with and without an SRD_OUTPUT_ANN callback. Disabling the
+ * store releases its contents. This may be called while the session
+ * decodes, but not from an output callback.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param enable TRUE to keep annotations.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_annstore_set(struct srd_session *sess,
+		gboolean enable)
+{
+	struct srd_annstore *store;
+
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	if (enable && !sess->annstore) {
+		store = annstore_new();
+		g_rw_lock_writer_lock(&sess->sinks_lock);
+		sess->annstore = store;
+		g_rw_lock_writer_unlock(&sess->sinks_lock);
+	} else if (!enable && sess->annstore) {
+		/* Decoder threads may be adding to it. */
+		g_rw_lock_writer_lock(&sess->sinks_lock);
+		store = sess->annstore;
+		sess->annstore = NULL;
+		g_rw_lock_writer_unlock(&sess->sinks_lock);
+		annstore_destroy(store);
+	}
+
+	return SRD_OK;
+}
+
+/**
+ * Get the stored annotations which overlap a range of samples.
+ *
+ * An annotation overlaps the range if it starts at or before
+ * end_sample and ends at or after start_sample. The callback receives
+ * the annotations in the order of their start samples. It runs with
+ * the store locked, so it must not call other store functions.
+ *
+ * @param sess The session. Must not be NULL and must have a store.
+ * @param inst_id The ID of the decoder instance. Must not be NULL.
+ * @param ann_row The annotation row, -1 for classes without a row.
+ * @param start_sample The first sample of the range.
+ * @param end_sample The last sample of the range.
+ * @param cb The function to call per annotation. Must not be NULL.
+ * @param cb_data Private data for the callback function. Can be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_annstore_query(struct srd_session *sess, const char *inst_id,
+		int ann_row, uint64_t start_sample, uint64_t end_sample,
+		srd_annstore_callback cb, void *cb_data)
+{
+	struct srd_annstore *store;
+	struct annstore_track *t;
+	struct srd_annstore_item item;
+	const uint64_t *start, *end, *bmax, *pmax;
+	guint hi, nblocks, b, i, last;
+
+	if (!sess || !sess->annstore || !inst_id || !cb)
+		return SRD_ERR_ARG;
+	if (start_sample > end_sample)
+		return SRD_ERR_ARG;
+
+	store = sess->annstore;
+	g_mutex_lock(&store->mutex);
+
+	if (!(t = track_get(store, inst_id, ann_row, NULL))) {
+		g_mutex_unlock(&store->mutex);
+		return SRD_OK;
+	}
+	track_index(t);
+
+	start = (const uint64_t *)t->start->data;
+	end = (const uint64_t *)t->end->data;
+	bmax = (const uint64_t *)t->block_max->data;
+	pmax = (const uint64_t *)t->block_pmax->data;
+
+	/* Entries from hi on start after the range. */
+	hi = upper_bound_u64(start, t->indexed, end_sample);
+	nblocks = (hi + ANNSTORE_BLOCK - 1) / ANNSTORE_BLOCK;
+
+	/* Blocks before b all end before the range. */
+	b = lower_bound_u64(pmax, nblocks, start_sample);
+
+	item.ann_row = ann_row < -1 ? -1 : ann_row;
+	for (; b < nblocks; b++) {
+		if (bmax[b] < start_sample)
+			continue;
+		last = MIN((b + 1) * ANNSTORE_BLOCK, hi);
+		for (i = b * ANNSTORE_BLOCK; i < last; i++) {
+			if (end[i] < start_sample)
+				continue;
+			item.start_sample = start[i];
+			item.end_sample = end[i];
+			item.ann_class = g_array_index(t->ann_class, int, i);
+			item.ann_text = g_ptr_array_index(store->texts,
+				g_array_index(t->text_id, guint32, i));
+			if (!cb(&item, cb_data))
+				goto done;
+		}
+	}
+
+done:
+	g_mutex_unlock(&store->mutex);
+
+	return SRD_OK;
+}
+
+/**
+ * Count the stored annotations which overlap a range of samples.
+ *
+ * Uses the same overlap rule as srd_annstore_query(), and takes
+ * logarithmic time in the number of annotations of the row.
+ *
+ * @param sess The session. Must not be NULL and must have a store.
+ * @param inst_id The ID of the decoder instance. Must not be NULL.
+ * @param ann_row The annotation row, -1 for classes without a row.
+ * @param start_sample The first sample of the range.
+ * @param end_sample The last sample of the range.
+ * @param count Pointer which receives the count. Must not be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_annstore_count(struct srd_session *sess, const char *inst_id,
+		int ann_row, uint64_t start_sample, uint64_t end_sample,
+		uint64_t *count)
+{
+	struct srd_annstore *store;
+	struct annstore_track *t;
+	guint started, ended;
+
+	if (!sess || !sess->annstore || !inst_id || !count)
+		return SRD_ERR_ARG;
+	if (start_sample > end_sample)
+		return SRD_ERR_ARG;
+
+	store = sess->annstore;
+	*count = 0;
+
+	g_mutex_lock(&store->mutex);
+	if ((t = track_get(store, inst_id, ann_row, NULL))) {
+		track_index(t);
+		/* Entries which end before the range also start before it. */
+		started = upper_bound_u64((const uint64_t *)t->start->data,
+			t->indexed, end_sample);
+		ended = lower_bound_u64((const uint64_t *)t->end_sorted->data,
+			t->indexed, start_sample);
+		*count = started - ended;
+	}
+	g_mutex_unlock(&store->mutex);
+
+	return SRD_OK;
+}
+
+/**
+ * Summarize the stored annotations in a range of samples.
+ *
+ * Picks the finest summary level which covers the range with at most
+ * max_buckets buckets, and returns its non-empty buckets which overlap
+ * the range, in ascending order. A bucket accounts for the annotations
+ * which start within it, so an annotation appears in one bucket only.
+ * Ranges which even the coarsest level cannot cover with max_buckets
+ * buckets are truncated.
+ *
+ * @param sess The session. Must not be NULL and must have a store.
+ * @param inst_id The ID of the decoder instance. Must not be NULL.
+ * @param ann_row The annotation row, -1 for classes without a row.
+ * @param start_sample The first sample of the range.
+ * @param end_sample The last sample of the range.
+ * @param buckets Array which receives the buckets. Must not be NULL.
+ * @param max_buckets Number of entries in buckets. Must be > 0.
+ *
+ * @return The number of buckets upon success, a (negative) error code
+ *         otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_annstore_summary(struct srd_session *sess,
+		const char *inst_id, int ann_row, uint64_t start_sample,
+		uint64_t end_sample, struct srd_annstore_bucket *buckets,
+		unsigned int max_buckets)
+{
+	struct srd_annstore *store;
+	struct annstore_track *t;
+	struct srd_annstore_bucket *out;
+	const struct lod_bucket *b;
+	const uint64_t *counts;
+	GArray *level;
+	unsigned int shift;
+	uint64_t first_idx, last_idx;
+	guint pos, c;
+	int l, count;
+
+	if (!sess || !sess->annstore || !inst_id || !buckets || !max_buckets)
+		return SRD_ERR_ARG;
+	if (start_sample > end_sample)
+		return SRD_ERR_ARG;
+
+	store = sess->annstore;
+	count = 0;
+	max_buckets = MIN(max_buckets, (unsigned int)G_MAXINT);
+
+	g_mutex_lock(&store->mutex);
+	if (!(t = track_get(store, inst_id, ann_row, NULL))) {
+		g_mutex_unlock(&store->mutex);
+		return 0;
+	}
+
+	for (l = 0; l < LOD_LEVELS - 1; l++) {
+		shift = lod_shift(l);
+		if ((end_sample >> shift) - (start_sample >> shift) < max_buckets)
+			break;
+	}
+	level = t->lod[l];
+	shift = lod_shift(l);
+	first_idx = start_sample >> shift;
+	last_idx = end_sample >> shift;
+
+	for (pos = lod_find(level, first_idx); pos < level->len; pos++) {
+		b = &g_array_index(level, struct lod_bucket, pos);
+		if (b->index > last_idx || (unsigned int)count == max_buckets)
+			break;
+		out = &buckets[count++];
+		out->start_sample = b->index << shift;
+		out->end_sample = out->start_sample + ((UINT64_C(1) << shift) - 1);
+		out->count = b->count;
+		out->first.start_sample = b->first_start;
+		out->first.end_sample = b->first_end;
+		out->first.ann_class = b->first_class;
+		out->first.ann_row = ann_row < -1 ? -1 : ann_row;
+		out->first.ann_text = g_ptr_array_index(store->texts, b->first_text);
+		out->last.start_sample = b->last_start;
+		out->last.end_sample = b->last_end;
+		out->last.ann_class = b->last_class;
+		out->last.ann_row = out->first.ann_row;
+		out->last.ann_text = g_ptr_array_index(store->texts, b->last_text);
+		counts = &g_array_index(t->lod_counts[l], uint64_t,
+			pos * t->num_classes);
+		out->dominant_class = 0;
+		for (c = 1; c < t->num_classes; c++) {
+			if (counts[c] > counts[out->dominant_class])
+				out->dominant_class = c;
+		}
+	}
+	g_mutex_unlock(&store->mutex);
+
+	return count;
+}
+
+/**
+ * Remove all annotations from the session's store.
+ *
+ * srd_session_terminate_reset() clears the store as well.
+ *
+ * @param sess The session. Must not be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_annstore_clear(struct srd_session *sess)
+{
+	struct srd_annstore *store;
+
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	if (!(store = sess->annstore))
+		return SRD_OK;
+
+	g_mutex_lock(&store->mutex);
+	g_hash_table_remove_all(store->insts);
+	g_hash_table_remove_all(store->text_ids);
+	g_ptr_array_set_size(store->texts, 0);
+	g_mutex_unlock(&store->mutex);
+
+	return SRD_OK;
+}
+
+/** @} */
@@ -277,6 +277,43 @@ int atk_decoder_session_send(atk_session *sess,
                             (struct srd_input_data *)inbuf);
 }
 
+/**
+ * @brief       向会话发送数据视图：各通道数据可从缓冲区任意位开始
+ *              （bit_offset），采样间隔可大于1位（bit_stride），无需先拷贝
+ * 
+ * @param views                 各通道的数据视图，views[n] 对应通道n
+ * 
+ * @retval      
+ */
+int atk_decoder_session_send_views(atk_session *sess,
+                            uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
+                            const struct atk_input_view *views)
+{
+    return srd_session_send_views((struct srd_session *)sess, abs_start_samplenum,
+                                  abs_end_samplenum,
+                                  (const struct srd_input_view *)views);
+}
+
+/**
+ * @brief       向会话发送分段数据：每个通道的数据可由多个缓冲区（如多个
+ *              DMA 段）组成，段起始位可不按字节对齐，无需先拷贝拼接
+ * 
+ * @param channels              各通道的分段列表，channels[n] 对应通道n
+ * @param num_channels          通道数
+ * 
+ * @retval      
+ */
+int atk_decoder_session_send_segments(atk_session *sess,
+                            uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
+                            const struct atk_input_segments *channels,
+                            unsigned int num_channels)
+{
+    return srd_session_send_segments((struct srd_session *)sess, abs_start_samplenum,
+                                     abs_end_samplenum,
+                                     (const struct srd_input_segments *)channels,
+                                     num_channels);
+}
+
 int atk_decoder_session_send_eof(atk_session *sess)
 {
     return srd_session_send_eof((struct srd_session *)sess);
@@ -298,6 +335,484 @@ int atk_decoder_pd_output_callback_add(atk_session *sess,
     return srd_pd_output_callback_add((struct srd_session *)sess, output_type, (srd_pd_output_callback)cb, cb_data);
 }
 
+/**
+ * @brief       流水线模式：堆叠解码器在各自的线程中运行，需在 start 之前设置
+ * @retval      
+ */
+int atk_decoder_session_pipeline_set(atk_session *sess, atk_gboolean enable)
+{
+    return srd_session_pipeline_set((struct srd_session *)sess, enable);
+}
+
+/**
+ * @brief       协程模式：decode() 在调用线程上运行，不再创建解码线程。
+ *              需在 start 之前设置，且所有调用须来自同一线程
+ * @retval      
+ */
+int atk_decoder_session_coroutine_set(atk_session *sess, atk_gboolean enable)
+{
+    return srd_session_coroutine_set((struct srd_session *)sess, enable);
+}
+
+/**
+ * @brief       共享解码：解码器、选项、通道映射和初始电平都相同的底层实例
+ *              只解码一次，输出同时提交给各个实例。需在 start 之前设置
+ * @retval      
+ */
+int atk_decoder_session_inst_sharing_set(atk_session *sess, atk_gboolean enable)
+{
+    return srd_session_inst_sharing_set((struct srd_session *)sess, enable);
+}
+
+/**
+ * @brief       设置会话工作线程的 CPU 亲和性、NUMA 节点、调度策略与线程名前缀。
+ *              NUMA 节点仅在 set_numa 为真时生效，需在 start 之前设置
+ * @retval      
+ */
+int atk_decoder_session_thread_config_set(atk_session *sess,
+                                          const struct atk_thread_config *config)
+{
+    return srd_session_thread_config_set((struct srd_session *)sess,
+                                         (const struct srd_thread_config *)config);
+}
+
+/**
+ * @brief       由上层应用（如线程池）提供工作线程的创建与等待
+ * @retval      
+ */
+int atk_decoder_session_thread_factory_set(atk_session *sess,
+                                           const struct atk_thread_factory *factory)
+{
+    return srd_session_thread_factory_set((struct srd_session *)sess,
+                                          (const struct srd_thread_factory *)factory);
+}
+
+/**
+ * @brief       启用会话内置的注释存储（按实例与注释行分列保存），
+ *              禁用时释放已保存的注释，解码过程中也可调用，但不能在输出回调中调用
+ * @retval      
+ */
+int atk_decoder_session_annstore_set(atk_session *sess, atk_gboolean enable)
+{
+    return srd_session_annstore_set((struct srd_session *)sess, enable);
+}
+
+/**
+ * @brief       查询与 [start_sample, end_sample] 重叠的注释，按起始采样点顺序回调。
+ *              回调返回 FALSE 时停止查询
+ * @retval      
+ */
+int atk_decoder_annstore_query(atk_session *sess, const char *inst_id,
+                               int ann_row, uint64_t start_sample, uint64_t end_sample,
+                               atk_annstore_callback cb, void *cb_data)
+{
+    return srd_annstore_query((struct srd_session *)sess, inst_id, ann_row,
+                              start_sample, end_sample,
+                              (srd_annstore_callback)cb, cb_data);
+}
+
+/**
+ * @brief       统计与 [start_sample, end_sample] 重叠的注释数量
+ * @retval      
+ */
+int atk_decoder_annstore_count(atk_session *sess, const char *inst_id,
+                               int ann_row, uint64_t start_sample, uint64_t end_sample,
+                               uint64_t *count)
+{
+    return srd_annstore_count((struct srd_session *)sess, inst_id, ann_row,
+                              start_sample, end_sample, count);
+}
+
+/**
+ * @brief       缩放显示用的注释摘要：在不超过 max_buckets 个分桶内返回
+ *              区间内各桶的注释数量、首尾注释与主要类别
+ * @retval      分桶数量，负数为错误码
+ */
+int atk_decoder_annstore_summary(atk_session *sess, const char *inst_id,
+                                 int ann_row, uint64_t start_sample, uint64_t end_sample,
+                                 struct atk_annstore_bucket *buckets, unsigned int max_buckets)
+{
+    return srd_annstore_summary((struct srd_session *)sess, inst_id, ann_row,
+                                start_sample, end_sample,
+                                (struct srd_annstore_bucket *)buckets, max_buckets);
+}
+
+/**
+ * @brief       清空注释存储
+ * @retval      
+ */
+int atk_decoder_annstore_clear(atk_session *sess)
+{
+    return srd_annstore_clear((struct srd_session *)sess);
+}
+
+/**
+ * @brief       将会话的注释写入磁盘文件 <path>.rec/.str/.idx，
+ *              path 为 NULL 时停止写入，解码过程中也可调用，但不能在输出回调中调用
+ * @retval      
+ */
+int atk_decoder_session_spill_set(atk_session *sess, const char *path)
+{
+    return srd_session_spill_set((struct srd_session *)sess, path);
+}
+
+/**
+ * @brief       以内存映射方式打开注释文件
+ * @retval      
+ */
+int atk_decoder_spill_open(const char *path, atk_spill **spill)
+{
+    return srd_spill_open(path, (struct srd_spill **)spill);
+}
+
+/**
+ * @brief       获取注释文件中的记录数量
+ * @retval      
+ */
+int atk_decoder_spill_count_get(const atk_spill *spill, uint64_t *count)
+{
+    return srd_spill_count_get((const struct srd_spill *)spill, count);
+}
+
+/**
+ * @brief       按序号读取注释文件中的一条记录
+ * @retval      
+ */
+int atk_decoder_spill_get(const atk_spill *spill, uint64_t index,
+                          struct atk_spill_item *item)
+{
+    return srd_spill_get((const struct srd_spill *)spill, index,
+                         (struct srd_spill_item *)item);
+}
+
+/**
+ * @brief       查询注释文件中与 [start_sample, end_sample] 重叠的记录，
+ *              按写入顺序回调，回调返回 FALSE 时停止查询
+ * @retval      
+ */
+int atk_decoder_spill_query(const atk_spill *spill,
+                            uint64_t start_sample, uint64_t end_sample,
+                            atk_spill_callback cb, void *cb_data)
+{
+    return srd_spill_query((const struct srd_spill *)spill,
+                           start_sample, end_sample,
+                           (srd_spill_callback)cb, cb_data);
+}
+
+/**
+ * @brief       关闭注释文件
+ * @retval      
+ */
+void atk_decoder_spill_close(atk_spill *spill)
+{
+    srd_spill_close((struct srd_spill *)spill);
+}
+
+/**
+ * @brief       创建导出器，将会话的注释（CSV / JSON lines）或二进制输出
+ *              写入文件，需在 start 之前创建
+ * @retval      
+ */
+int atk_decoder_exporter_new(atk_session *sess, int format, const char *path,
+                             unsigned int flags, atk_exporter **exporter)
+{
+    return srd_exporter_new((struct srd_session *)sess, format, path, flags,
+                            (struct srd_exporter **)exporter);
+}
+
+/**
+ * @brief       只导出匹配的实例 / 注释行 / 类别，ATK_EXPORT_ANY 匹配任意值；
+ *              可多次调用，匹配任一条件即导出
+ * @retval      
+ */
+int atk_decoder_exporter_select(atk_exporter *exporter, const char *inst_id,
+                                int ann_row, int ann_class)
+{
+    return srd_exporter_select((struct srd_exporter *)exporter, inst_id,
+                               ann_row, ann_class);
+}
+
+/**
+ * @brief       将导出器缓冲的内容写入文件
+ * @retval      
+ */
+int atk_decoder_exporter_flush(atk_exporter *exporter)
+{
+    return srd_exporter_flush((struct srd_exporter *)exporter);
+}
+
+/**
+ * @brief       关闭导出器并从会话中移除，解码过程中也可调用，但不能在输出回调中调用
+ * @retval      
+ */
+int atk_decoder_exporter_free(atk_exporter *exporter)
+{
+    return srd_exporter_free((struct srd_exporter *)exporter);
+}
+
+/**
+ * @brief       设置解码器状态检查点的间隔（采样点数），0 为关闭并丢弃已有检查点。
+ *              仅当会话中所有解码器都声明 checkpointable 时才会保存
+ * @retval      
+ */
+int atk_decoder_session_checkpoint_interval_set(atk_session *sess, uint64_t interval)
+{
+    return srd_session_checkpoint_interval_set((struct srd_session *)sess, interval);
+}
+
+/**
+ * @brief       获取各检查点所在的采样点
+ * @retval      检查点数量，负数为错误码
+ */
+int atk_decoder_session_checkpoints_get(atk_session *sess, uint64_t *samplenums,
+                                        unsigned int max)
+{
+    return srd_session_checkpoints_get((struct srd_session *)sess, samplenums, max);
+}
+
+/**
+ * @brief       从 start_sample 之前最近的检查点恢复，解码到 end_sample，
+ *              采样数据由 source 回调按块提供
+ * @retval      
+ */
+int atk_decoder_session_decode_range(atk_session *sess, uint64_t start_sample,
+                                     uint64_t end_sample, uint64_t chunk_size,
+                                     atk_sample_source source, void *cb_data)
+{
+    return srd_session_decode_range((struct srd_session *)sess, start_sample,
+                                    end_sample, chunk_size,
+                                    (srd_sample_source)source, cb_data);
+}
+
+/**
+ * @brief       设置解码结果缓存目录，NULL 为关闭
+ * @retval      
+ */
+int atk_decoder_session_result_cache_set(atk_session *sess, const char *dir)
+{
+    return srd_session_result_cache_set((struct srd_session *)sess, dir);
+}
+
+/**
+ * @brief       解码整个采集数据；若缓存中已有相同数据和解码器配置的结果，
+ *              则直接回放结果而不运行解码器，hit 返回是否命中
+ * @retval      
+ */
+int atk_decoder_session_decode_cached(atk_session *sess, uint64_t num_samples,
+                                      uint64_t chunk_size, atk_sample_source source,
+                                      void *cb_data, atk_gboolean *hit)
+{
+    return srd_session_decode_cached((struct srd_session *)sess, num_samples,
+                                     chunk_size, (srd_sample_source)source,
+                                     cb_data, (gboolean *)hit);
+}
+
+/**
+ * @brief       建立解码结果的搜索索引，flags 选择注释文本和/或 Python 输出，
+ *              0 为关闭并丢弃索引，解码过程中也可调用，但不能在输出回调中调用
+ * @retval      
+ */
+int atk_decoder_session_search_set(atk_session *sess, unsigned int flags)
+{
+    return srd_session_search_set((struct srd_session *)sess, flags);
+}
+
+/**
+ * @brief       搜索同时包含 query 中所有词的输出（不区分大小写，词尾 * 为前缀匹配），
+ *              与 [start_sample, end_sample] 重叠的结果按起始采样点顺序回调
+ * @retval      
+ */
+int atk_decoder_search_query(atk_session *sess, const char *inst_id, const char *query,
+                             uint64_t start_sample, uint64_t end_sample,
+                             atk_search_callback cb, void *cb_data)
+{
+    return srd_search_query((struct srd_session *)sess, inst_id, query,
+                            start_sample, end_sample,
+                            (srd_search_callback)cb, cb_data);
+}
+
+/**
+ * @brief       在原始采样数据中搜索信号：脉宽范围内的脉冲（毛刺）、
+ *              时钟线上的串行位模式或多通道状态组合，按匹配结束位置顺序回调
+ * @retval      
+ */
+int atk_decoder_scan_run(const struct atk_scan *scan, uint64_t start_sample,
+                         uint64_t end_sample, uint64_t chunk_size,
+                         atk_sample_source source, void *source_data,
+                         atk_scan_callback cb, void *cb_data)
+{
+    return srd_scan_run((const struct srd_scan *)scan, start_sample, end_sample,
+                        chunk_size, (srd_sample_source)source, source_data,
+                        (srd_scan_callback)cb, cb_data);
+}
+
+/**
+ * @brief       以内存映射方式打开采集文件（按通道分平面或 sigrok 交织格式），
+ *              num_samples 为 0 时按文件大小计算
+ * @retval      
+ */
+int atk_decoder_file_source_open(const char *path, int format, unsigned int num_channels,
+                                 uint64_t num_samples, atk_file_source **src)
+{
+    return srd_file_source_open(path, format, num_channels, num_samples,
+                                (struct srd_file_source **)src);
+}
+
+/**
+ * @brief       获取文件数据源的通道数与采样数
+ * @retval      
+ */
+int atk_decoder_file_source_info_get(const atk_file_source *src,
+                                     unsigned int *num_channels, uint64_t *num_samples)
+{
+    return srd_file_source_info_get((const struct srd_file_source *)src,
+                                    num_channels, num_samples);
+}
+
+/**
+ * @brief       文件数据源的取数回调，可作为 atk_sample_source 使用，
+ *              cb_data 传入文件数据源
+ * @retval      
+ */
+const struct atk_input_view *atk_decoder_file_source_get(uint64_t start_sample,
+                                                         uint64_t end_sample, void *cb_data)
+{
+    return (const struct atk_input_view *)srd_file_source_get(start_sample,
+                                                              end_sample, cb_data);
+}
+
+/**
+ * @brief       将文件全部采样按页对齐的块直接送入会话解码（不拷贝数据），
+ *              结束后需调用 atk_decoder_session_send_eof
+ * @retval      
+ */
+int atk_decoder_session_send_file(atk_session *sess, atk_file_source *src,
+                                  uint64_t chunk_size)
+{
+    return srd_session_send_file((struct srd_session *)sess,
+                                 (struct srd_file_source *)src, chunk_size);
+}
+
+/**
+ * @brief       关闭文件数据源
+ * @retval      
+ */
+void atk_decoder_file_source_close(atk_file_source *src)
+{
+    srd_file_source_close((struct srd_file_source *)src);
+}
+
+/**
+ * @brief       分配采样数据缓冲区：清零、64 字节对齐、末尾可多读 64 字节，
+ *              大缓冲区按大页对齐以减少 TLB 缺失
+ * @retval      
+ */
+void *atk_decoder_sample_buffer_alloc(size_t size, unsigned int flags)
+{
+    return srd_sample_buffer_alloc(size, flags);
+}
+
+/**
+ * @brief       释放 atk_decoder_sample_buffer_alloc 分配的缓冲区
+ * @retval      
+ */
+void atk_decoder_sample_buffer_free(void *buf)
+{
+    srd_sample_buffer_free(buf);
+}
+
+/**
+ * @brief       为会话建立环形缓冲区（按通道分平面），retention 为解码后
+ *              保留可回看的采样数，capacity 为 0 时删除
+ * @retval      
+ */
+int atk_decoder_session_ring_set(atk_session *sess, unsigned int num_channels,
+                                 uint64_t capacity, uint64_t retention)
+{
+    return srd_session_ring_set((struct srd_session *)sess, num_channels,
+                                capacity, retention);
+}
+
+/**
+ * @brief       采集线程在环形缓冲区中申请写入空间，满时阻塞，
+ *              planes 返回每个通道的写入地址
+ * @retval      
+ */
+int atk_decoder_ring_reserve(atk_session *sess, uint64_t *num_samples, uint8_t **planes)
+{
+    return srd_ring_reserve((struct srd_session *)sess, num_samples, planes);
+}
+
+/**
+ * @brief       提交已写入环形缓冲区的采样
+ * @retval      
+ */
+int atk_decoder_ring_commit(atk_session *sess, uint64_t num_samples)
+{
+    return srd_ring_commit((struct srd_session *)sess, num_samples);
+}
+
+/**
+ * @brief       标记数据流结束，解码完剩余采样后 ring_run 返回
+ * @retval      
+ */
+int atk_decoder_ring_close(atk_session *sess)
+{
+    return srd_ring_close((struct srd_session *)sess);
+}
+
+/**
+ * @brief       解码线程调用：持续将环形缓冲区中的采样直接送入解码器，
+ *              直到缓冲区关闭；不发送 EOF
+ * @retval      
+ */
+int atk_decoder_session_ring_run(atk_session *sess, uint64_t max_chunk)
+{
+    return srd_session_ring_run((struct srd_session *)sess, max_chunk);
+}
+
+/**
+ * @brief       从环形缓冲区中回看（拷贝）仍保留的采样
+ * @retval      
+ */
+int atk_decoder_ring_read(atk_session *sess, uint64_t start_sample,
+                          uint64_t end_sample, uint8_t **planes)
+{
+    return srd_ring_read((struct srd_session *)sess, start_sample,
+                         end_sample, planes);
+}
+
+/**
+ * @brief       输出投递方式：同步回调 / 投递线程 / 调用者轮询，
+ *              队列满时阻塞或丢弃。需在 start 之前设置
+ * @retval      
+ */
+int atk_decoder_session_output_delivery_set(atk_session *sess,
+                                            int delivery, int overflow, unsigned int queue_size)
+{
+    return srd_session_output_delivery_set((struct srd_session *)sess,
+                                           delivery, overflow, queue_size);
+}
+
+/**
+ * @brief       轮询模式下，在调用线程上执行排队输出的回调
+ * @retval      已投递的记录数，负数为错误码
+ */
+int atk_decoder_session_poll_output(atk_session *sess, unsigned int max_records)
+{
+    return srd_session_poll_output((struct srd_session *)sess, max_records);
+}
+
+/**
+ * @brief       获取输出队列的占用与丢弃计数
+ * @retval      
+ */
+int atk_decoder_session_output_stats_get(atk_session *sess, struct atk_output_stats *stats)
+{
+    return srd_session_output_stats_get((struct srd_session *)sess,
+                                        (struct srd_output_stats *)stats);
+}
+
 /*******************************************************/
 
 
@@ -435,6 +950,61 @@ struct atk_decoder_inst *atk_decoder_inst_find_by_id(atk_session *sess,
     return (struct atk_decoder_inst *)srd_inst_find_by_id((struct srd_session *)sess, inst_id);
 }
 
+/**
+ * @brief       设置实例工作线程的 CPU 亲和性、NUMA 节点与调度策略，
+ *              为 NULL 时使用会话的设置
+ * @retval      
+ */
+int atk_decoder_inst_thread_config_set(struct atk_decoder_inst *di,
+                                       const struct atk_thread_config *config)
+{
+    return srd_inst_thread_config_set((struct srd_decoder_inst *)di,
+                                      (const struct srd_thread_config *)config);
+}
+
+/**
+ * @brief       缓存实例传给上层解码器的 Python 输出，需在 start 之前启用
+ * @retval      
+ */
+int atk_decoder_inst_pycache_set(struct atk_decoder_inst *di, atk_gboolean enable)
+{
+    return srd_inst_pycache_set((struct srd_decoder_inst *)di, enable);
+}
+
+/**
+ * @brief       获取 Python 输出缓存的记录数与字节数
+ * @retval      
+ */
+int atk_decoder_inst_pycache_size_get(struct atk_decoder_inst *di,
+                                      uint64_t *records, uint64_t *bytes)
+{
+    return srd_inst_pycache_size_get((struct srd_decoder_inst *)di,
+                                     records, bytes);
+}
+
+/**
+ * @brief       将缓存的 Python 输出重放给另一个实例（如修改选项后新建的
+ *              上层解码器），无需重新解码原始采样数据
+ * @retval      
+ */
+int atk_decoder_inst_pycache_replay(struct atk_decoder_inst *di,
+                                    struct atk_decoder_inst *target)
+{
+    return srd_inst_pycache_replay((struct srd_decoder_inst *)di,
+                                   (struct srd_decoder_inst *)target);
+}
+
+/**
+ * @brief       按 factor 抽取实例的输入采样（多数表决或取首个采样），
+ *              输出的采样号按原始采样率换算，需在 start 之前设置
+ * @retval      
+ */
+int atk_decoder_inst_decimation_set(struct atk_decoder_inst *di,
+                                    unsigned int factor, int policy)
+{
+    return srd_inst_decimation_set((struct srd_decoder_inst *)di, factor, policy);
+}
+
 int atk_decoder_inst_initial_pins_set_all(struct atk_decoder_inst *di,
         atk_GArray *initial_pins)
 {
@@ -25,6 +25,7 @@ extern "C" {
 
 #include <stdint.h>
 #include <stdarg.h>
+#include <stddef.h>
 
 /* glib ---------------------------------------------- */
 typedef struct _atk_gslist
@@ -217,6 +218,25 @@ struct atk_input_data {
     uint8_t constant;
 };
 
+struct atk_input_view {
+    const uint8_t *data;
+    uint8_t constant;
+    uint64_t bit_offset;
+    uint32_t bit_stride;
+};
+
+struct atk_input_segment {
+    const uint8_t *data;
+    uint64_t bit_offset;
+    uint64_t bit_length;
+};
+
+struct atk_input_segments {
+    const struct atk_input_segment *segments;
+    unsigned int num_segments;
+    uint8_t constant;
+};
+
 struct atk_decoder_inst {
 	struct atk_decoder *decoder;
 	atk_session *sess;
@@ -242,7 +262,7 @@ struct atk_decoder_inst {
 	uint64_t abs_end_samplenum;
 
 	/** Pointer to the buffer/chunk of input samples. */
-	const struct atk_input_data *inbuf;
+	const struct atk_input_view *inbuf;
 
 	/** Length (in bytes) of the input sample buffer. */
 	// uint64_t inbuflen;
@@ -261,7 +281,7 @@ struct atk_decoder_inst {
 	atk_GArray *old_pins_array;
 
 	/** Handle for this PD stack's worker thread. */
-	atk_GThread *thread_handle;
+	void *thread_handle;
 
 	/** Indicates whether new samples are available for processing. */
 	atk_gboolean got_new_samples;
@@ -281,6 +301,36 @@ struct atk_decoder_inst {
 	atk_GCond got_new_samples_cond;
 	atk_GCond handled_all_samples_cond;
 	atk_GMutex data_mutex;
+
+	/** Input queue and worker of a stacked PD in pipeline mode. */
+	void *pipe;
+
+	/** Coroutine which runs decode() in coroutine mode. */
+	void *coro;
+
+	/** Worker thread options, NULL to use the session's options. */
+	void *thread_config;
+
+	/** Cache of the SRD_OUTPUT_PYTHON stream, NULL if disabled. */
+	void *pycache;
+
+	/** Conditions of the wait() a restored checkpoint was taken in. */
+	void *checkpoint_conditions;
+
+	/** Identical instance which decodes for this one, NULL if none. */
+	struct atk_decoder_inst *shared_inst;
+
+	/** Instances for which this one decodes. */
+	void *sharers;
+
+	/** Input decimation factor, 0 or 1 if all samples are decoded. */
+	unsigned int decimation;
+
+	/** How groups of samples are decimated (enum atk_decimation_policy). */
+	int decimation_policy;
+
+	/** Decimated input, shared by instances of the same settings. */
+	void *decimator;
 };
 
 struct atk_pd_output {
@@ -325,6 +375,181 @@ struct atk_pd_callback {
 	void *cb_data;
 };
 
+struct atk_annstore_item {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	int ann_class;
+	int ann_row;
+	char **ann_text;
+};
+
+struct atk_annstore_bucket {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	uint64_t count;
+	struct atk_annstore_item first;
+	struct atk_annstore_item last;
+	int dominant_class;
+};
+
+typedef atk_gboolean (*atk_annstore_callback)(const struct atk_annstore_item *item,
+		void *cb_data);
+
+typedef void        atk_spill;
+
+struct atk_spill_item {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	const char *inst_id;
+	int ann_row;
+	int ann_class;
+	char **ann_text;
+};
+
+typedef atk_gboolean (*atk_spill_callback)(const struct atk_spill_item *item,
+		void *cb_data);
+
+enum atk_thread_policy {
+	ATK_THREAD_POLICY_DEFAULT,
+	ATK_THREAD_POLICY_OTHER,
+	ATK_THREAD_POLICY_BATCH,
+	ATK_THREAD_POLICY_IDLE,
+	ATK_THREAD_POLICY_FIFO,
+	ATK_THREAD_POLICY_RR,
+};
+
+struct atk_thread_config {
+	const unsigned int *cpus;
+	unsigned int num_cpus;
+	int numa_node;
+	atk_gboolean set_numa;
+	int policy;
+	int priority;
+	int nice;
+	atk_gboolean set_nice;
+	const char *name_prefix;
+};
+
+typedef void *(*atk_thread_func)(void *data);
+
+struct atk_thread_factory {
+	void *(*spawn)(const char *name, atk_thread_func func, void *data,
+			void *cb_data);
+	void (*join)(void *handle, void *cb_data);
+	void *cb_data;
+};
+
+enum atk_output_delivery {
+	ATK_OUTPUT_DELIVERY_SYNC,
+	ATK_OUTPUT_DELIVERY_THREAD,
+	ATK_OUTPUT_DELIVERY_POLL,
+};
+
+enum atk_output_overflow {
+	ATK_OUTPUT_OVERFLOW_BLOCK,
+	ATK_OUTPUT_OVERFLOW_DROP,
+};
+
+enum atk_export_format {
+	ATK_EXPORT_CSV,
+	ATK_EXPORT_JSONL,
+	ATK_EXPORT_BINARY,
+};
+
+enum atk_export_flags {
+	ATK_EXPORT_FLAG_TIME = 1 << 0,
+	ATK_EXPORT_FLAG_HEADER = 1 << 1,
+};
+
+#define ATK_EXPORT_ANY (-2147483647 - 1)
+
+typedef void        atk_exporter;
+
+typedef const struct atk_input_view *(*atk_sample_source)(
+		uint64_t start_sample, uint64_t end_sample, void *cb_data);
+
+#define ATK_SAMPLE_BUFFER_ALIGN 64
+#define ATK_SAMPLE_BUFFER_PADDING 64
+#define ATK_SAMPLE_BUFFER_PLANE_SIZE(num_samples) \
+	((((num_samples) + 7) / 8 + ATK_SAMPLE_BUFFER_ALIGN - 1) / \
+	ATK_SAMPLE_BUFFER_ALIGN * ATK_SAMPLE_BUFFER_ALIGN)
+
+enum atk_sample_buffer_flags {
+	ATK_SAMPLE_BUFFER_HUGETLB = 1 << 0,
+};
+
+enum atk_file_format {
+	ATK_FILE_PLANES,
+	ATK_FILE_LOGIC,
+};
+
+typedef void        atk_file_source;
+
+enum atk_search_flags {
+	ATK_SEARCH_ANN = 1 << 0,
+	ATK_SEARCH_PYTHON = 1 << 1,
+};
+
+struct atk_search_match {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	const char *inst_id;
+	int output_type;
+	int ann_class;
+	int ann_row;
+};
+
+typedef atk_gboolean (*atk_search_callback)(const struct atk_search_match *match,
+		void *cb_data);
+
+enum atk_scan_type {
+	ATK_SCAN_PULSE,
+	ATK_SCAN_SERIAL,
+	ATK_SCAN_STATE,
+};
+
+enum atk_scan_edge {
+	ATK_SCAN_EDGE_RISING,
+	ATK_SCAN_EDGE_FALLING,
+};
+
+struct atk_scan {
+	int type;
+	int channel;
+	int level;
+	uint64_t min_width;
+	uint64_t max_width;
+	int clock_channel;
+	int clock_edge;
+	uint64_t pattern;
+	uint64_t pattern_mask;
+	unsigned int pattern_bits;
+	uint64_t state_mask;
+	uint64_t state_value;
+};
+
+struct atk_scan_match {
+	uint64_t start_sample;
+	uint64_t end_sample;
+};
+
+typedef atk_gboolean (*atk_scan_callback)(const struct atk_scan_match *match,
+		void *cb_data);
+
+enum atk_decimation_policy {
+	ATK_DECIMATION_MAJORITY,
+	ATK_DECIMATION_FIRST,
+};
+
+struct atk_output_stats {
+	uint64_t capacity;
+	uint64_t occupancy;
+	uint64_t high_water;
+	uint64_t queued;
+	uint64_t delivered;
+	uint64_t dropped;
+};
+
 /* ---------------------------------------------------------------------------------------------------------------------------------------- */
 
 
@@ -382,11 +607,92 @@ int atk_decoder_session_metadata_set_samplerate(atk_session *sess, uint64_t samp
 int atk_decoder_session_send(atk_session *sess,
                             uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
                             struct atk_input_data *inbuf);
+int atk_decoder_session_send_views(atk_session *sess,
+                            uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
+                            const struct atk_input_view *views);
+int atk_decoder_session_send_segments(atk_session *sess,
+                            uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
+                            const struct atk_input_segments *channels,
+                            unsigned int num_channels);
 int atk_decoder_session_send_eof(atk_session *sess);
 int atk_decoder_session_terminate_reset(atk_session *sess);
 int atk_decoder_session_destroy(atk_session *sess);
 int atk_decoder_pd_output_callback_add(atk_session *sess,
                                        int output_type, atk_pd_output_callback cb, void *cb_data);
+int atk_decoder_session_pipeline_set(atk_session *sess, atk_gboolean enable);
+int atk_decoder_session_coroutine_set(atk_session *sess, atk_gboolean enable);
+int atk_decoder_session_inst_sharing_set(atk_session *sess, atk_gboolean enable);
+int atk_decoder_session_thread_config_set(atk_session *sess,
+                                          const struct atk_thread_config *config);
+int atk_decoder_session_thread_factory_set(atk_session *sess,
+                                           const struct atk_thread_factory *factory);
+int atk_decoder_session_annstore_set(atk_session *sess, atk_gboolean enable);
+int atk_decoder_annstore_query(atk_session *sess, const char *inst_id,
+                               int ann_row, uint64_t start_sample, uint64_t end_sample,
+                               atk_annstore_callback cb, void *cb_data);
+int atk_decoder_annstore_count(atk_session *sess, const char *inst_id,
+                               int ann_row, uint64_t start_sample, uint64_t end_sample,
+                               uint64_t *count);
+int atk_decoder_annstore_summary(atk_session *sess, const char *inst_id,
+                                 int ann_row, uint64_t start_sample, uint64_t end_sample,
+                                 struct atk_annstore_bucket *buckets, unsigned int max_buckets);
+int atk_decoder_annstore_clear(atk_session *sess);
+int atk_decoder_session_spill_set(atk_session *sess, const char *path);
+int atk_decoder_spill_open(const char *path, atk_spill **spill);
+int atk_decoder_spill_count_get(const atk_spill *spill, uint64_t *count);
+int atk_decoder_spill_get(const atk_spill *spill, uint64_t index,
+                          struct atk_spill_item *item);
+int atk_decoder_spill_query(const atk_spill *spill,
+                            uint64_t start_sample, uint64_t end_sample,
+                            atk_spill_callback cb, void *cb_data);
+void atk_decoder_spill_close(atk_spill *spill);
+int atk_decoder_exporter_new(atk_session *sess, int format, const char *path,
+                             unsigned int flags, atk_exporter **exporter);
+int atk_decoder_exporter_select(atk_exporter *exporter, const char *inst_id,
+                                int ann_row, int ann_class);
+int atk_decoder_exporter_flush(atk_exporter *exporter);
+int atk_decoder_exporter_free(atk_exporter *exporter);
+int atk_decoder_session_checkpoint_interval_set(atk_session *sess, uint64_t interval);
+int atk_decoder_session_checkpoints_get(atk_session *sess, uint64_t *samplenums,
+                                        unsigned int max);
+int atk_decoder_session_decode_range(atk_session *sess, uint64_t start_sample,
+                                     uint64_t end_sample, uint64_t chunk_size,
+                                     atk_sample_source source, void *cb_data);
+int atk_decoder_session_result_cache_set(atk_session *sess, const char *dir);
+int atk_decoder_session_decode_cached(atk_session *sess, uint64_t num_samples,
+                                      uint64_t chunk_size, atk_sample_source source,
+                                      void *cb_data, atk_gboolean *hit);
+int atk_decoder_session_search_set(atk_session *sess, unsigned int flags);
+int atk_decoder_search_query(atk_session *sess, const char *inst_id, const char *query,
+                             uint64_t start_sample, uint64_t end_sample,
+                             atk_search_callback cb, void *cb_data);
+int atk_decoder_scan_run(const struct atk_scan *scan, uint64_t start_sample,
+                         uint64_t end_sample, uint64_t chunk_size,
+                         atk_sample_source source, void *source_data,
+                         atk_scan_callback cb, void *cb_data);
+int atk_decoder_file_source_open(const char *path, int format, unsigned int num_channels,
+                                 uint64_t num_samples, atk_file_source **src);
+int atk_decoder_file_source_info_get(const atk_file_source *src,
+                                     unsigned int *num_channels, uint64_t *num_samples);
+const struct atk_input_view *atk_decoder_file_source_get(uint64_t start_sample,
+                                                         uint64_t end_sample, void *cb_data);
+int atk_decoder_session_send_file(atk_session *sess, atk_file_source *src,
+                                  uint64_t chunk_size);
+void atk_decoder_file_source_close(atk_file_source *src);
+void *atk_decoder_sample_buffer_alloc(size_t size, unsigned int flags);
+void atk_decoder_sample_buffer_free(void *buf);
+int atk_decoder_session_ring_set(atk_session *sess, unsigned int num_channels,
+                                 uint64_t capacity, uint64_t retention);
+int atk_decoder_ring_reserve(atk_session *sess, uint64_t *num_samples, uint8_t **planes);
+int atk_decoder_ring_commit(atk_session *sess, uint64_t num_samples);
+int atk_decoder_ring_close(atk_session *sess);
+int atk_decoder_session_ring_run(atk_session *sess, uint64_t max_chunk);
+int atk_decoder_ring_read(atk_session *sess, uint64_t start_sample,
+                          uint64_t end_sample, uint8_t **planes);
+int atk_decoder_session_output_delivery_set(atk_session *sess,
+                                            int delivery, int overflow, unsigned int queue_size);
+int atk_decoder_session_poll_output(atk_session *sess, unsigned int max_records);
+int atk_decoder_session_output_stats_get(atk_session *sess, struct atk_output_stats *stats);
 
 
 
@@ -418,6 +724,15 @@ int atk_decoder_inst_stack(atk_session *sess,
         struct atk_decoder_inst *di_bottom, struct atk_decoder_inst *di_top);
 struct atk_decoder_inst *atk_decoder_inst_find_by_id(atk_session *sess,
         const char *inst_id);
+int atk_decoder_inst_thread_config_set(struct atk_decoder_inst *di,
+                                       const struct atk_thread_config *config);
+int atk_decoder_inst_pycache_set(struct atk_decoder_inst *di, atk_gboolean enable);
+int atk_decoder_inst_pycache_size_get(struct atk_decoder_inst *di,
+                                      uint64_t *records, uint64_t *bytes);
+int atk_decoder_inst_pycache_replay(struct atk_decoder_inst *di,
+                                    struct atk_decoder_inst *target);
+int atk_decoder_inst_decimation_set(struct atk_decoder_inst *di,
+                                    unsigned int factor, int policy);
 int atk_decoder_inst_initial_pins_set_all(struct atk_decoder_inst *di,
         atk_GArray *initial_pins);
 
@@ -0,0 +1,579 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file
+ *
+ * Checkpoints of decoder state, and decoding of sample ranges.
+ */
+
+/**
+ * @defgroup grp_checkpoint Checkpoints
+ *
+ * Resume decoding near an arbitrary position of a capture.
+ *
+ * With a checkpoint interval set, the session saves the state of all
+ * its decoder instances at the first chunk boundary after every
+ * interval. srd_session_decode_range() restores the latest checkpoint
+ * before the range and decodes from there, instead of from sample 0.
+ *
+ * Chunk boundaries are the safe points: the worker of a bottom decoder
+ * waits in wait() for more samples, stacked decoders are between two
+ * decode() calls. A checkpoint holds
+ *
+ * - the instance's Python attributes, pickled,
+ * - abs_cur_samplenum and the previous pin values (edge detection),
+ * - the conditions of the pending wait(), including skip progress.
+ *
+ * The Python call stack of decode() can't be saved. A restored instance
+ * runs decode() from its beginning, which yields the same behaviour
+ * only if decode() keeps all its state in attributes and computes its
+ * wait() conditions from them. Decoders declare that by setting the
+ * class attribute 'checkpointable' to True. Checkpoints are taken only
+ * if all instances of the session do, and none decimates its input.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+struct checkpoint_inst {
+	struct srd_decoder_inst *di;
+	/* pickle.dumps() of the instance's __dict__. */
+	GByteArray *state;
+	uint64_t abs_cur_samplenum;
+	GArray *old_pins;
+	GSList *conditions;
+};
+
+struct srd_checkpoint {
+	uint64_t samplenum;
+	GSList *insts;
+};
+
+/** @endcond */
+
+static GSList *conditions_copy(GSList *conds)
+{
+	GSList *copy, *terms, *l, *t;
+	struct srd_term *term;
+
+	copy = NULL;
+	for (l = conds; l; l = l->next) {
+		terms = NULL;
+		for (t = l->data; t; t = t->next) {
+			term = g_malloc(sizeof(*term));
+			*term = *(struct srd_term *)t->data;
+			terms = g_slist_append(terms, term);
+		}
+		copy = g_slist_append(copy, terms);
+	}
+
+	return copy;
+}
+
+/** @private */
+SRD_PRIV void srd_checkpoint_conditions_free(GSList *conds)
+{
+	GSList *l;
+
+	for (l = conds; l; l = l->next)
+		g_slist_free_full(l->data, g_free);
+	g_slist_free(conds);
+}
+
+static void checkpoint_inst_free(struct checkpoint_inst *ci)
+{
+	if (ci->state)
+		g_byte_array_free(ci->state, TRUE);
+	if (ci->old_pins)
+		g_array_free(ci->old_pins, TRUE);
+	srd_checkpoint_conditions_free(ci->conditions);
+	g_free(ci);
+}
+
+static void checkpoint_free(struct srd_checkpoint *cp)
+{
+	g_slist_free_full(cp->insts, (GDestroyNotify)checkpoint_inst_free);
+	g_free(cp);
+}
+
+/** @private */
+SRD_PRIV void srd_checkpoint_free_all(struct srd_session *sess)
+{
+	if (!sess->checkpoints)
+		return;
+
+	g_ptr_array_free(sess->checkpoints, TRUE);
+	sess->checkpoints = NULL;
+}
+
+static gboolean inst_checkpointable(struct srd_decoder_inst *di)
+{
+	PyObject *py_attr;
+	gboolean ret;
+	GSList *l;
+
+	if (!(py_attr = PyObject_GetAttrString(di->py_inst, "checkpointable"))) {
+		PyErr_Clear();
+		return FALSE;
+	}
+	ret = PyObject_IsTrue(py_attr) == 1;
+	Py_DECREF(py_attr);
+
+	for (l = di->next_di; ret && l; l = l->next)
+		ret = inst_checkpointable(l->data);
+
+	return ret;
+}
+
+/* Save an instance and the ones stacked on it, caller holds the GIL. */
+static gboolean checkpoint_inst_save(struct srd_checkpoint *cp,
+		PyObject *py_dumps, struct srd_decoder_inst *di)
+{
+	struct checkpoint_inst *ci;
+	PyObject *py_dict, *py_bytes;
+	char *buf;
+	Py_ssize_t len;
+	GSList *l;
+
+	py_bytes = NULL;
+	if ((py_dict = PyObject_GetAttrString(di->py_inst, "__dict__"))) {
+		py_bytes = PyObject_CallFunctionObjArgs(py_dumps, py_dict, NULL);
+		Py_DECREF(py_dict);
+	}
+	if (!py_bytes || PyBytes_AsStringAndSize(py_bytes, &buf, &len) < 0) {
+		srd_exception_catch("Cannot pickle state of %s", di->inst_id);
+		Py_XDECREF(py_bytes);
+		return FALSE;
+	}
+
+	ci = g_malloc0(sizeof(*ci));
+	ci->di = di;
+	ci->state = g_byte_array_sized_new(len);
+	g_byte_array_append(ci->state, (const guint8 *)buf, len);
+	Py_DECREF(py_bytes);
+	ci->abs_cur_samplenum = di->abs_cur_samplenum;
+	if (di->old_pins_array) {
+		ci->old_pins = g_array_sized_new(FALSE, FALSE, sizeof(uint8_t),
+			di->old_pins_array->len);
+		g_array_append_vals(ci->old_pins, di->old_pins_array->data,
+			di->old_pins_array->len);
+	}
+	ci->conditions = conditions_copy(di->condition_list);
+	cp->insts = g_slist_append(cp->insts, ci);
+
+	for (l = di->next_di; l; l = l->next) {
+		if (!checkpoint_inst_save(cp, py_dumps, l->data))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Save the state of the session's instances, if a checkpoint is due.
+ * Called at chunk boundaries, after all instances handled the chunk.
+ *
+ * @private
+ */
+SRD_PRIV void srd_checkpoint_take(struct srd_session *sess,
+		uint64_t samplenum)
+{
+	PyGILState_STATE gstate;
+	struct srd_checkpoint *cp, *last;
+	struct srd_decoder_inst *di;
+	PyObject *py_mod, *py_dumps;
+	gboolean ok;
+	GSList *d;
+
+	if (!sess->checkpoint_interval || !sess->di_list)
+		return;
+
+	/* Range decodes pass positions which have a checkpoint already. */
+	last = NULL;
+	if (sess->checkpoints && sess->checkpoints->len)
+		last = g_ptr_array_index(sess->checkpoints,
+			sess->checkpoints->len - 1);
+	if (last && samplenum < last->samplenum + sess->checkpoint_interval)
+		return;
+	if (!last && samplenum < sess->checkpoint_interval)
+		return;
+
+	/* Stacked decoders in pipeline mode must have caught up. */
+	for (d = sess->di_list; d; d = d->next)
+		srd_inst_pipe_drain_stack(d->data);
+
+	gstate = PyGILState_Ensure();
+
+	ok = TRUE;
+	for (d = sess->di_list; ok && d; d = d->next) {
+		di = d->data;
+		/* A decode() which ended can't be resumed. */
+		if (di->decoder_state != SRD_OK || di->want_wait_terminate ||
+				(!di->thread_handle && !di->coro))
+			ok = FALSE;
+		/* Groups of decimated samples span chunk boundaries. */
+		else if (di->decimator || !inst_checkpointable(di))
+			ok = FALSE;
+	}
+	if (!ok) {
+		srd_dbg("Session %d: No checkpoint at %" G_GUINT64_FORMAT
+			", not all decoders support it.", sess->session_id,
+			samplenum);
+		PyGILState_Release(gstate);
+		return;
+	}
+
+	if (!(py_mod = PyImport_ImportModule("pickle"))) {
+		srd_exception_catch("Cannot import pickle");
+		PyGILState_Release(gstate);
+		return;
+	}
+	py_dumps = PyObject_GetAttrString(py_mod, "dumps");
+	Py_DECREF(py_mod);
+	if (!py_dumps) {
+		srd_exception_catch("Cannot get pickle.dumps");
+		PyGILState_Release(gstate);
+		return;
+	}
+
+	cp = g_malloc0(sizeof(*cp));
+	cp->samplenum = samplenum;
+	for (d = sess->di_list; ok && d; d = d->next)
+		ok = checkpoint_inst_save(cp, py_dumps, d->data);
+	Py_DECREF(py_dumps);
+
+	PyGILState_Release(gstate);
+
+	if (!ok) {
+		srd_warn("Session %d: Cannot save decoder state, "
+			"checkpoints disabled.", sess->session_id);
+		checkpoint_free(cp);
+		sess->checkpoint_interval = 0;
+		return;
+	}
+
+	if (!sess->checkpoints)
+		sess->checkpoints = g_ptr_array_new_with_free_func(
+			(GDestroyNotify)checkpoint_free);
+	g_ptr_array_add(sess->checkpoints, cp);
+	srd_dbg("Session %d: Checkpoint %u at sample %" G_GUINT64_FORMAT ".",
+		sess->session_id, sess->checkpoints->len, samplenum);
+}
+
+/* Bring an instance back to a checkpoint, caller holds the GIL. */
+static gboolean checkpoint_inst_restore(struct checkpoint_inst *ci,
+		PyObject *py_loads)
+{
+	struct srd_decoder_inst *di;
+	PyObject *py_bytes, *py_state, *py_dict;
+	int ret;
+
+	di = ci->di;
+	py_state = NULL;
+	if ((py_bytes = PyBytes_FromStringAndSize((const char *)ci->state->data,
+			ci->state->len))) {
+		py_state = PyObject_CallFunctionObjArgs(py_loads, py_bytes, NULL);
+		Py_DECREF(py_bytes);
+	}
+	ret = -1;
+	if (py_state && (py_dict = PyObject_GetAttrString(di->py_inst,
+			"__dict__"))) {
+		ret = PyDict_Update(py_dict, py_state);
+		Py_DECREF(py_dict);
+	}
+	Py_XDECREF(py_state);
+	if (ret < 0) {
+		srd_exception_catch("Cannot restore state of %s", di->inst_id);
+		return FALSE;
+	}
+
+	di->abs_cur_samplenum = ci->abs_cur_samplenum;
+	if (di->old_pins_array)
+		g_array_free(di->old_pins_array, TRUE);
+	di->old_pins_array = NULL;
+	if (ci->old_pins) {
+		di->old_pins_array = g_array_sized_new(FALSE, FALSE,
+			sizeof(uint8_t), ci->old_pins->len);
+		g_array_append_vals(di->old_pins_array, ci->old_pins->data,
+			ci->old_pins->len);
+	}
+	srd_checkpoint_conditions_free(di->checkpoint_conditions);
+	di->checkpoint_conditions = conditions_copy(ci->conditions);
+
+	return TRUE;
+}
+
+static int checkpoint_restore(struct srd_session *sess,
+		struct srd_checkpoint *cp)
+{
+	PyGILState_STATE gstate;
+	PyObject *py_mod, *py_loads;
+	GSList *l;
+	int ret;
+
+	/* Stop the workers, bring instances to their state after start(). */
+	for (l = sess->di_list; l; l = l->next) {
+		if ((ret = srd_inst_terminate_reset(l->data)) != SRD_OK)
+			return ret;
+	}
+	/* reset() may have dropped it, the checkpoint would restore it. */
+	if (sess->samplerate) {
+		ret = srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+			g_variant_new_uint64(sess->samplerate));
+		if (ret != SRD_OK)
+			return ret;
+	}
+	if (!cp)
+		return SRD_OK;
+
+	gstate = PyGILState_Ensure();
+	py_loads = NULL;
+	if ((py_mod = PyImport_ImportModule("pickle"))) {
+		py_loads = PyObject_GetAttrString(py_mod, "loads");
+		Py_DECREF(py_mod);
+	}
+	if (!py_loads) {
+		srd_exception_catch("Cannot get pickle.loads");
+		PyGILState_Release(gstate);
+		return SRD_ERR_PYTHON;
+	}
+	ret = SRD_OK;
+	for (l = cp->insts; l && ret == SRD_OK; l = l->next) {
+		if (!checkpoint_inst_restore(l->data, py_loads))
+			ret = SRD_ERR_PYTHON;
+	}
+	Py_DECREF(py_loads);
+	PyGILState_Release(gstate);
+
+	return ret;
+}
+
+/**
+ * Continue a skip of the wait() a checkpoint was taken in.
+ *
+ * The first wait() after a restore sets up its conditions from
+ * scratch. If they are the ones of the checkpoint, carry over how many
+ * samples the skip terms have advanced already.
+ *
+ * @private
+ */
+SRD_PRIV void srd_checkpoint_resume(struct srd_decoder_inst *di)
+{
+	GSList *saved, *sc, *cc, *st, *ct;
+	struct srd_term *s, *c;
+	gboolean same;
+
+	if (!(saved = di->checkpoint_conditions))
+		return;
+	di->checkpoint_conditions = NULL;
+
+	/* Compare condition by condition, term by term. */
+	same = TRUE;
+	for (sc = saved, cc = di->condition_list; same && sc && cc;
+			sc = sc->next, cc = cc->next) {
+		for (st = sc->data, ct = cc->data; same && st && ct;
+				st = st->next, ct = ct->next) {
+			s = st->data;
+			c = ct->data;
+			same = s->type == c->type && (s->type == SRD_TERM_SKIP ?
+				s->num_samples_to_skip == c->num_samples_to_skip :
+				s->channel == c->channel);
+		}
+		same = same && !st && !ct;
+	}
+	same = same && !sc && !cc;
+
+	if (same) {
+		for (sc = saved, cc = di->condition_list; sc;
+				sc = sc->next, cc = cc->next) {
+			for (st = sc->data, ct = cc->data; st;
+					st = st->next, ct = ct->next) {
+				s = st->data;
+				c = ct->data;
+				c->num_samples_already_skipped =
+					s->num_samples_already_skipped;
+			}
+		}
+	} else {
+		srd_dbg("%s: wait() differs from the checkpoint's.",
+			di->inst_id);
+	}
+
+	srd_checkpoint_conditions_free(saved);
+}
+
+/**
+ * Set the interval of decoder state checkpoints of a session.
+ *
+ * A checkpoint gets taken at the first chunk boundary which is at
+ * least 'interval' samples after the previous one. Checkpoints are
+ * only taken if all instances of the session are checkpointable (see
+ * the group description). They are dropped by
+ * srd_session_terminate_reset().
+ *
+ * @param sess The session. Must not be NULL.
+ * @param interval Samples between checkpoints, 0 disables checkpoints
+ *                 and drops the existing ones.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_checkpoint_interval_set(struct srd_session *sess,
+		uint64_t interval)
+{
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	sess->checkpoint_interval = interval;
+	if (!interval)
+		srd_checkpoint_free_all(sess);
+
+	return SRD_OK;
+}
+
+/**
+ * Get the sample numbers of a session's checkpoints.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param samplenums Array which receives up to 'max' sample numbers in
+ *                   ascending order. Can be NULL.
+ * @param max Size of the array.
+ *
+ * @return The number of checkpoints, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_checkpoints_get(struct srd_session *sess,
+		uint64_t *samplenums, unsigned int max)
+{
+	struct srd_checkpoint *cp;
+	unsigned int i;
+
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	if (!sess->checkpoints)
+		return 0;
+
+	for (i = 0; samplenums && i < max && i < sess->checkpoints->len; i++) {
+		cp = g_ptr_array_index(sess->checkpoints, i);
+		samplenums[i] = cp->samplenum;
+	}
+
+	return sess->checkpoints->len;
+}
+
+/**
+ * Decode a range of samples of a capture which was decoded before.
+ *
+ * Continues from the current position if that's within the range or
+ * after the latest checkpoint before it, else restores the latest
+ * checkpoint before the range (or starts from sample 0). Samples are
+ * taken from the source in chunks, starting at the checkpoint. Output
+ * which ends before start_sample is dropped, except for Python output,
+ * which stacked decoders need. Afterwards the session is positioned at
+ * end_sample: srd_session_send() continues there, or a later range
+ * decode resumes without a restore.
+ *
+ * Chunk boundaries are multiples of chunk_size, such that bit-planes
+ * can be passed without shifting if chunk_size and the checkpoint
+ * positions are multiples of 8.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param start_sample The first sample of interest.
+ * @param end_sample The sample after the last one to decode.
+ * @param chunk_size The maximum number of samples per chunk, 0 for a
+ *                   default.
+ * @param source Function which returns the input data of a chunk.
+ *               Must not be NULL.
+ * @param cb_data Private data for the source. Can be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_decode_range(struct srd_session *sess,
+		uint64_t start_sample, uint64_t end_sample, uint64_t chunk_size,
+		srd_sample_source source, void *cb_data)
+{
+	struct srd_checkpoint *cp, *c;
+	const struct srd_input_view *inbuf;
+	uint64_t pos, next;
+	unsigned int i;
+	int ret;
+
+	if (!sess || !source || start_sample > end_sample)
+		return SRD_ERR_ARG;
+	if (!chunk_size)
+		chunk_size = 64 * 1024;
+
+	cp = NULL;
+	for (i = 0; sess->checkpoints && i < sess->checkpoints->len; i++) {
+		c = g_ptr_array_index(sess->checkpoints, i);
+		if (c->samplenum > start_sample)
+			break;
+		cp = c;
+	}
+
+	pos = sess->decode_samplenum;
+	if (pos > start_sample || (cp && pos < cp->samplenum)) {
+		srd_dbg("Session %d: Decoding %" G_GUINT64_FORMAT "-%"
+			G_GUINT64_FORMAT " from sample %" G_GUINT64_FORMAT ".",
+			sess->session_id, start_sample, end_sample,
+			cp ? cp->samplenum : 0);
+		if ((ret = checkpoint_restore(sess, cp)) != SRD_OK)
+			return ret;
+		pos = cp ? cp->samplenum : 0;
+		sess->decode_samplenum = pos;
+	}
+
+	sess->output_from = start_sample;
+	ret = SRD_OK;
+	while (pos < end_sample) {
+		next = MIN((pos / chunk_size + 1) * chunk_size, end_sample);
+		if (!(inbuf = source(pos, next, cb_data))) {
+			srd_err("No sample data for %" G_GUINT64_FORMAT "-%"
+				G_GUINT64_FORMAT ".", pos, next);
+			ret = SRD_ERR;
+			break;
+		}
+		ret = srd_session_send_views(sess, pos, next, inbuf);
+		if (ret != SRD_OK)
+			break;
+		pos = next;
+	}
+	sess->output_from = 0;
+
+	/* Have queued output reach the frontend before returning. */
+	srd_output_sync(sess);
+
+	return ret;
+}
+
+/** @} */
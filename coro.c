@@ -0,0 +1,288 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(HAVE_UCONTEXT_H)
+#include <ucontext.h>
+#endif
+
+/**
+ * @file
+ *
+ * Coroutines which run a decoder's decode() method on the caller's thread.
+ */
+
+/** @cond PRIVATE */
+
+/* C stack size of one coroutine, Python calls nest on this stack. */
+#define CORO_STACK_SIZE (4 * 1024 * 1024)
+
+struct srd_coro {
+	srd_coro_func func;
+	void *arg;
+	/** Set when func() has returned. */
+	gboolean done;
+	/** The only thread which may resume the coroutine. */
+	GThread *owner;
+	/* Keeps the owner's Python thread state alive between resumes. */
+	PyGILState_STATE gstate;
+	PyThreadState *tstate;
+	/* The coroutine's own Python thread state, for its frames. */
+	PyThreadState *co_tstate;
+#ifdef _WIN32
+	LPVOID fiber;
+	LPVOID caller;
+#elif defined(HAVE_UCONTEXT_H)
+	ucontext_t ctx;
+	ucontext_t caller;
+	void *stack;
+#endif
+};
+
+#if PY_VERSION_HEX >= 0x030c0000
+/* Part of the stable ABI since Python 3.9, newer than Py_LIMITED_API. */
+PyAPI_FUNC(PyInterpreterState *) PyInterpreterState_Get(void);
+#endif
+
+/** @endcond */
+
+/**
+ * Check whether coroutines are supported on this platform.
+ *
+ * Each coroutine runs Python code in a thread state of its own. Python
+ * before 3.12 does not support several thread states on one thread.
+ * Python 3.14 checks the C stack pointer against the bounds of the
+ * thread's stack, which a coroutine stack is not part of.
+ *
+ * @private
+ */
+SRD_PRIV gboolean srd_coro_supported(void)
+{
+#if PY_VERSION_HEX < 0x030c0000 || PY_VERSION_HEX >= 0x030e0000
+	return FALSE;
+#elif defined(_WIN32) || defined(HAVE_UCONTEXT_H)
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/*
+ * Make a thread state the one which PyGILState_Ensure() and friends
+ * use on the calling thread. The interpreter's frames, recursion depth
+ * and exception state live in the thread state, so each stack of C
+ * frames needs its own. Must be called without holding the GIL.
+ */
+static void coro_bind_tstate(PyThreadState *tstate)
+{
+	PyEval_RestoreThread(tstate);
+	(void)PyEval_SaveThread();
+}
+
+#ifdef _WIN32
+static VOID CALLBACK coro_entry(LPVOID param)
+{
+	struct srd_coro *co;
+
+	co = param;
+	coro_bind_tstate(co->co_tstate);
+	co->func(co->arg);
+	co->done = TRUE;
+	SwitchToFiber(co->caller);
+}
+#elif defined(HAVE_UCONTEXT_H)
+/* makecontext() only passes int arguments, split the pointer. */
+static void coro_entry(unsigned int lo, unsigned int hi)
+{
+	struct srd_coro *co;
+
+	co = (struct srd_coro *)(uintptr_t)(((uint64_t)hi << 32) | lo);
+	coro_bind_tstate(co->co_tstate);
+	co->func(co->arg);
+	co->done = TRUE;
+	/* Returning resumes uc_link, i.e. the last caller. */
+}
+#endif
+
+/**
+ * Create a coroutine which runs func(arg) upon the first resume.
+ *
+ * Must be called without holding the GIL. The calling thread becomes
+ * the coroutine's owner, only that thread may resume and free it.
+ *
+ * @param func The coroutine's body. Must not be NULL.
+ * @param arg The argument passed to func.
+ *
+ * @return The new coroutine, or NULL upon error.
+ *
+ * @private
+ */
+SRD_PRIV struct srd_coro *srd_coro_new(srd_coro_func func, void *arg)
+{
+	struct srd_coro *co;
+
+	if (!func || !srd_coro_supported())
+		return NULL;
+
+	co = g_malloc0(sizeof(*co));
+	co->func = func;
+	co->arg = arg;
+	co->owner = g_thread_self();
+
+#ifdef _WIN32
+	if (!(co->fiber = CreateFiber(CORO_STACK_SIZE, coro_entry, co))) {
+		srd_err("Cannot create decoder fiber.");
+		g_free(co);
+		return NULL;
+	}
+#elif defined(HAVE_UCONTEXT_H)
+	if (!(co->stack = g_try_malloc(CORO_STACK_SIZE))) {
+		srd_err("Cannot allocate decoder coroutine stack.");
+		g_free(co);
+		return NULL;
+	}
+	if (getcontext(&co->ctx) != 0) {
+		srd_err("Cannot create decoder coroutine context.");
+		g_free(co->stack);
+		g_free(co);
+		return NULL;
+	}
+	co->ctx.uc_stack.ss_sp = co->stack;
+	co->ctx.uc_stack.ss_size = CORO_STACK_SIZE;
+	co->ctx.uc_link = &co->caller;
+	makecontext(&co->ctx, (void (*)(void))coro_entry, 2,
+		(unsigned int)((uint64_t)(uintptr_t)co & 0xffffffff),
+		(unsigned int)((uint64_t)(uintptr_t)co >> 32));
+#endif
+
+	/*
+	 * The owner's thread state is restored whenever the coroutine
+	 * returns to the owner. Don't let PyGILState_Release() destroy
+	 * that thread state while the coroutine exists. The frames of
+	 * the suspended decode() live in the coroutine's thread state.
+	 */
+	co->gstate = PyGILState_Ensure();
+#if PY_VERSION_HEX >= 0x030c0000
+	co->co_tstate = PyThreadState_New(PyInterpreterState_Get());
+#endif
+	co->tstate = PyEval_SaveThread();
+
+	return co;
+}
+
+/**
+ * Run the coroutine until it yields or its body returns.
+ *
+ * Must be called without holding the GIL.
+ *
+ * @param co The coroutine. Must not be NULL.
+ *
+ * @retval SRD_OK The coroutine yielded, or is done.
+ * @retval SRD_ERR The calling thread is not the coroutine's owner.
+ *
+ * @private
+ */
+SRD_PRIV int srd_coro_resume(struct srd_coro *co)
+{
+	if (co->done)
+		return SRD_OK;
+
+	if (g_thread_self() != co->owner) {
+		srd_err("Decoder coroutine resumed from a foreign thread.");
+		return SRD_ERR;
+	}
+
+#ifdef _WIN32
+	if (IsThreadAFiber())
+		co->caller = GetCurrentFiber();
+	else
+		co->caller = ConvertThreadToFiber(NULL);
+	SwitchToFiber(co->fiber);
+#elif defined(HAVE_UCONTEXT_H)
+	swapcontext(&co->caller, &co->ctx);
+#endif
+	coro_bind_tstate(co->tstate);
+
+	return SRD_OK;
+}
+
+/**
+ * Return from the coroutine to the thread which resumed it.
+ *
+ * Must be called from within the coroutine, without holding the GIL.
+ *
+ * @param co The coroutine. Must not be NULL.
+ *
+ * @private
+ */
+SRD_PRIV void srd_coro_yield(struct srd_coro *co)
+{
+#ifdef _WIN32
+	SwitchToFiber(co->caller);
+#elif defined(HAVE_UCONTEXT_H)
+	swapcontext(&co->ctx, &co->caller);
+#endif
+	coro_bind_tstate(co->co_tstate);
+}
+
+/** @private */
+SRD_PRIV gboolean srd_coro_done(const struct srd_coro *co)
+{
+	return co->done;
+}
+
+/**
+ * Release a coroutine.
+ *
+ * Must be called by the owner thread, without holding the GIL, after
+ * the coroutine's body has returned. Otherwise the coroutine is leaked,
+ * as releasing the stack of a suspended decode() is not safe.
+ *
+ * @param co The coroutine. May be NULL.
+ *
+ * @private
+ */
+SRD_PRIV void srd_coro_free(struct srd_coro *co)
+{
+	if (!co)
+		return;
+
+	if (!co->done || g_thread_self() != co->owner) {
+		srd_err("Cannot release a suspended decoder coroutine.");
+		return;
+	}
+
+	PyEval_RestoreThread(co->tstate);
+	PyThreadState_Clear(co->co_tstate);
+	PyThreadState_Delete(co->co_tstate);
+	PyGILState_Release(co->gstate);
+
+#ifdef _WIN32
+	DeleteFiber(co->fiber);
+#elif defined(HAVE_UCONTEXT_H)
+	g_free(co->stack);
+#endif
+	g_free(co);
+}
@@ -0,0 +1,444 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file
+ *
+ * Decimated input for oversampled decoders.
+ */
+
+/**
+ * @defgroup grp_decimate Input decimation
+ *
+ * Decode heavily oversampled captures at a fraction of the samplerate.
+ *
+ * Decoders which wait() for edges and then skip to the middle of bits
+ * don't need hundreds of samples per bit, yet each skip walks all of
+ * them. A decimated instance gets one sample per 'factor' samples of
+ * the input instead, and the samplerate divided by the factor. Its
+ * output is scaled back, so stacked decoders and the frontend see
+ * sample numbers of the input.
+ *
+ * The decimated planes are built per chunk, once per factor and policy
+ * for all instances which use them, and only for the channels these
+ * instances read. Groups of samples may span chunks.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+struct srd_decimator {
+	unsigned int factor;
+	int policy;
+
+	/* Entries of inbuf, 0 until the channels have been collected. */
+	unsigned int num_channels;
+	gboolean *used;
+	struct srd_input_view *inbuf;
+
+	/* Planes of the decimated samples, plane_size bytes apart. */
+	uint8_t *planes;
+	uint64_t plane_size;
+	uint64_t capacity;
+
+	/* Decimated samples of the current chunk. */
+	uint64_t out_start;
+	uint64_t out_end;
+
+	/* The group which continues in the next chunk, per channel. */
+	uint64_t *ones;
+	uint8_t *first;
+};
+
+/** @endcond */
+
+static void decimator_channels_free(struct srd_decimator *dec)
+{
+	g_free(dec->used);
+	g_free(dec->inbuf);
+	g_free(dec->ones);
+	g_free(dec->first);
+	dec->used = NULL;
+	dec->inbuf = NULL;
+	dec->ones = NULL;
+	dec->first = NULL;
+	dec->num_channels = 0;
+}
+
+static void decimator_free(struct srd_decimator *dec)
+{
+	decimator_channels_free(dec);
+	srd_sample_buffer_free(dec->planes);
+	g_free(dec);
+}
+
+/* Collect the channels the instances using the decimator read. */
+static void decimator_channels(struct srd_session *sess,
+		struct srd_decimator *dec)
+{
+	struct srd_decoder_inst *di;
+	GSList *l;
+	int i, num;
+
+	num = 1;
+	for (l = sess->di_list; l; l = l->next) {
+		di = l->data;
+		if (di->decimator != dec)
+			continue;
+		for (i = 0; i < di->dec_num_channels; i++)
+			num = MAX(num, di->dec_channelmap[i] + 1);
+	}
+
+	dec->num_channels = num;
+	dec->used = g_malloc0(num * sizeof(gboolean));
+	dec->inbuf = g_malloc0(num * sizeof(struct srd_input_view));
+	dec->ones = g_malloc0(num * sizeof(uint64_t));
+	dec->first = g_malloc0(num);
+
+	for (l = sess->di_list; l; l = l->next) {
+		di = l->data;
+		if (di->decimator != dec)
+			continue;
+		for (i = 0; i < di->dec_num_channels; i++) {
+			if (di->dec_channelmap[i] >= 0)
+				dec->used[di->dec_channelmap[i]] = TRUE;
+		}
+	}
+}
+
+/* Number of high samples in [lo, hi). */
+static uint64_t plane_ones(const struct srd_input_view *in,
+		uint64_t lo, uint64_t hi)
+{
+	uint64_t ones;
+	unsigned int count;
+
+	if (!in->data)
+		return in->constant ? hi - lo : 0;
+
+	for (ones = 0; lo < hi; lo += count) {
+		count = MIN(hi - lo, 64);
+		ones += srd_popcount64(srd_plane_word(in, lo, count));
+	}
+
+	return ones;
+}
+
+/* Decimate one channel of the chunk [start, end) into plane. */
+static void decimate_channel(struct srd_decimator *dec, unsigned int ch,
+		const struct srd_input_view *in, uint64_t start, uint64_t end,
+		uint8_t *plane)
+{
+	uint64_t f, g, lo, hi, ones, tail;
+	uint8_t first, value;
+
+	f = dec->factor;
+
+	for (g = dec->out_start; g < dec->out_end; g++) {
+		/* Only the first group may have started in an earlier chunk. */
+		lo = g * f;
+		hi = lo + f - start;
+		if (lo < start) {
+			lo = 0;
+			first = dec->first[ch];
+			ones = dec->ones[ch];
+		} else {
+			lo -= start;
+			first = srd_plane_sample(in, lo);
+			ones = 0;
+		}
+
+		if (dec->policy == SRD_DECIMATION_FIRST) {
+			value = first;
+		} else {
+			ones += plane_ones(in, lo, hi);
+			if (2 * ones != f)
+				value = 2 * ones > f;
+			else
+				value = first;
+		}
+		if (value)
+			plane[(g - dec->out_start) / 8] |=
+				1 << ((g - dec->out_start) % 8);
+	}
+
+	/* Carry a group which ends in a later chunk. */
+	tail = dec->out_end * f;
+	if (tail >= end)
+		return;
+	if (tail >= start) {
+		dec->first[ch] = srd_plane_sample(in, tail - start);
+		dec->ones[ch] = 0;
+		lo = tail - start;
+	} else {
+		lo = 0;
+	}
+	if (dec->policy == SRD_DECIMATION_MAJORITY)
+		dec->ones[ch] += plane_ones(in, lo, end - start);
+}
+
+static int decimator_build(struct srd_session *sess,
+		struct srd_decimator *dec, uint64_t start, uint64_t end,
+		const struct srd_input_view *inbuf)
+{
+	struct srd_input_view *out;
+	uint8_t *plane;
+	uint64_t num;
+	unsigned int ch;
+
+	if (!dec->num_channels)
+		decimator_channels(sess, dec);
+
+	dec->out_start = start / dec->factor;
+	dec->out_end = end / dec->factor;
+	num = dec->out_end - dec->out_start;
+
+	if (num > dec->capacity) {
+		srd_sample_buffer_free(dec->planes);
+		dec->capacity = 0;
+		dec->plane_size = SRD_SAMPLE_BUFFER_PLANE_SIZE(num);
+		dec->planes = srd_sample_buffer_alloc(
+			dec->plane_size * dec->num_channels, 0);
+		if (!dec->planes)
+			return SRD_ERR_MALLOC;
+		dec->capacity = num;
+	}
+
+	for (ch = 0; ch < dec->num_channels; ch++) {
+		out = &dec->inbuf[ch];
+		memset(out, 0, sizeof(*out));
+		if (!dec->used[ch])
+			continue;
+
+		/* Whole groups of a constant channel are constant. */
+		if (!inbuf[ch].data && start % dec->factor == 0) {
+			out->constant = inbuf[ch].constant;
+			dec->first[ch] = inbuf[ch].constant;
+			dec->ones[ch] = inbuf[ch].constant ?
+				end - dec->out_end * dec->factor : 0;
+			continue;
+		}
+
+		plane = dec->planes + ch * dec->plane_size;
+		memset(plane, 0, (num + 7) / 8);
+		decimate_channel(dec, ch, &inbuf[ch], start, end, plane);
+		out->data = plane;
+	}
+
+	return SRD_OK;
+}
+
+/**
+ * Decimate a chunk for all decimated instances of a session.
+ *
+ * @private
+ */
+SRD_PRIV int srd_decimate_chunk(struct srd_session *sess,
+		uint64_t start_sample, uint64_t end_sample,
+		const struct srd_input_view *inbuf)
+{
+	GSList *l;
+	int ret;
+
+	for (l = sess->decimators; l; l = l->next) {
+		ret = decimator_build(sess, l->data, start_sample, end_sample,
+			inbuf);
+		if (ret != SRD_OK)
+			return ret;
+	}
+
+	return SRD_OK;
+}
+
+/**
+ * Decode the decimated samples of the current chunk.
+ *
+ * Groups which end in a later chunk are decoded with that one.
+ *
+ * @private
+ */
+SRD_PRIV int srd_decimate_inst_decode(struct srd_decoder_inst *di)
+{
+	struct srd_decimator *dec;
+
+	dec = di->decimator;
+	if (dec->out_end == dec->out_start)
+		return SRD_OK;
+
+	return srd_inst_decode(di, dec->out_start, dec->out_end, dec->inbuf);
+}
+
+/**
+ * Forget partial groups, and the channels, for a new input stream.
+ *
+ * @private
+ */
+SRD_PRIV void srd_decimate_reset(struct srd_session *sess)
+{
+	GSList *l;
+
+	for (l = sess->decimators; l; l = l->next)
+		decimator_channels_free(l->data);
+}
+
+/** @private */
+SRD_PRIV void srd_decimate_free(struct srd_session *sess)
+{
+	g_slist_free_full(sess->decimators, (GDestroyNotify)decimator_free);
+	sess->decimators = NULL;
+}
+
+static gboolean inst_decimatable(struct srd_decoder_inst *di)
+{
+	PyGILState_STATE gstate;
+	PyObject *py_attr;
+	gboolean ret;
+
+	gstate = PyGILState_Ensure();
+	ret = FALSE;
+	if ((py_attr = PyObject_GetAttrString(di->py_inst, "decimatable"))) {
+		ret = PyObject_IsTrue(py_attr) == 1;
+		Py_DECREF(py_attr);
+	}
+	PyErr_Clear();
+	PyGILState_Release(gstate);
+
+	return ret;
+}
+
+/* Drop decimators no instance uses anymore. */
+static void decimators_prune(struct srd_session *sess)
+{
+	struct srd_decimator *dec;
+	GSList *l, *next, *d;
+
+	for (l = sess->decimators; l; l = next) {
+		next = l->next;
+		dec = l->data;
+		for (d = sess->di_list; d; d = d->next) {
+			if (((struct srd_decoder_inst *)d->data)->decimator == dec)
+				break;
+		}
+		if (d)
+			continue;
+		sess->decimators = g_slist_delete_link(sess->decimators, l);
+		decimator_free(dec);
+	}
+}
+
+/**
+ * Decode only every n-th sample group of an instance's input.
+ *
+ * The instance gets one sample per 'factor' input samples: the level
+ * most of them have (SRD_DECIMATION_MAJORITY), which also filters
+ * glitches shorter than half a group, or the first one's
+ * (SRD_DECIMATION_FIRST), which is cheaper. Its samplerate is the
+ * session's divided by the factor, rounded down, so the factor should
+ * divide it. The sample numbers of its output are multiplied by the
+ * factor; edges are thereby found up to factor - 1 samples late. A
+ * group which is still incomplete at the end of the input is dropped.
+ *
+ * Only decoders which set the class attribute 'decimatable' to True
+ * can be decimated. They must reach their timing through wait() and
+ * the samplerate, and need enough samples per symbol left at the
+ * reduced rate. Only instances which get logic input, i.e. not stacked
+ * ones, can be decimated. Decimated sessions take no checkpoints.
+ *
+ * Instances with the same factor and policy share the decimated input.
+ * Set the decimation before srd_session_start(), and again after
+ * changing the instance's channels.
+ *
+ * @param di The decoder instance. Must not be NULL.
+ * @param factor The number of input samples per decimated one, 0 or 1
+ *               to decode all samples.
+ * @param policy How groups are reduced (enum srd_decimation_policy).
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_inst_decimation_set(struct srd_decoder_inst *di,
+		unsigned int factor, int policy)
+{
+	struct srd_session *sess;
+	struct srd_decimator *dec;
+	GSList *l;
+
+	if (!di || !di->sess)
+		return SRD_ERR_ARG;
+	if (policy != SRD_DECIMATION_MAJORITY && policy != SRD_DECIMATION_FIRST)
+		return SRD_ERR_ARG;
+
+	sess = di->sess;
+	if (factor > 1) {
+		if (!g_slist_find(sess->di_list, di) || !di->dec_num_channels) {
+			srd_err("%s: Only instances with logic input can be "
+				"decimated.", di->inst_id);
+			return SRD_ERR_ARG;
+		}
+		if (!inst_decimatable(di)) {
+			srd_err("%s: Decoder doesn't support decimated input.",
+				di->inst_id);
+			return SRD_ERR_ARG;
+		}
+	} else {
+		factor = 0;
+	}
+
+	dec = NULL;
+	for (l = sess->decimators; factor && l; l = l->next) {
+		dec = l->data;
+		if (dec->factor == factor && dec->policy == policy)
+			break;
+		dec = NULL;
+	}
+	if (factor && !dec) {
+		dec = g_malloc0(sizeof(struct srd_decimator));
+		dec->factor = factor;
+		dec->policy = policy;
+		sess->decimators = g_slist_append(sess->decimators, dec);
+	}
+
+	di->decimation = factor;
+	di->decimation_policy = policy;
+	di->decimator = dec;
+	decimators_prune(sess);
+	/* The instance's channels may be new to the decimator. */
+	if (dec)
+		decimator_channels_free(dec);
+
+	srd_dbg("%s: Decimating input by %u.", di->inst_id, MAX(factor, 1));
+
+	/* The instance may already know the undecimated samplerate. */
+	if (sess->samplerate)
+		return srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+			g_variant_new_uint64(sess->samplerate));
+
+	return SRD_OK;
+}
+
+/** @} */
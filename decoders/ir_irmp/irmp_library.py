@@ -86,6 +86,33 @@ def _library_setup_api(self):
         self._lib.irmp_add_one_sample.restype = ctypes.c_int
         self._lib.irmp_add_one_sample.argtypes = [ ctypes.c_int, ]
 
+        # Optional, older library builds lack the chunk detection.
+        try:
+            self._lib.irmp_detect_plane.restype = ctypes.c_size_t
+            self._lib.irmp_detect_plane.argtypes = [ ctypes.c_char_p, ctypes.c_uint64, ctypes.c_size_t, ctypes.c_uint32, ctypes.c_int, ctypes.POINTER(self.ResultData), ctypes.c_size_t, ]
+            self._has_detect_plane = True
+        except AttributeError:
+            self._has_detect_plane = False
+
+        # Optional, older library builds share one decoder state, and
+        # only run at one sample rate.
+        try:
+            self._lib.irmp_instance_set_sample_rate.restype = ctypes.c_uint32
+            self._lib.irmp_instance_set_sample_rate.argtypes = [ ctypes.c_void_p, ctypes.c_uint64, ]
+            self._lib.irmp_instance_get_sample_rate.restype = ctypes.c_uint32
+            self._lib.irmp_instance_get_sample_rate.argtypes = [ ctypes.c_void_p, ]
+            self._lib.irmp_instance_reset_state.restype = None
+            self._lib.irmp_instance_reset_state.argtypes = [ ctypes.c_void_p, ]
+            self._lib.irmp_instance_add_one_sample.restype = ctypes.c_int
+            self._lib.irmp_instance_add_one_sample.argtypes = [ ctypes.c_void_p, ctypes.c_int, ]
+            self._lib.irmp_instance_get_result_data.restype = ctypes.c_int
+            self._lib.irmp_instance_get_result_data.argtypes = [ ctypes.c_void_p, ctypes.POINTER(self.ResultData), ]
+            self._lib.irmp_instance_detect_plane.restype = ctypes.c_size_t
+            self._lib.irmp_instance_detect_plane.argtypes = [ ctypes.c_void_p, ctypes.c_char_p, ctypes.c_uint64, ctypes.c_size_t, ctypes.c_int, ctypes.POINTER(self.ResultData), ctypes.c_size_t, ]
+            self._has_instance_state = True
+        except AttributeError:
+            self._has_instance_state = False
+
         if False:
             self._lib.irmp_detect_buffer.restype = self.ResultData
             self._lib.irmp_detect_buffer.argtypes = [ ctypes.POINTER(ctypes.c_uint8), ctypes.c_size_t, ]
@@ -98,7 +125,9 @@ def _library_setup_api(self):
 
         # Create a result buffer that's local to the library instance.
         self._data = self.ResultData()
+        self._frames = (self.ResultData * 16)()
         self._inst = None
+        self._rate_factor = 1
 
         return True
 
@@ -127,7 +156,9 @@ def __enter__(self):
 
         if self._inst is None:
             self._inst = self._lib.irmp_instance_alloc()
-        self._lib.irmp_instance_lock(self._inst, 1)
+        # Instances with their own state need no serialization.
+        if not self._has_instance_state:
+            self._lib.irmp_instance_lock(self._inst, 1)
         return self
 
     def __exit__(self, extype, exvalue, trace):
@@ -135,34 +166,86 @@ def __exit__(self, extype, exvalue, trace):
         Leave a context (lock management).
         '''
 
-        self._lib.irmp_instance_unlock(self._inst)
+        if not self._has_instance_state:
+            self._lib.irmp_instance_unlock(self._inst)
         return False
 
     def client_id(self):
         return self._lib.irmp_instance_id(self._inst)
 
     def get_sample_rate(self):
+        if self._has_instance_state and self._inst:
+            return self._lib.irmp_instance_get_sample_rate(self._inst)
         return self._lib.irmp_get_sample_rate()
 
+    def set_sample_rate(self, samplerate):
+        '''
+        Setup detection for a capture's samplerate, return the rate at
+        which the detector runs, or 0 if the samplerate is unsupported.
+        '''
+
+        if self._has_instance_state:
+            if self._inst is None:
+                self._inst = self._lib.irmp_instance_alloc()
+            return self._lib.irmp_instance_set_sample_rate(self._inst, samplerate)
+        lib_rate = self._lib.irmp_get_sample_rate()
+        if not lib_rate or samplerate % lib_rate:
+            return 0
+        self._rate_factor = samplerate // lib_rate
+        return lib_rate
+
     def reset_state(self):
-        self._lib.irmp_reset_state()
+        if self._has_instance_state:
+            self._lib.irmp_instance_reset_state(self._inst)
+        else:
+            self._lib.irmp_reset_state()
 
     def add_one_sample(self, level):
+        if self._has_instance_state:
+            if not self._lib.irmp_instance_add_one_sample(self._inst, int(level)):
+                return False
+            self._lib.irmp_instance_get_result_data(self._inst, ctypes.byref(self._data))
+            return True
         if not self._lib.irmp_add_one_sample(int(level)):
             return False
         self._lib.irmp_get_result_data(ctypes.byref(self._data))
         return True
 
+    def has_detect_plane(self):
+        return self._has_detect_plane
+
+    def detect_plane(self, plane, first_sample, count, invert):
+        '''
+        Feed a chunk's bit-plane to the detector, return its frames.
+        '''
+
+        frames = []
+        while True:
+            if self._has_instance_state:
+                num = self._lib.irmp_instance_detect_plane(self._inst,
+                    plane, first_sample, count, int(invert),
+                    self._frames, len(self._frames))
+            else:
+                num = self._lib.irmp_detect_plane(plane, first_sample, count,
+                    self._rate_factor, int(invert), self._frames,
+                    len(self._frames))
+            frames.extend(self._result_dict(self._frames[i]) for i in range(num))
+            if num < len(self._frames):
+                return frames
+
+    def _result_dict(self, data):
+        return {
+            'proto_nr': data.protocol,
+            'proto_name': data.protocol_name.decode('UTF-8', 'ignore'),
+            'address': data.address,
+            'command': data.command,
+            'repeat': bool(data.flags & self.FLAG_REPETITION),
+            'release': bool(data.flags & self.FLAG_RELEASE),
+            'start': data.start_sample,
+            'end': data.end_sample,
+        }
+
     def get_result_data(self):
         if not self._data:
             return None
-        return {
-            'proto_nr': self._data.protocol,
-            'proto_name': self._data.protocol_name.decode('UTF-8', 'ignore'),
-            'address': self._data.address,
-            'command': self._data.command,
-            'repeat': bool(self._data.flags & self.FLAG_REPETITION),
-            'release': bool(self._data.flags & self.FLAG_RELEASE),
-            'start': self._data.start_sample,
-            'end': self._data.end_sample,
-        }
+        return self._result_dict(self._data)
@@ -63,8 +63,8 @@ def putframe(self, data):
         cmd = data['command']
         repeat = data['repeat']
         release = data['release']
-        ss = data['start'] * self.rate_factor
-        es = data['end'] * self.rate_factor
+        ss = data['start'] * self.samplerate // self.lib_rate
+        es = data['end'] * self.samplerate // self.lib_rate
 
         # Prepare display texts for several zoom levels.
         # Implementor's note: Keep list lengths for flags aligned during
@@ -121,15 +121,25 @@ def decode(self):
         lib_rate = self.irmp.get_sample_rate()
         if not lib_rate:
             raise LibraryError('Cannot determine IRMP library\'s samplerate.')
-        if self.samplerate % lib_rate:
-            raise SamplerateError('Capture samplerate must be multiple of library samplerate ({})'.format(lib_rate))
+        # Older libraries need a multiple of their samplerate, newer ones
+        # pick a detector rate which suits the capture.
+        self.lib_rate = self.irmp.set_sample_rate(self.samplerate)
+        if not self.lib_rate:
+            raise SamplerateError('Capture samplerate not supported by IRMP library ({})'.format(self.samplerate))
 
-        self.rate_factor = int(self.samplerate / lib_rate)
+        self.rate_factor = int(self.samplerate / self.lib_rate)
         active = 0 if self.options['polarity'] == 'active-low' else 1
 
-        ir, = self.wait()
         with self.irmp:
             self.irmp.reset_state()
+            if self.irmp.has_detect_plane():
+                # Have the library run over whole chunks, in C.
+                while True:
+                    ss, count, plane = self.wait_chunk(0)
+                    frames = self.irmp.detect_plane(plane, ss, count, active)
+                    for data in frames:
+                        self.putframe(data)
+            ir, = self.wait()
             while True:
                 if active == 1:
                     ir = 1 - ir
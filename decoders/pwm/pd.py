@@ -105,37 +105,42 @@ def decode(self):
         self.wait({0: 'f' if self.options['polarity'] == 'active-low' else 'r'})
         self.first_samplenum = self.samplenum
 
-        # Keep getting samples for the period's middle and terminal edges.
-        # At the same time that last sample starts the next period.
+        # Keep getting the widths of the active and the inactive pulse of
+        # periods, many periods at once. A batch ends with the edges of a
+        # chunk, its last period may continue in the next batch.
+        start_samplenum = self.samplenum
+        active = None
         while True:
-
-            # Get the next two edges. Setup some variables that get
-            # referenced in the calculation and in put() routines.
-            start_samplenum = self.samplenum
-            self.wait({0: 'e'})
-            end_samplenum = self.samplenum
-            self.wait({0: 'e'})
-            self.ss_block = start_samplenum
-            self.es_block = self.samplenum
-
-            # Calculate the period, the duty cycle, and its ratio.
-            period = self.samplenum - start_samplenum
-            duty = end_samplenum - start_samplenum
-            ratio = float(duty / period)
-
-            # Report the duty cycle in percent.
-            percent = float(ratio * 100)
-            self.putx([0, ['%f%%' % percent]])
-
-            # Report the duty cycle in the binary output.
-            self.putb([0, bytes([int(ratio * 256)])])
-
-            # Report the period in units of time.
-            period_t = float(period / self.samplerate)
-            self.putp(period_t)
-
-            # Update and report the new duty cycle average.
-            num_cycles += 1
-            average += percent
-            self.put(self.first_samplenum, self.es_block, self.out_average,
-                     float(average / num_cycles))
+            _, runs = self.pulses(0, 256)
+
+            # Each pair of runs is one period. Setup some variables that
+            # get referenced in the calculation and in put() routines.
+            for run in runs:
+                if active is None:
+                    active = run
+                    continue
+                duty, active = active, None
+                period = duty + run
+                self.ss_block = start_samplenum
+                self.es_block = start_samplenum + period
+                start_samplenum = self.es_block
+
+                # Calculate the duty cycle ratio.
+                ratio = float(duty / period)
+
+                # Report the duty cycle in percent.
+                percent = float(ratio * 100)
+                self.putx([0, ['%f%%' % percent]])
+
+                # Report the duty cycle in the binary output.
+                self.putb([0, bytes([int(ratio * 256)])])
+
+                # Report the period in units of time.
+                period_t = float(period / self.samplerate)
+                self.putp(period_t)
+
+                # Update and report the new duty cycle average.
+                num_cycles += 1
+                average += percent
+                self.put(self.first_samplenum, self.es_block, self.out_average,
+                         float(average / num_cycles))
@@ -151,44 +151,51 @@ def decode(self):
         avg_period = self.options['avg_period']
         delta = self.options['delta'] == 'yes'
         fmt = self.options['format']
-        ss = None
         last_n = deque()
         last_t = None
+        if edge == 'rising':
+            self.wait({Pin.DATA: 'r'})
+        elif edge == 'falling':
+            self.wait({Pin.DATA: 'f'})
+        else:
+            self.wait({Pin.DATA: 'e'})
+        ss = self.samplenum
+
+        # Get the times between edges from the lengths of the runs in
+        # between, many edges at once. Edges of one direction are two
+        # runs apart, a batch may end between them.
+        first = None
         while True:
-            if edge == 'rising':
-                pin = self.wait({Pin.DATA: 'r'})
-            elif edge == 'falling':
-                pin = self.wait({Pin.DATA: 'f'})
-            else:
-                pin = self.wait({Pin.DATA: 'e'})
-
-            if not ss:
-                ss = self.samplenum
-                continue
-            es = self.samplenum
-            sa = es - ss
-            t = sa / self.samplerate
-
-            if fmt == 'full':
-                cls, txt = Ann.TIME, [normalize_time(t)]
-            elif fmt == 'samples':
-                cls, txt = Ann.TERSE, terse_times(sa, fmt)
-            else:
-                cls, txt = Ann.TERSE, terse_times(t, fmt)
-            if txt:
-                self.put(ss, es, self.out_ann, [cls, txt])
-
-            if avg_period > 0:
-                if t > 0:
-                    last_n.append(t)
-                if len(last_n) > avg_period:
-                    last_n.popleft()
-                average = sum(last_n) / len(last_n)
-                cls, txt = Ann.AVG, normalize_time(average)
-                self.put(ss, es, self.out_ann, [cls, [txt]])
-            if last_t and delta:
-                cls, txt = Ann.DELTA, normalize_time(t - last_t)
-                self.put(ss, es, self.out_ann, [cls, [txt]])
-
-            last_t = t
-            ss = es
+            _, runs = self.pulses(Pin.DATA, 256)
+            for sa in runs:
+                if edge != 'any':
+                    if first is None:
+                        first = sa
+                        continue
+                    sa, first = first + sa, None
+                es = ss + sa
+                t = sa / self.samplerate
+
+                if fmt == 'full':
+                    cls, txt = Ann.TIME, [normalize_time(t)]
+                elif fmt == 'samples':
+                    cls, txt = Ann.TERSE, terse_times(sa, fmt)
+                else:
+                    cls, txt = Ann.TERSE, terse_times(t, fmt)
+                if txt:
+                    self.put(ss, es, self.out_ann, [cls, txt])
+
+                if avg_period > 0:
+                    if t > 0:
+                        last_n.append(t)
+                    if len(last_n) > avg_period:
+                        last_n.popleft()
+                    average = sum(last_n) / len(last_n)
+                    cls, txt = Ann.AVG, normalize_time(average)
+                    self.put(ss, es, self.out_ann, [cls, [txt]])
+                if last_t and delta:
+                    cls, txt = Ann.DELTA, normalize_time(t - last_t)
+                    self.put(ss, es, self.out_ann, [cls, [txt]])
+
+                last_t = t
+                ss = es
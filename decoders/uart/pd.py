@@ -101,6 +101,11 @@ class Decoder(srd.Decoder):
     inputs = ['logic']
     outputs = ['uart']
     tags = ['Embedded/industrial']
+    # decode() keeps its state in attributes, checkpoints can restart it.
+    checkpointable = True
+    # Bits are sampled after skips computed from the samplerate, which
+    # also works at a decimated rate.
+    decimatable = True
     optional_channels = (
         # Allow specifying only one of the signals, e.g. if only one data
         # direction exists (or is relevant).
@@ -0,0 +1,587 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @file
+ *
+ * Exporters which write decoder output to files.
+ */
+
+/**
+ * @defgroup grp_export Exporters
+ *
+ * Write annotations (CSV, JSON lines) or binary output (raw) to files.
+ *
+ * Exporters subscribe to the session's output like frontend callbacks
+ * do. Records are formatted into a large buffer by dedicated code and
+ * written in big blocks, which keeps exports of hundreds of millions of
+ * annotations I/O bound.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+#define EXPORT_BUFSIZE (1024 * 1024)
+
+struct export_select {
+	char *inst_id;
+	int ann_row;
+	int ann_class;
+};
+
+struct srd_exporter {
+	struct srd_session *sess;
+	int format;
+	unsigned int flags;
+	char *path;
+	FILE *file;
+	GMutex mutex;
+	/* Selected records, empty to export all. */
+	GArray *selects;
+	uint8_t *buf;
+	gsize len;
+	gsize size;
+};
+
+/** @endcond */
+
+static gboolean export_write(struct srd_exporter *exp)
+{
+	if (exp->file && exp->len &&
+			fwrite(exp->buf, 1, exp->len, exp->file) != exp->len) {
+		srd_err("Cannot write export file %s: %s, export stopped.",
+			exp->path, g_strerror(errno));
+		fclose(exp->file);
+		exp->file = NULL;
+	}
+	exp->len = 0;
+
+	return exp->file != NULL;
+}
+
+/* Make room for n more bytes in the buffer. */
+static uint8_t *export_reserve(struct srd_exporter *exp, gsize n)
+{
+	if (exp->len + n > exp->size) {
+		export_write(exp);
+		if (n > exp->size) {
+			exp->size = n;
+			exp->buf = g_realloc(exp->buf, exp->size);
+		}
+	}
+
+	return exp->buf + exp->len;
+}
+
+static inline void export_char(struct srd_exporter *exp, char c)
+{
+	*export_reserve(exp, 1) = c;
+	exp->len++;
+}
+
+static void export_bytes(struct srd_exporter *exp, const void *data, gsize n)
+{
+	memcpy(export_reserve(exp, n), data, n);
+	exp->len += n;
+}
+
+#define export_literal(exp, s) export_bytes(exp, s, sizeof(s) - 1)
+
+/* Format a number into the buffer, with at least min_digits digits. */
+static void export_u64(struct srd_exporter *exp, uint64_t val,
+		int min_digits)
+{
+	char tmp[20], *p;
+	int n;
+
+	p = tmp + sizeof(tmp);
+	n = 0;
+	do {
+		*--p = '0' + (val % 10);
+		val /= 10;
+		n++;
+	} while (val || n < min_digits);
+
+	export_bytes(exp, p, tmp + sizeof(tmp) - p);
+}
+
+static void export_int(struct srd_exporter *exp, int val)
+{
+	if (val < 0) {
+		export_char(exp, '-');
+		export_u64(exp, -(int64_t)val, 1);
+	} else {
+		export_u64(exp, val, 1);
+	}
+}
+
+/* Sample number as seconds, with nanosecond resolution. */
+static void export_time(struct srd_exporter *exp, uint64_t sample,
+		uint64_t samplerate)
+{
+	uint64_t secs, rem, nsecs;
+
+	secs = sample / samplerate;
+	rem = sample % samplerate;
+#if defined(__SIZEOF_INT128__)
+	nsecs = (unsigned __int128)rem * 1000000000 / samplerate;
+#else
+	nsecs = (uint64_t)((double)rem * 1e9 / samplerate);
+	nsecs = MIN(nsecs, 999999999);
+#endif
+
+	export_u64(exp, secs, 1);
+	export_char(exp, '.');
+	export_u64(exp, nsecs, 9);
+}
+
+static void export_csv_text(struct srd_exporter *exp, const char *s)
+{
+	const char *q;
+
+	export_char(exp, '"');
+	while ((q = strchr(s, '"'))) {
+		/* Double the quotes. */
+		export_bytes(exp, s, q - s + 1);
+		export_char(exp, '"');
+		s = q + 1;
+	}
+	export_bytes(exp, s, strlen(s));
+	export_char(exp, '"');
+}
+
+static void export_json_text(struct srd_exporter *exp, const char *s)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *run;
+	unsigned char c;
+
+	export_char(exp, '"');
+	for (run = s; (c = *s); s++) {
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		export_bytes(exp, run, s - run);
+		run = s + 1;
+		switch (c) {
+		case '"':
+			export_literal(exp, "\\\"");
+			break;
+		case '\\':
+			export_literal(exp, "\\\\");
+			break;
+		case '\n':
+			export_literal(exp, "\\n");
+			break;
+		case '\r':
+			export_literal(exp, "\\r");
+			break;
+		case '\t':
+			export_literal(exp, "\\t");
+			break;
+		default:
+			export_literal(exp, "\\u00");
+			export_char(exp, hex[c >> 4]);
+			export_char(exp, hex[c & 0xf]);
+			break;
+		}
+	}
+	export_bytes(exp, run, s - run);
+	export_char(exp, '"');
+}
+
+static void export_csv_header(struct srd_exporter *exp)
+{
+	export_literal(exp, "start_sample,end_sample,");
+	if (exp->flags & SRD_EXPORT_FLAG_TIME)
+		export_literal(exp, "start_time,end_time,");
+	export_literal(exp, "decoder,row,class,text\n");
+}
+
+static void export_csv_ann(struct srd_exporter *exp,
+		const struct srd_proto_data *pdata, uint64_t samplerate)
+{
+	const struct srd_proto_data_annotation *pda;
+
+	pda = pdata->data;
+	export_u64(exp, pdata->start_sample, 1);
+	export_char(exp, ',');
+	export_u64(exp, pdata->end_sample, 1);
+	export_char(exp, ',');
+	if (exp->flags & SRD_EXPORT_FLAG_TIME) {
+		/* Keep the columns, leave them empty without a samplerate. */
+		if (samplerate)
+			export_time(exp, pdata->start_sample, samplerate);
+		export_char(exp, ',');
+		if (samplerate)
+			export_time(exp, pdata->end_sample, samplerate);
+		export_char(exp, ',');
+	}
+	export_csv_text(exp, pdata->pdo->di->inst_id);
+	export_char(exp, ',');
+	export_int(exp, pda->ann_row);
+	export_char(exp, ',');
+	export_int(exp, pda->ann_class);
+	export_char(exp, ',');
+	/* The first text is the longest one. */
+	export_csv_text(exp, pda->ann_text && pda->ann_text[0] ?
+		pda->ann_text[0] : "");
+	export_char(exp, '\n');
+}
+
+static void export_jsonl_ann(struct srd_exporter *exp,
+		const struct srd_proto_data *pdata, uint64_t samplerate)
+{
+	const struct srd_proto_data_annotation *pda;
+	int i;
+
+	pda = pdata->data;
+	export_literal(exp, "{\"start\":");
+	export_u64(exp, pdata->start_sample, 1);
+	export_literal(exp, ",\"end\":");
+	export_u64(exp, pdata->end_sample, 1);
+	if ((exp->flags & SRD_EXPORT_FLAG_TIME) && samplerate) {
+		export_literal(exp, ",\"start_time\":");
+		export_time(exp, pdata->start_sample, samplerate);
+		export_literal(exp, ",\"end_time\":");
+		export_time(exp, pdata->end_sample, samplerate);
+	}
+	export_literal(exp, ",\"decoder\":");
+	export_json_text(exp, pdata->pdo->di->inst_id);
+	export_literal(exp, ",\"row\":");
+	export_int(exp, pda->ann_row);
+	export_literal(exp, ",\"class\":");
+	export_int(exp, pda->ann_class);
+	export_literal(exp, ",\"texts\":[");
+	for (i = 0; pda->ann_text && pda->ann_text[i]; i++) {
+		if (i)
+			export_char(exp, ',');
+		export_json_text(exp, pda->ann_text[i]);
+	}
+	export_literal(exp, "]}\n");
+}
+
+/* The caller must hold exp->mutex. */
+static gboolean export_selected(struct srd_exporter *exp,
+		const struct srd_proto_data *pdata, int ann_row, int ann_class)
+{
+	struct export_select *sel;
+	guint i;
+
+	if (!exp->selects->len)
+		return TRUE;
+
+	for (i = 0; i < exp->selects->len; i++) {
+		sel = &g_array_index(exp->selects, struct export_select, i);
+		if (sel->inst_id && strcmp(sel->inst_id, pdata->pdo->di->inst_id))
+			continue;
+		if (sel->ann_row != SRD_EXPORT_ANY && sel->ann_row != ann_row)
+			continue;
+		if (sel->ann_class != SRD_EXPORT_ANY && sel->ann_class != ann_class)
+			continue;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static int export_output_type(const struct srd_exporter *exp)
+{
+	return exp->format == SRD_EXPORT_BINARY ?
+		SRD_OUTPUT_BINARY : SRD_OUTPUT_ANN;
+}
+
+/**
+ * Check whether an exporter writes output of a given type. The caller
+ * must hold the session's sinks_lock.
+ *
+ * @private
+ */
+SRD_PRIV gboolean srd_export_wanted(struct srd_session *sess, int output_type)
+{
+	GSList *l;
+
+	for (l = sess->exporters; l; l = l->next) {
+		if (export_output_type(l->data) == output_type)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Pass an output record to the session's exporters. The caller must
+ * hold the session's sinks_lock.
+ *
+ * @private
+ */
+SRD_PRIV void srd_export_add(struct srd_session *sess,
+		const struct srd_proto_data *pdata, int output_type)
+{
+	struct srd_exporter *exp;
+	const struct srd_proto_data_annotation *pda;
+	const struct srd_proto_data_binary *pdb;
+	uint64_t samplerate;
+	gboolean selected;
+	GSList *l;
+
+	samplerate = sess->samplerate;
+	for (l = sess->exporters; l; l = l->next) {
+		exp = l->data;
+		if (export_output_type(exp) != output_type)
+			continue;
+
+		/* Selections may be added while the session decodes. */
+		g_mutex_lock(&exp->mutex);
+		if (output_type == SRD_OUTPUT_ANN) {
+			pda = pdata->data;
+			selected = export_selected(exp, pdata, pda->ann_row,
+				pda->ann_class);
+		} else {
+			pdb = pdata->data;
+			selected = export_selected(exp, pdata, SRD_EXPORT_ANY,
+				pdb->bin_class);
+		}
+
+		if (!selected || !exp->file) {
+			/* Not selected, or stopped after a write error. */
+		} else if (exp->format == SRD_EXPORT_CSV) {
+			export_csv_ann(exp, pdata, samplerate);
+		} else if (exp->format == SRD_EXPORT_JSONL) {
+			export_jsonl_ann(exp, pdata, samplerate);
+		} else {
+			pdb = pdata->data;
+			export_bytes(exp, pdb->data, pdb->size);
+		}
+		g_mutex_unlock(&exp->mutex);
+	}
+}
+
+/** @private */
+SRD_PRIV void srd_export_flush_all(struct srd_session *sess)
+{
+	GSList *l;
+
+	g_rw_lock_reader_lock(&sess->sinks_lock);
+	for (l = sess->exporters; l; l = l->next)
+		srd_exporter_flush(l->data);
+	g_rw_lock_reader_unlock(&sess->sinks_lock);
+}
+
+static void export_free(struct srd_exporter *exp)
+{
+	struct export_select *sel;
+	guint i;
+
+	export_write(exp);
+	if (exp->file)
+		fclose(exp->file);
+	for (i = 0; i < exp->selects->len; i++) {
+		sel = &g_array_index(exp->selects, struct export_select, i);
+		g_free(sel->inst_id);
+	}
+	g_array_free(exp->selects, TRUE);
+	g_mutex_clear(&exp->mutex);
+	g_free(exp->buf);
+	g_free(exp->path);
+	g_free(exp);
+}
+
+/** @private */
+SRD_PRIV void srd_export_free_all(struct srd_session *sess)
+{
+	g_slist_free_full(sess->exporters, (GDestroyNotify)export_free);
+	sess->exporters = NULL;
+}
+
+/**
+ * Create an exporter which writes the output of a session to a file.
+ *
+ * CSV and JSON lines exporters write annotations, binary exporters
+ * write the payload of binary outputs. Exporters should be created
+ * before the session is started. They are flushed by
+ * srd_session_send_eof() and freed along with the session.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param format The file format (enum srd_export_format).
+ * @param path The file to create or truncate. Must not be NULL.
+ * @param flags Bitwise OR of enum srd_export_flags.
+ * @param exporter Pointer which receives the exporter. Must not be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_exporter_new(struct srd_session *sess, int format,
+		const char *path, unsigned int flags,
+		struct srd_exporter **exporter)
+{
+	struct srd_exporter *exp;
+	FILE *file;
+
+	if (!sess || !path || !exporter)
+		return SRD_ERR_ARG;
+
+	if (format != SRD_EXPORT_CSV && format != SRD_EXPORT_JSONL &&
+			format != SRD_EXPORT_BINARY) {
+		srd_err("Invalid export format %d.", format);
+		return SRD_ERR_ARG;
+	}
+
+	if (!(file = g_fopen(path, "wb"))) {
+		srd_err("Cannot create export file %s: %s.", path,
+			g_strerror(errno));
+		return SRD_ERR;
+	}
+	/* Writes go out in big blocks already. */
+	setvbuf(file, NULL, _IONBF, 0);
+
+	exp = g_malloc0(sizeof(*exp));
+	exp->sess = sess;
+	exp->format = format;
+	exp->flags = flags;
+	exp->path = g_strdup(path);
+	exp->file = file;
+	g_mutex_init(&exp->mutex);
+	exp->selects = g_array_new(FALSE, FALSE, sizeof(struct export_select));
+	exp->size = EXPORT_BUFSIZE;
+	if (!(exp->buf = g_try_malloc(exp->size))) {
+		srd_err("Failed to allocate export buffer.");
+		g_free(exp->path);
+		g_array_free(exp->selects, TRUE);
+		g_mutex_clear(&exp->mutex);
+		g_free(exp);
+		fclose(file);
+		return SRD_ERR_MALLOC;
+	}
+
+	if (format == SRD_EXPORT_CSV && (flags & SRD_EXPORT_FLAG_HEADER))
+		export_csv_header(exp);
+
+	srd_dbg("Exporting output of session %d to %s.", sess->session_id,
+		path);
+	g_rw_lock_writer_lock(&sess->sinks_lock);
+	sess->exporters = g_slist_append(sess->exporters, exp);
+	g_rw_lock_writer_unlock(&sess->sinks_lock);
+	*exporter = exp;
+
+	return SRD_OK;
+}
+
+/**
+ * Restrict an exporter to selected records.
+ *
+ * Without selections, an exporter writes all records of its output
+ * type. Otherwise it writes the records which match any selection.
+ * For binary exporters, ann_class selects the binary class and ann_row
+ * is ignored. Selections may be added while the session decodes, they
+ * apply to the records which are put afterwards.
+ *
+ * @param exporter The exporter. Must not be NULL.
+ * @param inst_id The decoder instance, NULL for any.
+ * @param ann_row The annotation row, or SRD_EXPORT_ANY.
+ * @param ann_class The annotation (binary) class, or SRD_EXPORT_ANY.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_exporter_select(struct srd_exporter *exporter,
+		const char *inst_id, int ann_row, int ann_class)
+{
+	struct export_select sel;
+
+	if (!exporter)
+		return SRD_ERR_ARG;
+
+	sel.inst_id = g_strdup(inst_id);
+	sel.ann_row = exporter->format == SRD_EXPORT_BINARY ?
+		SRD_EXPORT_ANY : ann_row;
+	sel.ann_class = ann_class;
+	g_mutex_lock(&exporter->mutex);
+	g_array_append_val(exporter->selects, sel);
+	g_mutex_unlock(&exporter->mutex);
+
+	return SRD_OK;
+}
+
+/**
+ * Write the buffered records of an exporter to its file.
+ *
+ * @param exporter The exporter. Must not be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_exporter_flush(struct srd_exporter *exporter)
+{
+	gboolean ok;
+
+	if (!exporter)
+		return SRD_ERR_ARG;
+
+	g_mutex_lock(&exporter->mutex);
+	ok = export_write(exporter) && fflush(exporter->file) == 0;
+	g_mutex_unlock(&exporter->mutex);
+
+	return ok ? SRD_OK : SRD_ERR;
+}
+
+/**
+ * Flush and close an exporter, and detach it from its session.
+ *
+ * This may be called while the session decodes, but not from an output
+ * callback.
+ *
+ * @param exporter The exporter. Must not be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_exporter_free(struct srd_exporter *exporter)
+{
+	struct srd_session *sess;
+
+	if (!exporter)
+		return SRD_ERR_ARG;
+
+	sess = exporter->sess;
+	/* Queued records may still be on their way to it. */
+	srd_output_sync(sess);
+	g_rw_lock_writer_lock(&sess->sinks_lock);
+	sess->exporters = g_slist_remove(sess->exporters, exporter);
+	g_rw_lock_writer_unlock(&sess->sinks_lock);
+	export_free(exporter);
+
+	return SRD_OK;
+}
+
+/** @} */
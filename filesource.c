@@ -0,0 +1,417 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @file
+ *
+ * Sample data from memory-mapped capture files.
+ */
+
+/**
+ * @defgroup grp_filesource File sources
+ *
+ * Feed capture files into sessions without reading them into buffers.
+ *
+ * The file is memory-mapped. Bit-plane files are passed to
+ * srd_session_send_views() as pointers into the mapping, so the samples are
+ * never copied; the kernel reads them in as the decoders touch them.
+ * Logic dumps interleave the channels and are converted into
+ * bit-planes chunk by chunk, eight samples of eight channels at a time.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+struct srd_file_source {
+	GMappedFile *mf;
+	const uint8_t *data;
+	gsize len;
+	int format;
+	unsigned int num_channels;
+	uint64_t num_samples;
+	/* SRD_FILE_PLANES: bytes per plane. */
+	uint64_t plane_size;
+	/* SRD_FILE_LOGIC: bytes per sample. */
+	unsigned int unitsize;
+	/* SRD_FILE_LOGIC: planes of the current chunk. */
+	uint8_t *planes;
+	uint64_t planes_stride;
+	struct srd_input_view *inbuf;
+	uint64_t page_size;
+};
+
+/** @endcond */
+
+#define FILE_SOURCE_CHUNK_BYTES (256 * 1024)
+
+static uint64_t file_page_size(void)
+{
+#ifdef HAVE_SYS_MMAN_H
+	long size;
+
+	if ((size = sysconf(_SC_PAGESIZE)) > 0)
+		return size;
+#endif
+	return 4096;
+}
+
+/* Hint the kernel about the use of [start, end) of the mapping. */
+static void file_advise(const struct srd_file_source *src, uint64_t start,
+		uint64_t end, int advice)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(POSIX_MADV_SEQUENTIAL)
+	uint64_t aligned;
+
+	end = MIN(end, src->len);
+	if (start >= end)
+		return;
+	aligned = start & ~(src->page_size - 1);
+	posix_madvise((void *)(src->data + aligned), end - aligned, advice);
+#else
+	(void)src;
+	(void)start;
+	(void)end;
+	(void)advice;
+#endif
+}
+
+/* Announce that the samples [start, end) will be needed soon. */
+static void file_prefetch(const struct srd_file_source *src, uint64_t start,
+		uint64_t end)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(POSIX_MADV_WILLNEED)
+	unsigned int ch;
+
+	if (src->format == SRD_FILE_LOGIC) {
+		file_advise(src, start * src->unitsize, end * src->unitsize,
+			POSIX_MADV_WILLNEED);
+		return;
+	}
+	for (ch = 0; ch < src->num_channels; ch++)
+		file_advise(src, ch * src->plane_size + start / 8,
+			ch * src->plane_size + (end + 7) / 8,
+			POSIX_MADV_WILLNEED);
+#else
+	(void)src;
+	(void)start;
+	(void)end;
+#endif
+}
+
+/*
+ * Transpose an 8x8 bit matrix: bit k of byte j moves to bit j of
+ * byte k. With byte j holding sample j, byte k then is the plane
+ * byte of channel k.
+ */
+static inline uint64_t transpose8(uint64_t x)
+{
+	uint64_t t;
+
+	t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+	x ^= t ^ (t << 28);
+
+	return x;
+}
+
+/* Convert the interleaved samples [start, end) into bit-planes. */
+static int file_logic_convert(struct srd_file_source *src, uint64_t start,
+		uint64_t end)
+{
+	const uint8_t *in;
+	uint8_t *planes;
+	uint64_t nbytes, g, x;
+	unsigned int unitsize, b, k, j, n, ch;
+
+	nbytes = (end - start + 7) / 8;
+	if (nbytes > src->planes_stride) {
+		planes = g_try_realloc(src->planes, nbytes * src->num_channels);
+		if (!planes) {
+			srd_err("Failed to allocate %" G_GUINT64_FORMAT
+				" bytes of bit-planes.",
+				nbytes * src->num_channels);
+			return SRD_ERR_MALLOC;
+		}
+		src->planes = planes;
+		src->planes_stride = nbytes;
+	}
+
+	unitsize = src->unitsize;
+	in = src->data + start * unitsize;
+	for (g = 0; g < nbytes; g++) {
+		n = MIN(end - start - g * 8, 8);
+		for (b = 0; b < unitsize; b++) {
+			x = 0;
+			for (j = 0; j < n; j++)
+				x |= (uint64_t)in[(g * 8 + j) * unitsize + b] << (8 * j);
+			x = transpose8(x);
+			for (k = 0; k < 8; k++) {
+				ch = b * 8 + k;
+				if (ch >= src->num_channels)
+					break;
+				src->planes[ch * src->planes_stride + g] = x >> (8 * k);
+			}
+		}
+	}
+
+	for (ch = 0; ch < src->num_channels; ch++) {
+		src->inbuf[ch].data = src->planes + ch * src->planes_stride;
+		src->inbuf[ch].constant = 0;
+	}
+
+	return SRD_OK;
+}
+
+/**
+ * Open a capture file as a source of sample data.
+ *
+ * The formats:
+ *
+ * - SRD_FILE_PLANES: the bit-planes of the channels, one after
+ *   another, each (num_samples + 7) / 8 bytes long. Sample i of a
+ *   channel is bit i % 8 of byte i / 8 of its plane.
+ * - SRD_FILE_LOGIC: raw logic data like in sigrok session files,
+ *   (num_channels + 7) / 8 bytes per sample, channel n in bit n % 8 of
+ *   byte n / 8.
+ *
+ * @param path The file name. Must not be NULL.
+ * @param format The file format, one of enum srd_file_format.
+ * @param num_channels The number of channels in the file. Must be > 0.
+ * @param num_samples The number of samples, or 0 to derive it from the
+ *                    file size.
+ * @param src Pointer which receives the source. Must not be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_file_source_open(const char *path, int format,
+		unsigned int num_channels, uint64_t num_samples,
+		struct srd_file_source **src)
+{
+	struct srd_file_source *s;
+	GError *error;
+	uint64_t needed;
+
+	if (!path || !src || !num_channels)
+		return SRD_ERR_ARG;
+	if (format != SRD_FILE_PLANES && format != SRD_FILE_LOGIC)
+		return SRD_ERR_ARG;
+
+	s = g_malloc0(sizeof(*s));
+	s->format = format;
+	s->num_channels = num_channels;
+	s->page_size = file_page_size();
+
+	error = NULL;
+	if (!(s->mf = g_mapped_file_new(path, FALSE, &error))) {
+		srd_err("Cannot map capture file %s: %s.", path, error->message);
+		g_error_free(error);
+		g_free(s);
+		return SRD_ERR;
+	}
+	s->data = (const uint8_t *)g_mapped_file_get_contents(s->mf);
+	s->len = g_mapped_file_get_length(s->mf);
+
+	if (format == SRD_FILE_PLANES) {
+		if (!num_samples)
+			num_samples = (s->len / num_channels) * 8;
+		s->plane_size = (num_samples + 7) / 8;
+		needed = s->plane_size * num_channels;
+	} else {
+		s->unitsize = (num_channels + 7) / 8;
+		if (!num_samples)
+			num_samples = s->len / s->unitsize;
+		needed = num_samples * s->unitsize;
+	}
+	if (!num_samples || needed > s->len) {
+		srd_err("Capture file %s is too short for %" G_GUINT64_FORMAT
+			" samples of %u channels.", path, num_samples,
+			num_channels);
+		srd_file_source_close(s);
+		return SRD_ERR_ARG;
+	}
+	s->num_samples = num_samples;
+	s->inbuf = g_malloc0(num_channels * sizeof(struct srd_input_view));
+
+#if defined(HAVE_SYS_MMAN_H) && defined(POSIX_MADV_SEQUENTIAL)
+	file_advise(s, 0, s->len, POSIX_MADV_SEQUENTIAL);
+#endif
+
+	srd_dbg("Mapped capture file %s: %" G_GUINT64_FORMAT " samples of "
+		"%u channels.", path, num_samples, num_channels);
+
+	*src = s;
+
+	return SRD_OK;
+}
+
+/**
+ * Get the number of channels and samples of a file source.
+ *
+ * @param src The source. Must not be NULL.
+ * @param num_channels Receives the number of channels. Can be NULL.
+ * @param num_samples Receives the number of samples. Can be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_file_source_info_get(const struct srd_file_source *src,
+		unsigned int *num_channels, uint64_t *num_samples)
+{
+	if (!src)
+		return SRD_ERR_ARG;
+
+	if (num_channels)
+		*num_channels = src->num_channels;
+	if (num_samples)
+		*num_samples = src->num_samples;
+
+	return SRD_OK;
+}
+
+/**
+ * Get the input data of the samples [start_sample, end_sample).
+ *
+ * This is a srd_sample_source, which takes the file source as its
+ * cb_data, so file sources can be used with srd_session_decode_range(),
+ * srd_session_decode_cached() and srd_scan_run().
+ *
+ * For bit-plane files the data points into the mapping, which requires
+ * start_sample to be a multiple of 8. For logic dumps it points to
+ * planes which are valid until the next call.
+ *
+ * @return The views, one entry per channel, or NULL upon errors.
+ *
+ * @since 0.6.0
+ */
+SRD_API const struct srd_input_view *srd_file_source_get(
+		uint64_t start_sample, uint64_t end_sample, void *cb_data)
+{
+	struct srd_file_source *src;
+	unsigned int ch;
+
+	if (!(src = cb_data) || start_sample >= end_sample ||
+			end_sample > src->num_samples)
+		return NULL;
+
+	if (src->format == SRD_FILE_LOGIC) {
+		if (file_logic_convert(src, start_sample, end_sample) != SRD_OK)
+			return NULL;
+		return src->inbuf;
+	}
+
+	if (start_sample % 8) {
+		srd_err("Bit-plane chunks must start at a multiple of 8 "
+			"samples, not at %" G_GUINT64_FORMAT ".", start_sample);
+		return NULL;
+	}
+	for (ch = 0; ch < src->num_channels; ch++) {
+		src->inbuf[ch].data = (uint8_t *)src->data +
+			ch * src->plane_size + start_sample / 8;
+		src->inbuf[ch].constant = 0;
+	}
+
+	return src->inbuf;
+}
+
+/**
+ * Send all samples of a file source to a session.
+ *
+ * The chunk size is rounded up to whole pages of the bit-planes, so
+ * every chunk starts on a page boundary of the mapping if the planes
+ * do (i.e. their size is a multiple of the page size). While a chunk
+ * is decoded, the kernel is asked to read ahead the next one.
+ *
+ * The samples are sent as samples 0 to num_samples - 1 of the session.
+ * srd_session_send_eof() is up to the caller.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param src The file source. Must not be NULL.
+ * @param chunk_size The minimum number of samples per chunk, 0 for a
+ *                   default.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_send_file(struct srd_session *sess,
+		struct srd_file_source *src, uint64_t chunk_size)
+{
+	const struct srd_input_view *inbuf;
+	uint64_t pos, next, page_samples;
+	int ret;
+
+	if (!sess || !src)
+		return SRD_ERR_ARG;
+
+	page_samples = src->page_size * 8;
+	if (!chunk_size)
+		chunk_size = FILE_SOURCE_CHUNK_BYTES * 8;
+	chunk_size = (chunk_size + page_samples - 1) / page_samples *
+		page_samples;
+
+	for (pos = 0; pos < src->num_samples; pos = next) {
+		next = MIN(pos + chunk_size, src->num_samples);
+		file_prefetch(src, next, MIN(next + chunk_size, src->num_samples));
+		if (!(inbuf = srd_file_source_get(pos, next, src)))
+			return SRD_ERR;
+		ret = srd_session_send_views(sess, pos, next, inbuf);
+		if (ret != SRD_OK)
+			return ret;
+	}
+
+	return SRD_OK;
+}
+
+/**
+ * Close a file source.
+ *
+ * @param src The source. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SRD_API void srd_file_source_close(struct srd_file_source *src)
+{
+	if (!src)
+		return;
+
+	g_mapped_file_unref(src->mf);
+	g_free(src->planes);
+	g_free(src->inbuf);
+	g_free(src);
+}
+
+/** @} */
@@ -31,6 +31,28 @@
 
 extern SRD_PRIV GSList *sessions;
 
+/* Max. number of queued SRD_OUTPUT_PYTHON items per stacked instance. */
+#define PIPE_QUEUE_DEPTH 256
+
+struct srd_pipe_item {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	PyObject *data;
+};
+
+struct srd_inst_pipe {
+	/** Worker thread which feeds the queue into decode(). */
+	struct srd_thread *thread;
+	/** Pending items (struct srd_pipe_item), oldest first. */
+	GQueue queue;
+	/** Indicates that the worker currently runs decode(). */
+	gboolean busy;
+	/** Requests termination of the worker. */
+	gboolean want_terminate;
+	GMutex mutex;
+	GCond cond;
+};
+
 /** @endcond */
 
 /**
@@ -424,6 +446,8 @@ SRD_API struct srd_decoder_inst *srd_inst_new(struct srd_session *sess,
 	// di->inbuflen = 0;
 	di->abs_cur_samplenum = 0;
 	di->thread_handle = NULL;
+	di->coro = NULL;
+	di->thread_config = NULL;
 	di->got_new_samples = FALSE;
 	di->handled_all_samples = FALSE;
 	di->want_wait_terminate = FALSE;
@@ -440,6 +464,12 @@ SRD_API struct srd_decoder_inst *srd_inst_new(struct srd_session *sess,
 	g_cond_init(&di->handled_all_samples_cond);
 	g_mutex_init(&di->data_mutex);
 
+	/* The worker only gets started when pipeline mode feeds data. */
+	di->pipe = g_malloc0(sizeof(struct srd_inst_pipe));
+	g_queue_init(&di->pipe->queue);
+	g_mutex_init(&di->pipe->mutex);
+	g_cond_init(&di->pipe->cond);
+
 	/* Instance takes input from a frontend by default. */
 	sess->di_list = g_slist_append(sess->di_list, di);
 	srd_dbg("Creating new %s instance %s.", decoder_id, di->inst_id);
@@ -451,6 +481,23 @@ static void srd_inst_join_decode_thread(struct srd_decoder_inst *di)
 {
 	if (!di)
 		return;
+
+	if (di->coro) {
+		/*
+		 * Coroutine mode: have the suspended wait() see the
+		 * termination request, and run decode() to its end.
+		 */
+		srd_dbg("%s: Terminating decoder coroutine.", di->inst_id);
+		di->want_wait_terminate = TRUE;
+		while (!srd_coro_done(di->coro)) {
+			if (srd_coro_resume(di->coro) != SRD_OK)
+				break;
+		}
+		srd_coro_free(di->coro);
+		di->coro = NULL;
+		return;
+	}
+
 	if (!di->thread_handle)
 		return;
 
@@ -467,7 +514,7 @@ static void srd_inst_join_decode_thread(struct srd_decoder_inst *di)
 	g_mutex_unlock(&di->data_mutex);
 
 	srd_dbg("%s: Running join().", di->inst_id);
-	(void)g_thread_join(di->thread_handle);
+	srd_thread_join(di->thread_handle);
 	srd_dbg("%s: Call to join() done.", di->inst_id);
 	di->thread_handle = NULL;
 
@@ -483,6 +530,210 @@ static void srd_inst_join_decode_thread(struct srd_decoder_inst *di)
 	g_mutex_init(&di->data_mutex);
 }
 
+/**
+ * Worker thread of a stacked PD in pipeline mode.
+ *
+ * Feeds the SRD_OUTPUT_PYTHON items that the lower PD put() into the
+ * instance's decode() method, in the order they were queued.
+ *
+ * @param data Pointer to the stacked PD's decoder instance.
+ *             Must not be NULL.
+ *
+ * @return Always NULL.
+ */
+static gpointer pipe_thread(gpointer data)
+{
+	struct srd_decoder_inst *di;
+	struct srd_inst_pipe *pipe;
+	struct srd_pipe_item *item;
+	PyObject *py_res;
+	PyGILState_STATE gstate;
+
+	di = data;
+	pipe = di->pipe;
+
+	srd_dbg("%s: Starting pipeline thread.", di->inst_id);
+
+	while (TRUE) {
+		g_mutex_lock(&pipe->mutex);
+		while (g_queue_is_empty(&pipe->queue) && !pipe->want_terminate)
+			g_cond_wait(&pipe->cond, &pipe->mutex);
+		if (pipe->want_terminate) {
+			g_mutex_unlock(&pipe->mutex);
+			break;
+		}
+		item = g_queue_pop_head(&pipe->queue);
+		pipe->busy = TRUE;
+		/* Wake up a producer which waits for room in the queue. */
+		g_cond_broadcast(&pipe->cond);
+		g_mutex_unlock(&pipe->mutex);
+
+		gstate = PyGILState_Ensure();
+		if (!(py_res = PyObject_CallMethod(di->py_inst, "decode", "KKO",
+				item->start_sample, item->end_sample, item->data))) {
+			srd_exception_catch("Calling %s decode() failed",
+						di->inst_id);
+		}
+		Py_XDECREF(py_res);
+		Py_DECREF(item->data);
+		PyGILState_Release(gstate);
+		g_free(item);
+
+		g_mutex_lock(&pipe->mutex);
+		pipe->busy = FALSE;
+		/* Wake up drain requests. */
+		g_cond_broadcast(&pipe->cond);
+		g_mutex_unlock(&pipe->mutex);
+	}
+
+	srd_dbg("%s: Pipeline thread done.", di->inst_id);
+
+	return NULL;
+}
+
+/**
+ * Queue SRD_OUTPUT_PYTHON data for a stacked PD in pipeline mode.
+ *
+ * Starts the instance's pipeline worker upon first use. Blocks while
+ * the queue is full, with the GIL released.
+ *
+ * @param di The stacked decoder instance. Must not be NULL.
+ * @param start_sample Start sample number of the data.
+ * @param end_sample End sample number of the data.
+ * @param py_data The data object, a new reference is taken.
+ *
+ * @private
+ */
+SRD_PRIV void srd_inst_pipe_push(struct srd_decoder_inst *di,
+		uint64_t start_sample, uint64_t end_sample, PyObject *py_data)
+{
+	struct srd_inst_pipe *pipe;
+	struct srd_pipe_item *item;
+	PyObject *py_res;
+
+	/* Caller holds the GIL. */
+	pipe = di->pipe;
+
+	item = g_malloc(sizeof(*item));
+	item->start_sample = start_sample;
+	item->end_sample = end_sample;
+	item->data = py_data;
+	Py_INCREF(py_data);
+
+	Py_BEGIN_ALLOW_THREADS
+
+	g_mutex_lock(&pipe->mutex);
+	if (!pipe->thread) {
+		srd_dbg("No pipeline thread for this decoder instance "
+			"exists yet, creating one: %s.", di->inst_id);
+		pipe->thread = srd_thread_spawn(di->sess, di, di->inst_id,
+			pipe_thread, di);
+	}
+	if (pipe->thread) {
+		while (g_queue_get_length(&pipe->queue) >= PIPE_QUEUE_DEPTH &&
+				!pipe->want_terminate)
+			g_cond_wait(&pipe->cond, &pipe->mutex);
+		g_queue_push_tail(&pipe->queue, item);
+		g_cond_broadcast(&pipe->cond);
+		item = NULL;
+	}
+	g_mutex_unlock(&pipe->mutex);
+
+	Py_END_ALLOW_THREADS
+
+	if (item) {
+		/* No worker, decode in the lower PD's thread instead. */
+		if (!(py_res = PyObject_CallMethod(di->py_inst, "decode",
+				"KKO", start_sample, end_sample, py_data))) {
+			srd_exception_catch("Calling %s decode() failed",
+						di->inst_id);
+		}
+		Py_XDECREF(py_res);
+		Py_DECREF(item->data);
+		g_free(item);
+	}
+}
+
+/* Wait until the pipeline worker has consumed all queued items. */
+static void srd_inst_pipe_drain(struct srd_decoder_inst *di)
+{
+	struct srd_inst_pipe *pipe;
+
+	/* Caller must not hold the GIL. */
+	pipe = di->pipe;
+	if (!pipe)
+		return;
+
+	g_mutex_lock(&pipe->mutex);
+	while (pipe->thread && !pipe->want_terminate &&
+			(!g_queue_is_empty(&pipe->queue) || pipe->busy))
+		g_cond_wait(&pipe->cond, &pipe->mutex);
+	g_mutex_unlock(&pipe->mutex);
+}
+
+/* Terminate the pipeline worker, discard items which were not decoded. */
+static void srd_inst_pipe_stop(struct srd_decoder_inst *di)
+{
+	struct srd_inst_pipe *pipe;
+	struct srd_pipe_item *item;
+	PyGILState_STATE gstate;
+
+	/* Caller must not hold the GIL. */
+	pipe = di->pipe;
+	if (!pipe || !pipe->thread)
+		return;
+
+	srd_dbg("%s: Joining pipeline thread.", di->inst_id);
+
+	g_mutex_lock(&pipe->mutex);
+	pipe->want_terminate = TRUE;
+	g_cond_broadcast(&pipe->cond);
+	g_mutex_unlock(&pipe->mutex);
+
+	srd_thread_join(pipe->thread);
+	pipe->thread = NULL;
+
+	if (!g_queue_is_empty(&pipe->queue)) {
+		srd_dbg("%s: Discarding %u pending pipeline items.",
+			di->inst_id, g_queue_get_length(&pipe->queue));
+		gstate = PyGILState_Ensure();
+		while ((item = g_queue_pop_head(&pipe->queue))) {
+			Py_DECREF(item->data);
+			g_free(item);
+		}
+		PyGILState_Release(gstate);
+	}
+	pipe->busy = FALSE;
+	pipe->want_terminate = FALSE;
+}
+
+/**
+ * Wait until the pipeline workers of all PDs stacked on top of 'di'
+ * have consumed their queued items. Caller must not hold the GIL.
+ *
+ * @private
+ */
+SRD_PRIV void srd_inst_pipe_drain_stack(struct srd_decoder_inst *di)
+{
+	GSList *l;
+
+	for (l = di->next_di; l; l = l->next) {
+		srd_inst_pipe_drain(l->data);
+		srd_inst_pipe_drain_stack(l->data);
+	}
+}
+
+/* Terminate the pipeline workers of all PDs stacked on top of 'di'. */
+static void srd_inst_pipe_stop_stack(struct srd_decoder_inst *di)
+{
+	GSList *l;
+
+	for (l = di->next_di; l; l = l->next) {
+		srd_inst_pipe_stop(l->data);
+		srd_inst_pipe_stop_stack(l->data);
+	}
+}
+
 static void srd_inst_reset_state(struct srd_decoder_inst *di)
 {
 	if (!di)
@@ -499,6 +750,8 @@ static void srd_inst_reset_state(struct srd_decoder_inst *di)
 	// di->inbuflen = 0;
 	di->abs_cur_samplenum = 0;
 	oldpins_array_free(di);
+	srd_checkpoint_conditions_free(di->checkpoint_conditions);
+	di->checkpoint_conditions = NULL;
 	di->got_new_samples = FALSE;
 	di->handled_all_samples = FALSE;
 	di->want_wait_terminate = FALSE;
@@ -721,6 +974,81 @@ SRD_PRIV int srd_inst_start(struct srd_decoder_inst *di)
 	return SRD_OK;
 }
 
+/* Caller holds the GIL. */
+static gboolean srd_inst_identical(struct srd_decoder_inst *a,
+		struct srd_decoder_inst *b)
+{
+	PyObject *py_a, *py_b;
+	int ret;
+
+	if (a->decoder != b->decoder || a->dec_num_channels != b->dec_num_channels)
+		return FALSE;
+	if (MAX(a->decimation, 1) != MAX(b->decimation, 1) ||
+			(a->decimation > 1 &&
+			a->decimation_policy != b->decimation_policy))
+		return FALSE;
+	if (memcmp(a->dec_channelmap, b->dec_channelmap,
+			a->dec_num_channels * sizeof(int)))
+		return FALSE;
+	if (!a->old_pins_array != !b->old_pins_array)
+		return FALSE;
+	if (a->old_pins_array && (a->old_pins_array->len != b->old_pins_array->len ||
+			memcmp(a->old_pins_array->data, b->old_pins_array->data,
+			a->old_pins_array->len)))
+		return FALSE;
+
+	/* Both instances went through srd_inst_option_set(), or neither. */
+	py_a = PyObject_GetAttrString(a->py_inst, "options");
+	py_b = PyObject_GetAttrString(b->py_inst, "options");
+	ret = (py_a && py_b) ? PyObject_RichCompareBool(py_a, py_b, Py_EQ) :
+		(!py_a && !py_b);
+	Py_XDECREF(py_a);
+	Py_XDECREF(py_b);
+	PyErr_Clear();
+
+	return ret == 1;
+}
+
+/**
+ * Find bottom instances of a session which are configured identically
+ * to an earlier one. Such an instance doesn't decode, the earlier one's
+ * output is put on its outputs as well, and fed to the PDs stacked on it.
+ *
+ * @private
+ */
+SRD_PRIV void srd_inst_share_find(struct srd_session *sess)
+{
+	PyGILState_STATE gstate;
+	struct srd_decoder_inst *di, *other;
+	GSList *d, *o;
+
+	/* Start over, options may have changed since the last start. */
+	for (d = sess->di_list; d; d = d->next) {
+		di = d->data;
+		di->shared_inst = NULL;
+		g_slist_free(di->sharers);
+		di->sharers = NULL;
+	}
+	if (!sess->inst_sharing)
+		return;
+
+	gstate = PyGILState_Ensure();
+	for (d = sess->di_list; d; d = d->next) {
+		di = d->data;
+		for (o = sess->di_list; o != d; o = o->next) {
+			other = o->data;
+			if (other->shared_inst || !srd_inst_identical(other, di))
+				continue;
+			srd_dbg("Instance %s decodes for %s.", other->inst_id,
+				di->inst_id);
+			di->shared_inst = other;
+			other->sharers = g_slist_append(other->sharers, di);
+			break;
+		}
+	}
+	PyGILState_Release(gstate);
+}
+
 /**
  * Check whether the specified sample matches the specified term.
  *
@@ -824,12 +1152,11 @@ static gboolean have_non_null_conds(const struct srd_decoder_inst *di)
 	return FALSE;
 }
 
-static void update_old_pins_array(struct srd_decoder_inst *di)
+/* Remember the channels' values at the current sample, for edge terms. */
+SRD_PRIV void update_old_pins_array(struct srd_decoder_inst *di)
 {
 	uint8_t sample;
-	int i, ch, byte_offset, bit_offset;
-
-    uint8_t *sample_pos;
+	int i, ch;
 
 	if (!di || !di->dec_channelmap )
 		return;
@@ -841,13 +1168,8 @@ static void update_old_pins_array(struct srd_decoder_inst *di)
 			continue; /* Ignore unused optional channels. */
 
         ch = di->dec_channelmap[i];
-        if( di->inbuf[ch].data ){
-            sample_pos  = (uint8_t *)di->inbuf[ch].data + ((di->abs_cur_samplenum - di->abs_start_samplenum) / 8);
-            bit_offset  = (di->abs_cur_samplenum - di->abs_start_samplenum) % 8;
-            sample      = *sample_pos & ( 1 << bit_offset ) ? 1 : 0;
-        }
-        else
-            sample = di->inbuf[ch].constant ? 1 : 0;
+        sample = srd_plane_sample(&di->inbuf[ch],
+            di->abs_cur_samplenum - di->abs_start_samplenum);
 
         di->old_pins_array->data[ch] = sample;
 
@@ -861,8 +1183,7 @@ static void update_old_pins_array(struct srd_decoder_inst *di)
 static void update_old_pins_array_initial_pins(struct srd_decoder_inst *di)
 {
 	uint8_t sample;
-	int i, bit_offset;
-	const uint8_t *sample_pos;
+	int i;
 
 	if (!di || !di->dec_channelmap)
 		return;
@@ -879,13 +1200,8 @@ static void update_old_pins_array_initial_pins(struct srd_decoder_inst *di)
 			continue; /* Ignore unused optional channels. */
 
         ch = di->dec_channelmap[i];
-        if( di->inbuf[ch].data ){
-            sample_pos  = di->inbuf[ch].data + ((di->abs_cur_samplenum - di->abs_start_samplenum) / 8);
-            bit_offset  = (di->abs_cur_samplenum - di->abs_start_samplenum) % 8;
-            sample      = *sample_pos & ( 1 << bit_offset ) ? 1 : 0;
-        }
-        else
-            sample = di->inbuf[ch].constant ? 1 : 0;
+        sample = srd_plane_sample(&di->inbuf[ch],
+            di->abs_cur_samplenum - di->abs_start_samplenum);
 
         di->old_pins_array->data[ch] = sample;
 
@@ -921,8 +1237,8 @@ static void _term_skip_min_num(struct srd_decoder_inst *di,
 static gboolean term_matches(struct srd_decoder_inst *di,
 		struct srd_term *term)
 {
-	uint8_t old_sample, sample, *sample_pos;
-	int bit_offset, ch;
+	uint8_t old_sample, sample;
+	int ch;
 
 	/* Caller ensures di, di->dec_channelmap, term, sample_pos != NULL. */
     if (term->type == SRD_TERM_SKIP) {
@@ -937,16 +1253,10 @@ static gboolean term_matches(struct srd_decoder_inst *di,
     }
 
     ch = di->dec_channelmap[term->channel];
-    if( di->inbuf[ch].data ){
-        sample_pos  = (uint8_t *)di->inbuf[ch].data + ((di->abs_cur_samplenum - di->abs_start_samplenum) / 8);
-        bit_offset  = (di->abs_cur_samplenum - di->abs_start_samplenum) % 8;
-        sample      = *sample_pos & ( 1 << bit_offset ) ? 1 : 0;
-
+    sample = srd_plane_sample(&di->inbuf[ch],
+        di->abs_cur_samplenum - di->abs_start_samplenum);
+    if( di->inbuf[ch].data )
         di->is_input_const   = FALSE;
-    }
-    else {
-        sample = di->inbuf[ch].constant ? 1 : 0;
-    }
 
     old_sample = di->old_pins_array->data[ch];
 
@@ -1164,6 +1474,162 @@ static gboolean find_match(struct srd_decoder_inst *di)
     return FALSE;
 }
 
+/*
+ * Check whether a term can match at any sample of a chunk which starts
+ * at the instance's current sample. Returns TRUE when in doubt.
+ */
+static gboolean term_may_match(const struct srd_decoder_inst *di,
+		const struct srd_term *term, const struct srd_input_view *inbuf,
+		uint64_t num_samples)
+{
+	const struct srd_input_view *in;
+	uint8_t old, first;
+	gboolean flat;
+	int ch;
+
+	ch = di->dec_channelmap[term->channel];
+	if (ch < 0)
+		return TRUE;
+
+	in = &inbuf[ch];
+	old = di->old_pins_array->data[ch];
+	first = srd_plane_sample(in, 0);
+	flat = srd_plane_find_change(in, 1, num_samples) == num_samples;
+
+	switch (term->type) {
+	case SRD_TERM_HIGH:
+		return first == 1 || !flat;
+	case SRD_TERM_LOW:
+		return first == 0 || !flat;
+	case SRD_TERM_RISING_EDGE:
+		return (old == 0 && first == 1) || !flat;
+	case SRD_TERM_FALLING_EDGE:
+		return (old == 1 && first == 0) || !flat;
+	case SRD_TERM_EITHER_EDGE:
+		return (old <= 1 && old != first) || !flat;
+	case SRD_TERM_NO_EDGE:
+		return old == first || num_samples > 1;
+	default:
+		return TRUE;
+	}
+}
+
+/* Check whether a condition can match in a chunk, TRUE when in doubt. */
+static gboolean cond_may_match(const struct srd_decoder_inst *di,
+		const GSList *cond, const struct srd_input_view *inbuf,
+		uint64_t num_samples)
+{
+	const GSList *l;
+	const struct srd_term *term;
+
+	/* A lone skip term matches when its count is reached. */
+	term = cond->data;
+	if (!cond->next && term->type == SRD_TERM_SKIP) {
+		if (term->num_samples_already_skipped >= term->num_samples_to_skip)
+			return TRUE;
+		return term->num_samples_to_skip -
+			term->num_samples_already_skipped < num_samples;
+	}
+
+	/*
+	 * Skip terms in combination with other terms only count samples
+	 * where the preceding terms matched, leave those to the worker.
+	 */
+	for (l = cond; l; l = l->next) {
+		term = l->data;
+		if (term->type == SRD_TERM_SKIP)
+			return TRUE;
+	}
+
+	/* All terms must match (logical AND). */
+	for (l = cond; l; l = l->next) {
+		term = l->data;
+		if (term->type == SRD_TERM_ALWAYS_FALSE)
+			return FALSE;
+		if (!term_may_match(di, term, inbuf, num_samples))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Skip a chunk on the submitting side when no condition can match in it.
+ *
+ * The worker is parked in wait() with its condition list between chunks.
+ * When the chunk cannot possibly satisfy any of these conditions (e.g.
+ * an edge on a channel which keeps its level), advance the instance as
+ * if the worker had scanned the chunk, without waking the worker: the
+ * current sample number, the previous pin values, and lone skip counts.
+ *
+ * Caller holds di->data_mutex (unless in coroutine mode).
+ *
+ * @return TRUE if the chunk was consumed, FALSE if the worker must
+ *         process the chunk.
+ */
+static gboolean prefilter_skip_chunk(struct srd_decoder_inst *di,
+		uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
+		const struct srd_input_view *inbuf)
+{
+	GSList *l, *cond;
+	struct srd_term *term;
+	uint64_t num_samples;
+	int i, ch;
+
+	num_samples = abs_end_samplenum - abs_start_samplenum;
+	if (!num_samples)
+		return FALSE;
+
+	/* Only when the worker is waiting for more samples. */
+	if (!di->thread_handle && !di->coro)
+		return FALSE;
+	if (!di->handled_all_samples || di->got_new_samples ||
+			di->want_wait_terminate || di->communicate_eof)
+		return FALSE;
+
+	/* Sample 0 seeds the initial pins, leave it to the worker. */
+	if (di->abs_cur_samplenum == 0)
+		return FALSE;
+
+	if (!di->dec_channelmap || !di->old_pins_array || !have_non_null_conds(di))
+		return FALSE;
+
+	/* Previous pin values are kept per input channel index. */
+	for (i = 0; i < di->dec_num_channels; i++) {
+		ch = di->dec_channelmap[i];
+		if (ch >= (int)di->old_pins_array->len)
+			return FALSE;
+	}
+
+	for (l = di->condition_list; l; l = l->next) {
+		cond = l->data;
+		if (cond && cond_may_match(di, cond, inbuf, num_samples))
+			return FALSE;
+	}
+
+	/* No match possible, carry the state over to the next chunk. */
+	for (l = di->condition_list; l; l = l->next) {
+		cond = l->data;
+		if (!cond || cond->next)
+			continue;
+		term = cond->data;
+		if (term->type == SRD_TERM_SKIP)
+			term->num_samples_already_skipped += num_samples;
+	}
+
+	for (i = 0; i < di->dec_num_channels; i++) {
+		ch = di->dec_channelmap[i];
+		if (ch == -1)
+			continue; /* Ignore unused optional channels. */
+		di->old_pins_array->data[ch] =
+			srd_plane_sample(&inbuf[ch], num_samples - 1);
+	}
+
+	di->abs_cur_samplenum = abs_end_samplenum;
+
+	return TRUE;
+}
+
 /**
  * Process available samples and check if they match the defined conditions.
  *
@@ -1319,6 +1785,53 @@ static gpointer di_thread(gpointer data)
 	return NULL;
 }
 
+/* Coroutine body (per PD-stack), runs the same code as the worker thread. */
+static void di_coro(void *data)
+{
+	(void)di_thread(data);
+}
+
+/* Coroutine mode: switch to decode() until it has handled the chunk. */
+static int srd_inst_decode_coro(struct srd_decoder_inst *di,
+		uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
+		const struct srd_input_view *inbuf)
+{
+	/* If this is the first call, create the coroutine. */
+	if (!di->coro) {
+		srd_dbg("No coroutine for this decoder stack "
+			"exists yet, creating one: %s.", di->inst_id);
+		if (!(di->coro = srd_coro_new(di_coro, di)))
+			return SRD_ERR;
+	}
+
+	/* Don't switch to decode() when no condition can match. */
+	if (prefilter_skip_chunk(di, abs_start_samplenum,
+			abs_end_samplenum, inbuf)) {
+		srd_spew("%s: No match possible, chunk skipped.", di->inst_id);
+		srd_inst_flush(di);
+		return SRD_OK;
+	}
+
+	/* No other thread accesses the instance, no locking needed. */
+	di->abs_start_samplenum = abs_start_samplenum;
+	di->abs_end_samplenum = abs_end_samplenum;
+	di->inbuf = inbuf;
+	di->got_new_samples = TRUE;
+	di->handled_all_samples = FALSE;
+
+	/* Returns when wait() needs more samples, or decode() ended. */
+	if (srd_coro_resume(di->coro) != SRD_OK)
+		return SRD_ERR;
+
+	/* Flush all PDs in the stack that can be flushed */
+	srd_inst_flush(di);
+
+	if (di->want_wait_terminate)
+		return SRD_ERR_TERM_REQ;
+
+	return SRD_OK;
+}
+
 /**
  * Decode a chunk of samples.
  *
@@ -1371,7 +1884,7 @@ static gpointer di_thread(gpointer data)
  */
 SRD_PRIV int srd_inst_decode(struct srd_decoder_inst *di,
 		uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
-		const struct srd_input_data *inbuf)
+		const struct srd_input_view *inbuf)
 {
 	/* Return an error upon unusable input. */
 	if (!di) {
@@ -1402,16 +1915,32 @@ SRD_PRIV int srd_inst_decode(struct srd_decoder_inst *di,
 		abs_end_samplenum - abs_start_samplenum,
 		di->inst_id);
 
+	if (di->sess->coroutine)
+		return srd_inst_decode_coro(di, abs_start_samplenum,
+			abs_end_samplenum, inbuf);
+
 	/* If this is the first call, start the worker thread. */
 	if (!di->thread_handle) {
 		srd_dbg("No worker thread for this decoder stack "
 			"exists yet, creating one: %s.", di->inst_id);
-		di->thread_handle = g_thread_new(di->inst_id,
-						 di_thread, di);
+		di->thread_handle = srd_thread_spawn(di->sess, di,
+						     di->inst_id, di_thread, di);
+		if (!di->thread_handle)
+			return SRD_ERR;
 	}
 
 	/* Push the new sample chunk to the worker thread. */
 	g_mutex_lock(&di->data_mutex);
+
+	/* Don't wake up the worker when no condition can match. */
+	if (prefilter_skip_chunk(di, abs_start_samplenum,
+			abs_end_samplenum, inbuf)) {
+		g_mutex_unlock(&di->data_mutex);
+		srd_spew("%s: No match possible, chunk skipped.", di->inst_id);
+		srd_inst_flush(di);
+		return SRD_OK;
+	}
+
 	di->abs_start_samplenum = abs_start_samplenum;
 	di->abs_end_samplenum = abs_end_samplenum;
 	di->inbuf = inbuf;
@@ -1460,6 +1989,10 @@ SRD_PRIV int srd_inst_flush(struct srd_decoder_inst *di)
 
 	gstate = PyGILState_Ensure();
 	if (PyObject_HasAttrString(di->py_inst, "flush")) {
+		/* In pipeline mode, have all queued data decoded first. */
+		Py_BEGIN_ALLOW_THREADS
+		srd_inst_pipe_drain(di);
+		Py_END_ALLOW_THREADS
 		srd_dbg("Calling flush() of instance %s", di->inst_id);
 		py_ret = PyObject_CallMethod(di->py_inst, "flush", NULL);
 		Py_XDECREF(py_ret);
@@ -1499,7 +2032,23 @@ SRD_PRIV int srd_inst_send_eof(struct srd_decoder_inst *di)
 	 * started or previously finished is perfectly acceptable.
 	 */
 	srd_dbg("End of sample data: instance %s.", di->inst_id);
-	if (!di->thread_handle) {
+
+	/* Stacked PDs in pipeline mode: consume all queued data. */
+	srd_inst_pipe_drain(di);
+
+	if (di->shared_inst) {
+		/* The shared instance handled EOF, finish the PDs on top. */
+		for (l = di->next_di; l; l = l->next)
+			srd_inst_flush(l->data);
+		for (l = di->next_di; l; l = l->next) {
+			ret = srd_inst_send_eof(l->data);
+			if (ret != SRD_OK)
+				return ret;
+		}
+		return SRD_OK;
+	}
+
+	if (!di->thread_handle && !di->coro) {
 		srd_dbg("No worker thread, nothing to do.");
 		return SRD_OK;
 	}
@@ -1516,10 +2065,14 @@ SRD_PRIV int srd_inst_send_eof(struct srd_decoder_inst *di)
 	g_mutex_unlock(&di->data_mutex);
 
 	/* Only return from here when the condition was handled. */
-	g_mutex_lock(&di->data_mutex);
-	while (!di->handled_all_samples && !di->want_wait_terminate)
-		g_cond_wait(&di->handled_all_samples_cond, &di->data_mutex);
-	g_mutex_unlock(&di->data_mutex);
+	if (di->coro) {
+		srd_coro_resume(di->coro);
+	} else {
+		g_mutex_lock(&di->data_mutex);
+		while (!di->handled_all_samples && !di->want_wait_terminate)
+			g_cond_wait(&di->handled_all_samples_cond, &di->data_mutex);
+		g_mutex_unlock(&di->data_mutex);
+	}
 
 	/* Flush the decoder instance which handled EOF. */
 	srd_inst_flush(di);
@@ -1571,6 +2124,7 @@ SRD_PRIV int srd_inst_terminate_reset(struct srd_decoder_inst *di)
 	 */
 	srd_dbg("Terminating instance %s", di->inst_id);
 	srd_inst_join_decode_thread(di);
+	srd_inst_pipe_stop(di);
 	srd_inst_reset_state(di);
 
 	/*
@@ -1581,6 +2135,8 @@ SRD_PRIV int srd_inst_terminate_reset(struct srd_decoder_inst *di)
 	 * as it's not referenced any longer.
 	 */
 	gstate = PyGILState_Ensure();
+	/* A new capture follows, its output replaces the cached one. */
+	srd_pycache_clear(di);
 	if (PyObject_HasAttrString(di->py_inst, "reset")) {
 		srd_dbg("Calling reset() of instance %s", di->inst_id);
 		py_ret = PyObject_CallMethod(di->py_inst, "reset", NULL);
@@ -1608,13 +2164,23 @@ SRD_PRIV void srd_inst_free(struct srd_decoder_inst *di)
 	srd_dbg("Freeing instance %s.", di->inst_id);
 
 	srd_inst_join_decode_thread(di);
+	srd_inst_pipe_stop(di);
+	srd_inst_pipe_stop_stack(di);
 
 	srd_inst_reset_state(di);
 
 	gstate = PyGILState_Ensure();
+	srd_pycache_free(di);
 	Py_DECREF(di->py_inst);
 	PyGILState_Release(gstate);
 
+	g_mutex_clear(&di->pipe->mutex);
+	g_cond_clear(&di->pipe->cond);
+	g_free(di->pipe);
+
+	srd_thread_config_free(di->thread_config);
+	srd_checkpoint_conditions_free(di->checkpoint_conditions);
+	g_slist_free(di->sharers);
 	g_free(di->inst_id);
 	g_free(di->dec_channelmap);
 	g_free(di->channel_samples);
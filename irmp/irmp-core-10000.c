@@ -0,0 +1,23 @@
+/*
+ * irmp-core-10000.c
+ *
+ * Copyright (c) 2020-2021 Gerhard Sittig <gerhard.sittig@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/* The IRMP core logic at 10kHz ticks. */
+#define F_INTERRUPTS 10000
+#define IRMP_CORE(name) name ## _10000
+
+/* Disable the protocols which need higher tick rates. */
+#define IRMP_SUPPORT_SIEMENS_PROTOCOL 0
+#define IRMP_SUPPORT_RECS80_PROTOCOL 0
+#define IRMP_SUPPORT_RECS80EXT_PROTOCOL 0
+#define IRMP_SUPPORT_LEGO_PROTOCOL 0
+#define IRMP_SUPPORT_RCMM_PROTOCOL 0
+
+#include "irmp-core.c"
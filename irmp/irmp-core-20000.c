@@ -0,0 +1,16 @@
+/*
+ * irmp-core-20000.c
+ *
+ * Copyright (c) 2020-2021 Gerhard Sittig <gerhard.sittig@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/* The IRMP core logic at 20kHz ticks. */
+#define F_INTERRUPTS 20000
+#define IRMP_CORE(name) name ## _20000
+
+#include "irmp-core.c"
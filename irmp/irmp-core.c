@@ -0,0 +1,147 @@
+/*
+ * irmp-core.c
+ *
+ * Copyright (c) 2009-2019 Frank Meyer - frank(at)fli4l.de
+ * Copyright (c) 2009-2019 Rene Staffen - r.staffen(at)gmx.de
+ * Copyright (c) 2020-2021 Gerhard Sittig <gerhard.sittig@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * The IRMP core logic for one tick rate. The including source file
+ * defines F_INTERRUPTS, and IRMP_CORE() which names the build's global
+ * symbols. The core's timing is a compile time option, the library
+ * builds the core once per supported rate and picks one at runtime.
+ */
+#ifndef F_INTERRUPTS
+#  error "F_INTERRUPTS must be defined"
+#endif
+
+#include "irmp-core.h"
+
+/*
+ * This libsigrokdecode incarnation of IRMP will always be used in the
+ * UNIX_OR_WINDOWS configuration. But libtool(1) breaks the upstream
+ * logic's platform detection. Check reliably available conditions here
+ * and provide expected symbols to the library, to reduce changes to the
+ * upstream project.
+ */
+#if defined _WIN32
+#  if !defined WIN32
+#    define WIN32
+#  endif
+#else
+#  if !defined unix
+#    define unix
+#  endif
+#endif
+
+/*
+ * The decoder state lives in a context which the current thread points
+ * to, the library has one context per instance.
+ */
+#if defined _MSC_VER
+#  define IRMP_THREAD_LOCAL __declspec(thread)
+#else
+#  define IRMP_THREAD_LOCAL __thread
+#endif
+
+/* Keep the global symbols of the builds apart. */
+#define irmp_init               IRMP_CORE(irmp_init)
+#define irmp_get_data           IRMP_CORE(irmp_get_data)
+#define irmp_set_callback_ptr   IRMP_CORE(irmp_set_callback_ptr)
+#define irmp_ISR                IRMP_CORE(irmp_ISR)
+#define irmp_protocol_names     IRMP_CORE(irmp_protocol_names)
+#define print_spectrum          IRMP_CORE(print_spectrum)
+
+#include "irmp.h"
+
+/* ANALYZE mode's test program, not used by the library. */
+#define main                    IRMP_CORE(irmp_main)
+
+#include "irmp.c"
+
+#undef main
+
+static void core_init(void *ctx)
+{
+	irmp_context_init(ctx);
+
+	/*
+	 * Silence the core logic's ANALYZE mode diagnostics. These
+	 * are shared by all instances, and never change.
+	 */
+	silent = 1;
+	verbose = 0;
+}
+
+static void core_reset(void *ctx)
+{
+	size_t i;
+	IRMP_DATA data;
+
+	core_init(ctx);
+	irmp_ctx = ctx;
+
+	/*
+	 * Provide the equivalent of 1s idle input signal level. Then
+	 * drain any potentially accumulated result data. This clears
+	 * the internal decoder state.
+	 */
+	irmp_ctx->IRMP_PIN = 0xff;
+	i = F_INTERRUPTS;
+	while (i-- > 0) {
+		(void)irmp_ISR();
+	}
+	(void)irmp_get_data(&data);
+
+	irmp_ctx->time_counter = 0;
+	irmp_ctx->s_startBitSample = 0;
+	irmp_ctx->s_curSample = 0;
+}
+
+static int core_add_one_sample(void *ctx, int sample)
+{
+	int ret;
+
+	irmp_ctx = ctx;
+
+	irmp_ctx->IRMP_PIN = sample ? 0xff : 0x00;
+	ret = irmp_ISR() ? 1 : 0;
+	irmp_ctx->s_curSample++;
+
+	return ret;
+}
+
+/* Fills in all but the protocol name and the end sample. */
+static int core_get_result_data(void *ctx, struct irmp_result_data *data)
+{
+	IRMP_DATA d;
+
+	irmp_ctx = ctx;
+
+	if (!irmp_get_data(&d))
+		return 0;
+
+	data->address = d.address;
+	data->command = d.command;
+	data->protocol = d.protocol;
+	data->flags = d.flags;
+	data->start_sample = irmp_ctx->s_startBitSample;
+	return 1;
+}
+
+const struct irmp_core IRMP_CORE(irmp_core) = {
+	.sample_rate = F_INTERRUPTS,
+	.context_size = sizeof(IRMP_CONTEXT),
+	.init = core_init,
+	.reset = core_reset,
+	.add_one_sample = core_add_one_sample,
+	.get_result_data = core_get_result_data,
+	.protocol_names = irmp_protocol_names,
+	.num_protocols = IRMP_N_PROTOCOLS + 1,
+};
@@ -0,0 +1,41 @@
+/*
+ * irmp-core.h
+ *
+ * Copyright (c) 2020-2021 Gerhard Sittig <gerhard.sittig@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef IRMP_CORE_H
+#define IRMP_CORE_H
+
+#include "irmp-main-sharedlib.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The IRMP core logic, built for one tick rate. The library's private
+ * interface between the PC library and the core logic builds. The
+ * decoder state is an opaque context of context_size bytes, which the
+ * routines work on.
+ */
+struct irmp_core {
+	uint32_t sample_rate;
+	size_t context_size;
+	void (*init)(void *ctx);
+	void (*reset)(void *ctx);
+	int (*add_one_sample)(void *ctx, int sample);
+	int (*get_result_data)(void *ctx, struct irmp_result_data *data);
+	const char *const *protocol_names;
+	size_t num_protocols;
+};
+
+extern const struct irmp_core irmp_core_10000;
+extern const struct irmp_core irmp_core_15000;
+extern const struct irmp_core irmp_core_20000;
+
+#endif
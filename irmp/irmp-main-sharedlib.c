@@ -24,27 +24,11 @@
 #include <string.h>
 
 /*
- * Include the IRMP core logic. This approach is required because of
- * static variables which hold internal state. The core logic started
- * as an MCU project where resources are severely constrained.
- *
- * This libsigrokdecode incarnation of IRMP will always be used in the
- * UNIX_OR_WINDOWS configuration. But libtool(1) breaks the upstream
- * logic's platform detection. Check reliably available conditions here
- * and provide expected symbols to the library, to reduce changes to the
- * upstream project.
+ * The IRMP core logic started as an MCU project where resources are
+ * severely constrained, its timing is a compile time option. The
+ * library contains builds of the core for several tick rates.
  */
-#if defined _WIN32
-#  if !defined WIN32
-#    define WIN32
-#  endif
-#else
-#  if !defined unix
-#    define unix
-#  endif
-#endif
-#include "irmp.h"
-#include "irmp.c"
+#include "irmp-core.h"
 
 /*
  * The remaining source code implements the PC library, which accepts
@@ -61,13 +45,12 @@
  *   frame started in the core. Fortunately the 32bit counters only roll
  *   over after some 2.5 days at the highest available sample rate. So
  *   this limitation is not a blocker.
- * - The IRMP core keeps internal state in global variables. Which is
- *   appropriate for MCU configurations. For the PC library use case
- *   this constraint prevents concurrency, only a single data stream
- *   can get processed at any time. This limitation can get addressed
- *   later, making the flexible and featureful IRMP detection available
- *   in the first place is considered highly desirable, and is a great
- *   improvement in itself.
+ * - The IRMP core's enabled protocols are a compile time option, and
+ *   are shared by all instances. Each instance selects the core build
+ *   for its tick rate and has its own decoder state, so instances can
+ *   process separate data streams on different threads. The routines
+ *   without an instance parameter all work on one shared default
+ *   instance at the default rate, and are not thread safe.
  * - The detection of IR frames from buffered data is both limited and
  *   complicated at the same time. The routine re-uses the caller's
  *   buffer _and_ internal state across multiple calls. Thus windowed
@@ -106,11 +89,30 @@ static int irmp_lib_initialized;
 static size_t irmp_lib_client_id;
 static GMutex irmp_lib_mutex;
 
+/* The core builds, from the highest tick rate. The first is the default. */
+static const struct irmp_core *const irmp_cores[] = {
+	&irmp_core_20000,
+	&irmp_core_15000,
+	&irmp_core_10000,
+};
+
 struct irmp_instance {
 	size_t client_id;
 	GMutex *mutex;
+	GMutex lock;
+	const struct irmp_core *core;
+	void *ctx;
+	uint64_t samplerate;
+	uint32_t ticks;
+	uint32_t first_tick;
+	uint32_t end_sample;
+	uint64_t next_sample;
+	uint64_t resume_sample;
 };
 
+/* Backs the routines which predate instances. */
+static struct irmp_instance irmp_lib_default;
+
 static void irmp_lib_autoinit(void)
 {
 	if (irmp_lib_initialized)
@@ -118,6 +120,10 @@ static void irmp_lib_autoinit(void)
 
 	irmp_lib_client_id = 0;
 	g_mutex_init(&irmp_lib_mutex);
+	irmp_lib_default.mutex = &irmp_lib_mutex;
+	irmp_lib_default.core = irmp_cores[0];
+	irmp_lib_default.ctx = g_malloc0(irmp_cores[0]->context_size);
+	irmp_cores[0]->init(irmp_lib_default.ctx);
 
 	irmp_lib_initialized = 1;
 }
@@ -144,7 +150,11 @@ IRMP_DLLEXPORT struct irmp_instance *irmp_instance_alloc(void)
 		return NULL;
 
 	inst->client_id = irmp_next_client_id();
-	inst->mutex = &irmp_lib_mutex;
+	g_mutex_init(&inst->lock);
+	inst->mutex = &inst->lock;
+	inst->core = irmp_cores[0];
+	inst->ctx = g_malloc0(inst->core->context_size);
+	inst->core->init(inst->ctx);
 
 	return inst;
 }
@@ -157,6 +167,8 @@ IRMP_DLLEXPORT void irmp_instance_free(struct irmp_instance *state)
 	if (!state)
 		return;
 
+	g_mutex_clear(&state->lock);
+	g_free(state->ctx);
 	g_free(state);
 }
 
@@ -205,84 +217,217 @@ IRMP_DLLEXPORT void irmp_instance_unlock(struct irmp_instance *state)
 	g_mutex_unlock(state->mutex);
 }
 
-static uint32_t s_end_sample;
-
 IRMP_DLLEXPORT uint32_t irmp_get_sample_rate(void)
 {
-	return F_INTERRUPTS;
+	return irmp_cores[0]->sample_rate;
 }
 
-IRMP_DLLEXPORT void irmp_reset_state(void)
+IRMP_DLLEXPORT uint32_t irmp_instance_set_sample_rate(struct irmp_instance *state,
+	uint64_t samplerate)
 {
+	const struct irmp_core *core;
 	size_t i;
-	IRMP_DATA data;
 
-	/*
-	 * Provide the equivalent of 1s idle input signal level. Then
-	 * drain any potentially accumulated result data. This clears
-	 * the internal decoder state.
-	 */
-	IRMP_PIN = 0xff;
-	i = F_INTERRUPTS;
-	while (i-- > 0) {
-		(void)irmp_ISR();
+	if (!state)
+		return 0;
+
+	/* Use the highest tick rate which the capture provides. */
+	core = NULL;
+	for (i = 0; i < ARRAY_SIZE(irmp_cores); i++) {
+		if (irmp_cores[i]->sample_rate <= samplerate) {
+			core = irmp_cores[i];
+			break;
+		}
 	}
-	(void)irmp_get_data(&data);
+	if (!core)
+		return 0;
 
-	time_counter = 0;
-	s_startBitSample = 0;
-	s_curSample = 0;
-	s_end_sample = 0;
+	if (core != state->core) {
+		g_free(state->ctx);
+		state->core = core;
+		state->ctx = g_malloc0(core->context_size);
+		core->init(state->ctx);
+	}
+	state->samplerate = samplerate;
+	irmp_instance_reset_state(state);
 
-	/*
-	 * TODO This is not the most appropriate location to control the
-	 * core logic's verbosity. But out of the public set of library
-	 * routines this call is closest to some initialization routine.
-	 * The query for compile time parameter values is optional, the
-	 * state reset is not. Multiple verbosity setup activities in
-	 * the same program lifetime won't harm. This HACK is clearly
-	 * preferrable over more fiddling with core logic innards, or
-	 * the introduction of yet another DLL routine.
-	 */
-	silent = 1;
-	verbose = 0;
+	return core->sample_rate;
 }
 
-IRMP_DLLEXPORT int irmp_add_one_sample(int sample)
+IRMP_DLLEXPORT uint32_t irmp_instance_get_sample_rate(struct irmp_instance *state)
+{
+	return state ? state->core->sample_rate : 0;
+}
+
+IRMP_DLLEXPORT void irmp_instance_reset_state(struct irmp_instance *state)
+{
+	if (!state)
+		return;
+
+	state->core->reset(state->ctx);
+	state->ticks = 0;
+	state->first_tick = 0;
+	state->end_sample = 0;
+	state->next_sample = 0;
+	state->resume_sample = UINT64_MAX;
+}
+
+static int irmp_instance_feed(struct irmp_instance *state, int sample)
 {
 	int ret;
 
-	IRMP_PIN = sample ? 0xff : 0x00;
-	ret = irmp_ISR() ? 1 : 0;
-	s_end_sample = s_curSample++;
+	ret = state->core->add_one_sample(state->ctx, sample);
+	state->end_sample = state->ticks++;
+
 	return ret;
 }
 
-IRMP_DLLEXPORT int irmp_get_result_data(struct irmp_result_data *data)
+IRMP_DLLEXPORT int irmp_instance_add_one_sample(struct irmp_instance *state,
+	int sample)
 {
-	IRMP_DATA d;
+	if (!state)
+		return 0;
 
-	if (!irmp_get_data(&d))
+	return irmp_instance_feed(state, sample);
+}
+
+static int irmp_instance_result(struct irmp_instance *state,
+	struct irmp_result_data *data)
+{
+	if (!state->core->get_result_data(state->ctx, data))
 		return 0;
 
-	data->address = d.address;
-	data->command = d.command;
-	data->protocol = d.protocol;
-	data->protocol_name = irmp_get_protocol_name(d.protocol);
-	data->flags = d.flags;
-	data->start_sample = s_startBitSample;
-	data->end_sample = s_end_sample;
+	data->protocol_name = irmp_get_protocol_name(data->protocol);
+	data->start_sample += state->first_tick;
+	data->end_sample = state->end_sample;
 	return 1;
 }
 
+IRMP_DLLEXPORT int irmp_instance_get_result_data(struct irmp_instance *state,
+	struct irmp_result_data *data)
+{
+	if (!state || !data)
+		return 0;
+
+	return irmp_instance_result(state, data);
+}
+
+/*
+ * The capture's sample number of a detector tick. Ticks fall on the
+ * nearest preceding sample when the capture's rate is no multiple of
+ * the tick rate.
+ */
+static uint64_t irmp_instance_tick_sample(struct irmp_instance *state,
+	uint32_t tick)
+{
+	uint64_t rate, samplerate;
+
+	rate = state->core->sample_rate;
+	samplerate = state->samplerate ? state->samplerate : rate;
+
+	return tick * (samplerate / rate) + tick * (samplerate % rate) / rate;
+}
+
+/*
+ * Restart detection at a capture's sample number, for input which is
+ * not contiguous with what was fed before. Continues with the first
+ * tick at or after the sample, and keeps the tick numbers of results
+ * in the capture's timeline.
+ */
+static void irmp_instance_resync(struct irmp_instance *state,
+	uint64_t sample)
+{
+	uint64_t rate, samplerate;
+
+	rate = state->core->sample_rate;
+	samplerate = state->samplerate ? state->samplerate : rate;
+
+	state->core->reset(state->ctx);
+	state->ticks = (sample * rate + samplerate - 1) / samplerate;
+	state->first_tick = state->ticks;
+	state->end_sample = state->ticks;
+	state->next_sample = sample;
+	state->resume_sample = UINT64_MAX;
+}
+
+IRMP_DLLEXPORT size_t irmp_instance_detect_plane(struct irmp_instance *state,
+	const uint8_t *plane, uint64_t first_sample, size_t num_samples,
+	int invert, struct irmp_result_data *results, size_t max_results)
+{
+	uint64_t pos, end;
+	size_t count, idx;
+	int level;
+
+	if (!state || !plane || !results)
+		return 0;
+
+	/*
+	 * The tick counter tells which sample is fed next. Which also
+	 * resumes a previous call that stopped with a full buffer. Input
+	 * after a gap, or which goes back in time, restarts detection.
+	 */
+	end = first_sample + num_samples;
+	pos = irmp_instance_tick_sample(state, state->ticks);
+	if ((first_sample != state->next_sample &&
+			first_sample != state->resume_sample) ||
+			pos < first_sample) {
+		irmp_instance_resync(state, first_sample);
+		pos = irmp_instance_tick_sample(state, state->ticks);
+	}
+
+	count = 0;
+	while (pos < end && count < max_results) {
+		idx = pos - first_sample;
+		level = (plane[idx / 8] >> (idx % 8)) & 1;
+		if (invert)
+			level = !level;
+		if (irmp_instance_feed(state, level))
+			irmp_instance_result(state, &results[count++]);
+		pos = irmp_instance_tick_sample(state, state->ticks);
+	}
+	state->next_sample = end;
+	state->resume_sample = count == max_results ? first_sample : UINT64_MAX;
+
+	return count;
+}
+
+IRMP_DLLEXPORT void irmp_reset_state(void)
+{
+	irmp_instance_reset_state(&irmp_lib_default);
+}
+
+IRMP_DLLEXPORT int irmp_add_one_sample(int sample)
+{
+	return irmp_instance_add_one_sample(&irmp_lib_default, sample);
+}
+
+IRMP_DLLEXPORT int irmp_get_result_data(struct irmp_result_data *data)
+{
+	return irmp_instance_get_result_data(&irmp_lib_default, data);
+}
+
+IRMP_DLLEXPORT size_t irmp_detect_plane(const uint8_t *plane,
+	uint64_t first_sample, size_t num_samples, uint32_t rate_factor,
+	int invert, struct irmp_result_data *results, size_t max_results)
+{
+	if (!rate_factor)
+		return 0;
+
+	irmp_lib_default.samplerate = (uint64_t)rate_factor *
+		irmp_lib_default.core->sample_rate;
+
+	return irmp_instance_detect_plane(&irmp_lib_default, plane,
+		first_sample, num_samples, invert, results, max_results);
+}
+
 #if WITH_IRMP_DETECT_BUFFER
 IRMP_DLLEXPORT struct irmp_result_data irmp_detect_buffer(const uint8_t *buff, size_t len)
 {
 	struct irmp_result_data ret;
 
 	memset(&ret, 0, sizeof(ret));
-	while (s_curSample < len) {
-		if (irmp_add_one_sample(buff[s_curSample])) {
+	while (irmp_lib_default.ticks < len) {
+		if (irmp_add_one_sample(buff[irmp_lib_default.ticks])) {
 			irmp_get_result_data(&ret);
 			return ret;
 		}
@@ -295,9 +440,9 @@ IRMP_DLLEXPORT const char *irmp_get_protocol_name(uint32_t protocol)
 {
 	const char *name;
 
-	if (protocol >= ARRAY_SIZE(irmp_protocol_names))
+	if (protocol >= irmp_cores[0]->num_protocols)
 		return "unknown";
-	name = irmp_protocol_names[protocol];
+	name = irmp_cores[0]->protocol_names[protocol];
 	if (!name || !*name)
 		return "unknown";
 	return name;
@@ -97,10 +97,36 @@ struct irmp_result_data {
  *
  * The internally used sample rate is a compile time option. Any data
  * that is provided at runtime needs to match this rate, or detection
- * will fail.
+ * will fail. This is the default instance's rate, instances can
+ * select other rates, see @ref irmp_instance_set_sample_rate().
  */
 IRMP_DLLEXPORT uint32_t irmp_get_sample_rate(void);
 
+/**
+ * @brief Select a decoder instance's sample rate for a capture.
+ *
+ * The library contains detectors for several sample rates (10kHz,
+ * 15kHz, 20kHz). Selects the highest one which the capture's rate
+ * provides, and resets the instance's state. Samples fed individually
+ * must come at the returned rate. @ref irmp_instance_detect_plane()
+ * takes the capture's samples, and picks the ones to feed.
+ *
+ * @param[in] state Reference to the instance's state.
+ * @param[in] samplerate The capture's samplerate.
+ *
+ * @returns The instance's sample rate, or zero if the capture's rate
+ *   is too low.
+ */
+IRMP_DLLEXPORT uint32_t irmp_instance_set_sample_rate(struct irmp_instance *state,
+	uint64_t samplerate);
+
+/**
+ * @brief Query a decoder instance's sample rate.
+ *
+ * @param[in] state Reference to the instance's state.
+ */
+IRMP_DLLEXPORT uint32_t irmp_instance_get_sample_rate(struct irmp_instance *state);
+
 /**
  * @brief Reset internal decoder state.
  *
@@ -108,6 +134,18 @@ IRMP_DLLEXPORT uint32_t irmp_get_sample_rate(void);
  */
 IRMP_DLLEXPORT void irmp_reset_state(void);
 
+/**
+ * @brief Reset a decoder instance's state.
+ *
+ * The irmp_instance_*() detection routines work on the instance's own
+ * decoder state, and need no lock. Different instances can process
+ * data on different threads at the same time. The routines without an
+ * instance parameter work on a shared default instance.
+ *
+ * @param[in] state Reference to the instance's state.
+ */
+IRMP_DLLEXPORT void irmp_instance_reset_state(struct irmp_instance *state);
+
 /**
  * @brief Feed an individual sample to the detector.
  *
@@ -121,6 +159,55 @@ IRMP_DLLEXPORT void irmp_reset_state(void);
  */
 IRMP_DLLEXPORT int irmp_add_one_sample(int sample);
 
+/**
+ * @brief Feed an individual sample to a decoder instance.
+ *
+ * @see irmp_add_one_sample()
+ */
+IRMP_DLLEXPORT int irmp_instance_add_one_sample(struct irmp_instance *state,
+	int sample);
+
+/**
+ * @brief Feed a bit-plane of samples to the detector, collect all frames.
+ *
+ * Feeds the samples which fall on detector ticks, i.e. every
+ * rate_factor-th sample of the capture starting at sample 0, up to the
+ * end of the plane. Detection continues across calls when the planes of
+ * consecutive calls are contiguous. A plane after a gap, or one before
+ * the previous, restarts detection at its first sample. Make sure
+ * @ref irmp_reset_state() was called before the first call. Result data is available in the
+ * caller's buffer, @ref irmp_get_result_data() is not needed.
+ *
+ * @param[in] plane The samples, sample i in bit (i % 8) of byte (i / 8).
+ * @param[in] first_sample The capture's sample number of the first sample.
+ * @param[in] num_samples The number of samples in the plane.
+ * @param[in] rate_factor Capture samples per detector tick.
+ * @param[in] invert Whether to invert the levels (active-high input).
+ * @param[out] results The caller provided buffer for detected frames.
+ * @param[in] max_results The number of frames the buffer can hold.
+ *
+ * @returns The number of detected frames. If the buffer is full, call
+ *   again with the same arguments to process the rest of the plane.
+ */
+IRMP_DLLEXPORT size_t irmp_detect_plane(const uint8_t *plane,
+	uint64_t first_sample, size_t num_samples, uint32_t rate_factor,
+	int invert, struct irmp_result_data *results, size_t max_results);
+
+/**
+ * @brief Feed a bit-plane of samples to a decoder instance.
+ *
+ * Like @ref irmp_detect_plane(), with the capture's samplerate from
+ * @ref irmp_instance_set_sample_rate() instead of a rate factor. The
+ * capture's rate need not be a multiple of the instance's rate, each
+ * tick then takes the sample at or before its time. Without a
+ * selected samplerate, each sample is one tick.
+ *
+ * @see irmp_detect_plane()
+ */
+IRMP_DLLEXPORT size_t irmp_instance_detect_plane(struct irmp_instance *state,
+	const uint8_t *plane, uint64_t first_sample, size_t num_samples,
+	int invert, struct irmp_result_data *results, size_t max_results);
+
 #if WITH_IRMP_DETECT_BUFFER
 /**
  * @brief Process the given buffer until an IR frame is found.
@@ -144,6 +231,14 @@ IRMP_DLLEXPORT struct irmp_result_data irmp_detect_buffer(const uint8_t *buf, si
  */
 IRMP_DLLEXPORT int irmp_get_result_data(struct irmp_result_data *data);
 
+/**
+ * @brief Query a decoder instance's result data.
+ *
+ * @see irmp_get_result_data()
+ */
+IRMP_DLLEXPORT int irmp_instance_get_result_data(struct irmp_instance *state,
+	struct irmp_result_data *data);
+
 /**
  * @brief Resolve the protocol identifer to the protocol's name.
  *
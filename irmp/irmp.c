@@ -624,7 +624,6 @@
 #  define ANALYZE_ONLY_NORMAL_PRINTF(...)       { if (! silent && !verbose) { printf (__VA_ARGS__); } }
 #  define ANALYZE_NEWLINE()                     { if (verbose)              { putchar ('\n');       } }
 static int                                      silent;
-static int                                      time_counter;
 static int                                      verbose;
 
 #elif 0 /* not every PIC compiler knows variadic macros :-( */
@@ -1160,6 +1159,151 @@ typedef struct
     uint_fast8_t    flags;                                                   // some flags
 } IRMP_PARAMETER;
 
+/*---------------------------------------------------------------------------------------------------------------------------------------------------
+ *  Decoder state
+ *  @details  everything the decoder keeps between calls of irmp_ISR(). irmp_ctx points to the state in use: the default context,
+ *            or, in the shared library, the context of the instance which the calling thread works on
+ *---------------------------------------------------------------------------------------------------------------------------------------------------
+ */
+typedef struct
+{
+#ifdef ANALYZE
+    int                     time_counter;
+    uint_fast8_t            IRMP_PIN;
+    uint_fast8_t            radio;
+    uint32_t                s_curSample;
+    uint32_t                s_startBitSample;
+#endif
+
+    uint_fast8_t            first_bit;                                          // GRUNDIG, NOKIA, IR60
+    uint_fast8_t            irmp_bit;                                           // current bit position
+    IRMP_PARAMETER          irmp_param;
+    IRMP_PARAMETER          irmp_param2;                                        // RC5 together with FDC or RCCAR
+
+    volatile uint_fast8_t   irmp_ir_detected;
+    volatile uint_fast8_t   irmp_protocol;
+    volatile uint_fast16_t  irmp_address;
+#if IRMP_32_BIT == 1
+    volatile uint_fast32_t  irmp_command;
+#else
+    volatile uint_fast16_t  irmp_command;
+#endif
+    volatile uint_fast16_t  irmp_id;                                            // only used for SAMSUNG protocol
+    volatile uint_fast8_t   irmp_flags;
+
+    // used by irmp_store_bit(), which is called by irmp_ISR()
+    uint_fast16_t           irmp_tmp_address;                                   // ir address
+#if IRMP_32_BIT == 1
+    uint_fast32_t           irmp_tmp_command;                                   // ir command
+#else
+    uint_fast16_t           irmp_tmp_command;                                   // ir command
+#endif
+    uint_fast16_t           irmp_tmp_address2;                                  // ir address
+    uint_fast16_t           irmp_tmp_command2;                                  // ir command
+    uint_fast16_t           irmp_lgair_address;                                 // ir address
+    uint_fast16_t           irmp_lgair_command;                                 // ir command
+    uint_fast16_t           irmp_tmp_id;                                        // ir id (only SAMSUNG)
+    uint8_t                 xor_check[6];                                       // check kaseikyo "parity" bits
+    uint_fast8_t            genre2;                                             // save genre2 bits here, later copied to MSB in flags
+    uint_fast8_t            parity;                                             // number of '1' of the first 14 bits, check if even.
+    uint_fast8_t            check;                                              // number of '1' of the first 14 bits, check if even.
+    uint_fast8_t            mitsu_parity;                                       // number of '1' of the first 14 bits, check if even.
+
+    // used by irmp_ISR()
+    uint_fast8_t            irmp_start_bit_detected;                            // flag: start bit detected
+    uint_fast8_t            wait_for_space;                                     // flag: wait for data bit space
+    uint_fast8_t            wait_for_start_space;                               // flag: wait for start bit space
+    uint_fast8_t            irmp_pulse_time;                                    // count bit time for pulse
+    PAUSE_LEN               irmp_pause_time;                                    // count bit time for pause
+    uint_fast16_t           last_irmp_address;                                  // save last irmp address to recognize key repetition
+#if IRMP_32_BIT == 1
+    uint_fast32_t           last_irmp_command;                                  // save last irmp command to recognize key repetition
+#else
+    uint_fast16_t           last_irmp_command;                                  // save last irmp command to recognize key repetition
+#endif
+    uint_fast16_t           key_repetition_len;                                 // SIRCS repeats frame 2-5 times with 45 ms pause
+    uint_fast8_t            repetition_frame_number;
+    uint_fast16_t           last_irmp_denon_command;                            // save last irmp command to recognize DENON frame repetition
+    uint_fast16_t           denon_repetition_len;                               // denon repetition len of 2nd auto generated frame
+    uint_fast8_t            rc5_cmd_bit6;                                       // bit 6 of RC5 command is the inverted 2nd start bit
+    PAUSE_LEN               last_pause;                                         // last pause value
+    uint_fast8_t            last_value;                                         // last bit value
+    uint_fast8_t            waiting_for_2nd_pulse;
+} IRMP_CONTEXT;
+
+#if IRMP_32_BIT == 1
+#  define IRMP_CONTEXT_INITIALIZER              { .last_irmp_address = 0xFFFF, .last_irmp_command = 0xFFFFFFFF, .denon_repetition_len = 0xFFFF }
+#else
+#  define IRMP_CONTEXT_INITIALIZER              { .last_irmp_address = 0xFFFF, .last_irmp_command = 0xFFFF, .denon_repetition_len = 0xFFFF }
+#endif
+
+#ifndef IRMP_THREAD_LOCAL                                                       // thread local storage class, if each thread may decode on its own
+#  define IRMP_THREAD_LOCAL
+#endif
+
+static IRMP_CONTEXT                             irmp_default_context = IRMP_CONTEXT_INITIALIZER;
+static IRMP_THREAD_LOCAL IRMP_CONTEXT *         irmp_ctx = &irmp_default_context;
+
+/*---------------------------------------------------------------------------------------------------------------------------------------------------
+ *  Initialize decoder state
+ *  @details  puts a context into the state the decoder starts in
+ *  @param    context
+ *---------------------------------------------------------------------------------------------------------------------------------------------------
+ */
+static void
+irmp_context_init (IRMP_CONTEXT * ctx)
+{
+    static const IRMP_CONTEXT initial = IRMP_CONTEXT_INITIALIZER;
+
+    *ctx = initial;
+}
+
+// state variables of the decoder, in the current context
+#ifdef ANALYZE
+#  define time_counter                          (irmp_ctx->time_counter)
+#  define IRMP_PIN                              (irmp_ctx->IRMP_PIN)
+#  define radio                                 (irmp_ctx->radio)
+#  define s_curSample                           (irmp_ctx->s_curSample)
+#  define s_startBitSample                      (irmp_ctx->s_startBitSample)
+#endif
+#define first_bit                               (irmp_ctx->first_bit)
+#define irmp_bit                                (irmp_ctx->irmp_bit)
+#define irmp_param                              (irmp_ctx->irmp_param)
+#define irmp_param2                             (irmp_ctx->irmp_param2)
+#define irmp_ir_detected                        (irmp_ctx->irmp_ir_detected)
+#define irmp_protocol                           (irmp_ctx->irmp_protocol)
+#define irmp_address                            (irmp_ctx->irmp_address)
+#define irmp_command                            (irmp_ctx->irmp_command)
+#define irmp_id                                 (irmp_ctx->irmp_id)
+#define irmp_flags                              (irmp_ctx->irmp_flags)
+#define irmp_tmp_address                        (irmp_ctx->irmp_tmp_address)
+#define irmp_tmp_command                        (irmp_ctx->irmp_tmp_command)
+#define irmp_tmp_address2                       (irmp_ctx->irmp_tmp_address2)
+#define irmp_tmp_command2                       (irmp_ctx->irmp_tmp_command2)
+#define irmp_lgair_address                      (irmp_ctx->irmp_lgair_address)
+#define irmp_lgair_command                      (irmp_ctx->irmp_lgair_command)
+#define irmp_tmp_id                             (irmp_ctx->irmp_tmp_id)
+#define xor_check                               (irmp_ctx->xor_check)
+#define genre2                                  (irmp_ctx->genre2)
+#define parity                                  (irmp_ctx->parity)
+#define check                                   (irmp_ctx->check)
+#define mitsu_parity                            (irmp_ctx->mitsu_parity)
+#define irmp_start_bit_detected                 (irmp_ctx->irmp_start_bit_detected)
+#define wait_for_space                          (irmp_ctx->wait_for_space)
+#define wait_for_start_space                    (irmp_ctx->wait_for_start_space)
+#define irmp_pulse_time                         (irmp_ctx->irmp_pulse_time)
+#define irmp_pause_time                         (irmp_ctx->irmp_pause_time)
+#define last_irmp_address                       (irmp_ctx->last_irmp_address)
+#define last_irmp_command                       (irmp_ctx->last_irmp_command)
+#define key_repetition_len                      (irmp_ctx->key_repetition_len)
+#define repetition_frame_number                 (irmp_ctx->repetition_frame_number)
+#define last_irmp_denon_command                 (irmp_ctx->last_irmp_denon_command)
+#define denon_repetition_len                    (irmp_ctx->denon_repetition_len)
+#define rc5_cmd_bit6                            (irmp_ctx->rc5_cmd_bit6)
+#define last_pause                              (irmp_ctx->last_pause)
+#define last_value                              (irmp_ctx->last_value)
+#define waiting_for_2nd_pulse                   (irmp_ctx->waiting_for_2nd_pulse)
+
 #if IRMP_SUPPORT_SIRCS_PROTOCOL == 1
 
 static const PROGMEM IRMP_PARAMETER sircs_param =
@@ -1759,8 +1903,6 @@ static const PROGMEM IRMP_PARAMETER bang_olufsen_param =
 
 #if IRMP_SUPPORT_GRUNDIG_NOKIA_IR60_PROTOCOL == 1
 
-static uint_fast8_t first_bit;
-
 static const PROGMEM IRMP_PARAMETER grundig_param =
 {
     IRMP_GRUNDIG_PROTOCOL,                                              // protocol:        ir protocol
@@ -2290,23 +2432,6 @@ static const PROGMEM IRMP_PARAMETER radio1_param =
 
 #endif
 
-static uint_fast8_t                             irmp_bit;                   // current bit position
-static IRMP_PARAMETER                           irmp_param;
-
-#if IRMP_SUPPORT_RC5_PROTOCOL == 1 && (IRMP_SUPPORT_FDC_PROTOCOL == 1 || IRMP_SUPPORT_RCCAR_PROTOCOL == 1)
-static IRMP_PARAMETER                           irmp_param2;
-#endif
-
-static volatile uint_fast8_t                    irmp_ir_detected = FALSE;
-static volatile uint_fast8_t                    irmp_protocol;
-static volatile uint_fast16_t                   irmp_address;
-#if IRMP_32_BIT == 1
-static volatile uint_fast32_t                   irmp_command;
-#else
-static volatile uint_fast16_t                   irmp_command;
-#endif
-static volatile uint_fast16_t                   irmp_id;                // only used for SAMSUNG protocol
-static volatile uint_fast8_t                    irmp_flags;
 // static volatile uint_fast8_t                 irmp_busy_flag;
 
 #if defined(__MBED__)
@@ -2317,8 +2442,6 @@ gpio_t                                          gpioIRin;               // use l
 
 #ifdef ANALYZE
 #define input(x)                                (x)
-static uint_fast8_t                             IRMP_PIN;
-static uint_fast8_t                             radio;
 #endif
 
 /*---------------------------------------------------------------------------------------------------------------------------------------------------
@@ -2667,41 +2790,6 @@ irmp_set_callback_ptr (void (*cb)(uint_fast8_t))
 }
 #endif // IRMP_USE_CALLBACK == 1
 
-// these statics must not be volatile, because they are only used by irmp_store_bit(), which is called by irmp_ISR()
-static uint_fast16_t irmp_tmp_address;                                      // ir address
-#if IRMP_32_BIT == 1
-static uint_fast32_t irmp_tmp_command;                                      // ir command
-#else
-static uint_fast16_t irmp_tmp_command;                                      // ir command
-#endif
-
-#if (IRMP_SUPPORT_RC5_PROTOCOL == 1 && (IRMP_SUPPORT_FDC_PROTOCOL == 1 || IRMP_SUPPORT_RCCAR_PROTOCOL == 1)) || IRMP_SUPPORT_NEC42_PROTOCOL == 1
-static uint_fast16_t irmp_tmp_address2;                                     // ir address
-static uint_fast16_t irmp_tmp_command2;                                     // ir command
-#endif
-
-#if IRMP_SUPPORT_LGAIR_PROTOCOL == 1
-static uint_fast16_t irmp_lgair_address;                                    // ir address
-static uint_fast16_t irmp_lgair_command;                                    // ir command
-#endif
-
-#if IRMP_SUPPORT_SAMSUNG_PROTOCOL == 1
-static uint_fast16_t irmp_tmp_id;                                           // ir id (only SAMSUNG)
-#endif
-#if IRMP_SUPPORT_KASEIKYO_PROTOCOL == 1
-static uint8_t      xor_check[6];                                           // check kaseikyo "parity" bits
-static uint_fast8_t genre2;                                                 // save genre2 bits here, later copied to MSB in flags
-#endif
-
-#if IRMP_SUPPORT_ORTEK_PROTOCOL == 1
-static uint_fast8_t  parity;                                                // number of '1' of the first 14 bits, check if even.
-#endif
-
-#if IRMP_SUPPORT_MITSU_HEAVY_PROTOCOL == 1
-static uint_fast8_t  check;                                                 // number of '1' of the first 14 bits, check if even.
-static uint_fast8_t  mitsu_parity;                                          // number of '1' of the first 14 bits, check if even.
-#endif
-
 /*---------------------------------------------------------------------------------------------------------------------------------------------------
  *  store bit
  *  @details  store bit in temp address or temp command
@@ -2976,11 +3064,6 @@ irmp_store_bit2 (uint_fast8_t value)
 }
 #endif // IRMP_SUPPORT_RC5_PROTOCOL == 1 && (IRMP_SUPPORT_FDC_PROTOCOL == 1 || IRMP_SUPPORT_RCCAR_PROTOCOL == 1)
 
-#ifdef ANALYZE
-static uint32_t s_curSample;
-static uint32_t s_startBitSample;
-#endif
-
 /*---------------------------------------------------------------------------------------------------------------------------------------------------
  *  ISR routine
  *  @details  ISR routine, called 10000 times per second
@@ -2989,35 +3072,6 @@ static uint32_t s_startBitSample;
 uint_fast8_t
 irmp_ISR (void)
 {
-    static uint_fast8_t     irmp_start_bit_detected;                                // flag: start bit detected
-    static uint_fast8_t     wait_for_space;                                         // flag: wait for data bit space
-    static uint_fast8_t     wait_for_start_space;                                   // flag: wait for start bit space
-    static uint_fast8_t     irmp_pulse_time;                                        // count bit time for pulse
-    static PAUSE_LEN        irmp_pause_time;                                        // count bit time for pause
-    static uint_fast16_t    last_irmp_address = 0xFFFF;                             // save last irmp address to recognize key repetition
-#if IRMP_32_BIT == 1
-    static uint_fast32_t    last_irmp_command = 0xFFFFFFFF;                         // save last irmp command to recognize key repetition
-#else
-    static uint_fast16_t    last_irmp_command = 0xFFFF;                             // save last irmp command to recognize key repetition
-#endif
-    static uint_fast16_t    key_repetition_len;                                     // SIRCS repeats frame 2-5 times with 45 ms pause
-    static uint_fast8_t     repetition_frame_number;
-#if IRMP_SUPPORT_DENON_PROTOCOL == 1
-    static uint_fast16_t    last_irmp_denon_command;                                // save last irmp command to recognize DENON frame repetition
-    static uint_fast16_t    denon_repetition_len = 0xFFFF;                          // denon repetition len of 2nd auto generated frame
-#endif
-#if IRMP_SUPPORT_RC5_PROTOCOL == 1 || IRMP_SUPPORT_S100_PROTOCOL == 1
-    static uint_fast8_t     rc5_cmd_bit6;                                           // bit 6 of RC5 command is the inverted 2nd start bit
-#endif
-#if IRMP_SUPPORT_MANCHESTER == 1
-    static PAUSE_LEN        last_pause;                                             // last pause value
-#endif
-#if IRMP_SUPPORT_MANCHESTER == 1 || IRMP_SUPPORT_BANG_OLUFSEN_PROTOCOL == 1
-    static uint_fast8_t     last_value;                                             // last bit value
-#endif
-#if IRMP_SUPPORT_RCII_PROTOCOL == 1
-    static uint_fast8_t     waiting_for_2nd_pulse = 0;
-#endif
     uint_fast8_t            irmp_input;                                             // input value
 
 #ifdef ANALYZE
@@ -6149,3 +6203,49 @@ main (int argc, char ** argv)
 }
 
 #endif // ANALYZE
+
+// the state variables are plain names again for code which includes this file
+#ifdef ANALYZE
+#  undef time_counter
+#  undef IRMP_PIN
+#  undef radio
+#  undef s_curSample
+#  undef s_startBitSample
+#endif
+#undef first_bit
+#undef irmp_bit
+#undef irmp_param
+#undef irmp_param2
+#undef irmp_ir_detected
+#undef irmp_protocol
+#undef irmp_address
+#undef irmp_command
+#undef irmp_id
+#undef irmp_flags
+#undef irmp_tmp_address
+#undef irmp_tmp_command
+#undef irmp_tmp_address2
+#undef irmp_tmp_command2
+#undef irmp_lgair_address
+#undef irmp_lgair_command
+#undef irmp_tmp_id
+#undef xor_check
+#undef genre2
+#undef parity
+#undef check
+#undef mitsu_parity
+#undef irmp_start_bit_detected
+#undef wait_for_space
+#undef wait_for_start_space
+#undef irmp_pulse_time
+#undef irmp_pause_time
+#undef last_irmp_address
+#undef last_irmp_command
+#undef key_repetition_len
+#undef repetition_frame_number
+#undef last_irmp_denon_command
+#undef denon_repetition_len
+#undef rc5_cmd_bit6
+#undef last_pause
+#undef last_value
+#undef waiting_for_2nd_pulse
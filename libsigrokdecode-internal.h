@@ -71,6 +71,12 @@ typedef struct {
 	PyObject *sample;
 } srd_logic;
 
+struct srd_output_queue;
+struct srd_annstore;
+struct srd_spill_writer;
+struct srd_rcache;
+struct srd_search;
+
 struct srd_session {
 	int session_id;
 
@@ -79,6 +85,70 @@ struct srd_session {
 
 	/* List of frontend callbacks to receive decoder output. */
 	GSList *callbacks;
+
+	/* Run stacked PDs on their own worker threads (pipeline mode). */
+	gboolean pipeline;
+
+	/* Run decode() as a coroutine on the caller's thread. */
+	gboolean coroutine;
+
+	/* Have identically configured bottom instances share one decode. */
+	gboolean inst_sharing;
+
+	/* Queue of output records, NULL for synchronous delivery. */
+	struct srd_output_queue *outq;
+
+	/* Options for worker threads, NULL for the platform defaults. */
+	struct srd_thread_config *thread_config;
+
+	/* Frontend hooks which run worker threads, spawn is NULL if unset. */
+	struct srd_thread_factory thread_factory;
+
+	/* Store of the session's annotations, NULL if disabled. */
+	struct srd_annstore *annstore;
+
+	/* Writer of the session's spill files, NULL if disabled. */
+	struct srd_spill_writer *spill;
+
+	/* Exporters which write the session's output to files. */
+	GSList *exporters;
+
+	/*
+	 * Read-held while output reaches annstore, spill, search and
+	 * exporters, write-held while the frontend attaches or detaches them.
+	 */
+	GRWLock sinks_lock;
+
+	/* Samplerate from srd_session_metadata_set(), 0 if unknown. */
+	uint64_t samplerate;
+
+	/* Samples between decoder state checkpoints, 0 if disabled. */
+	uint64_t checkpoint_interval;
+
+	/* Checkpoints in ascending sample order, NULL if none. */
+	GPtrArray *checkpoints;
+
+	/* End of the last chunk which was sent. */
+	uint64_t decode_samplenum;
+
+	/* Output which ends before this sample is dropped (range decodes). */
+	uint64_t output_from;
+
+	/* Result cache of srd_session_decode_cached(), NULL if disabled. */
+	struct srd_rcache *rcache;
+
+	/* Search index over the session's output, NULL if disabled. */
+	struct srd_search *search;
+
+	/* Ring buffer of streamed input, NULL if not set up. */
+	struct srd_ring *ring;
+
+	/* Decimated views of the input (struct srd_decimator), per setting. */
+	GSList *decimators;
+
+	/* Views of the input data of srd_session_send(). */
+	struct srd_input_view *send_views;
+	unsigned int num_send_views;
 };
 
 /* srd.c */
@@ -90,17 +160,144 @@ SRD_PRIV struct srd_pd_callback *srd_pd_output_callback_find(struct srd_session
 
 /* instance.c */
 SRD_PRIV int srd_inst_start(struct srd_decoder_inst *di);
+SRD_PRIV void srd_inst_share_find(struct srd_session *sess);
 SRD_PRIV void match_array_free(struct srd_decoder_inst *di);
 SRD_PRIV void condition_list_free(struct srd_decoder_inst *di);
 SRD_PRIV int srd_inst_decode(struct srd_decoder_inst *di,
 		uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
-		const struct srd_input_data *inbuf);
+		const struct srd_input_view *inbuf);
 SRD_PRIV int process_samples_until_condition_match(struct srd_decoder_inst *di, gboolean *found_match);
+SRD_PRIV void update_old_pins_array(struct srd_decoder_inst *di);
 SRD_PRIV int srd_inst_flush(struct srd_decoder_inst *di);
 SRD_PRIV int srd_inst_send_eof(struct srd_decoder_inst *di);
 SRD_PRIV int srd_inst_terminate_reset(struct srd_decoder_inst *di);
 SRD_PRIV void srd_inst_free(struct srd_decoder_inst *di);
 SRD_PRIV void srd_inst_free_all(struct srd_session *sess);
+SRD_PRIV void srd_inst_pipe_push(struct srd_decoder_inst *di,
+		uint64_t start_sample, uint64_t end_sample, PyObject *py_data);
+SRD_PRIV void srd_inst_pipe_drain_stack(struct srd_decoder_inst *di);
+
+/* coro.c */
+typedef void (*srd_coro_func)(void *arg);
+SRD_PRIV gboolean srd_coro_supported(void);
+SRD_PRIV struct srd_coro *srd_coro_new(srd_coro_func func, void *arg);
+SRD_PRIV int srd_coro_resume(struct srd_coro *co);
+SRD_PRIV void srd_coro_yield(struct srd_coro *co);
+SRD_PRIV gboolean srd_coro_done(const struct srd_coro *co);
+SRD_PRIV void srd_coro_free(struct srd_coro *co);
+
+/* plane.c */
+
+/* Index of the least significant set bit, word must not be zero. */
+static inline unsigned int srd_ctz64(uint64_t word)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(word);
+#else
+	unsigned int n;
+
+	for (n = 0; !(word & 1); n++)
+		word >>= 1;
+
+	return n;
+#endif
+}
+
+/* Number of set bits. */
+static inline unsigned int srd_popcount64(uint64_t word)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(word);
+#else
+	unsigned int n;
+
+	for (n = 0; word; n++)
+		word &= word - 1;
+
+	return n;
+#endif
+}
+
+SRD_PRIV uint64_t srd_plane_load64(const uint8_t *data, uint64_t idx);
+SRD_PRIV uint8_t srd_plane_sample(const struct srd_input_view *in, uint64_t idx);
+SRD_PRIV uint64_t srd_plane_word(const struct srd_input_view *in,
+		uint64_t idx, unsigned int count);
+SRD_PRIV uint64_t srd_plane_find_value(const struct srd_input_view *in,
+		uint64_t start, uint64_t end, uint8_t value);
+SRD_PRIV uint64_t srd_plane_find_change(const struct srd_input_view *in,
+		uint64_t start, uint64_t end);
+
+/* thread.c */
+SRD_PRIV struct srd_thread *srd_thread_spawn(struct srd_session *sess,
+		struct srd_decoder_inst *di, const char *name,
+		srd_thread_func func, void *data);
+SRD_PRIV void srd_thread_join(struct srd_thread *thread);
+SRD_PRIV void srd_thread_config_free(struct srd_thread_config *config);
+
+/* annstore.c */
+SRD_PRIV void srd_annstore_add(struct srd_session *sess,
+		const struct srd_proto_data *pdata);
+SRD_PRIV void srd_annstore_free(struct srd_session *sess);
+
+/* spill.c */
+SRD_PRIV void srd_spill_add(struct srd_session *sess,
+		const struct srd_proto_data *pdata);
+SRD_PRIV void srd_spill_flush(struct srd_session *sess);
+SRD_PRIV void srd_spill_free(struct srd_session *sess);
+
+/* pycache.c */
+SRD_PRIV void srd_pycache_add(struct srd_decoder_inst *di,
+		uint64_t start_sample, uint64_t end_sample, PyObject *obj);
+SRD_PRIV void srd_pycache_clear(struct srd_decoder_inst *di);
+SRD_PRIV void srd_pycache_free(struct srd_decoder_inst *di);
+
+/* checkpoint.c */
+SRD_PRIV void srd_checkpoint_conditions_free(GSList *conds);
+SRD_PRIV void srd_checkpoint_take(struct srd_session *sess,
+		uint64_t samplenum);
+SRD_PRIV void srd_checkpoint_resume(struct srd_decoder_inst *di);
+SRD_PRIV void srd_checkpoint_free_all(struct srd_session *sess);
+
+/* export.c */
+SRD_PRIV gboolean srd_export_wanted(struct srd_session *sess, int output_type);
+SRD_PRIV void srd_export_add(struct srd_session *sess,
+		const struct srd_proto_data *pdata, int output_type);
+SRD_PRIV void srd_export_flush_all(struct srd_session *sess);
+SRD_PRIV void srd_export_free_all(struct srd_session *sess);
+
+/* search.c */
+SRD_PRIV void srd_search_add(struct srd_session *sess,
+		const struct srd_proto_data *pdata);
+SRD_PRIV void srd_search_add_python(struct srd_decoder_inst *di,
+		uint64_t start_sample, uint64_t end_sample, PyObject *obj);
+SRD_PRIV void srd_search_clear(struct srd_session *sess);
+SRD_PRIV void srd_search_free(struct srd_session *sess);
+
+/* ring.c */
+SRD_PRIV void srd_ring_reset(struct srd_session *sess);
+SRD_PRIV void srd_ring_free(struct srd_session *sess);
+
+/* decimate.c */
+SRD_PRIV int srd_decimate_chunk(struct srd_session *sess,
+		uint64_t start_sample, uint64_t end_sample,
+		const struct srd_input_view *inbuf);
+SRD_PRIV int srd_decimate_inst_decode(struct srd_decoder_inst *di);
+SRD_PRIV void srd_decimate_reset(struct srd_session *sess);
+SRD_PRIV void srd_decimate_free(struct srd_session *sess);
+
+/* resultcache.c */
+SRD_PRIV gboolean srd_rcache_recording(struct srd_session *sess);
+SRD_PRIV void srd_rcache_add(struct srd_session *sess,
+		const struct srd_proto_data *pdata, int output_type);
+SRD_PRIV void srd_rcache_free(struct srd_session *sess);
+
+/* output.c */
+SRD_PRIV gboolean srd_output_wanted(struct srd_session *sess, int output_type);
+SRD_PRIV void srd_output_submit(struct srd_session *sess,
+		struct srd_proto_data *pdata);
+SRD_PRIV void srd_output_release(struct srd_proto_data *pdata);
+SRD_PRIV void srd_output_sync(struct srd_session *sess);
+SRD_PRIV void srd_output_free(struct srd_session *sess);
 
 /* log.c */
 #if defined(G_OS_WIN32) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 4))
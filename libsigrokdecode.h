@@ -30,6 +30,15 @@ extern "C" {
 #endif
 
 struct srd_session;
+struct srd_inst_pipe;
+struct srd_coro;
+struct srd_thread;
+struct srd_thread_config;
+struct srd_pycache;
+struct srd_spill;
+struct srd_exporter;
+struct srd_file_source;
+struct srd_ring;
 
 /**
  * @file
@@ -253,6 +262,41 @@ struct srd_input_data {
     uint8_t constant;
 };
 
+/**
+ * A channel's samples within a buffer, for srd_session_send_views().
+ * Like struct srd_input_data, but the samples need not start at a byte
+ * boundary, and need not be adjacent.
+ */
+struct srd_input_view {
+	/** The plane bytes, NULL for a constant channel. */
+	const uint8_t *data;
+	/** The level of a constant channel. */
+	uint8_t constant;
+	/** Bit of data which holds the chunk's first sample. */
+	uint64_t bit_offset;
+	/** Bits from one sample to the next, 0 or 1 for a packed plane. */
+	uint32_t bit_stride;
+};
+
+/** A piece of a channel's bit-plane, for srd_session_send_segments(). */
+struct srd_input_segment {
+	/** The plane bytes. */
+	const uint8_t *data;
+	/** The first sample is bit (bit_offset % 8) of byte (bit_offset / 8). */
+	uint64_t bit_offset;
+	/** The number of samples. */
+	uint64_t bit_length;
+};
+
+/** The segments of one channel, for srd_session_send_segments(). */
+struct srd_input_segments {
+	/** The channel's samples in order, NULL for a constant channel. */
+	const struct srd_input_segment *segments;
+	unsigned int num_segments;
+	/** The level of a constant channel. */
+	uint8_t constant;
+};
+
 struct srd_decoder_inst {
 	struct srd_decoder *decoder;
 	struct srd_session *sess;
@@ -278,7 +322,7 @@ struct srd_decoder_inst {
 	uint64_t abs_end_samplenum;
 
 	/** Pointer to the buffer/chunk of input samples. */
-	const struct srd_input_data *inbuf;
+	const struct srd_input_view *inbuf;
 
 	/** Length (in bytes) of the input sample buffer. */
 	// uint64_t inbuflen;
@@ -298,7 +342,7 @@ struct srd_decoder_inst {
 	GArray *old_pins_array;
 
 	/** Handle for this PD stack's worker thread. */
-	GThread *thread_handle;
+	struct srd_thread *thread_handle;
 
 	/** Indicates whether new samples are available for processing. */
 	gboolean got_new_samples;
@@ -318,6 +362,36 @@ struct srd_decoder_inst {
 	GCond got_new_samples_cond;
 	GCond handled_all_samples_cond;
 	GMutex data_mutex;
+
+	/** Input queue and worker of a stacked PD in pipeline mode. */
+	struct srd_inst_pipe *pipe;
+
+	/** Coroutine which runs decode() in coroutine mode. */
+	struct srd_coro *coro;
+
+	/** Worker thread options, NULL to use the session's options. */
+	struct srd_thread_config *thread_config;
+
+	/** Cache of the SRD_OUTPUT_PYTHON stream, NULL if disabled. */
+	struct srd_pycache *pycache;
+
+	/** Conditions of the wait() a restored checkpoint was taken in. */
+	GSList *checkpoint_conditions;
+
+	/** Identical instance which decodes for this one, NULL if none. */
+	struct srd_decoder_inst *shared_inst;
+
+	/** Instances for which this one decodes. */
+	GSList *sharers;
+
+	/** Input decimation factor, 0 or 1 if all samples are decoded. */
+	unsigned int decimation;
+
+	/** How groups of samples are decimated (enum srd_decimation_policy). */
+	int decimation_policy;
+
+	/** Decimated input, shared by instances of the same settings. */
+	struct srd_decimator *decimator;
 };
 
 struct srd_pd_output {
@@ -362,6 +436,276 @@ struct srd_pd_callback {
 	void *cb_data;
 };
 
+/** An annotation as kept by the session's annotation store. */
+struct srd_annstore_item {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	int ann_class;
+	int ann_row;
+	/** Owned by the store, valid until it gets cleared. */
+	char **ann_text;
+};
+
+/** Summary of the annotations which start in a range of samples. */
+struct srd_annstore_bucket {
+	/** First sample of the bucket's range. */
+	uint64_t start_sample;
+	/** Last sample of the bucket's range. */
+	uint64_t end_sample;
+	/** Number of annotations which start in the range. */
+	uint64_t count;
+	/** The annotation which starts first. */
+	struct srd_annstore_item first;
+	/** The annotation which starts last. */
+	struct srd_annstore_item last;
+	/** The most frequent annotation class, the lowest one on ties. */
+	int dominant_class;
+};
+
+/** Return FALSE to stop the query. */
+typedef gboolean (*srd_annstore_callback)(const struct srd_annstore_item *item,
+		void *cb_data);
+
+/** An annotation as read from a spill file. */
+struct srd_spill_item {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	/** Owned by the reader, valid until it gets closed. */
+	const char *inst_id;
+	int ann_row;
+	int ann_class;
+	/** Owned by the reader, valid until it gets closed. */
+	char **ann_text;
+};
+
+/** Return FALSE to stop the query. */
+typedef gboolean (*srd_spill_callback)(const struct srd_spill_item *item,
+		void *cb_data);
+
+/** Output which srd_session_search_set() indexes. */
+enum srd_search_flags {
+	/** Annotation texts. */
+	SRD_SEARCH_ANN = 1 << 0,
+	/** Strings and integers in SRD_OUTPUT_PYTHON data. */
+	SRD_SEARCH_PYTHON = 1 << 1,
+};
+
+/** An output which matched a srd_search_query(). */
+struct srd_search_match {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	/** Owned by the index, valid until it gets cleared. */
+	const char *inst_id;
+	/** SRD_OUTPUT_ANN or SRD_OUTPUT_PYTHON. */
+	int output_type;
+	/** Annotation class and row, -1 for Python output. */
+	int ann_class;
+	int ann_row;
+};
+
+/** Alignment of buffers from srd_sample_buffer_alloc(), in bytes. */
+#define SRD_SAMPLE_BUFFER_ALIGN 64
+/** Readable bytes after the end of buffers from srd_sample_buffer_alloc(). */
+#define SRD_SAMPLE_BUFFER_PADDING 64
+/** Bytes per plane of num_samples samples which keep planes aligned. */
+#define SRD_SAMPLE_BUFFER_PLANE_SIZE(num_samples) \
+	((((num_samples) + 7) / 8 + SRD_SAMPLE_BUFFER_ALIGN - 1) / \
+	SRD_SAMPLE_BUFFER_ALIGN * SRD_SAMPLE_BUFFER_ALIGN)
+
+/** Flags of srd_sample_buffer_alloc(). */
+enum srd_sample_buffer_flags {
+	/** Try explicitly reserved huge pages (hugetlbfs) first. */
+	SRD_SAMPLE_BUFFER_HUGETLB = 1 << 0,
+};
+
+/** Formats of capture files for srd_file_source_open(). */
+enum srd_file_format {
+	/** The bit-planes of all channels, one after another. */
+	SRD_FILE_PLANES,
+	/** Interleaved samples of all channels, like sigrok logic files. */
+	SRD_FILE_LOGIC,
+};
+
+/** Kinds of srd_scan_run() searches. */
+enum srd_scan_type {
+	/** Pulses of a level, with a width in a range. */
+	SRD_SCAN_PULSE,
+	/** A bit pattern on a clocked data line. */
+	SRD_SCAN_SERIAL,
+	/** A combination of channel levels. */
+	SRD_SCAN_STATE,
+};
+
+enum srd_scan_edge {
+	SRD_SCAN_EDGE_RISING,
+	SRD_SCAN_EDGE_FALLING,
+};
+
+/** What srd_scan_run() searches for, see there for the fields' use. */
+struct srd_scan {
+	int type;
+	/** Pulse channel, or serial data channel. */
+	int channel;
+	/** Pulse level, -1 for either. */
+	int level;
+	/** Range of pulse and state widths in samples, max 0 for no limit. */
+	uint64_t min_width;
+	uint64_t max_width;
+	int clock_channel;
+	int clock_edge;
+	/** Serial pattern, the most recent bit is the least significant. */
+	uint64_t pattern;
+	uint64_t pattern_mask;
+	unsigned int pattern_bits;
+	/** Bit n selects channel n, and holds its level. */
+	uint64_t state_mask;
+	uint64_t state_value;
+};
+
+/** A match of srd_scan_run(), end_sample is the sample after it. */
+struct srd_scan_match {
+	uint64_t start_sample;
+	uint64_t end_sample;
+};
+
+/** Return FALSE to stop the scan. */
+typedef gboolean (*srd_scan_callback)(const struct srd_scan_match *match,
+		void *cb_data);
+
+/** How srd_inst_decimation_set() reduces a group of samples to one. */
+enum srd_decimation_policy {
+	/** The level most samples of the group have, ties take the first. */
+	SRD_DECIMATION_MAJORITY,
+	/** The level of the group's first sample. */
+	SRD_DECIMATION_FIRST,
+};
+
+/** Return FALSE to stop the query. */
+typedef gboolean (*srd_search_callback)(const struct srd_search_match *match,
+		void *cb_data);
+
+/** Scheduling policies for worker threads. */
+enum srd_thread_policy {
+	/** Keep the policy the thread inherits. */
+	SRD_THREAD_POLICY_DEFAULT,
+	/** Normal time-sharing. */
+	SRD_THREAD_POLICY_OTHER,
+	/** Time-sharing, for throughput rather than latency. */
+	SRD_THREAD_POLICY_BATCH,
+	/** Run only when the CPU is idle otherwise. */
+	SRD_THREAD_POLICY_IDLE,
+	/** Realtime, first in first out. */
+	SRD_THREAD_POLICY_FIFO,
+	/** Realtime, round robin. */
+	SRD_THREAD_POLICY_RR,
+};
+
+/** Options for the worker threads which the library creates. */
+struct srd_thread_config {
+	/** CPUs the threads may run on, NULL for no restriction. */
+	const unsigned int *cpus;
+	/** Number of entries in cpus. */
+	unsigned int num_cpus;
+	/**
+	 * NUMA node to run on and to preferably allocate memory from,
+	 * only applied if set_numa is TRUE. Combined with cpus, the
+	 * intersection is used.
+	 */
+	int numa_node;
+	gboolean set_numa;
+	/** Scheduling policy, see enum srd_thread_policy. */
+	int policy;
+	/** Static priority for SRD_THREAD_POLICY_FIFO/_RR. */
+	int priority;
+	/** Nice level, only applied if set_nice is TRUE. */
+	int nice;
+	gboolean set_nice;
+	/** Prefix of the thread names, NULL for none. */
+	const char *name_prefix;
+};
+
+typedef void *(*srd_thread_func)(void *data);
+
+/**
+ * Hooks which let the frontend run the library's worker threads, e.g.
+ * on threads of its own pool. Each spawned function runs until the
+ * library stops it, so a pool must not queue it behind other work.
+ */
+struct srd_thread_factory {
+	/**
+	 * Start running func(data) concurrently. Returns an opaque
+	 * handle for join(), or NULL upon error.
+	 */
+	void *(*spawn)(const char *name, srd_thread_func func, void *data,
+			void *cb_data);
+	/** Wait until func() of a spawned handle has returned. */
+	void (*join)(void *handle, void *cb_data);
+	void *cb_data;
+};
+
+/** How output records reach the frontend callbacks of a session. */
+enum srd_output_delivery {
+	/** Callbacks run in the decoder threads, from within put(). */
+	SRD_OUTPUT_DELIVERY_SYNC,
+	/** Records are queued, a delivery thread runs the callbacks. */
+	SRD_OUTPUT_DELIVERY_THREAD,
+	/** Records are queued, srd_session_poll_output() runs the callbacks. */
+	SRD_OUTPUT_DELIVERY_POLL,
+};
+
+/** What put() does when the output queue of a session is full. */
+enum srd_output_overflow {
+	/** Wait until the consumer made room. */
+	SRD_OUTPUT_OVERFLOW_BLOCK,
+	/** Discard the record and count it. */
+	SRD_OUTPUT_OVERFLOW_DROP,
+};
+
+struct srd_output_stats {
+	/** Number of record slots in the queue. */
+	uint64_t capacity;
+	/** Number of records currently waiting for delivery. */
+	uint64_t occupancy;
+	/** Highest occupancy seen so far. */
+	uint64_t high_water;
+	/** Number of records which were queued. */
+	uint64_t queued;
+	/** Number of records which were passed to the callbacks. */
+	uint64_t delivered;
+	/** Number of records which were discarded as the queue was full. */
+	uint64_t dropped;
+};
+
+/** File formats of exporters. */
+enum srd_export_format {
+	/** Annotations as comma-separated values, one per line. */
+	SRD_EXPORT_CSV,
+	/** Annotations as JSON objects, one per line. */
+	SRD_EXPORT_JSONL,
+	/** The raw bytes of binary outputs, concatenated. */
+	SRD_EXPORT_BINARY,
+};
+
+/** Flags of exporters. */
+enum srd_export_flags {
+	/** Add start and end time in seconds, based on the samplerate. */
+	SRD_EXPORT_FLAG_TIME = 1 << 0,
+	/** Start CSV files with a line of column names. */
+	SRD_EXPORT_FLAG_HEADER = 1 << 1,
+};
+
+/**
+ * Returns the views of the samples [start_sample, end_sample) for
+ * srd_session_decode_range() and srd_session_decode_cached(), laid out
+ * like for srd_session_send_views().
+ * The data must stay valid until the next call. NULL is an error.
+ */
+typedef const struct srd_input_view *(*srd_sample_source)(
+		uint64_t start_sample, uint64_t end_sample, void *cb_data);
+
+/** Matches any annotation row or class in srd_exporter_select(). */
+#define SRD_EXPORT_ANY G_MININT
+
 
 
 
@@ -379,11 +723,142 @@ SRD_API int srd_session_metadata_set(struct srd_session *sess, int key,
 SRD_API int srd_session_send(struct srd_session *sess,
 		uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
 		struct srd_input_data *inbuf);
+SRD_API int srd_session_send_views(struct srd_session *sess,
+		uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
+		const struct srd_input_view *views);
+SRD_API int srd_session_send_segments(struct srd_session *sess,
+		uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
+		const struct srd_input_segments *channels,
+		unsigned int num_channels);
 SRD_API int srd_session_send_eof(struct srd_session *sess);
 SRD_API int srd_session_terminate_reset(struct srd_session *sess);
 SRD_API int srd_session_destroy(struct srd_session *sess);
 SRD_API int srd_pd_output_callback_add(struct srd_session *sess,
 		int output_type, srd_pd_output_callback cb, void *cb_data);
+SRD_API int srd_session_pipeline_set(struct srd_session *sess,
+		gboolean enable);
+SRD_API int srd_session_coroutine_set(struct srd_session *sess,
+		gboolean enable);
+SRD_API int srd_session_inst_sharing_set(struct srd_session *sess,
+		gboolean enable);
+
+/* thread.c */
+SRD_API int srd_session_thread_config_set(struct srd_session *sess,
+		const struct srd_thread_config *config);
+SRD_API int srd_session_thread_factory_set(struct srd_session *sess,
+		const struct srd_thread_factory *factory);
+SRD_API int srd_inst_thread_config_set(struct srd_decoder_inst *di,
+		const struct srd_thread_config *config);
+
+/* annstore.c */
+SRD_API int srd_session_annstore_set(struct srd_session *sess,
+		gboolean enable);
+SRD_API int srd_annstore_query(struct srd_session *sess, const char *inst_id,
+		int ann_row, uint64_t start_sample, uint64_t end_sample,
+		srd_annstore_callback cb, void *cb_data);
+SRD_API int srd_annstore_count(struct srd_session *sess, const char *inst_id,
+		int ann_row, uint64_t start_sample, uint64_t end_sample,
+		uint64_t *count);
+SRD_API int srd_annstore_summary(struct srd_session *sess,
+		const char *inst_id, int ann_row, uint64_t start_sample,
+		uint64_t end_sample, struct srd_annstore_bucket *buckets,
+		unsigned int max_buckets);
+SRD_API int srd_annstore_clear(struct srd_session *sess);
+
+/* spill.c */
+SRD_API int srd_session_spill_set(struct srd_session *sess, const char *path);
+SRD_API int srd_spill_open(const char *path, struct srd_spill **spill);
+SRD_API int srd_spill_count_get(const struct srd_spill *spill,
+		uint64_t *count);
+SRD_API int srd_spill_get(const struct srd_spill *spill, uint64_t index,
+		struct srd_spill_item *item);
+SRD_API int srd_spill_query(const struct srd_spill *spill,
+		uint64_t start_sample, uint64_t end_sample,
+		srd_spill_callback cb, void *cb_data);
+SRD_API void srd_spill_close(struct srd_spill *spill);
+
+/* pycache.c */
+SRD_API int srd_inst_pycache_set(struct srd_decoder_inst *di, gboolean enable);
+SRD_API int srd_inst_pycache_size_get(struct srd_decoder_inst *di,
+		uint64_t *records, uint64_t *bytes);
+SRD_API int srd_inst_pycache_replay(struct srd_decoder_inst *di,
+		struct srd_decoder_inst *target);
+
+/* checkpoint.c */
+SRD_API int srd_session_checkpoint_interval_set(struct srd_session *sess,
+		uint64_t interval);
+SRD_API int srd_session_checkpoints_get(struct srd_session *sess,
+		uint64_t *samplenums, unsigned int max);
+SRD_API int srd_session_decode_range(struct srd_session *sess,
+		uint64_t start_sample, uint64_t end_sample, uint64_t chunk_size,
+		srd_sample_source source, void *cb_data);
+
+/* search.c */
+SRD_API int srd_session_search_set(struct srd_session *sess,
+		unsigned int flags);
+SRD_API int srd_search_query(struct srd_session *sess, const char *inst_id,
+		const char *query, uint64_t start_sample, uint64_t end_sample,
+		srd_search_callback cb, void *cb_data);
+
+/* scan.c */
+SRD_API int srd_scan_run(const struct srd_scan *scan, uint64_t start_sample,
+		uint64_t end_sample, uint64_t chunk_size, srd_sample_source source,
+		void *source_data, srd_scan_callback cb, void *cb_data);
+
+/* filesource.c */
+SRD_API int srd_file_source_open(const char *path, int format,
+		unsigned int num_channels, uint64_t num_samples,
+		struct srd_file_source **src);
+SRD_API int srd_file_source_info_get(const struct srd_file_source *src,
+		unsigned int *num_channels, uint64_t *num_samples);
+SRD_API const struct srd_input_view *srd_file_source_get(
+		uint64_t start_sample, uint64_t end_sample, void *cb_data);
+SRD_API int srd_session_send_file(struct srd_session *sess,
+		struct srd_file_source *src, uint64_t chunk_size);
+SRD_API void srd_file_source_close(struct srd_file_source *src);
+
+/* samplebuf.c */
+SRD_API void *srd_sample_buffer_alloc(size_t size, unsigned int flags);
+SRD_API void srd_sample_buffer_free(void *buf);
+
+/* ring.c */
+SRD_API int srd_session_ring_set(struct srd_session *sess,
+		unsigned int num_channels, uint64_t capacity, uint64_t retention);
+SRD_API int srd_ring_reserve(struct srd_session *sess, uint64_t *num_samples,
+		uint8_t **planes);
+SRD_API int srd_ring_commit(struct srd_session *sess, uint64_t num_samples);
+SRD_API int srd_ring_close(struct srd_session *sess);
+SRD_API int srd_session_ring_run(struct srd_session *sess, uint64_t max_chunk);
+SRD_API int srd_ring_read(struct srd_session *sess, uint64_t start_sample,
+		uint64_t end_sample, uint8_t **planes);
+
+/* decimate.c */
+SRD_API int srd_inst_decimation_set(struct srd_decoder_inst *di,
+		unsigned int factor, int policy);
+
+/* resultcache.c */
+SRD_API int srd_session_result_cache_set(struct srd_session *sess,
+		const char *dir);
+SRD_API int srd_session_decode_cached(struct srd_session *sess,
+		uint64_t num_samples, uint64_t chunk_size,
+		srd_sample_source source, void *cb_data, gboolean *hit);
+
+/* export.c */
+SRD_API int srd_exporter_new(struct srd_session *sess, int format,
+		const char *path, unsigned int flags,
+		struct srd_exporter **exporter);
+SRD_API int srd_exporter_select(struct srd_exporter *exporter,
+		const char *inst_id, int ann_row, int ann_class);
+SRD_API int srd_exporter_flush(struct srd_exporter *exporter);
+SRD_API int srd_exporter_free(struct srd_exporter *exporter);
+
+/* output.c */
+SRD_API int srd_session_output_delivery_set(struct srd_session *sess,
+		int delivery, int overflow, unsigned int queue_size);
+SRD_API int srd_session_poll_output(struct srd_session *sess,
+		unsigned int max_records);
+SRD_API int srd_session_output_stats_get(struct srd_session *sess,
+		struct srd_output_stats *stats);
 
 /* decoder.c */
 SRD_API const GSList *srd_decoder_list(void);
@@ -0,0 +1,673 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file
+ *
+ * Delivery of decoder output to the frontend callbacks.
+ */
+
+/**
+ * @defgroup grp_output Output delivery
+ *
+ * Deferred delivery of decoder output to the frontend callbacks.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+/* Default number of record slots, used when no queue size is given. */
+#define OUTPUT_QUEUE_DEFAULT (64 * 1024)
+
+/* Upper bound for the time a producer or EOF waiter sleeps between checks. */
+#define OUTPUT_WAIT_USEC (10 * 1000)
+
+/*
+ * A self-contained copy of one put() call. The payload (annotation
+ * strings, binary or logic data, meta GVariant) is owned by the record.
+ */
+struct srd_output_record {
+	struct srd_proto_data pdata;
+	int output_type;
+	union {
+		struct srd_proto_data_annotation ann;
+		struct srd_proto_data_binary bin;
+		struct srd_proto_data_logic logic;
+	} u;
+};
+
+/*
+ * Slot of the bounded queue. A slot can be written when its sequence
+ * number equals the enqueue position, and read when it equals the
+ * dequeue position plus one.
+ */
+struct srd_output_slot {
+	gsize seq;
+	struct srd_output_record *rec;
+};
+
+struct srd_output_queue {
+	struct srd_session *sess;
+	int delivery;
+	int overflow;
+
+	struct srd_output_slot *slots;
+	gsize mask;
+	/* Claimed by producers with compare-and-swap. */
+	gsize enqueue_pos;
+	/* Only advanced by the single consumer. */
+	gsize dequeue_pos;
+
+	/* Counters, updated atomically. */
+	gsize high_water;
+	gsize queued;
+	gsize delivered;
+	gsize dropped;
+
+	/* Only used to sleep, the queue itself doesn't take the mutex. */
+	GMutex mutex;
+	GCond cond;
+	/* Number of producers and EOF waiters sleeping on cond. */
+	gint waiters;
+	/* Set while the consumer sleeps on cond, producers wake it then. */
+	gint consumer_waiting;
+
+	struct srd_thread *thread;
+	gboolean want_terminate;
+};
+
+/** @endcond */
+
+static void output_wake(struct srd_output_queue *q)
+{
+	g_mutex_lock(&q->mutex);
+	g_cond_broadcast(&q->cond);
+	g_mutex_unlock(&q->mutex);
+}
+
+static gsize output_occupancy(struct srd_output_queue *q)
+{
+	return (gsize)g_atomic_pointer_get(&q->enqueue_pos) -
+		(gsize)g_atomic_pointer_get(&q->dequeue_pos);
+}
+
+static void output_update_high_water(struct srd_output_queue *q, gsize pos)
+{
+	gsize used, hw;
+
+	used = pos + 1 - (gsize)g_atomic_pointer_get(&q->dequeue_pos);
+	do {
+		hw = (gsize)g_atomic_pointer_get(&q->high_water);
+		if (used <= hw)
+			return;
+	} while (!g_atomic_pointer_compare_and_exchange(&q->high_water,
+			hw, used));
+}
+
+/* Returns FALSE if the queue is full. Safe for any number of producers. */
+static gboolean output_push(struct srd_output_queue *q,
+		struct srd_output_record *rec)
+{
+	struct srd_output_slot *slot;
+	gsize pos, seq;
+	gssize dif;
+
+	pos = (gsize)g_atomic_pointer_get(&q->enqueue_pos);
+	for (;;) {
+		slot = &q->slots[pos & q->mask];
+		seq = (gsize)g_atomic_pointer_get(&slot->seq);
+		dif = (gssize)(seq - pos);
+		if (dif == 0) {
+			if (g_atomic_pointer_compare_and_exchange(
+					&q->enqueue_pos, pos, pos + 1))
+				break;
+			pos = (gsize)g_atomic_pointer_get(&q->enqueue_pos);
+		} else if (dif < 0) {
+			return FALSE;
+		} else {
+			pos = (gsize)g_atomic_pointer_get(&q->enqueue_pos);
+		}
+	}
+
+	slot->rec = rec;
+	g_atomic_pointer_set(&slot->seq, pos + 1);
+
+	output_update_high_water(q, pos);
+	g_atomic_pointer_add(&q->queued, 1);
+
+	return TRUE;
+}
+
+/* Returns NULL if the queue is empty. Must only run in the consumer. */
+static struct srd_output_record *output_pop(struct srd_output_queue *q)
+{
+	struct srd_output_slot *slot;
+	struct srd_output_record *rec;
+	gsize pos, seq;
+
+	pos = (gsize)g_atomic_pointer_get(&q->dequeue_pos);
+	slot = &q->slots[pos & q->mask];
+	seq = (gsize)g_atomic_pointer_get(&slot->seq);
+	if ((gssize)(seq - (pos + 1)) < 0)
+		return NULL;
+
+	rec = slot->rec;
+	slot->rec = NULL;
+	g_atomic_pointer_set(&slot->seq, pos + q->mask + 1);
+	g_atomic_pointer_set(&q->dequeue_pos, pos + 1);
+
+	return rec;
+}
+
+static void output_dispatch(struct srd_session *sess,
+		struct srd_proto_data *pdata, int output_type)
+{
+	struct srd_pd_callback *cb;
+
+	/* The frontend may detach sinks while decoder threads deliver. */
+	g_rw_lock_reader_lock(&sess->sinks_lock);
+	if (output_type == SRD_OUTPUT_ANN) {
+		srd_annstore_add(sess, pdata);
+		srd_spill_add(sess, pdata);
+		srd_search_add(sess, pdata);
+	}
+	if (sess->exporters)
+		srd_export_add(sess, pdata, output_type);
+	g_rw_lock_reader_unlock(&sess->sinks_lock);
+
+	if ((cb = srd_pd_output_callback_find(sess, output_type)))
+		cb->cb(pdata, cb->cb_data);
+}
+
+static void output_payload_release(void *data, int output_type)
+{
+	struct srd_proto_data_annotation *pda;
+	struct srd_proto_data_binary *pdb;
+	struct srd_proto_data_logic *pdl;
+
+	if (!data)
+		return;
+
+	switch (output_type) {
+	case SRD_OUTPUT_ANN:
+		pda = data;
+		if (pda->ann_text)
+			g_strfreev(pda->ann_text);
+		pda->ann_text = NULL;
+		break;
+	case SRD_OUTPUT_BINARY:
+		pdb = data;
+		g_free((void *)pdb->data);
+		pdb->data = NULL;
+		break;
+	case SRD_OUTPUT_LOGIC:
+		pdl = data;
+		g_free((void *)pdl->data);
+		pdl->data = NULL;
+		break;
+	case SRD_OUTPUT_META:
+		g_variant_unref(data);
+		break;
+	default:
+		break;
+	}
+}
+
+/* The record's output type is used, the instance may be gone already. */
+static void output_record_free(struct srd_output_record *rec)
+{
+	output_payload_release(rec->pdata.data, rec->output_type);
+	g_free(rec);
+}
+
+/*
+ * Deliver up to max_records queued records (0: no limit). Must only run
+ * in the consumer, i.e. the delivery thread or the polling caller.
+ */
+static unsigned int output_deliver(struct srd_output_queue *q,
+		unsigned int max_records)
+{
+	struct srd_output_record *rec;
+	unsigned int count;
+
+	count = 0;
+	while (!max_records || count < max_records) {
+		if (!(rec = output_pop(q)))
+			break;
+		/* A producer may be waiting for this slot. */
+		if (g_atomic_int_get(&q->waiters))
+			output_wake(q);
+		output_dispatch(q->sess, &rec->pdata, rec->output_type);
+		output_record_free(rec);
+		g_atomic_pointer_add(&q->delivered, 1);
+		count++;
+	}
+
+	/* EOF waiters check the delivered counter. */
+	if (count && g_atomic_int_get(&q->waiters))
+		output_wake(q);
+
+	return count;
+}
+
+static gpointer output_thread(gpointer data)
+{
+	struct srd_output_queue *q;
+	gboolean stop;
+
+	q = data;
+
+	for (;;) {
+		if (output_deliver(q, 0))
+			continue;
+
+		/*
+		 * Sleep until a producer publishes into the empty queue, it
+		 * sees consumer_waiting and wakes us, or until terminated.
+		 */
+		g_mutex_lock(&q->mutex);
+		g_atomic_int_set(&q->consumer_waiting, 1);
+		while (!output_occupancy(q) && !q->want_terminate)
+			g_cond_wait(&q->cond, &q->mutex);
+		g_atomic_int_set(&q->consumer_waiting, 0);
+		stop = q->want_terminate && !output_occupancy(q);
+		g_mutex_unlock(&q->mutex);
+		if (stop)
+			break;
+	}
+
+	return NULL;
+}
+
+static struct srd_output_queue *output_queue_new(struct srd_session *sess,
+		int delivery, int overflow, unsigned int queue_size)
+{
+	struct srd_output_queue *q;
+	gsize size, i;
+
+	/* Round up to a power of two, the position is masked. */
+	size = 2;
+	while (size < queue_size)
+		size <<= 1;
+
+	q = g_malloc0(sizeof(*q));
+	if (!(q->slots = g_try_malloc(size * sizeof(*q->slots)))) {
+		srd_err("Cannot allocate output queue of %" G_GSIZE_FORMAT
+			" records.", size);
+		g_free(q);
+		return NULL;
+	}
+	for (i = 0; i < size; i++) {
+		q->slots[i].seq = i;
+		q->slots[i].rec = NULL;
+	}
+	q->mask = size - 1;
+	q->sess = sess;
+	q->delivery = delivery;
+	q->overflow = overflow;
+	g_mutex_init(&q->mutex);
+	g_cond_init(&q->cond);
+
+	if (delivery == SRD_OUTPUT_DELIVERY_THREAD) {
+		q->thread = srd_thread_spawn(sess, NULL, "srd-output",
+			output_thread, q);
+		if (!q->thread) {
+			g_cond_clear(&q->cond);
+			g_mutex_clear(&q->mutex);
+			g_free(q->slots);
+			g_free(q);
+			return NULL;
+		}
+	}
+
+	return q;
+}
+
+static void output_queue_free(struct srd_output_queue *q)
+{
+	struct srd_output_record *rec;
+
+	if (q->thread) {
+		/* The thread delivers what is left before it returns. */
+		g_mutex_lock(&q->mutex);
+		q->want_terminate = TRUE;
+		g_cond_broadcast(&q->cond);
+		g_mutex_unlock(&q->mutex);
+		srd_thread_join(q->thread);
+		q->thread = NULL;
+	}
+
+	/* Records which nobody polled are discarded. */
+	while ((rec = output_pop(q)))
+		output_record_free(rec);
+
+	g_cond_clear(&q->cond);
+	g_mutex_clear(&q->mutex);
+	g_free(q->slots);
+	g_free(q);
+}
+
+/**
+ * Check whether put() needs to convert output of a given type.
+ *
+ * @private
+ */
+SRD_PRIV gboolean srd_output_wanted(struct srd_session *sess, int output_type)
+{
+	gboolean wanted;
+
+	g_rw_lock_reader_lock(&sess->sinks_lock);
+	wanted = (output_type == SRD_OUTPUT_ANN &&
+			(sess->annstore || sess->spill || sess->search)) ||
+		srd_export_wanted(sess, output_type);
+	g_rw_lock_reader_unlock(&sess->sinks_lock);
+	if (wanted)
+		return TRUE;
+	if (srd_rcache_recording(sess))
+		return TRUE;
+
+	return srd_pd_output_callback_find(sess, output_type) != NULL;
+}
+
+/**
+ * Release the payload of converted decoder output.
+ *
+ * @param pdata The output, as filled in by put(). Its data field points
+ *              to the payload, which is released but not freed itself.
+ *
+ * @private
+ */
+SRD_PRIV void srd_output_release(struct srd_proto_data *pdata)
+{
+	output_payload_release(pdata->data, pdata->pdo->output_type);
+	if (pdata->pdo->output_type == SRD_OUTPUT_META)
+		pdata->data = NULL;
+}
+
+/**
+ * Hand converted decoder output over for delivery to the frontend.
+ *
+ * The payload is taken over: it is either released after the callback
+ * returned, or moved into a queued record. Must be called without
+ * holding the GIL, as it may run the callback or wait for queue space.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param pdata The output. Must not be NULL, SRD_OUTPUT_PYTHON is not
+ *              supported.
+ *
+ * @private
+ */
+SRD_PRIV void srd_output_submit(struct srd_session *sess,
+		struct srd_proto_data *pdata)
+{
+	struct srd_output_queue *q;
+	struct srd_output_record *rec;
+	int output_type;
+
+	output_type = pdata->pdo->output_type;
+	q = sess->outq;
+
+	/* A cache entry holds all output, also what is dropped or queued. */
+	if (sess->rcache)
+		srd_rcache_add(sess, pdata, output_type);
+
+	if (!q) {
+		output_dispatch(sess, pdata, output_type);
+		srd_output_release(pdata);
+		return;
+	}
+
+	rec = g_malloc(sizeof(*rec));
+	rec->pdata = *pdata;
+	rec->output_type = output_type;
+	switch (output_type) {
+	case SRD_OUTPUT_ANN:
+		rec->u.ann = *(struct srd_proto_data_annotation *)pdata->data;
+		rec->pdata.data = &rec->u.ann;
+		break;
+	case SRD_OUTPUT_BINARY:
+		rec->u.bin = *(struct srd_proto_data_binary *)pdata->data;
+		rec->pdata.data = &rec->u.bin;
+		break;
+	case SRD_OUTPUT_LOGIC:
+		rec->u.logic = *(struct srd_proto_data_logic *)pdata->data;
+		rec->pdata.data = &rec->u.logic;
+		break;
+	default:
+		/* The meta GVariant reference moves as is. */
+		break;
+	}
+
+	while (!output_push(q, rec)) {
+		if (q->overflow == SRD_OUTPUT_OVERFLOW_DROP) {
+			g_atomic_pointer_add(&q->dropped, 1);
+			output_record_free(rec);
+			return;
+		}
+		g_mutex_lock(&q->mutex);
+		g_atomic_int_inc(&q->waiters);
+		if (output_occupancy(q) > q->mask)
+			g_cond_wait_until(&q->cond, &q->mutex,
+				g_get_monotonic_time() + OUTPUT_WAIT_USEC);
+		g_atomic_int_add(&q->waiters, -1);
+		g_mutex_unlock(&q->mutex);
+	}
+
+	if (g_atomic_int_get(&q->consumer_waiting))
+		output_wake(q);
+}
+
+/**
+ * Wait until the delivery thread has passed all queued records on.
+ *
+ * Does nothing unless the session uses SRD_OUTPUT_DELIVERY_THREAD.
+ *
+ * @private
+ */
+SRD_PRIV void srd_output_sync(struct srd_session *sess)
+{
+	struct srd_output_queue *q;
+	gsize done;
+
+	q = sess->outq;
+	if (!q || !q->thread)
+		return;
+
+	g_mutex_lock(&q->mutex);
+	g_atomic_int_inc(&q->waiters);
+	for (;;) {
+		done = (gsize)g_atomic_pointer_get(&q->delivered);
+		if (done == (gsize)g_atomic_pointer_get(&q->queued))
+			break;
+		g_cond_wait_until(&q->cond, &q->mutex,
+			g_get_monotonic_time() + OUTPUT_WAIT_USEC);
+	}
+	g_atomic_int_add(&q->waiters, -1);
+	g_mutex_unlock(&q->mutex);
+}
+
+/**
+ * Stop the delivery of a session's output and release the queue.
+ *
+ * The delivery thread passes queued records on before it stops, records
+ * which were never polled are discarded. Must be called before the
+ * session's decoder instances are freed.
+ *
+ * @private
+ */
+SRD_PRIV void srd_output_free(struct srd_session *sess)
+{
+	if (!sess->outq)
+		return;
+
+	output_queue_free(sess->outq);
+	sess->outq = NULL;
+}
+
+/**
+ * Select how decoder output reaches the frontend callbacks.
+ *
+ * With SRD_OUTPUT_DELIVERY_SYNC (the default) the callbacks run inside
+ * the decoders' put() calls, in the decoder worker threads. The other
+ * modes convert the output into self-contained records and append them
+ * to a bounded queue, so that slow callbacks don't stall the decoders.
+ * SRD_OUTPUT_DELIVERY_THREAD runs the callbacks in a single delivery
+ * thread of the session, SRD_OUTPUT_DELIVERY_POLL leaves it to the
+ * frontend to call srd_session_poll_output().
+ *
+ * Records are delivered in the order in which they were queued. Output
+ * of type SRD_OUTPUT_PYTHON is always delivered synchronously.
+ *
+ * In SRD_OUTPUT_DELIVERY_THREAD mode srd_session_send_eof() returns
+ * after all queued records were delivered. When polling with the
+ * SRD_OUTPUT_OVERFLOW_BLOCK policy, srd_session_poll_output() must be
+ * called from another thread than srd_session_send(), or the decoders
+ * may wait for queue space forever.
+ *
+ * Must be called before srd_session_start().
+ *
+ * @param sess The session to configure. Must not be NULL.
+ * @param delivery The delivery mode, see enum srd_output_delivery.
+ * @param overflow What to do when the queue is full, see
+ *                 enum srd_output_overflow.
+ * @param queue_size Number of records the queue can hold, rounded up to
+ *                   a power of two. 0 selects a default size.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *         SRD_ERR if the queue or the delivery thread cannot be created.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_output_delivery_set(struct srd_session *sess,
+		int delivery, int overflow, unsigned int queue_size)
+{
+	struct srd_output_queue *q;
+
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	if (delivery < SRD_OUTPUT_DELIVERY_SYNC ||
+			delivery > SRD_OUTPUT_DELIVERY_POLL)
+		return SRD_ERR_ARG;
+
+	if (overflow != SRD_OUTPUT_OVERFLOW_BLOCK &&
+			overflow != SRD_OUTPUT_OVERFLOW_DROP)
+		return SRD_ERR_ARG;
+
+	srd_output_free(sess);
+
+	if (delivery == SRD_OUTPUT_DELIVERY_SYNC) {
+		srd_dbg("Synchronous output delivery for session %d.",
+			sess->session_id);
+		return SRD_OK;
+	}
+
+	if (!queue_size)
+		queue_size = OUTPUT_QUEUE_DEFAULT;
+
+	if (!(q = output_queue_new(sess, delivery, overflow, queue_size)))
+		return SRD_ERR;
+
+	srd_dbg("Queued output delivery (%s, %s when full, %" G_GSIZE_FORMAT
+		" records) for session %d.",
+		delivery == SRD_OUTPUT_DELIVERY_THREAD ? "thread" : "poll",
+		overflow == SRD_OUTPUT_OVERFLOW_DROP ? "drop" : "block",
+		q->mask + 1, sess->session_id);
+
+	sess->outq = q;
+
+	return SRD_OK;
+}
+
+/**
+ * Pass queued output records on to the frontend callbacks.
+ *
+ * The callbacks run in the calling thread. Only one thread at a time
+ * may poll a session.
+ *
+ * @param sess The session. Must not be NULL, and must be configured for
+ *             SRD_OUTPUT_DELIVERY_POLL.
+ * @param max_records The maximum number of records to deliver, 0 for
+ *                    all records which are currently queued.
+ *
+ * @return The number of delivered records, or a (negative) error code.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_poll_output(struct srd_session *sess,
+		unsigned int max_records)
+{
+	unsigned int count;
+
+	if (!sess || !sess->outq)
+		return SRD_ERR_ARG;
+
+	if (sess->outq->delivery != SRD_OUTPUT_DELIVERY_POLL)
+		return SRD_ERR_ARG;
+
+	count = output_deliver(sess->outq, max_records);
+
+	return (int)MIN(count, (unsigned int)G_MAXINT);
+}
+
+/**
+ * Get the counters of a session's output queue.
+ *
+ * All counters are zero in SRD_OUTPUT_DELIVERY_SYNC mode. The values
+ * are snapshots, they may change while decoders are running.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param stats Pointer to a struct which receives the counters.
+ *              Must not be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_output_stats_get(struct srd_session *sess,
+		struct srd_output_stats *stats)
+{
+	struct srd_output_queue *q;
+
+	if (!sess || !stats)
+		return SRD_ERR_ARG;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!(q = sess->outq))
+		return SRD_OK;
+
+	stats->capacity = q->mask + 1;
+	stats->occupancy = output_occupancy(q);
+	stats->high_water = (gsize)g_atomic_pointer_get(&q->high_water);
+	stats->queued = (gsize)g_atomic_pointer_get(&q->queued);
+	stats->delivered = (gsize)g_atomic_pointer_get(&q->delivered);
+	stats->dropped = (gsize)g_atomic_pointer_get(&q->dropped);
+
+	return SRD_OK;
+}
+
+/** @} */
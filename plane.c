@@ -0,0 +1,223 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file
+ *
+ * Helpers which scan the per-channel bit-planes of input chunks.
+ *
+ * Sample i of a plane is bit (i % 8) of byte (i / 8), so loading eight
+ * bytes in little endian order yields 64 consecutive samples per word.
+ * A channel's view may start at any bit of its buffer (bit_offset),
+ * and may have its samples further apart than one bit (bit_stride),
+ * e.g. to decode a window of a buffer or one channel of interleaved
+ * samples in place. Packed planes take the word-parallel
+ * paths, strided ones are read a sample at a time.
+ */
+
+/* Bit of the buffer which holds sample idx of the chunk. */
+static inline uint64_t plane_bit(const struct srd_input_view *in,
+		uint64_t idx)
+{
+	if (in->bit_stride > 1)
+		return in->bit_offset + idx * in->bit_stride;
+
+	return in->bit_offset + idx;
+}
+
+/** @private */
+SRD_PRIV uint64_t srd_plane_load64(const uint8_t *data, uint64_t idx)
+{
+	uint64_t word;
+
+	/* Caller ensures idx is a multiple of 8. */
+	memcpy(&word, data + (idx >> 3), sizeof(word));
+
+	return GUINT64_FROM_LE(word);
+}
+
+/**
+ * Get one sample of a channel.
+ *
+ * @param in The channel's input data. Must not be NULL.
+ * @param idx The sample index relative to the start of the chunk.
+ *
+ * @return The sample value (0/1).
+ *
+ * @private
+ */
+SRD_PRIV uint8_t srd_plane_sample(const struct srd_input_view *in, uint64_t idx)
+{
+	uint64_t bit;
+
+	if (!in->data)
+		return in->constant ? 1 : 0;
+
+	bit = plane_bit(in, idx);
+
+	return (in->data[bit >> 3] >> (bit & 7)) & 1;
+}
+
+/**
+ * Get up to 64 consecutive samples of a channel as a word.
+ *
+ * Reads only the bytes which hold the requested samples, so it is safe
+ * at the end of a chunk.
+ *
+ * @param in The channel's input data. Must not be NULL.
+ * @param idx Index of the first sample.
+ * @param count Number of samples, 1 to 64.
+ *
+ * @return Sample idx + n in bit n, bits from count on are zero.
+ *
+ * @private
+ */
+SRD_PRIV uint64_t srd_plane_word(const struct srd_input_view *in,
+		uint64_t idx, unsigned int count)
+{
+	uint64_t word, mask, bit;
+	unsigned int i, shift, nbytes;
+	const uint8_t *p;
+
+	mask = (count >= 64) ? ~(uint64_t)0 : ((uint64_t)1 << count) - 1;
+	if (!in->data)
+		return in->constant ? mask : 0;
+
+	if (in->bit_stride > 1) {
+		word = 0;
+		for (i = 0; i < count; i++)
+			word |= (uint64_t)srd_plane_sample(in, idx + i) << i;
+		return word;
+	}
+
+	bit = plane_bit(in, idx);
+	shift = bit & 7;
+	if (!shift && count >= 64)
+		return srd_plane_load64(in->data, bit);
+
+	/* The bytes which hold the samples, up to 9 when not aligned. */
+	p = in->data + (bit >> 3);
+	nbytes = (shift + count + 7) / 8;
+	word = 0;
+	for (i = 0; i < MIN(nbytes, 8); i++)
+		word |= (uint64_t)p[i] << (8 * i);
+	word >>= shift;
+	if (nbytes > 8)
+		word |= (uint64_t)p[8] << (64 - shift);
+
+	return word & mask;
+}
+
+/* Find the first bit with a given value in [start, end) of a buffer. */
+static uint64_t plane_find_bit(const uint8_t *data, uint64_t start,
+		uint64_t end, uint8_t value)
+{
+	uint64_t i, word, flip;
+
+	/* Flip words such that matching samples are one bits. */
+	flip = value ? 0 : ~(uint64_t)0;
+
+	i = start;
+	while (i < end && (i & 63)) {
+		if (((data[i >> 3] >> (i & 7)) & 1) == value)
+			return i;
+		i++;
+	}
+
+	while (end - i >= 64) {
+		word = srd_plane_load64(data, i) ^ flip;
+		if (word)
+			return i + srd_ctz64(word);
+		i += 64;
+	}
+
+	while (i < end) {
+		if (((data[i >> 3] >> (i & 7)) & 1) == value)
+			return i;
+		i++;
+	}
+
+	return end;
+}
+
+/**
+ * Find the first sample with a given value in a range of a channel.
+ *
+ * Scans 64 samples per step in the body of the range.
+ *
+ * @param in The channel's input data. Must not be NULL.
+ * @param start Index of the first sample to check.
+ * @param end Index after the last sample to check.
+ * @param value The sample value (0/1) to look for.
+ *
+ * @return The index of the first matching sample, or 'end' if there is
+ *         none in the range.
+ *
+ * @private
+ */
+SRD_PRIV uint64_t srd_plane_find_value(const struct srd_input_view *in,
+		uint64_t start, uint64_t end, uint8_t value)
+{
+	uint64_t i;
+
+	if (start >= end)
+		return end;
+	if (!in->data)
+		return ((in->constant ? 1 : 0) == value) ? start : end;
+
+	if (in->bit_stride > 1) {
+		for (i = start; i < end; i++) {
+			if (srd_plane_sample(in, i) == value)
+				return i;
+		}
+		return end;
+	}
+
+	return plane_find_bit(in->data, in->bit_offset + start,
+		in->bit_offset + end, value) - in->bit_offset;
+}
+
+/**
+ * Find the first sample in a range which differs from its predecessor.
+ *
+ * @param in The channel's input data. Must not be NULL.
+ * @param start Index of the first sample to check, must be > 0.
+ * @param end Index after the last sample to check.
+ *
+ * @return The index of the first sample after a level change, or 'end'
+ *         if the channel keeps its level throughout the range.
+ *
+ * @private
+ */
+SRD_PRIV uint64_t srd_plane_find_change(const struct srd_input_view *in,
+		uint64_t start, uint64_t end)
+{
+	if (!in->data || start >= end)
+		return end;
+
+	return srd_plane_find_value(in, start, end,
+		srd_plane_sample(in, start - 1) ^ 1);
+}
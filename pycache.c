@@ -0,0 +1,319 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file
+ *
+ * Caches of the SRD_OUTPUT_PYTHON stream of decoder instances.
+ */
+
+/**
+ * @defgroup grp_pycache Python output caches
+ *
+ * Record what an instance passes to its stacked decoders, and replay it.
+ *
+ * Every put() on an SRD_OUTPUT_PYTHON output is stored as a record of
+ * start and end sample, and the data object in Python's marshal format
+ * (via the marshal module, the C API is not part of the limited API).
+ * When the options of an upper decoder change, a freshly created
+ * instance can be fed from the cache instead of decoding the whole
+ * capture again from the bottom of the stack.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+/* Record header: start sample, end sample, length of the data. */
+#define PYCACHE_HEADER_SIZE (8 + 8 + 4)
+
+struct srd_pycache {
+	/* marshal.dumps() and marshal.loads(). */
+	PyObject *py_dumps;
+	PyObject *py_loads;
+	GByteArray *data;
+	uint64_t num_records;
+	/* Set when an object could not be stored, the cache is unusable. */
+	gboolean incomplete;
+};
+
+/** @endcond */
+
+static void pycache_free(struct srd_pycache *pc)
+{
+	if (!pc)
+		return;
+
+	Py_XDECREF(pc->py_dumps);
+	Py_XDECREF(pc->py_loads);
+	g_byte_array_free(pc->data, TRUE);
+	g_free(pc);
+}
+
+/**
+ * Append a put() on an SRD_OUTPUT_PYTHON output to the cache of an
+ * instance, if it has one. The caller must hold the GIL.
+ *
+ * @private
+ */
+SRD_PRIV void srd_pycache_add(struct srd_decoder_inst *di,
+		uint64_t start_sample, uint64_t end_sample, PyObject *obj)
+{
+	struct srd_pycache *pc;
+	PyObject *py_bytes;
+	char *buf;
+	Py_ssize_t len;
+	uint8_t hdr[PYCACHE_HEADER_SIZE];
+	uint64_t v64;
+	uint32_t v32;
+
+	if (!(pc = di->pycache) || pc->incomplete)
+		return;
+
+	py_bytes = PyObject_CallFunctionObjArgs(pc->py_dumps, obj, NULL);
+	if (!py_bytes || PyBytes_AsStringAndSize(py_bytes, &buf, &len) < 0 ||
+			(uint64_t)len > G_MAXUINT32) {
+		PyErr_Clear();
+		Py_XDECREF(py_bytes);
+		srd_warn("%s: Python output can't be cached, cache disabled.",
+			di->inst_id);
+		pc->incomplete = TRUE;
+		g_byte_array_set_size(pc->data, 0);
+		pc->num_records = 0;
+		return;
+	}
+
+	v64 = GUINT64_TO_LE(start_sample);
+	memcpy(hdr, &v64, 8);
+	v64 = GUINT64_TO_LE(end_sample);
+	memcpy(hdr + 8, &v64, 8);
+	v32 = GUINT32_TO_LE((uint32_t)len);
+	memcpy(hdr + 16, &v32, 4);
+	g_byte_array_append(pc->data, hdr, sizeof(hdr));
+	g_byte_array_append(pc->data, (const guint8 *)buf, len);
+	pc->num_records++;
+	Py_DECREF(py_bytes);
+}
+
+/**
+ * Drop the records of an instance's cache, e.g. for a new capture.
+ *
+ * @private
+ */
+SRD_PRIV void srd_pycache_clear(struct srd_decoder_inst *di)
+{
+	struct srd_pycache *pc;
+
+	if (!(pc = di->pycache))
+		return;
+
+	g_byte_array_set_size(pc->data, 0);
+	pc->num_records = 0;
+	pc->incomplete = FALSE;
+}
+
+/** @private */
+SRD_PRIV void srd_pycache_free(struct srd_decoder_inst *di)
+{
+	pycache_free(di->pycache);
+	di->pycache = NULL;
+}
+
+/**
+ * Enable or disable caching of an instance's SRD_OUTPUT_PYTHON stream.
+ *
+ * Enable it before the session is started, such that the cache covers
+ * the whole capture. Disabling drops the recorded data.
+ *
+ * @param di The decoder instance. Must not be NULL.
+ * @param enable TRUE to record the instance's Python output.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_inst_pycache_set(struct srd_decoder_inst *di, gboolean enable)
+{
+	PyGILState_STATE gstate;
+	struct srd_pycache *pc;
+	PyObject *py_mod;
+	int ret;
+
+	if (!di)
+		return SRD_ERR_ARG;
+
+	/* The cache is only touched with the GIL held. */
+	gstate = PyGILState_Ensure();
+	ret = SRD_OK;
+	if (!enable) {
+		srd_pycache_free(di);
+	} else if (!di->pycache) {
+		pc = g_malloc0(sizeof(*pc));
+		pc->data = g_byte_array_new();
+		if ((py_mod = PyImport_ImportModule("marshal"))) {
+			pc->py_dumps = PyObject_GetAttrString(py_mod, "dumps");
+			pc->py_loads = PyObject_GetAttrString(py_mod, "loads");
+			Py_DECREF(py_mod);
+		}
+		if (!pc->py_dumps || !pc->py_loads) {
+			srd_exception_catch("Failed to get marshal functions");
+			pycache_free(pc);
+			ret = SRD_ERR_PYTHON;
+		} else {
+			di->pycache = pc;
+		}
+	}
+	PyGILState_Release(gstate);
+
+	return ret;
+}
+
+/**
+ * Get the size of an instance's Python output cache.
+ *
+ * @param di The decoder instance. Must not be NULL.
+ * @param records Pointer which receives the number of records. Can be NULL.
+ * @param bytes Pointer which receives the size of the data. Can be NULL.
+ *
+ * @return SRD_OK upon success, SRD_ERR if caching is disabled or some
+ *         output could not be cached, SRD_ERR_ARG upon bogus arguments.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_inst_pycache_size_get(struct srd_decoder_inst *di,
+		uint64_t *records, uint64_t *bytes)
+{
+	PyGILState_STATE gstate;
+	int ret;
+
+	if (!di)
+		return SRD_ERR_ARG;
+
+	gstate = PyGILState_Ensure();
+	ret = SRD_ERR;
+	if (di->pycache && !di->pycache->incomplete) {
+		if (records)
+			*records = di->pycache->num_records;
+		if (bytes)
+			*bytes = di->pycache->data->len;
+		ret = SRD_OK;
+	}
+	PyGILState_Release(gstate);
+
+	return ret;
+}
+
+/**
+ * Feed the cached Python output of an instance into another instance.
+ *
+ * Calls the target's decode() with every recorded (ss, es, data) in
+ * the order they were put, just like a stacked decoder would have been
+ * called. The target usually is a freshly configured instance of the
+ * upper decoder, in a session of its own which was started and gets
+ * srd_session_send_eof() after the replay. Its output reaches that
+ * session's callbacks, and the decoders stacked on top of it.
+ *
+ * @param di The instance whose output was cached. Must not be NULL.
+ * @param target The instance to feed. Must not be NULL, must not be
+ *               stacked on top of di.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_inst_pycache_replay(struct srd_decoder_inst *di,
+		struct srd_decoder_inst *target)
+{
+	PyGILState_STATE gstate;
+	struct srd_pycache *pc;
+	PyObject *py_bytes, *py_data, *py_res;
+	const uint8_t *p, *end;
+	uint64_t start_sample, end_sample, v64;
+	uint32_t len;
+	int ret;
+
+	if (!di || !target || di == target)
+		return SRD_ERR_ARG;
+	if (g_slist_find(di->next_di, target)) {
+		srd_err("%s is stacked on %s, replay would duplicate its input.",
+			target->inst_id, di->inst_id);
+		return SRD_ERR_ARG;
+	}
+
+	gstate = PyGILState_Ensure();
+
+	if (!(pc = di->pycache) || pc->incomplete) {
+		srd_err("%s has no usable Python output cache.", di->inst_id);
+		PyGILState_Release(gstate);
+		return SRD_ERR;
+	}
+
+	srd_dbg("Replaying %" G_GUINT64_FORMAT " records of %s into %s.",
+		pc->num_records, di->inst_id, target->inst_id);
+
+	ret = SRD_OK;
+	p = pc->data->data;
+	end = p + pc->data->len;
+	while (end - p >= PYCACHE_HEADER_SIZE) {
+		memcpy(&v64, p, 8);
+		start_sample = GUINT64_FROM_LE(v64);
+		memcpy(&v64, p + 8, 8);
+		end_sample = GUINT64_FROM_LE(v64);
+		memcpy(&len, p + 16, 4);
+		len = GUINT32_FROM_LE(len);
+		p += PYCACHE_HEADER_SIZE;
+
+		py_bytes = PyBytes_FromStringAndSize((const char *)p, len);
+		p += len;
+		py_data = NULL;
+		if (py_bytes)
+			py_data = PyObject_CallFunctionObjArgs(pc->py_loads,
+				py_bytes, NULL);
+		Py_XDECREF(py_bytes);
+		if (!py_data) {
+			srd_exception_catch("Reading cached output of %s failed",
+				di->inst_id);
+			ret = SRD_ERR_PYTHON;
+			break;
+		}
+		py_res = PyObject_CallMethod(target->py_inst, "decode", "KKO",
+			start_sample, end_sample, py_data);
+		Py_DECREF(py_data);
+		if (!py_res) {
+			srd_exception_catch("Calling %s decode() failed",
+				target->inst_id);
+			ret = SRD_ERR_PYTHON;
+			break;
+		}
+		Py_DECREF(py_res);
+	}
+
+	PyGILState_Release(gstate);
+
+	return ret;
+}
+
+/** @} */
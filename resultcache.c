@@ -0,0 +1,918 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @file
+ *
+ * Caching of decoder output across sessions.
+ */
+
+/**
+ * @defgroup grp_resultcache Result cache
+ *
+ * Keep the output of a decoder stack on disk, keyed by its input.
+ *
+ * srd_session_decode_cached() computes a SHA-256 digest over the sample
+ * data, the samplerate, and the session's decoder stacks: decoder ids,
+ * the contents of the decoders' Python sources (there is no version
+ * field in a decoder, a changed pd.py must not hit an old entry),
+ * options and channel maps. If <dir>/<digest>.srdc exists, its records
+ * are delivered to the session's callbacks, stores and exporters like
+ * the decoders' output would have been, without running any decoder.
+ * Otherwise the capture is decoded and all output which reaches the
+ * frontend is recorded into that file.
+ *
+ * File layout, all integers little endian:
+ *
+ * - header: magic "SRDRCACH", u32 version, u32 reserved,
+ * - records: u32 output index, u64 start sample, u64 end sample, and
+ *   the payload of the output's type,
+ * - output table: per output u32 length and the instance id, u32
+ *   pdo_id and u32 output type,
+ * - trailer: u64 offset of the output table, u32 number of outputs,
+ *   u64 number of records, magic "SRDRCEND".
+ *
+ * Entries are written to a temporary file and renamed when complete,
+ * concurrent sessions never see partial entries.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+#define RCACHE_VERSION 1
+#define RCACHE_HEADER_SIZE 16
+#define RCACHE_TRAILER_SIZE (8 + 4 + 8 + 8)
+
+static const char rcache_magic[] = "SRDRCACH";
+static const char rcache_magic_end[] = "SRDRCEND";
+
+struct srd_rcache {
+	char *dir;
+	/* Serializes the recorder, dispatch may run on the output thread. */
+	GMutex mutex;
+	FILE *fp;
+	char *path;
+	char *tmp_path;
+	/* Output index + 1 by pdo, and the outputs in index order. */
+	GHashTable *pdo_index;
+	GPtrArray *pdos;
+	GByteArray *rec;
+	uint64_t num_records;
+	/* Set upon a write error, the entry gets discarded. */
+	gboolean failed;
+};
+
+/** @endcond */
+
+static void rcache_put_u32(GByteArray *buf, uint32_t v)
+{
+	v = GUINT32_TO_LE(v);
+	g_byte_array_append(buf, (const guint8 *)&v, 4);
+}
+
+static void rcache_put_u64(GByteArray *buf, uint64_t v)
+{
+	v = GUINT64_TO_LE(v);
+	g_byte_array_append(buf, (const guint8 *)&v, 8);
+}
+
+static void rcache_put_bytes(GByteArray *buf, const void *data, uint32_t len)
+{
+	rcache_put_u32(buf, len);
+	if (len)
+		g_byte_array_append(buf, data, len);
+}
+
+/* Bounds checked reads, *p is advanced, FALSE upon truncated data. */
+static gboolean rcache_get_u32(const uint8_t **p, const uint8_t *end,
+		uint32_t *v)
+{
+	if (end - *p < 4)
+		return FALSE;
+	memcpy(v, *p, 4);
+	*v = GUINT32_FROM_LE(*v);
+	*p += 4;
+
+	return TRUE;
+}
+
+static gboolean rcache_get_u64(const uint8_t **p, const uint8_t *end,
+		uint64_t *v)
+{
+	if (end - *p < 8)
+		return FALSE;
+	memcpy(v, *p, 8);
+	*v = GUINT64_FROM_LE(*v);
+	*p += 8;
+
+	return TRUE;
+}
+
+static gboolean rcache_get_bytes(const uint8_t **p, const uint8_t *end,
+		const uint8_t **data, uint32_t *len)
+{
+	if (!rcache_get_u32(p, end, len) || (uint64_t)(end - *p) < *len)
+		return FALSE;
+	*data = *p;
+	*p += *len;
+
+	return TRUE;
+}
+
+/* Size of SRD_OUTPUT_LOGIC data, which isn't kept in the output. */
+static uint32_t rcache_logic_size(const struct srd_pd_output *pdo)
+{
+	return (g_slist_length(pdo->di->decoder->logic_output_channels) + 7) / 8;
+}
+
+static void rcache_recorder_close(struct srd_rcache *rc)
+{
+	if (rc->fp)
+		fclose(rc->fp);
+	rc->fp = NULL;
+	if (rc->tmp_path)
+		g_unlink(rc->tmp_path);
+	g_free(rc->tmp_path);
+	rc->tmp_path = NULL;
+	g_free(rc->path);
+	rc->path = NULL;
+	if (rc->pdo_index)
+		g_hash_table_destroy(rc->pdo_index);
+	rc->pdo_index = NULL;
+	if (rc->pdos)
+		g_ptr_array_free(rc->pdos, TRUE);
+	rc->pdos = NULL;
+	if (rc->rec)
+		g_byte_array_free(rc->rec, TRUE);
+	rc->rec = NULL;
+}
+
+static int rcache_recorder_open(struct srd_rcache *rc, const char *path)
+{
+	GByteArray *hdr;
+	int fd;
+
+	rc->path = g_strdup(path);
+	rc->tmp_path = g_strconcat(path, ".XXXXXX", NULL);
+	fd = g_mkstemp(rc->tmp_path);
+	if (fd < 0 || !(rc->fp = fdopen(fd, "wb"))) {
+		srd_err("Cannot create result cache file %s: %s.",
+			rc->tmp_path, g_strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+			g_unlink(rc->tmp_path);
+		}
+		g_free(rc->tmp_path);
+		rc->tmp_path = NULL;
+		rcache_recorder_close(rc);
+		return SRD_ERR;
+	}
+	rc->pdo_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+	rc->pdos = g_ptr_array_new();
+	rc->rec = g_byte_array_new();
+	rc->num_records = 0;
+	rc->failed = FALSE;
+
+	hdr = rc->rec;
+	g_byte_array_append(hdr, (const guint8 *)rcache_magic, 8);
+	rcache_put_u32(hdr, RCACHE_VERSION);
+	rcache_put_u32(hdr, 0);
+	if (fwrite(hdr->data, hdr->len, 1, rc->fp) != 1)
+		rc->failed = TRUE;
+	g_byte_array_set_size(hdr, 0);
+
+	return SRD_OK;
+}
+
+/* Write the output table and trailer, and move the entry in place. */
+static int rcache_recorder_finish(struct srd_rcache *rc)
+{
+	struct srd_pd_output *pdo;
+	GByteArray *buf;
+	long offset;
+	unsigned int i;
+	int ret;
+
+	buf = rc->rec;
+	g_byte_array_set_size(buf, 0);
+	if ((offset = ftell(rc->fp)) < 0)
+		rc->failed = TRUE;
+	for (i = 0; i < rc->pdos->len; i++) {
+		pdo = g_ptr_array_index(rc->pdos, i);
+		rcache_put_bytes(buf, pdo->di->inst_id, strlen(pdo->di->inst_id));
+		rcache_put_u32(buf, pdo->pdo_id);
+		rcache_put_u32(buf, pdo->output_type);
+	}
+	rcache_put_u64(buf, offset);
+	rcache_put_u32(buf, rc->pdos->len);
+	rcache_put_u64(buf, rc->num_records);
+	g_byte_array_append(buf, (const guint8 *)rcache_magic_end, 8);
+	if (fwrite(buf->data, buf->len, 1, rc->fp) != 1)
+		rc->failed = TRUE;
+	if (fclose(rc->fp) != 0)
+		rc->failed = TRUE;
+	rc->fp = NULL;
+
+	ret = SRD_ERR;
+	if (rc->failed) {
+		srd_err("Writing result cache file %s failed.", rc->tmp_path);
+	} else if (g_rename(rc->tmp_path, rc->path) != 0) {
+		srd_err("Cannot rename %s to %s: %s.", rc->tmp_path, rc->path,
+			g_strerror(errno));
+	} else {
+		srd_dbg("Stored %" G_GUINT64_FORMAT " records in %s.",
+			rc->num_records, rc->path);
+		g_free(rc->tmp_path);
+		rc->tmp_path = NULL;
+		ret = SRD_OK;
+	}
+	rcache_recorder_close(rc);
+
+	return ret;
+}
+
+/**
+ * Check whether output is being recorded into a result cache entry.
+ *
+ * @private
+ */
+SRD_PRIV gboolean srd_rcache_recording(struct srd_session *sess)
+{
+	return sess->rcache && sess->rcache->fp;
+}
+
+/**
+ * Append output which decoders submit to the cache entry which is
+ * being recorded, if any. Runs before the output is queued, so that
+ * entries are complete regardless of the output delivery.
+ *
+ * @private
+ */
+SRD_PRIV void srd_rcache_add(struct srd_session *sess,
+		const struct srd_proto_data *pdata, int output_type)
+{
+	struct srd_rcache *rc;
+	const struct srd_proto_data_annotation *pda;
+	const struct srd_proto_data_binary *pdb;
+	const struct srd_proto_data_logic *pdl;
+	const char *type;
+	GByteArray *buf;
+	gpointer idx;
+	uint32_t i, n;
+
+	if (!(rc = sess->rcache))
+		return;
+
+	g_mutex_lock(&rc->mutex);
+	if (!rc->fp || rc->failed) {
+		g_mutex_unlock(&rc->mutex);
+		return;
+	}
+
+	if (!(idx = g_hash_table_lookup(rc->pdo_index, pdata->pdo))) {
+		g_ptr_array_add(rc->pdos, pdata->pdo);
+		idx = GUINT_TO_POINTER(rc->pdos->len);
+		g_hash_table_insert(rc->pdo_index, pdata->pdo, idx);
+	}
+
+	buf = rc->rec;
+	g_byte_array_set_size(buf, 0);
+	rcache_put_u32(buf, GPOINTER_TO_UINT(idx) - 1);
+	rcache_put_u64(buf, pdata->start_sample);
+	rcache_put_u64(buf, pdata->end_sample);
+	switch (output_type) {
+	case SRD_OUTPUT_ANN:
+		pda = pdata->data;
+		n = pda->ann_text ? g_strv_length(pda->ann_text) : 0;
+		rcache_put_u32(buf, pda->ann_class);
+		rcache_put_u32(buf, pda->ann_row);
+		rcache_put_u32(buf, n);
+		for (i = 0; i < n; i++)
+			rcache_put_bytes(buf, pda->ann_text[i],
+				strlen(pda->ann_text[i]));
+		break;
+	case SRD_OUTPUT_BINARY:
+		pdb = pdata->data;
+		rcache_put_u32(buf, pdb->bin_class);
+		rcache_put_u64(buf, pdb->size);
+		g_byte_array_append(buf, pdb->data, pdb->size);
+		break;
+	case SRD_OUTPUT_LOGIC:
+		pdl = pdata->data;
+		rcache_put_u32(buf, pdl->logic_group);
+		rcache_put_u64(buf, pdl->repeat_count);
+		rcache_put_bytes(buf, pdl->data, rcache_logic_size(pdata->pdo));
+		break;
+	case SRD_OUTPUT_META:
+		type = g_variant_get_type_string(pdata->data);
+		rcache_put_bytes(buf, type, strlen(type));
+		rcache_put_bytes(buf, g_variant_get_data(pdata->data),
+			g_variant_get_size(pdata->data));
+		break;
+	default:
+		g_mutex_unlock(&rc->mutex);
+		return;
+	}
+
+	if (fwrite(buf->data, buf->len, 1, rc->fp) != 1) {
+		srd_err("Writing result cache file %s failed: %s.",
+			rc->tmp_path, g_strerror(errno));
+		rc->failed = TRUE;
+	}
+	rc->num_records++;
+	g_mutex_unlock(&rc->mutex);
+}
+
+/** @private */
+SRD_PRIV void srd_rcache_free(struct srd_session *sess)
+{
+	struct srd_rcache *rc;
+
+	if (!(rc = sess->rcache))
+		return;
+
+	rcache_recorder_close(rc);
+	g_mutex_clear(&rc->mutex);
+	g_free(rc->dir);
+	g_free(rc);
+	sess->rcache = NULL;
+}
+
+/**
+ * Keep the output of srd_session_decode_cached() in a directory.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param dir The cache directory, created if needed. NULL disables
+ *            the cache.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_result_cache_set(struct srd_session *sess,
+		const char *dir)
+{
+	struct srd_rcache *rc;
+
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	srd_rcache_free(sess);
+	if (!dir)
+		return SRD_OK;
+
+	if (g_mkdir_with_parents(dir, 0755) != 0) {
+		srd_err("Cannot create result cache directory %s: %s.",
+			dir, g_strerror(errno));
+		return SRD_ERR;
+	}
+
+	rc = g_malloc0(sizeof(*rc));
+	g_mutex_init(&rc->mutex);
+	rc->dir = g_strdup(dir);
+	sess->rcache = rc;
+
+	srd_dbg("Session %d: Caching results in %s.", sess->session_id, dir);
+
+	return SRD_OK;
+}
+
+static void rcache_key_u64(GChecksum *cs, uint64_t v)
+{
+	v = GUINT64_TO_LE(v);
+	g_checksum_update(cs, (const guchar *)&v, 8);
+}
+
+static void rcache_key_str(GChecksum *cs, const char *s)
+{
+	/* Including the NUL keeps adjacent strings apart. */
+	g_checksum_update(cs, (const guchar *)s, strlen(s) + 1);
+}
+
+static int rcache_name_cmp(gconstpointer a, gconstpointer b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Hash the Python sources of a decoder, i.e. the files of its package. */
+static void rcache_key_sources(GChecksum *cs, const struct srd_decoder *dec)
+{
+	char *file, *dirname, *path, *contents;
+	const char *name;
+	GPtrArray *names;
+	GDir *dir;
+	gsize len;
+	unsigned int i;
+
+	if (py_attr_as_str(dec->py_mod, "__file__", &file) != SRD_OK) {
+		/* Nothing to tell versions apart, the id has to do. */
+		srd_dbg("Decoder %s has no source file.", dec->id);
+		return;
+	}
+	dirname = g_path_get_dirname(file);
+	g_free(file);
+
+	names = g_ptr_array_new_with_free_func(g_free);
+	if ((dir = g_dir_open(dirname, 0, NULL))) {
+		while ((name = g_dir_read_name(dir))) {
+			if (g_str_has_suffix(name, ".py"))
+				g_ptr_array_add(names, g_strdup(name));
+		}
+		g_dir_close(dir);
+	}
+	g_ptr_array_sort(names, rcache_name_cmp);
+
+	for (i = 0; i < names->len; i++) {
+		path = g_build_filename(dirname, names->pdata[i], NULL);
+		if (g_file_get_contents(path, &contents, &len, NULL)) {
+			rcache_key_str(cs, names->pdata[i]);
+			rcache_key_u64(cs, len);
+			g_checksum_update(cs, (const guchar *)contents, len);
+			g_free(contents);
+		}
+		g_free(path);
+	}
+	g_ptr_array_free(names, TRUE);
+	g_free(dirname);
+}
+
+/* Hash an instance and the ones stacked on it, caller holds the GIL. */
+static void rcache_key_inst(GChecksum *cs, struct srd_decoder_inst *di)
+{
+	PyObject *py_opts, *py_repr;
+	char *repr;
+	GSList *l;
+	int i;
+
+	rcache_key_str(cs, di->decoder->id);
+	rcache_key_sources(cs, di->decoder);
+
+	repr = NULL;
+	if ((py_opts = PyObject_GetAttrString(di->py_inst, "options"))) {
+		/* The dict is filled in the decoder's option order. */
+		if ((py_repr = PyObject_Repr(py_opts))) {
+			py_str_as_str(py_repr, &repr);
+			Py_DECREF(py_repr);
+		}
+		Py_DECREF(py_opts);
+	}
+	PyErr_Clear();
+	rcache_key_str(cs, repr ? repr : "");
+	g_free(repr);
+
+	rcache_key_u64(cs, di->dec_num_channels);
+	for (i = 0; i < di->dec_num_channels; i++)
+		rcache_key_u64(cs, (uint64_t)(int64_t)di->dec_channelmap[i]);
+	rcache_key_u64(cs, MAX(di->decimation, 1));
+	rcache_key_u64(cs, di->decimation > 1 ? di->decimation_policy : 0);
+
+	rcache_key_str(cs, "{");
+	for (l = di->next_di; l; l = l->next)
+		rcache_key_inst(cs, l->data);
+	rcache_key_str(cs, "}");
+}
+
+/* Hash the samples of one channel of a chunk. */
+static void rcache_key_plane(GChecksum *cs, const struct srd_input_view *in,
+		uint64_t num_samples)
+{
+	const uint8_t *data;
+	uint64_t len, i, word;
+	unsigned int count;
+	uint8_t last;
+
+	if (!in->data) {
+		rcache_key_u64(cs, in->constant ? 1 : 0);
+		return;
+	}
+
+	rcache_key_u64(cs, 2);
+	if (in->bit_stride > 1 || in->bit_offset % 8) {
+		/* Hash the bytes a packed plane of the samples would have. */
+		for (i = 0; i < num_samples; i += 64) {
+			count = MIN(num_samples - i, 64);
+			word = GUINT64_TO_LE(srd_plane_word(in, i, count));
+			g_checksum_update(cs, (const guchar *)&word,
+				(count + 7) / 8);
+		}
+		return;
+	}
+
+	data = in->data + in->bit_offset / 8;
+	len = num_samples / 8;
+	g_checksum_update(cs, data, len);
+	if (num_samples % 8) {
+		/* Bits beyond the chunk are not part of the input. */
+		last = data[len] & ((1 << (num_samples % 8)) - 1);
+		g_checksum_update(cs, &last, 1);
+	}
+}
+
+static char *rcache_key(struct srd_session *sess, uint64_t num_samples,
+		uint64_t chunk_size, srd_sample_source source, void *cb_data)
+{
+	PyGILState_STATE gstate;
+	GChecksum *cs;
+	const struct srd_input_view *inbuf;
+	struct srd_decoder_inst *di;
+	GSList *l;
+	uint64_t pos, next;
+	int num_channels, i;
+	char *key;
+
+	cs = g_checksum_new(G_CHECKSUM_SHA256);
+	rcache_key_u64(cs, RCACHE_VERSION);
+	rcache_key_u64(cs, num_samples);
+	rcache_key_u64(cs, chunk_size);
+	rcache_key_u64(cs, sess->samplerate);
+
+	gstate = PyGILState_Ensure();
+	for (l = sess->di_list; l; l = l->next)
+		rcache_key_inst(cs, l->data);
+	PyGILState_Release(gstate);
+
+	/* The input array is indexed by the bottom decoders' channel maps. */
+	num_channels = 0;
+	for (l = sess->di_list; l; l = l->next) {
+		di = l->data;
+		for (i = 0; i < di->dec_num_channels; i++)
+			num_channels = MAX(num_channels, di->dec_channelmap[i] + 1);
+	}
+
+	for (pos = 0; pos < num_samples; pos = next) {
+		next = MIN(pos + chunk_size, num_samples);
+		if (!(inbuf = source(pos, next, cb_data))) {
+			srd_err("No sample data for %" G_GUINT64_FORMAT "-%"
+				G_GUINT64_FORMAT ".", pos, next);
+			g_checksum_free(cs);
+			return NULL;
+		}
+		for (i = 0; i < num_channels; i++)
+			rcache_key_plane(cs, &inbuf[i], next - pos);
+	}
+
+	key = g_strdup(g_checksum_get_string(cs));
+	g_checksum_free(cs);
+
+	return key;
+}
+
+/* Find the session's output which a cache entry's table refers to. */
+static struct srd_pd_output *rcache_output_find(struct srd_session *sess,
+		const char *inst_id, int pdo_id, int output_type)
+{
+	struct srd_decoder_inst *di;
+	struct srd_pd_output *pdo;
+	GSList *l;
+
+	if (!(di = srd_inst_find_by_id(sess, inst_id)))
+		return NULL;
+	for (l = di->pd_output; l; l = l->next) {
+		pdo = l->data;
+		if (pdo->pdo_id == pdo_id && pdo->output_type == output_type)
+			return pdo;
+	}
+
+	return NULL;
+}
+
+/* Parse the output table of an entry, NULL if it doesn't fit the session. */
+static struct srd_pd_output **rcache_outputs_load(struct srd_session *sess,
+		const uint8_t *data, gsize len, const uint8_t **records_end,
+		uint32_t *num_outputs)
+{
+	struct srd_pd_output **pdos;
+	const uint8_t *p, *end, *id;
+	uint64_t offset, num_records;
+	uint32_t n, i, id_len, pdo_id, output_type;
+	char *inst_id;
+
+	if (len < RCACHE_HEADER_SIZE + RCACHE_TRAILER_SIZE ||
+			memcmp(data, rcache_magic, 8) ||
+			memcmp(data + len - 8, rcache_magic_end, 8))
+		return NULL;
+	p = data + 8;
+	if (!rcache_get_u32(&p, data + len, &n) || n != RCACHE_VERSION)
+		return NULL;
+
+	p = data + len - RCACHE_TRAILER_SIZE;
+	end = data + len - 8;
+	if (!rcache_get_u64(&p, end, &offset) || !rcache_get_u32(&p, end, &n) ||
+			!rcache_get_u64(&p, end, &num_records))
+		return NULL;
+	if (offset < RCACHE_HEADER_SIZE || offset > len - RCACHE_TRAILER_SIZE)
+		return NULL;
+
+	pdos = g_malloc0((n + 1) * sizeof(*pdos));
+	p = data + offset;
+	end = data + len - RCACHE_TRAILER_SIZE;
+	for (i = 0; i < n; i++) {
+		if (!rcache_get_bytes(&p, end, &id, &id_len) ||
+				!rcache_get_u32(&p, end, &pdo_id) ||
+				!rcache_get_u32(&p, end, &output_type))
+			break;
+		inst_id = g_strndup((const char *)id, id_len);
+		pdos[i] = rcache_output_find(sess, inst_id, pdo_id, output_type);
+		if (!pdos[i])
+			srd_warn("Result cache refers to unknown output %d of %s.",
+				pdo_id, inst_id);
+		g_free(inst_id);
+		if (!pdos[i])
+			break;
+	}
+	if (i < n) {
+		g_free(pdos);
+		return NULL;
+	}
+
+	*records_end = data + offset;
+	*num_outputs = n;
+
+	return pdos;
+}
+
+/* Decode one record into an owned payload, FALSE upon bogus data. */
+static gboolean rcache_record_load(const uint8_t **p, const uint8_t *end,
+		struct srd_pd_output *pdo, struct srd_proto_data *pdata)
+{
+	struct srd_proto_data_annotation *pda;
+	struct srd_proto_data_binary *pdb;
+	struct srd_proto_data_logic *pdl;
+	const uint8_t *bytes, *type;
+	uint32_t v32, n, i, len, type_len;
+	uint64_t v64;
+	char *type_str;
+	void *copy;
+
+	switch (pdo->output_type) {
+	case SRD_OUTPUT_ANN:
+		pda = pdata->data;
+		if (!rcache_get_u32(p, end, &v32))
+			return FALSE;
+		pda->ann_class = (int32_t)v32;
+		if (!rcache_get_u32(p, end, &v32) || !rcache_get_u32(p, end, &n))
+			return FALSE;
+		pda->ann_row = (int32_t)v32;
+		if ((uint64_t)(end - *p) / 4 < n)
+			return FALSE;
+		pda->ann_text = g_malloc0((n + 1) * sizeof(char *));
+		for (i = 0; i < n; i++) {
+			if (!rcache_get_bytes(p, end, &bytes, &len)) {
+				g_strfreev(pda->ann_text);
+				pda->ann_text = NULL;
+				return FALSE;
+			}
+			pda->ann_text[i] = g_strndup((const char *)bytes, len);
+		}
+		return TRUE;
+	case SRD_OUTPUT_BINARY:
+		pdb = pdata->data;
+		if (!rcache_get_u32(p, end, &v32) || !rcache_get_u64(p, end, &v64) ||
+				(uint64_t)(end - *p) < v64)
+			return FALSE;
+		pdb->bin_class = (int32_t)v32;
+		pdb->size = v64;
+		pdb->data = g_malloc(v64);
+		memcpy((void *)pdb->data, *p, v64);
+		*p += v64;
+		return TRUE;
+	case SRD_OUTPUT_LOGIC:
+		pdl = pdata->data;
+		if (!rcache_get_u32(p, end, &v32) || !rcache_get_u64(p, end, &v64) ||
+				!rcache_get_bytes(p, end, &bytes, &len) ||
+				len != rcache_logic_size(pdo))
+			return FALSE;
+		pdl->logic_group = (int32_t)v32;
+		pdl->repeat_count = v64;
+		pdl->data = g_malloc(len ? len : 1);
+		memcpy((void *)pdl->data, bytes, len);
+		return TRUE;
+	case SRD_OUTPUT_META:
+		if (!rcache_get_bytes(p, end, &type, &type_len) ||
+				!rcache_get_bytes(p, end, &bytes, &len))
+			return FALSE;
+		type_str = g_strndup((const char *)type, type_len);
+		if (!g_variant_type_string_is_valid(type_str)) {
+			g_free(type_str);
+			return FALSE;
+		}
+		copy = g_malloc(len ? len : 1);
+		memcpy(copy, bytes, len);
+		pdata->data = g_variant_ref_sink(g_variant_new_from_data(
+			G_VARIANT_TYPE(type_str), copy, len, FALSE, g_free, copy));
+		g_free(type_str);
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/*
+ * Deliver the records of a cache entry. Returns FALSE if the entry
+ * doesn't fit the session, in which case nothing was delivered.
+ */
+static gboolean rcache_replay(struct srd_session *sess, const char *path)
+{
+	GMappedFile *mf;
+	struct srd_pd_output **pdos;
+	struct srd_proto_data pdata;
+	struct srd_proto_data_annotation pda;
+	struct srd_proto_data_binary pdb;
+	struct srd_proto_data_logic pdl;
+	const uint8_t *data, *p, *end;
+	uint64_t count;
+	uint32_t num_outputs, idx;
+	gsize len;
+	int pass;
+
+	if (!(mf = g_mapped_file_new(path, FALSE, NULL)))
+		return FALSE;
+	data = (const uint8_t *)g_mapped_file_get_contents(mf);
+	len = g_mapped_file_get_length(mf);
+
+	if (!(pdos = rcache_outputs_load(sess, data, len, &end,
+			&num_outputs))) {
+		srd_warn("Ignoring unusable result cache file %s.", path);
+		g_mapped_file_unref(mf);
+		return FALSE;
+	}
+
+	/* Check all records first, a bogus entry must not deliver anything. */
+	for (pass = 0; pass < 2; pass++) {
+		p = data + RCACHE_HEADER_SIZE;
+		count = 0;
+		while (p < end) {
+			if (!rcache_get_u32(&p, end, &idx) || idx >= num_outputs ||
+					!rcache_get_u64(&p, end, &pdata.start_sample) ||
+					!rcache_get_u64(&p, end, &pdata.end_sample))
+				break;
+			pdata.pdo = pdos[idx];
+			switch (pdata.pdo->output_type) {
+			case SRD_OUTPUT_ANN:
+				pdata.data = &pda;
+				break;
+			case SRD_OUTPUT_BINARY:
+				pdata.data = &pdb;
+				break;
+			case SRD_OUTPUT_LOGIC:
+				pdata.data = &pdl;
+				break;
+			default:
+				pdata.data = NULL;
+				break;
+			}
+			if (!rcache_record_load(&p, end, pdata.pdo, &pdata))
+				break;
+			if (pass == 0)
+				srd_output_release(&pdata);
+			else
+				srd_output_submit(sess, &pdata);
+			count++;
+		}
+		if (pass == 0 && p != end) {
+			srd_warn("Ignoring corrupt result cache file %s.", path);
+			g_free(pdos);
+			g_mapped_file_unref(mf);
+			return FALSE;
+		}
+	}
+
+	srd_dbg("Session %d: Replayed %" G_GUINT64_FORMAT " records from %s.",
+		sess->session_id, count, path);
+	g_free(pdos);
+	g_mapped_file_unref(mf);
+
+	return TRUE;
+}
+
+/**
+ * Decode a whole capture, or replay its output from the result cache.
+ *
+ * The session must have been started and have its samplerate set, as
+ * for srd_session_send(). The samples are fetched from the source in
+ * chunks of chunk_size (the last one may be shorter), first to compute
+ * the cache key, then to decode them if the cache has no entry yet.
+ * The source must return the same data for the same range each time.
+ *
+ * Upon a cache hit, the recorded output is delivered to the session's
+ * callbacks, annotation store, spill files and exporters, and no
+ * decoder runs. Otherwise the samples are decoded and
+ * srd_session_send_eof() is called, and the output is stored for
+ * later sessions. Without a cache directory, the samples are decoded.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param num_samples The number of samples in the capture.
+ * @param chunk_size Number of samples per srd_session_send(), 0 for
+ *                   a default.
+ * @param source Callback which returns the samples of a chunk. Must not
+ *               be NULL.
+ * @param cb_data Passed to the source.
+ * @param hit Pointer which receives whether the output was replayed.
+ *            Can be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_decode_cached(struct srd_session *sess,
+		uint64_t num_samples, uint64_t chunk_size,
+		srd_sample_source source, void *cb_data, gboolean *hit)
+{
+	struct srd_rcache *rc;
+	const struct srd_input_view *inbuf;
+	uint64_t pos, next;
+	char *key, *name, *path;
+	int ret;
+
+	if (!sess || !source)
+		return SRD_ERR_ARG;
+	if (!chunk_size)
+		chunk_size = 64 * 1024;
+	if (hit)
+		*hit = FALSE;
+
+	path = NULL;
+	if ((rc = sess->rcache)) {
+		if (!(key = rcache_key(sess, num_samples, chunk_size, source,
+				cb_data)))
+			return SRD_ERR;
+		name = g_strconcat(key, ".srdc", NULL);
+		path = g_build_filename(rc->dir, name, NULL);
+		g_free(name);
+		g_free(key);
+
+		if (g_file_test(path, G_FILE_TEST_IS_REGULAR) &&
+				rcache_replay(sess, path)) {
+			srd_output_sync(sess);
+			srd_spill_flush(sess);
+			srd_export_flush_all(sess);
+			g_free(path);
+			if (hit)
+				*hit = TRUE;
+			return SRD_OK;
+		}
+
+		g_mutex_lock(&rc->mutex);
+		rcache_recorder_close(rc);
+		rcache_recorder_open(rc, path);
+		g_mutex_unlock(&rc->mutex);
+	}
+
+	ret = SRD_OK;
+	for (pos = 0; pos < num_samples; pos = next) {
+		next = MIN(pos + chunk_size, num_samples);
+		if (!(inbuf = source(pos, next, cb_data))) {
+			srd_err("No sample data for %" G_GUINT64_FORMAT "-%"
+				G_GUINT64_FORMAT ".", pos, next);
+			ret = SRD_ERR;
+			break;
+		}
+		ret = srd_session_send_views(sess, pos, next, inbuf);
+		if (ret != SRD_OK)
+			break;
+	}
+	if (ret == SRD_OK)
+		ret = srd_session_send_eof(sess);
+
+	if (rc) {
+		g_mutex_lock(&rc->mutex);
+		if (ret == SRD_OK && rc->fp)
+			rcache_recorder_finish(rc);
+		else
+			rcache_recorder_close(rc);
+		g_mutex_unlock(&rc->mutex);
+	}
+	g_free(path);
+
+	return ret;
+}
+
+/** @} */
@@ -0,0 +1,424 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file
+ *
+ * Ring buffer of bit-planes for streaming input.
+ */
+
+/**
+ * @defgroup grp_ring Ring buffer input
+ *
+ * Stream samples into a session through a ring buffer which the
+ * library owns.
+ *
+ * The acquisition side reserves space in the ring, writes the
+ * bit-planes of the channels there and commits them. The decoding side
+ * runs srd_session_ring_run(), which hands the committed samples to
+ * the decoders as views into the ring, without copying. Both sides may
+ * run on different threads.
+ *
+ * Samples are counted from 0 like the sample numbers of
+ * srd_session_send(). The ring keeps the 'retention' samples before
+ * the decoders' position, which srd_ring_read() can copy out, e.g.
+ * to look at the signal when a decoder failed. The producer blocks
+ * while the rest of the ring is full, which bounds the decoders' lag
+ * to capacity - retention samples.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+struct srd_ring {
+	GMutex mutex;
+	GCond cond;
+	unsigned int num_channels;
+	/* Samples per plane, a multiple of 64. */
+	uint64_t capacity;
+	uint64_t retention;
+	/* num_channels planes of capacity / 8 bytes. */
+	uint8_t *planes;
+	/* Absolute sample numbers of the cursors. */
+	uint64_t head;
+	uint64_t tail;
+	uint64_t granted;
+	/* A commit ended within a byte, only srd_ring_close() may follow. */
+	gboolean partial;
+	gboolean closed;
+	gboolean failed;
+	struct srd_input_view *inbuf;
+};
+
+/** @endcond */
+
+/* The oldest sample which must not be overwritten. */
+static uint64_t ring_oldest(const struct srd_ring *r)
+{
+	return (r->tail > r->retention) ? r->tail - r->retention : 0;
+}
+
+static uint8_t *ring_plane(const struct srd_ring *r, unsigned int ch)
+{
+	return r->planes + ch * (r->capacity / 8);
+}
+
+static void ring_free(struct srd_ring *r)
+{
+	if (!r)
+		return;
+
+	g_cond_clear(&r->cond);
+	g_mutex_clear(&r->mutex);
+	g_free(r->planes);
+	g_free(r->inbuf);
+	g_free(r);
+}
+
+/**
+ * Set up the ring buffer of a session.
+ *
+ * Replaces an existing ring, whose samples are discarded. The ring must
+ * not be in use at that time.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param num_channels The number of channels, indexed like the input
+ *                     data of srd_session_send().
+ * @param capacity The number of samples the ring holds, rounded up to a
+ *                 multiple of 64. 0 removes the ring.
+ * @param retention The number of decoded samples to keep for
+ *                  srd_ring_read(). At most the capacity minus 64.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_ring_set(struct srd_session *sess,
+		unsigned int num_channels, uint64_t capacity, uint64_t retention)
+{
+	struct srd_ring *r;
+
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	srd_ring_free(sess);
+	if (!capacity)
+		return SRD_OK;
+
+	capacity = (capacity + 63) / 64 * 64;
+	/* Leave the producer room when the decoders have caught up. */
+	if (!num_channels || retention > capacity - 64)
+		return SRD_ERR_ARG;
+
+	r = g_malloc0(sizeof(*r));
+	if (!(r->planes = g_try_malloc0(num_channels * (capacity / 8)))) {
+		srd_err("Cannot allocate ring buffer of %" G_GUINT64_FORMAT
+			" samples of %u channels.", capacity, num_channels);
+		g_free(r);
+		return SRD_ERR_MALLOC;
+	}
+	r->inbuf = g_malloc0(num_channels * sizeof(struct srd_input_view));
+	r->num_channels = num_channels;
+	r->capacity = capacity;
+	r->retention = retention;
+	g_mutex_init(&r->mutex);
+	g_cond_init(&r->cond);
+	sess->ring = r;
+
+	return SRD_OK;
+}
+
+/**
+ * Reserve space in the ring buffer of a session for new samples.
+ *
+ * Blocks until there is space for at least 8 samples. The space is
+ * contiguous, so less than requested may be granted at the end of the
+ * ring.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param num_samples The number of samples wanted, receives the number
+ *                    granted, a multiple of 8. Must not be NULL.
+ * @param planes Receives a pointer per channel, at which the samples'
+ *               bit-plane bytes are to be written. Must have room for
+ *               as many pointers as the ring has channels.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise, also
+ *         if the ring was closed or the decoders failed.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_ring_reserve(struct srd_session *sess, uint64_t *num_samples,
+		uint8_t **planes)
+{
+	struct srd_ring *r;
+	uint64_t pos, n;
+	unsigned int ch;
+	int ret;
+
+	if (!sess || !(r = sess->ring) || !num_samples || !planes ||
+			*num_samples < 8)
+		return SRD_ERR_ARG;
+
+	g_mutex_lock(&r->mutex);
+	if (r->partial) {
+		srd_err("Cannot append samples after a partial byte.");
+		ret = SRD_ERR_ARG;
+		goto out;
+	}
+	while (!r->closed && !r->failed &&
+			r->capacity - (r->head - ring_oldest(r)) < 8)
+		g_cond_wait(&r->cond, &r->mutex);
+	if (r->closed || r->failed) {
+		ret = SRD_ERR;
+		goto out;
+	}
+
+	pos = r->head % r->capacity;
+	n = MIN(*num_samples, r->capacity - (r->head - ring_oldest(r)));
+	n = MIN(n, r->capacity - pos) & ~(uint64_t)7;
+	for (ch = 0; ch < r->num_channels; ch++)
+		planes[ch] = ring_plane(r, ch) + pos / 8;
+	r->granted = n;
+	*num_samples = n;
+	ret = SRD_OK;
+
+out:
+	g_mutex_unlock(&r->mutex);
+
+	return ret;
+}
+
+/**
+ * Commit samples written into the space from srd_ring_reserve().
+ *
+ * @param sess The session. Must not be NULL.
+ * @param num_samples The number of samples written, at most the number
+ *                    granted. If it's not a multiple of 8, only
+ *                    srd_ring_close() may follow.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_ring_commit(struct srd_session *sess, uint64_t num_samples)
+{
+	struct srd_ring *r;
+
+	if (!sess || !(r = sess->ring))
+		return SRD_ERR_ARG;
+
+	g_mutex_lock(&r->mutex);
+	if (num_samples > r->granted) {
+		g_mutex_unlock(&r->mutex);
+		return SRD_ERR_ARG;
+	}
+	r->head += num_samples;
+	r->granted = 0;
+	if (num_samples % 8)
+		r->partial = TRUE;
+	g_cond_broadcast(&r->cond);
+	g_mutex_unlock(&r->mutex);
+
+	return SRD_OK;
+}
+
+/**
+ * Mark the end of the stream in the ring buffer of a session.
+ *
+ * srd_session_ring_run() returns once it has sent the committed samples.
+ *
+ * @param sess The session. Must not be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_ring_close(struct srd_session *sess)
+{
+	struct srd_ring *r;
+
+	if (!sess || !(r = sess->ring))
+		return SRD_ERR_ARG;
+
+	g_mutex_lock(&r->mutex);
+	r->closed = TRUE;
+	g_cond_broadcast(&r->cond);
+	g_mutex_unlock(&r->mutex);
+
+	return SRD_OK;
+}
+
+/**
+ * Decode the samples of the ring buffer of a session as they arrive.
+ *
+ * Sends the committed samples to the decoders, at most max_chunk at a
+ * time, until the ring is closed and all its samples were sent. The
+ * input data of srd_session_send() points into the ring. EOF is not
+ * sent, that's up to the caller.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param max_chunk The maximum number of samples per
+ *                  srd_session_send(), 0 for no limit.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise. Upon
+ *         errors, the producer's srd_ring_reserve() fails as well.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_ring_run(struct srd_session *sess, uint64_t max_chunk)
+{
+	struct srd_ring *r;
+	uint64_t pos, n, start;
+	unsigned int ch;
+	int ret;
+
+	if (!sess || !(r = sess->ring))
+		return SRD_ERR_ARG;
+
+	ret = SRD_OK;
+	g_mutex_lock(&r->mutex);
+	for (;;) {
+		while (r->head == r->tail && !r->closed)
+			g_cond_wait(&r->cond, &r->mutex);
+		if (r->head == r->tail)
+			break;
+
+		start = r->tail;
+		pos = start % r->capacity;
+		n = MIN(r->head - start, r->capacity - pos);
+		/* Keep chunks starting on plane bytes. */
+		if (max_chunk)
+			n = MIN(n, MAX(max_chunk & ~(uint64_t)7, 8));
+		for (ch = 0; ch < r->num_channels; ch++) {
+			r->inbuf[ch].data = ring_plane(r, ch) + pos / 8;
+			r->inbuf[ch].constant = 0;
+		}
+
+		/* The samples stay put until the tail moves past them. */
+		g_mutex_unlock(&r->mutex);
+		ret = srd_session_send_views(sess, start, start + n, r->inbuf);
+		g_mutex_lock(&r->mutex);
+		if (ret != SRD_OK) {
+			r->failed = TRUE;
+			g_cond_broadcast(&r->cond);
+			break;
+		}
+		r->tail = start + n;
+		g_cond_broadcast(&r->cond);
+	}
+	g_mutex_unlock(&r->mutex);
+
+	return ret;
+}
+
+/**
+ * Copy samples which are still in the ring buffer of a session.
+ *
+ * Available are the committed samples from the retention window before
+ * the decoders' position on. The decoders' position is the end of the
+ * chunk they are working on, or of the last one.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param start_sample The first sample to copy.
+ * @param end_sample The sample after the last one to copy.
+ * @param planes A buffer per channel, which receives the samples from
+ *               bit 0 of its first byte on. Must be
+ *               (end_sample - start_sample + 7) / 8 bytes long.
+ *
+ * @return SRD_OK upon success, SRD_ERR_ARG if the samples are not in
+ *         the ring (anymore), another (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_ring_read(struct srd_session *sess, uint64_t start_sample,
+		uint64_t end_sample, uint8_t **planes)
+{
+	struct srd_ring *r;
+	const uint8_t *plane;
+	uint64_t nbytes, bytes, i, pos;
+	unsigned int ch, shift, rest;
+	int ret;
+
+	if (!sess || !(r = sess->ring) || !planes || start_sample > end_sample)
+		return SRD_ERR_ARG;
+
+	g_mutex_lock(&r->mutex);
+	if (start_sample < ring_oldest(r) || end_sample > r->head) {
+		ret = SRD_ERR_ARG;
+		goto out;
+	}
+
+	/* The capacity is a multiple of 8, so the plane bytes wrap. */
+	nbytes = (end_sample - start_sample + 7) / 8;
+	bytes = r->capacity / 8;
+	shift = start_sample % 8;
+	rest = (end_sample - start_sample) % 8;
+	for (ch = 0; ch < r->num_channels; ch++) {
+		plane = ring_plane(r, ch);
+		pos = (start_sample % r->capacity) / 8;
+		for (i = 0; i < nbytes; i++) {
+			planes[ch][i] = plane[pos] >> shift;
+			if (shift)
+				planes[ch][i] |= plane[(pos + 1) % bytes] <<
+					(8 - shift);
+			pos = (pos + 1) % bytes;
+		}
+		if (rest)
+			planes[ch][nbytes - 1] &= (1 << rest) - 1;
+	}
+	ret = SRD_OK;
+
+out:
+	g_mutex_unlock(&r->mutex);
+
+	return ret;
+}
+
+/** @private */
+SRD_PRIV void srd_ring_reset(struct srd_session *sess)
+{
+	struct srd_ring *r;
+
+	if (!(r = sess->ring))
+		return;
+
+	g_mutex_lock(&r->mutex);
+	r->head = r->tail = 0;
+	r->granted = 0;
+	r->partial = r->closed = r->failed = FALSE;
+	g_cond_broadcast(&r->cond);
+	g_mutex_unlock(&r->mutex);
+}
+
+/** @private */
+SRD_PRIV void srd_ring_free(struct srd_session *sess)
+{
+	ring_free(sess->ring);
+	sess->ring = NULL;
+}
+
+/** @} */
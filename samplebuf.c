@@ -0,0 +1,222 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @file
+ *
+ * Allocation of sample buffers.
+ */
+
+/**
+ * @defgroup grp_samplebuf Sample buffers
+ *
+ * Memory for bit-planes which suits the word-parallel plane scans.
+ *
+ * Buffers start at a multiple of SRD_SAMPLE_BUFFER_ALIGN bytes and are
+ * followed by SRD_SAMPLE_BUFFER_PADDING readable bytes, so kernels may
+ * load whole words or vectors past the last sample. Large buffers are
+ * mapped such that the kernel can back them with huge pages, which
+ * saves TLB misses when scanning captures of many gigabytes.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+#define SAMPLE_BUFFER_MAGIC 0x5352444255465231ULL
+
+/* Huge page size assumed for alignment, the common one on x86 and ARM. */
+#define SAMPLE_BUFFER_HUGE_PAGE (2 * 1024 * 1024)
+
+/* Kept in the SRD_SAMPLE_BUFFER_ALIGN bytes before the buffer. */
+struct sample_buffer_header {
+	uint64_t magic;
+	void *base;
+	size_t size;
+	gboolean mapped;
+};
+
+/** @endcond */
+
+G_STATIC_ASSERT(sizeof(struct sample_buffer_header) <= SRD_SAMPLE_BUFFER_ALIGN);
+
+#ifdef HAVE_SYS_MMAN_H
+/* Map anonymous memory, aligned to huge pages if it's large. */
+static void *sample_buffer_map(size_t size, unsigned int flags,
+		size_t *map_size)
+{
+	uint8_t *p, *aligned;
+	size_t page, len;
+
+	page = sysconf(_SC_PAGESIZE);
+	if (size < SAMPLE_BUFFER_HUGE_PAGE) {
+		len = (size + page - 1) / page * page;
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return NULL;
+		*map_size = len;
+		return p;
+	}
+
+	len = (size + SAMPLE_BUFFER_HUGE_PAGE - 1) / SAMPLE_BUFFER_HUGE_PAGE *
+		SAMPLE_BUFFER_HUGE_PAGE;
+
+#ifdef MAP_HUGETLB
+	if (flags & SRD_SAMPLE_BUFFER_HUGETLB) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED) {
+			*map_size = len;
+			return p;
+		}
+		srd_dbg("No explicit huge pages for %" G_GSIZE_FORMAT
+			" bytes, using transparent ones.", len);
+	}
+#else
+	(void)flags;
+#endif
+
+	/* Over-allocate, then trim to a huge page boundary. */
+	p = mmap(NULL, len + SAMPLE_BUFFER_HUGE_PAGE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	aligned = (uint8_t *)(((uintptr_t)p + SAMPLE_BUFFER_HUGE_PAGE - 1) &
+		~(uintptr_t)(SAMPLE_BUFFER_HUGE_PAGE - 1));
+	if (aligned > p)
+		munmap(p, aligned - p);
+	munmap(aligned + len, SAMPLE_BUFFER_HUGE_PAGE - (aligned - p));
+#ifdef MADV_HUGEPAGE
+	madvise(aligned, len, MADV_HUGEPAGE);
+#endif
+	*map_size = len;
+
+	return aligned;
+}
+#endif
+
+/**
+ * Allocate a buffer for sample data.
+ *
+ * The buffer is zeroed, starts at a multiple of SRD_SAMPLE_BUFFER_ALIGN
+ * bytes, and SRD_SAMPLE_BUFFER_PADDING bytes after its end can be read.
+ * Buffers of a few megabytes and more are aligned to huge pages and
+ * marked for transparent huge pages. With SRD_SAMPLE_BUFFER_HUGETLB,
+ * explicitly reserved huge pages are tried first.
+ *
+ * To keep several planes in one buffer aligned, space them
+ * SRD_SAMPLE_BUFFER_PLANE_SIZE(num_samples) bytes apart.
+ *
+ * @param size The number of bytes. Must be > 0.
+ * @param flags Flags from enum srd_sample_buffer_flags, or 0.
+ *
+ * @return The buffer, or NULL upon errors. Free it with
+ *         srd_sample_buffer_free().
+ *
+ * @since 0.6.0
+ */
+SRD_API void *srd_sample_buffer_alloc(size_t size, unsigned int flags)
+{
+	struct sample_buffer_header *hdr;
+	uint8_t *base, *buf;
+	size_t total, map_size;
+
+	if (!size || size > G_MAXSIZE - 2 * SRD_SAMPLE_BUFFER_ALIGN -
+			SRD_SAMPLE_BUFFER_PADDING)
+		return NULL;
+
+	total = SRD_SAMPLE_BUFFER_ALIGN + size + SRD_SAMPLE_BUFFER_PADDING;
+
+#ifdef HAVE_SYS_MMAN_H
+	/* Mappings start on a page, which is aligned enough. */
+	if ((base = sample_buffer_map(total, flags, &map_size))) {
+		buf = base + SRD_SAMPLE_BUFFER_ALIGN;
+		hdr = (struct sample_buffer_header *)base;
+		hdr->magic = SAMPLE_BUFFER_MAGIC;
+		hdr->base = base;
+		hdr->size = map_size;
+		hdr->mapped = TRUE;
+		return buf;
+	}
+	srd_dbg("Cannot map %" G_GSIZE_FORMAT " bytes, using the heap.", total);
+#else
+	(void)flags;
+	(void)map_size;
+#endif
+
+	if (!(base = g_try_malloc0(total + SRD_SAMPLE_BUFFER_ALIGN - 1))) {
+		srd_err("Failed to allocate sample buffer of %" G_GSIZE_FORMAT
+			" bytes.", size);
+		return NULL;
+	}
+	buf = (uint8_t *)(((uintptr_t)base + 2 * SRD_SAMPLE_BUFFER_ALIGN - 1) &
+		~(uintptr_t)(SRD_SAMPLE_BUFFER_ALIGN - 1));
+	hdr = (struct sample_buffer_header *)(buf - SRD_SAMPLE_BUFFER_ALIGN);
+	hdr->magic = SAMPLE_BUFFER_MAGIC;
+	hdr->base = base;
+	hdr->size = total;
+	hdr->mapped = FALSE;
+
+	return buf;
+}
+
+/**
+ * Free a buffer from srd_sample_buffer_alloc().
+ *
+ * @param buf The buffer. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SRD_API void srd_sample_buffer_free(void *buf)
+{
+	struct sample_buffer_header *hdr;
+
+	if (!buf)
+		return;
+
+	hdr = (struct sample_buffer_header *)((uint8_t *)buf -
+		SRD_SAMPLE_BUFFER_ALIGN);
+	if (hdr->magic != SAMPLE_BUFFER_MAGIC) {
+		srd_err("%p is not a sample buffer.", buf);
+		return;
+	}
+	hdr->magic = 0;
+
+#ifdef HAVE_SYS_MMAN_H
+	if (hdr->mapped) {
+		munmap(hdr->base, hdr->size);
+		return;
+	}
+#endif
+	g_free(hdr->base);
+}
+
+/** @} */
@@ -0,0 +1,307 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file
+ *
+ * Searches for signal patterns in raw sample data.
+ */
+
+/**
+ * @defgroup grp_scan Signal scans
+ *
+ * Find pulses, serial bit patterns and channel states in sample data,
+ * without running a decoder.
+ *
+ * A scan fetches the samples from a srd_sample_source in chunks, like
+ * srd_session_decode_range(), and keeps its state across chunks, so
+ * matches may span chunk boundaries. The kernels work on 64 samples at
+ * a time: pulses jump from edge to edge with the plane search of the
+ * decoders' wait(), states AND the words of all involved channels,
+ * and clock edges of serial patterns come from shifting the clock
+ * word against itself.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+struct scan_run {
+	const struct srd_scan *scan;
+	srd_scan_callback cb;
+	void *cb_data;
+	gboolean stop;
+
+	/* Pulses and states: the current run of samples. */
+	int level;
+	gboolean in_run;
+	gboolean run_known;
+	uint64_t run_start;
+
+	/* Serial patterns: shift register, and sample of each bit. */
+	int prev_clk;
+	uint64_t reg;
+	uint64_t num_bits;
+	uint64_t bit_pos[64];
+};
+
+/** @endcond */
+
+static inline uint64_t scan_mask(unsigned int count)
+{
+	return (count >= 64) ? ~(uint64_t)0 : ((uint64_t)1 << count) - 1;
+}
+
+static void scan_report(struct scan_run *r, uint64_t start, uint64_t end)
+{
+	const struct srd_scan *scan;
+	struct srd_scan_match match;
+	uint64_t width;
+
+	scan = r->scan;
+	width = end - start;
+	if (scan->type != SRD_SCAN_SERIAL && (width < scan->min_width ||
+			(scan->max_width && width > scan->max_width)))
+		return;
+
+	match.start_sample = start;
+	match.end_sample = end;
+	if (!r->cb(&match, r->cb_data))
+		r->stop = TRUE;
+}
+
+/* Runs of one level, bounded by the other level on both sides. */
+static void scan_pulse(struct scan_run *r, const struct srd_input_view *in,
+		uint64_t pos, uint64_t n)
+{
+	const struct srd_scan *scan;
+	uint64_t i, j;
+	int level;
+
+	scan = r->scan;
+	for (i = 0; i < n && !r->stop; i = j) {
+		level = srd_plane_sample(in, i);
+		j = srd_plane_find_value(in, i, n, level ^ 1);
+		if (level == r->level)
+			continue;
+		/* Edge at pos + i, which ends the previous run. */
+		if (r->run_known && (scan->level < 0 || r->level == scan->level))
+			scan_report(r, r->run_start, pos + i);
+		/* A run which started before the scan has no known width. */
+		r->run_known = r->level >= 0;
+		r->run_start = pos + i;
+		r->level = level;
+	}
+}
+
+/* Runs of samples in which all selected channels have their values. */
+static void scan_state(struct scan_run *r, const struct srd_input_view *in,
+		uint64_t pos, uint64_t n)
+{
+	const struct srd_scan *scan;
+	uint64_t i, word, w, t;
+	unsigned int count, b, ch;
+
+	scan = r->scan;
+	for (i = 0; i < n && !r->stop; i += 64) {
+		count = MIN(n - i, 64);
+		word = scan_mask(count);
+		for (ch = 0; ch < 64 && word; ch++) {
+			if (!(scan->state_mask & ((uint64_t)1 << ch)))
+				continue;
+			w = srd_plane_word(&in[ch], i, count);
+			if (!(scan->state_value & ((uint64_t)1 << ch)))
+				w = ~w;
+			word &= w;
+		}
+
+		/* Walk the boundaries of the runs of one bits. */
+		for (b = 0; b < count && !r->stop; ) {
+			t = (r->in_run ? ~word : word) & scan_mask(count) &
+				~scan_mask(b);
+			if (!t)
+				break;
+			b = srd_ctz64(t);
+			if (r->in_run)
+				scan_report(r, r->run_start, pos + i + b);
+			else
+				r->run_start = pos + i + b;
+			r->in_run = !r->in_run;
+		}
+	}
+}
+
+/* Data bits sampled on clock edges, compared after every bit. */
+static void scan_serial(struct scan_run *r, const struct srd_input_view *in,
+		uint64_t pos, uint64_t n)
+{
+	const struct srd_scan *scan;
+	uint64_t i, clk, data, prev, edges, mask, pmask;
+	unsigned int count, b;
+
+	scan = r->scan;
+	pmask = scan_mask(scan->pattern_bits);
+	if (scan->pattern_mask)
+		pmask &= scan->pattern_mask;
+
+	for (i = 0; i < n && !r->stop; i += 64) {
+		count = MIN(n - i, 64);
+		mask = scan_mask(count);
+		clk = srd_plane_word(&in[scan->clock_channel], i, count);
+		data = srd_plane_word(&in[scan->channel], i, count);
+
+		/* Bit k of prev is the clock sample before sample k. */
+		prev = (clk << 1) | (r->prev_clk > 0 ? 1 : 0);
+		if (scan->clock_edge == SRD_SCAN_EDGE_FALLING)
+			edges = ~clk & prev;
+		else
+			edges = clk & ~prev;
+		edges &= mask;
+		/* No edge at the very first sample of the scan. */
+		if (r->prev_clk < 0)
+			edges &= ~(uint64_t)1;
+		r->prev_clk = (clk >> (count - 1)) & 1;
+
+		while (edges && !r->stop) {
+			b = srd_ctz64(edges);
+			edges &= edges - 1;
+			r->reg = (r->reg << 1) | ((data >> b) & 1);
+			r->bit_pos[r->num_bits & 63] = pos + i + b;
+			r->num_bits++;
+			if (r->num_bits < scan->pattern_bits ||
+					((r->reg ^ scan->pattern) & pmask))
+				continue;
+			scan_report(r, r->bit_pos[(r->num_bits -
+				scan->pattern_bits) & 63], pos + i + b + 1);
+		}
+	}
+}
+
+/**
+ * Search sample data for a signal pattern.
+ *
+ * The kinds of searches:
+ *
+ * - SRD_SCAN_PULSE: runs of 'level' (or of either level, if it is -1)
+ *   on 'channel' which start and end within the range. A match covers
+ *   the pulse, from its first sample to the one after its last.
+ * - SRD_SCAN_SERIAL: the last 'pattern_bits' bits of 'channel', each
+ *   sampled at a 'clock_edge' of 'clock_channel', equal 'pattern' in
+ *   the bits of 'pattern_mask' (0 for all). The most recent bit is the
+ *   least significant one. A match covers the edges of its first and
+ *   last bit, and the scan continues with the next bit, so matches of
+ *   a repeating pattern may overlap.
+ * - SRD_SCAN_STATE: runs of samples in which the channels in
+ *   'state_mask' (bit n for channel n) have the levels in
+ *   'state_value'. A run which still lasts at the end of the range
+ *   ends there.
+ *
+ * For pulses and states, matches must be at least 'min_width' and,
+ * unless 'max_width' is 0, at most 'max_width' samples long. A glitch
+ * search, e.g., looks for pulses of either level with 'max_width' set.
+ *
+ * @param scan What to search for. Must not be NULL.
+ * @param start_sample The first sample of the range.
+ * @param end_sample The sample after the last one of the range.
+ * @param chunk_size Number of samples to fetch at once, 0 for a default.
+ * @param source Callback which returns the samples of a chunk, laid out
+ *               like for srd_session_send_views(). Must not be NULL.
+ * @param source_data Passed to the source.
+ * @param cb The function to call per match, in the order of their end
+ *           samples. Return FALSE to stop the scan. Must not be NULL.
+ * @param cb_data Private data for the callback function. Can be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_scan_run(const struct srd_scan *scan, uint64_t start_sample,
+		uint64_t end_sample, uint64_t chunk_size, srd_sample_source source,
+		void *source_data, srd_scan_callback cb, void *cb_data)
+{
+	struct scan_run r;
+	const struct srd_input_view *inbuf;
+	uint64_t pos, next;
+
+	if (!scan || !source || !cb || start_sample > end_sample)
+		return SRD_ERR_ARG;
+
+	switch (scan->type) {
+	case SRD_SCAN_PULSE:
+		if (scan->channel < 0 || scan->level < -1 || scan->level > 1)
+			return SRD_ERR_ARG;
+		break;
+	case SRD_SCAN_SERIAL:
+		if (scan->channel < 0 || scan->clock_channel < 0 ||
+				scan->pattern_bits < 1 || scan->pattern_bits > 64)
+			return SRD_ERR_ARG;
+		break;
+	case SRD_SCAN_STATE:
+		if (!scan->state_mask)
+			return SRD_ERR_ARG;
+		break;
+	default:
+		return SRD_ERR_ARG;
+	}
+
+	if (!chunk_size)
+		chunk_size = 64 * 1024;
+
+	memset(&r, 0, sizeof(r));
+	r.scan = scan;
+	r.cb = cb;
+	r.cb_data = cb_data;
+	r.level = -1;
+	r.prev_clk = -1;
+
+	for (pos = start_sample; pos < end_sample && !r.stop; pos = next) {
+		next = MIN(pos + chunk_size, end_sample);
+		if (!(inbuf = source(pos, next, source_data))) {
+			srd_err("No sample data for %" G_GUINT64_FORMAT "-%"
+				G_GUINT64_FORMAT ".", pos, next);
+			return SRD_ERR;
+		}
+		switch (scan->type) {
+		case SRD_SCAN_PULSE:
+			scan_pulse(&r, &inbuf[scan->channel], pos, next - pos);
+			break;
+		case SRD_SCAN_SERIAL:
+			scan_serial(&r, inbuf, pos, next - pos);
+			break;
+		case SRD_SCAN_STATE:
+			scan_state(&r, inbuf, pos, next - pos);
+			break;
+		}
+	}
+
+	/* A state which lasts until the end matched all the way. */
+	if (scan->type == SRD_SCAN_STATE && r.in_run && !r.stop)
+		scan_report(&r, r.run_start, end_sample);
+
+	return SRD_OK;
+}
+
+/** @} */
@@ -0,0 +1,610 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file
+ *
+ * Full text search over decoder output.
+ */
+
+/**
+ * @defgroup grp_search Search index
+ *
+ * Inverted index over decoder output, built while decoding.
+ *
+ * Every indexed output becomes a record (sample range, instance, class
+ * and row). Annotation texts are split into tokens of letters, digits
+ * and '_', and lower cased. Python output is walked into lists, tuples
+ * and dicts: strings are split like texts, integers are indexed in
+ * decimal and as 0x-prefixed hex, so "0x50" finds an I2C address which
+ * a decoder put as the number 80.
+ *
+ * Per token, the index keeps the ascending ids of the records which
+ * contain it. A query intersects these lists, starting with the
+ * shortest, and sorts the matches by sample. Its cost depends on the
+ * length of the lists, not on the size of the capture.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+/* Nesting depth up to which Python output is walked. */
+#define SEARCH_PY_DEPTH 4
+
+struct search_record {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	guint32 inst;
+	int output_type;
+	int ann_class;
+	int ann_row;
+};
+
+struct srd_search {
+	GMutex mutex;
+	unsigned int flags;
+	GArray *records;
+	/* Token -> GArray of ascending guint32 record ids. */
+	GHashTable *postings;
+	/* Interned instance ids, and their index by id. */
+	GPtrArray *insts;
+	GHashTable *inst_index;
+	gboolean full;
+};
+
+/** @endcond */
+
+static void postings_free(gpointer data)
+{
+	g_array_free(data, TRUE);
+}
+
+static struct srd_search *search_new(unsigned int flags)
+{
+	struct srd_search *s;
+
+	s = g_malloc0(sizeof(*s));
+	g_mutex_init(&s->mutex);
+	s->flags = flags;
+	s->records = g_array_new(FALSE, FALSE, sizeof(struct search_record));
+	s->postings = g_hash_table_new_full(g_str_hash, g_str_equal,
+		g_free, postings_free);
+	s->insts = g_ptr_array_new_with_free_func(g_free);
+	s->inst_index = g_hash_table_new(g_str_hash, g_str_equal);
+
+	return s;
+}
+
+static void search_destroy(struct srd_search *s)
+{
+	g_hash_table_destroy(s->inst_index);
+	g_ptr_array_free(s->insts, TRUE);
+	g_hash_table_destroy(s->postings);
+	g_array_free(s->records, TRUE);
+	g_mutex_clear(&s->mutex);
+	g_free(s);
+}
+
+static inline gboolean token_char(char c)
+{
+	return g_ascii_isalnum(c) || c == '_';
+}
+
+/* Add a record id to a token's list, once per record. */
+static void search_post(struct srd_search *s, const char *token, gsize len,
+		guint32 id)
+{
+	GArray *ids;
+	char *key;
+
+	key = g_ascii_strdown(token, len);
+	if (!(ids = g_hash_table_lookup(s->postings, key))) {
+		ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+		g_hash_table_insert(s->postings, key, ids);
+	} else {
+		g_free(key);
+		if (ids->len && g_array_index(ids, guint32, ids->len - 1) == id)
+			return;
+	}
+	g_array_append_val(ids, id);
+}
+
+static void search_post_text(struct srd_search *s, const char *text,
+		guint32 id)
+{
+	const char *p, *start;
+
+	for (p = text; *p; ) {
+		while (*p && !token_char(*p))
+			p++;
+		start = p;
+		while (token_char(*p))
+			p++;
+		if (p > start)
+			search_post(s, start, p - start, id);
+	}
+}
+
+/* Append a record, returns its id, or G_MAXUINT32 if the index is full. */
+static guint32 search_record_add(struct srd_search *s, const char *inst_id,
+		uint64_t start_sample, uint64_t end_sample, int output_type,
+		int ann_class, int ann_row)
+{
+	struct search_record rec;
+	gpointer idx;
+
+	if (s->records->len == G_MAXUINT32 - 1) {
+		if (!s->full)
+			srd_warn("Search index is full, output is no longer indexed.");
+		s->full = TRUE;
+		return G_MAXUINT32;
+	}
+
+	if (!g_hash_table_lookup_extended(s->inst_index, inst_id, NULL, &idx)) {
+		idx = GUINT_TO_POINTER(s->insts->len);
+		g_ptr_array_add(s->insts, g_strdup(inst_id));
+		g_hash_table_insert(s->inst_index,
+			g_ptr_array_index(s->insts, s->insts->len - 1), idx);
+	}
+
+	rec.start_sample = start_sample;
+	rec.end_sample = end_sample;
+	rec.inst = GPOINTER_TO_UINT(idx);
+	rec.output_type = output_type;
+	rec.ann_class = ann_class;
+	rec.ann_row = ann_row;
+	g_array_append_val(s->records, rec);
+
+	return s->records->len - 1;
+}
+
+/**
+ * Index an annotation, if the session has a search index for them.
+ * The caller must hold the session's sinks_lock.
+ *
+ * @private
+ */
+SRD_PRIV void srd_search_add(struct srd_session *sess,
+		const struct srd_proto_data *pdata)
+{
+	struct srd_search *s;
+	const struct srd_proto_data_annotation *pda;
+	guint32 id;
+	char **t;
+
+	if (!(s = sess->search) || !(s->flags & SRD_SEARCH_ANN))
+		return;
+
+	pda = pdata->data;
+	g_mutex_lock(&s->mutex);
+	id = search_record_add(s, pdata->pdo->di->inst_id,
+		pdata->start_sample, pdata->end_sample, SRD_OUTPUT_ANN,
+		pda->ann_class, pda->ann_row);
+	if (id != G_MAXUINT32) {
+		for (t = pda->ann_text; t && *t; t++)
+			search_post_text(s, *t, id);
+	}
+	g_mutex_unlock(&s->mutex);
+}
+
+/* Caller holds the GIL and the index lock. */
+static void search_post_py(struct srd_search *s, PyObject *obj, guint32 id,
+		int depth)
+{
+	PyObject *py_items, *py_item;
+	Py_ssize_t i, n;
+	long long v;
+	char *str, buf[24];
+
+	if (depth > SEARCH_PY_DEPTH)
+		return;
+
+	if (PyUnicode_Check(obj)) {
+		if (py_str_as_str(obj, &str) == SRD_OK) {
+			search_post_text(s, str, id);
+			g_free(str);
+		}
+	} else if (PyLong_Check(obj)) {
+		v = PyLong_AsLongLong(obj);
+		if (v == -1 && PyErr_Occurred()) {
+			PyErr_Clear();
+			return;
+		}
+		g_snprintf(buf, sizeof(buf), "%lld", v);
+		search_post(s, buf, strlen(buf), id);
+		if (v >= 0) {
+			g_snprintf(buf, sizeof(buf), "0x%llx", v);
+			search_post(s, buf, strlen(buf), id);
+		}
+	} else if (PyList_Check(obj) || PyTuple_Check(obj) || PyDict_Check(obj)) {
+		/* For dicts, both keys and values are searchable. */
+		py_items = PyDict_Check(obj) ? PyDict_Items(obj) :
+			PySequence_List(obj);
+		if (!py_items) {
+			PyErr_Clear();
+			return;
+		}
+		n = PyList_Size(py_items);
+		for (i = 0; i < n; i++) {
+			py_item = PyList_GetItem(py_items, i);
+			search_post_py(s, py_item, id, depth + 1);
+		}
+		Py_DECREF(py_items);
+	}
+}
+
+/**
+ * Index an SRD_OUTPUT_PYTHON put(), if the session has a search index
+ * for Python output. The caller must hold the GIL.
+ *
+ * @private
+ */
+SRD_PRIV void srd_search_add_python(struct srd_decoder_inst *di,
+		uint64_t start_sample, uint64_t end_sample, PyObject *obj)
+{
+	struct srd_search *s;
+	guint32 id;
+
+	g_rw_lock_reader_lock(&di->sess->sinks_lock);
+	if ((s = di->sess->search) && (s->flags & SRD_SEARCH_PYTHON)) {
+		g_mutex_lock(&s->mutex);
+		id = search_record_add(s, di->inst_id, start_sample,
+			end_sample, SRD_OUTPUT_PYTHON, -1, -1);
+		if (id != G_MAXUINT32)
+			search_post_py(s, obj, id, 0);
+		g_mutex_unlock(&s->mutex);
+	}
+	g_rw_lock_reader_unlock(&di->sess->sinks_lock);
+}
+
+/**
+ * Drop the indexed output, e.g. for a new capture.
+ *
+ * @private
+ */
+SRD_PRIV void srd_search_clear(struct srd_session *sess)
+{
+	struct srd_search *s;
+
+	if (!(s = sess->search))
+		return;
+
+	g_mutex_lock(&s->mutex);
+	g_array_set_size(s->records, 0);
+	g_hash_table_remove_all(s->postings);
+	g_hash_table_remove_all(s->inst_index);
+	g_ptr_array_set_size(s->insts, 0);
+	s->full = FALSE;
+	g_mutex_unlock(&s->mutex);
+}
+
+/** @private */
+SRD_PRIV void srd_search_free(struct srd_session *sess)
+{
+	if (!sess->search)
+		return;
+
+	search_destroy(sess->search);
+	sess->search = NULL;
+}
+
+/**
+ * Enable or disable the session's search index.
+ *
+ * When enabled, the output selected by flags gets indexed as it is
+ * put, for srd_search_query(). This works with and without callbacks.
+ * Changing the flags drops what was indexed so far, as does
+ * srd_session_terminate_reset(). This may be called while the session
+ * decodes, but not from an output callback.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param flags SRD_SEARCH_* flags of the output to index, 0 disables
+ *              the index.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_search_set(struct srd_session *sess,
+		unsigned int flags)
+{
+	struct srd_search *s, *old;
+
+	if (!sess)
+		return SRD_ERR_ARG;
+	if (flags & ~(SRD_SEARCH_ANN | SRD_SEARCH_PYTHON))
+		return SRD_ERR_ARG;
+
+	if (sess->search && sess->search->flags == flags)
+		return SRD_OK;
+
+	s = flags ? search_new(flags) : NULL;
+	/* Decoder threads may be adding to the old index. */
+	g_rw_lock_writer_lock(&sess->sinks_lock);
+	old = sess->search;
+	sess->search = s;
+	g_rw_lock_writer_unlock(&sess->sinks_lock);
+	if (old)
+		search_destroy(old);
+
+	return SRD_OK;
+}
+
+static gint search_id_cmp(gconstpointer a, gconstpointer b)
+{
+	guint32 x, y;
+
+	x = *(const guint32 *)a;
+	y = *(const guint32 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Collect the ids of all tokens which start with a prefix. */
+static GArray *search_prefix_ids(struct srd_search *s, const char *prefix)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	GArray *ids, *tok;
+	guint32 *v;
+	guint i, n;
+
+	ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+	g_hash_table_iter_init(&iter, s->postings);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (!g_str_has_prefix(key, prefix))
+			continue;
+		tok = value;
+		g_array_append_vals(ids, tok->data, tok->len);
+	}
+
+	/* Sort and drop duplicates. */
+	g_array_sort(ids, search_id_cmp);
+	v = (guint32 *)ids->data;
+	for (i = n = 0; i < ids->len; i++) {
+		if (!n || v[n - 1] != v[i])
+			v[n++] = v[i];
+	}
+	g_array_set_size(ids, n);
+
+	return ids;
+}
+
+static gint search_list_len_cmp(gconstpointer a, gconstpointer b)
+{
+	guint x, y;
+
+	x = (*(GArray * const *)a)->len;
+	y = (*(GArray * const *)b)->len;
+
+	return (x > y) - (x < y);
+}
+
+/* First index at or after lo with ids[index] >= id, by galloping. */
+static guint search_seek(const guint32 *ids, guint len, guint lo, guint32 id)
+{
+	guint step, hi, mid;
+
+	step = 1;
+	hi = lo;
+	while (hi < len && ids[hi] < id) {
+		lo = hi + 1;
+		hi += step;
+		step <<= 1;
+	}
+	hi = MIN(hi, len);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (ids[mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Intersect sorted id lists, shortest first. */
+static GArray *search_intersect(GPtrArray *lists)
+{
+	GArray *out, *l;
+	guint *pos, i, j, len;
+	const guint32 *first;
+	guint32 id;
+	gboolean all;
+
+	g_ptr_array_sort(lists, search_list_len_cmp);
+	out = g_array_new(FALSE, FALSE, sizeof(guint32));
+	pos = g_malloc0(lists->len * sizeof(guint));
+	l = g_ptr_array_index(lists, 0);
+	first = (const guint32 *)l->data;
+	len = l->len;
+
+	for (i = 0; i < len; i++) {
+		id = first[i];
+		all = TRUE;
+		for (j = 1; j < lists->len && all; j++) {
+			l = g_ptr_array_index(lists, j);
+			pos[j] = search_seek((const guint32 *)l->data, l->len,
+				pos[j], id);
+			all = pos[j] < l->len &&
+				g_array_index(l, guint32, pos[j]) == id;
+		}
+		if (all)
+			g_array_append_val(out, id);
+	}
+	g_free(pos);
+
+	return out;
+}
+
+static gint search_match_cmp(gconstpointer a, gconstpointer b,
+		gpointer user_data)
+{
+	const struct search_record *records, *x, *y;
+
+	records = user_data;
+	x = &records[*(const guint32 *)a];
+	y = &records[*(const guint32 *)b];
+
+	if (x->start_sample != y->start_sample)
+		return x->start_sample < y->start_sample ? -1 : 1;
+	if (x->end_sample != y->end_sample)
+		return x->end_sample < y->end_sample ? -1 : 1;
+
+	return search_id_cmp(a, b);
+}
+
+/**
+ * Find the indexed output which contains all terms of a query.
+ *
+ * The query consists of terms separated by anything but letters,
+ * digits, '_' and '*'. Matching is case insensitive, a term which ends
+ * in '*' matches all tokens which start with it. An output matches if
+ * it contains all terms. The callback receives the matches which
+ * overlap the range in the order of their start samples. It runs with
+ * the index locked, so it must not call other search functions.
+ *
+ * @param sess The session. Must not be NULL and must have an index.
+ * @param inst_id The ID of the decoder instance, NULL for all.
+ * @param query The terms to search for. Must not be NULL or empty.
+ * @param start_sample The first sample of the range.
+ * @param end_sample The last sample of the range.
+ * @param cb The function to call per match. Must not be NULL.
+ * @param cb_data Private data for the callback function. Can be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_search_query(struct srd_session *sess, const char *inst_id,
+		const char *query, uint64_t start_sample, uint64_t end_sample,
+		srd_search_callback cb, void *cb_data)
+{
+	struct srd_search *s;
+	const struct search_record *records, *rec;
+	struct srd_search_match match;
+	GPtrArray *lists, *owned;
+	GArray *ids, *hits;
+	gpointer inst;
+	const char *p, *start;
+	char *term;
+	gboolean prefix, empty;
+	guint32 inst_idx;
+	guint i;
+
+	if (!sess || !sess->search || !query || !cb)
+		return SRD_ERR_ARG;
+	if (start_sample > end_sample)
+		return SRD_ERR_ARG;
+
+	s = sess->search;
+	g_mutex_lock(&s->mutex);
+
+	inst_idx = G_MAXUINT32;
+	if (inst_id) {
+		if (!g_hash_table_lookup_extended(s->inst_index, inst_id,
+				NULL, &inst)) {
+			g_mutex_unlock(&s->mutex);
+			return SRD_OK;
+		}
+		inst_idx = GPOINTER_TO_UINT(inst);
+	}
+
+	lists = g_ptr_array_new();
+	owned = g_ptr_array_new_with_free_func(postings_free);
+	empty = FALSE;
+	for (p = query; *p; ) {
+		while (*p && !token_char(*p))
+			p++;
+		start = p;
+		while (token_char(*p))
+			p++;
+		if (p == start) {
+			/* A lone '*' has no token. */
+			if (*p)
+				p++;
+			continue;
+		}
+		prefix = *p == '*';
+		term = g_ascii_strdown(start, p - start);
+		if (prefix) {
+			ids = search_prefix_ids(s, term);
+			g_ptr_array_add(owned, ids);
+		} else if (!(ids = g_hash_table_lookup(s->postings, term))) {
+			empty = TRUE;
+		}
+		g_free(term);
+		if (empty)
+			break;
+		g_ptr_array_add(lists, ids);
+	}
+
+	/* A term which was never indexed matches nothing. */
+	if (empty || !lists->len) {
+		g_ptr_array_free(lists, TRUE);
+		g_ptr_array_free(owned, TRUE);
+		g_mutex_unlock(&s->mutex);
+		return empty ? SRD_OK : SRD_ERR_ARG;
+	}
+
+	hits = search_intersect(lists);
+	records = (const struct search_record *)s->records->data;
+
+	/* Filter before sorting, to sort only what gets reported. */
+	for (i = 0; i < hits->len; ) {
+		rec = &records[g_array_index(hits, guint32, i)];
+		if ((inst_id && rec->inst != inst_idx) ||
+				rec->start_sample > end_sample ||
+				rec->end_sample < start_sample)
+			g_array_remove_index_fast(hits, i);
+		else
+			i++;
+	}
+	g_array_sort_with_data(hits, search_match_cmp, (gpointer)records);
+
+	for (i = 0; i < hits->len; i++) {
+		rec = &records[g_array_index(hits, guint32, i)];
+		match.start_sample = rec->start_sample;
+		match.end_sample = rec->end_sample;
+		match.inst_id = g_ptr_array_index(s->insts, rec->inst);
+		match.output_type = rec->output_type;
+		match.ann_class = rec->ann_class;
+		match.ann_row = rec->ann_row;
+		if (!cb(&match, cb_data))
+			break;
+	}
+
+	g_array_free(hits, TRUE);
+	g_ptr_array_free(lists, TRUE);
+	g_ptr_array_free(owned, TRUE);
+	g_mutex_unlock(&s->mutex);
+
+	return SRD_OK;
+}
+
+/** @} */
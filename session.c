@@ -24,6 +24,7 @@
 #include "libsigrokdecode.h"
 #include <inttypes.h>
 #include <glib.h>
+#include <string.h>
 
 /**
  * @file
@@ -67,6 +68,27 @@ SRD_API int srd_session_new(struct srd_session **sess)
 	*sess = g_malloc(sizeof(struct srd_session));
 	(*sess)->session_id = ++max_session_id;
 	(*sess)->di_list = (*sess)->callbacks = NULL;
+	(*sess)->pipeline = FALSE;
+	(*sess)->coroutine = FALSE;
+	(*sess)->inst_sharing = FALSE;
+	(*sess)->outq = NULL;
+	(*sess)->thread_config = NULL;
+	(*sess)->annstore = NULL;
+	(*sess)->spill = NULL;
+	(*sess)->exporters = NULL;
+	g_rw_lock_init(&(*sess)->sinks_lock);
+	(*sess)->samplerate = 0;
+	(*sess)->checkpoint_interval = 0;
+	(*sess)->checkpoints = NULL;
+	(*sess)->decode_samplenum = 0;
+	(*sess)->output_from = 0;
+	(*sess)->rcache = NULL;
+	(*sess)->search = NULL;
+	(*sess)->ring = NULL;
+	(*sess)->decimators = NULL;
+	(*sess)->send_views = NULL;
+	(*sess)->num_send_views = 0;
+	memset(&(*sess)->thread_factory, 0, sizeof((*sess)->thread_factory));
 
 	/* Keep a list of all sessions, so we can clean up as needed. */
 	sessions = g_slist_append(sessions, *sess);
@@ -107,6 +129,10 @@ SRD_API int srd_session_start(struct srd_session *sess)
 			break;
 	}
 
+	/* The options are final now. */
+	if (ret == SRD_OK)
+		srd_inst_share_find(sess);
+
 	return ret;
 }
 
@@ -116,6 +142,7 @@ static int srd_inst_send_meta(struct srd_decoder_inst *di, int key,
 	PyObject *py_ret;
 	GSList *l;
 	struct srd_decoder_inst *next_di;
+	uint64_t samplerate;
 	int ret;
 	PyGILState_STATE gstate;
 
@@ -123,12 +150,17 @@ static int srd_inst_send_meta(struct srd_decoder_inst *di, int key,
 		/* This is the only key we pass on to the decoder for now. */
 		return SRD_OK;
 
+	/* Stacked PDs get sample numbers of the undecimated input. */
+	samplerate = g_variant_get_uint64(data);
+	if (di->decimation > 1)
+		samplerate /= di->decimation;
+
 	gstate = PyGILState_Ensure();
 
 	if (PyObject_HasAttrString(di->py_inst, "metadata")) {
 		py_ret = PyObject_CallMethod(di->py_inst, "metadata", "lK",
 				(long)SRD_CONF_SAMPLERATE,
-				(unsigned long long)g_variant_get_uint64(data));
+				(unsigned long long)samplerate);
 		Py_XDECREF(py_ret);
 	}
 
@@ -190,6 +222,7 @@ SRD_API int srd_session_metadata_set(struct srd_session *sess, int key,
 
 	srd_dbg("Setting session %d samplerate to %"G_GUINT64_FORMAT".",
 			sess->session_id, g_variant_get_uint64(data));
+	sess->samplerate = g_variant_get_uint64(data);
 
 	ret = SRD_OK;
 	for (l = sess->di_list; l; l = l->next) {
@@ -263,22 +296,194 @@ SRD_API int srd_session_metadata_set(struct srd_session *sess, int key,
 SRD_API int srd_session_send(struct srd_session *sess,
 		uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
 		struct srd_input_data *inbuf)
+{
+	struct srd_decoder_inst *di;
+	GSList *l;
+	unsigned int num, ch;
+	int i;
+
+	if (!sess || !inbuf)
+		return SRD_ERR_ARG;
+
+	/* The input data has an entry for each channel which is read. */
+	num = 1;
+	for (l = sess->di_list; l; l = l->next) {
+		di = l->data;
+		for (i = 0; i < di->dec_num_channels; i++)
+			num = MAX(num, (unsigned int)(di->dec_channelmap[i] + 1));
+	}
+	if (num > sess->num_send_views) {
+		g_free(sess->send_views);
+		sess->send_views = g_malloc0(num * sizeof(*sess->send_views));
+		sess->num_send_views = num;
+	}
+
+	for (ch = 0; ch < num; ch++) {
+		sess->send_views[ch].data = inbuf[ch].data;
+		sess->send_views[ch].constant = inbuf[ch].constant;
+		sess->send_views[ch].bit_offset = 0;
+		sess->send_views[ch].bit_stride = 0;
+	}
+
+	return srd_session_send_views(sess, abs_start_samplenum,
+		abs_end_samplenum, sess->send_views);
+}
+
+/**
+ * Send a chunk of logic sample data as views into the caller's buffers.
+ *
+ * Like srd_session_send(), but every channel's samples may start at any
+ * bit of its buffer, and may be further apart than one bit. This way a
+ * window of a larger buffer, or one channel of interleaved samples, is
+ * decoded without copying it first.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param abs_start_samplenum The absolute starting sample number of the
+ *              chunk, relative to the start of capture.
+ * @param abs_end_samplenum The absolute sample number after the chunk.
+ * @param views The view of each channel, indexed like the input data
+ *              of srd_session_send(). Must not be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_send_views(struct srd_session *sess,
+		uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
+		const struct srd_input_view *views)
 {
 	GSList *d;
+	struct srd_decoder_inst *di;
+	const struct srd_input_view *inbuf;
 	int ret;
 
-	if (!sess)
+	if (!sess || !views)
 		return SRD_ERR_ARG;
 
+	inbuf = views;
+
+	if ((ret = srd_decimate_chunk(sess, abs_start_samplenum,
+			abs_end_samplenum, inbuf)) != SRD_OK)
+		return ret;
+
 	for (d = sess->di_list; d; d = d->next) {
-		if ((ret = srd_inst_decode(d->data, abs_start_samplenum,
-				abs_end_samplenum, inbuf)) != SRD_OK)
+		di = d->data;
+		/* Sharing instances get their output from another one. */
+		if (di->shared_inst)
+			continue;
+		if (di->decimator)
+			ret = srd_decimate_inst_decode(di);
+		else
+			ret = srd_inst_decode(di, abs_start_samplenum,
+				abs_end_samplenum, inbuf);
+		if (ret != SRD_OK)
 			return ret;
 	}
+	sess->decode_samplenum = abs_end_samplenum;
+
+	/* Chunk boundaries are safe points for checkpoints. */
+	srd_checkpoint_take(sess, abs_end_samplenum);
 
 	return SRD_OK;
 }
 
+/**
+ * Send a chunk of logic sample data whose channels consist of segments.
+ *
+ * Like srd_session_send(), but every channel's samples may be spread
+ * over several buffers, e.g. the DMA segments of a transfer, and need
+ * not start at a byte boundary. The chunk is sent in pieces which end
+ * where any channel's segment ends, each passed to the decoders in
+ * place with the segment's bit offset, so the segments are never
+ * joined or copied.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param abs_start_samplenum The absolute starting sample number of the
+ *              chunk, relative to the start of capture.
+ * @param abs_end_samplenum The absolute sample number after the chunk.
+ * @param channels The segments of each channel, indexed like the input
+ *                 data of srd_session_send(). Must not be NULL.
+ * @param num_channels The number of channels. Must be > 0.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_send_segments(struct srd_session *sess,
+		uint64_t abs_start_samplenum, uint64_t abs_end_samplenum,
+		const struct srd_input_segments *channels,
+		unsigned int num_channels)
+{
+	const struct srd_input_segment *seg;
+	struct srd_input_view *inbuf;
+	uint64_t *seg_pos, total, pos, len;
+	unsigned int *seg_idx, ch, i;
+	int ret;
+
+	if (!sess || !channels || !num_channels ||
+			abs_start_samplenum > abs_end_samplenum)
+		return SRD_ERR_ARG;
+
+	for (ch = 0; ch < num_channels; ch++) {
+		if (!channels[ch].segments)
+			continue;
+		total = 0;
+		for (i = 0; i < channels[ch].num_segments; i++)
+			total += channels[ch].segments[i].bit_length;
+		if (total < abs_end_samplenum - abs_start_samplenum) {
+			srd_err("Channel %u has %" G_GUINT64_FORMAT " of %"
+				G_GUINT64_FORMAT " samples.", ch, total,
+				abs_end_samplenum - abs_start_samplenum);
+			return SRD_ERR_ARG;
+		}
+	}
+
+	inbuf = g_malloc0(num_channels * sizeof(*inbuf));
+	seg_idx = g_malloc0(num_channels * sizeof(*seg_idx));
+	seg_pos = g_malloc0(num_channels * sizeof(*seg_pos));
+
+	ret = SRD_OK;
+	for (pos = abs_start_samplenum; pos < abs_end_samplenum; pos += len) {
+		/* The piece ends where the first segment ends. */
+		len = abs_end_samplenum - pos;
+		for (ch = 0; ch < num_channels; ch++) {
+			if (!channels[ch].segments)
+				continue;
+			while (!channels[ch].segments[seg_idx[ch]].bit_length)
+				seg_idx[ch]++;
+			seg = &channels[ch].segments[seg_idx[ch]];
+			len = MIN(len, seg->bit_length - seg_pos[ch]);
+		}
+
+		for (ch = 0; ch < num_channels; ch++) {
+			if (!channels[ch].segments) {
+				inbuf[ch].data = NULL;
+				inbuf[ch].constant = channels[ch].constant;
+				continue;
+			}
+			seg = &channels[ch].segments[seg_idx[ch]];
+			inbuf[ch].data = seg->data;
+			inbuf[ch].constant = 0;
+			inbuf[ch].bit_offset = seg->bit_offset + seg_pos[ch];
+			seg_pos[ch] += len;
+			if (seg_pos[ch] == seg->bit_length) {
+				seg_idx[ch]++;
+				seg_pos[ch] = 0;
+			}
+		}
+
+		ret = srd_session_send_views(sess, pos, pos + len, inbuf);
+		if (ret != SRD_OK)
+			break;
+	}
+
+	g_free(seg_pos);
+	g_free(seg_idx);
+	g_free(inbuf);
+
+	return ret;
+}
+
 /**
  * Communicate the end of the stream of sample data to the session.
  *
@@ -302,6 +507,11 @@ SRD_API int srd_session_send_eof(struct srd_session *sess)
 			return ret;
 	}
 
+	/* Have queued output reach the frontend before returning. */
+	srd_output_sync(sess);
+	srd_spill_flush(sess);
+	srd_export_flush_all(sess);
+
 	return SRD_OK;
 }
 
@@ -321,6 +531,9 @@ SRD_API int srd_session_send_eof(struct srd_session *sess)
  * processed input data. This avoids the necessity to re-construct the
  * decoder stack.
  *
+ * The annotations in the session's annotation store and its search
+ * index are removed.
+ *
  * @param sess The session in which to terminate decoders. Must not be NULL.
  *
  * @return SRD_OK upon success, a (negative) error code otherwise.
@@ -341,6 +554,15 @@ SRD_API int srd_session_terminate_reset(struct srd_session *sess)
 			return ret;
 	}
 
+	/* Stored and indexed output, and checkpoints, belong to the aborted input. */
+	srd_annstore_clear(sess);
+	srd_search_clear(sess);
+	srd_checkpoint_free_all(sess);
+	sess->decode_samplenum = 0;
+	/* Streaming restarts at sample 0. */
+	srd_ring_reset(sess);
+	srd_decimate_reset(sess);
+
 	return SRD_OK;
 }
 
@@ -363,10 +585,23 @@ SRD_API int srd_session_destroy(struct srd_session *sess)
 		return SRD_ERR_ARG;
 
 	session_id = sess->session_id;
+	/* Queued records refer to the instances' outputs. */
+	srd_output_free(sess);
+	srd_annstore_free(sess);
+	srd_spill_free(sess);
+	srd_export_free_all(sess);
+	srd_checkpoint_free_all(sess);
+	srd_rcache_free(sess);
+	srd_search_free(sess);
+	srd_ring_free(sess);
+	srd_decimate_free(sess);
+	g_free(sess->send_views);
 	if (sess->di_list)
 		srd_inst_free_all(sess);
 	if (sess->callbacks)
 		g_slist_free_full(sess->callbacks, g_free);
+	srd_thread_config_free(sess->thread_config);
+	g_rw_lock_clear(&sess->sinks_lock);
 	sessions = g_slist_remove(sessions, sess);
 	g_free(sess);
 
@@ -411,6 +646,117 @@ SRD_API int srd_pd_output_callback_add(struct srd_session *sess,
 	return SRD_OK;
 }
 
+/**
+ * Enable or disable pipelined execution of stacked decoders.
+ *
+ * By default, SRD_OUTPUT_PYTHON data which a decoder put()s is passed
+ * to the decode() method of the stacked decoders right away, in the
+ * thread of the lower decoder. In pipeline mode every stacked decoder
+ * instead consumes a queue of (ss, es, data) items on its own worker
+ * thread, so that the levels of a stack can overlap their work.
+ *
+ * The order of items is kept per stacked instance. Flushes and EOF wait
+ * for the queues of the affected instances to drain first.
+ *
+ * Must be called before srd_session_start().
+ *
+ * @param sess The session to configure. Must not be NULL.
+ * @param enable TRUE to run stacked decoders in pipeline mode.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_pipeline_set(struct srd_session *sess,
+		gboolean enable)
+{
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	srd_dbg("%s pipeline mode for session %d.",
+		enable ? "Enabling" : "Disabling", sess->session_id);
+
+	sess->pipeline = enable ? TRUE : FALSE;
+
+	return SRD_OK;
+}
+
+/**
+ * Enable or disable coroutine mode for a session.
+ *
+ * By default, every decoder instance which receives frontend data runs
+ * its decode() method in a worker thread, and each chunk of samples is
+ * handed over by means of condition variables. In coroutine mode the
+ * decode() method runs on a separate stack in the thread which calls
+ * srd_session_send(), and the library switches to it until wait() needs
+ * more samples. This avoids two context switches per chunk and stack.
+ *
+ * All calls for the session (send, EOF, reset, destroy) must come from
+ * the same thread then. Must be called before srd_session_start().
+ *
+ * @param sess The session to configure. Must not be NULL.
+ * @param enable TRUE to run decoders in coroutine mode.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *         SRD_ERR if coroutines are not supported on this platform.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_coroutine_set(struct srd_session *sess,
+		gboolean enable)
+{
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	if (enable && !srd_coro_supported()) {
+		srd_err("Coroutine mode is not supported on this platform.");
+		return SRD_ERR;
+	}
+
+	srd_dbg("%s coroutine mode for session %d.",
+		enable ? "Enabling" : "Disabling", sess->session_id);
+
+	sess->coroutine = enable ? TRUE : FALSE;
+
+	return SRD_OK;
+}
+
+/**
+ * Enable or disable sharing of identically configured instances.
+ *
+ * Frontends often create the same bottom decoder twice, e.g. UART on
+ * the same channel below a MODBUS stack and for a plain ASCII view.
+ * With sharing enabled, srd_session_start() looks for instances which
+ * have the same decoder, options, channel map and initial pins as an
+ * earlier instance of the session. Only the earlier one decodes, its
+ * output is put on the outputs of both, so callbacks still see each
+ * instance's output, and the PDs stacked on each get the Python
+ * output. Stacked instances are not shared.
+ *
+ * Sessions with sharing instances take no checkpoints. Must be called
+ * before srd_session_start().
+ *
+ * @param sess The session to configure. Must not be NULL.
+ * @param enable TRUE to share identical instances.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_inst_sharing_set(struct srd_session *sess,
+		gboolean enable)
+{
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	srd_dbg("%s instance sharing for session %d.",
+		enable ? "Enabling" : "Disabling", sess->session_id);
+
+	sess->inst_sharing = enable ? TRUE : FALSE;
+
+	return SRD_OK;
+}
+
 /** @private */
 SRD_PRIV struct srd_pd_callback *srd_pd_output_callback_find(
 		struct srd_session *sess, int output_type)
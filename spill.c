@@ -0,0 +1,667 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @file
+ *
+ * Disk-backed annotation storage ("spill files").
+ */
+
+/**
+ * @defgroup grp_spill Spill files
+ *
+ * Append-only on-disk storage of annotations, read back via mmap.
+ *
+ * A spill consists of three files which share a base path:
+ *
+ * - <path>.rec: Fixed-size records (struct spill_record), one per
+ *   annotation, in the order in which decoders put them.
+ * - <path>.str: The string table. Every distinct annotation text (all
+ *   alternatives) and instance ID is stored once, as a 32-bit length
+ *   followed by the NUL-terminated strings. Entries are numbered in
+ *   the order of the file.
+ * - <path>.idx: The sparse index. For every SPILL_INDEX_STRIDE records
+ *   it holds the lowest start and the highest end sample of the block.
+ *
+ * All files start with a 16-byte header (8-byte magic, 32-bit version,
+ * 32-bit parameter), all numbers are little endian.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+#define SPILL_VERSION 1
+
+/* Records per index entry. */
+#define SPILL_INDEX_STRIDE 4096
+
+#define SPILL_HEADER_SIZE 16
+
+struct spill_record {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	/* String table IDs. */
+	uint32_t inst;
+	uint32_t text;
+	int32_t ann_row;
+	int32_t ann_class;
+};
+
+struct spill_index {
+	uint64_t min_start;
+	uint64_t max_end;
+};
+
+struct srd_spill_writer {
+	GMutex mutex;
+	char *path;
+	FILE *rec;
+	FILE *str;
+	FILE *idx;
+	/* Joined text -> string ID + 1. */
+	GHashTable *str_ids;
+	uint32_t num_strings;
+	uint64_t num_records;
+	/* Index entry of the current block. */
+	struct spill_index block;
+};
+
+struct srd_spill {
+	GMappedFile *rec;
+	GMappedFile *idx;
+	const uint8_t *records;
+	uint64_t num_records;
+	const uint8_t *index;
+	uint64_t num_index;
+	/* String ID -> NULL-terminated string array. */
+	GPtrArray *strings;
+};
+
+/** @endcond */
+
+static const char spill_magic_rec[8] = "SRDSPREC";
+static const char spill_magic_str[8] = "SRDSPSTR";
+static const char spill_magic_idx[8] = "SRDSPIDX";
+
+static gboolean spill_write_header(FILE *f, const char *magic, uint32_t param)
+{
+	uint8_t hdr[SPILL_HEADER_SIZE];
+	uint32_t val;
+
+	memcpy(hdr, magic, 8);
+	val = GUINT32_TO_LE(SPILL_VERSION);
+	memcpy(hdr + 8, &val, 4);
+	val = GUINT32_TO_LE(param);
+	memcpy(hdr + 12, &val, 4);
+
+	return fwrite(hdr, sizeof(hdr), 1, f) == 1;
+}
+
+static FILE *spill_create(const char *path, const char *suffix,
+		const char *magic, uint32_t param)
+{
+	char *filename;
+	FILE *f;
+
+	filename = g_strconcat(path, suffix, NULL);
+	if (!(f = g_fopen(filename, "wb"))) {
+		srd_err("Cannot create spill file %s: %s.", filename,
+			g_strerror(errno));
+	} else if (!spill_write_header(f, magic, param)) {
+		srd_err("Cannot write spill file %s.", filename);
+		fclose(f);
+		f = NULL;
+	}
+	g_free(filename);
+
+	return f;
+}
+
+static void spill_writer_close(struct srd_spill_writer *w)
+{
+	if (w->rec)
+		fclose(w->rec);
+	if (w->str)
+		fclose(w->str);
+	if (w->idx)
+		fclose(w->idx);
+	w->rec = w->str = w->idx = NULL;
+}
+
+static void spill_writer_free(struct srd_spill_writer *w)
+{
+	spill_writer_close(w);
+	g_hash_table_destroy(w->str_ids);
+	g_mutex_clear(&w->mutex);
+	g_free(w->path);
+	g_free(w);
+}
+
+/* Get the ID of a string table entry, append it if it is new. */
+static gboolean spill_string_id(struct srd_spill_writer *w, char **strv,
+		uint32_t *id)
+{
+	char *key;
+	gpointer val;
+	uint32_t len, le;
+	int i;
+
+	key = g_strjoinv("\x1f", strv);
+	if ((val = g_hash_table_lookup(w->str_ids, key))) {
+		g_free(key);
+		*id = GPOINTER_TO_UINT(val) - 1;
+		return TRUE;
+	}
+
+	len = 0;
+	for (i = 0; strv[i]; i++)
+		len += strlen(strv[i]) + 1;
+	le = GUINT32_TO_LE(len);
+	if (fwrite(&le, sizeof(le), 1, w->str) != 1) {
+		g_free(key);
+		return FALSE;
+	}
+	for (i = 0; strv[i]; i++) {
+		if (fwrite(strv[i], strlen(strv[i]) + 1, 1, w->str) != 1) {
+			g_free(key);
+			return FALSE;
+		}
+	}
+
+	*id = w->num_strings++;
+	g_hash_table_insert(w->str_ids, key, GUINT_TO_POINTER(*id + 1));
+
+	return TRUE;
+}
+
+static gboolean spill_write_index(struct srd_spill_writer *w)
+{
+	uint64_t vals[2];
+
+	vals[0] = GUINT64_TO_LE(w->block.min_start);
+	vals[1] = GUINT64_TO_LE(w->block.max_end);
+
+	return fwrite(vals, sizeof(vals), 1, w->idx) == 1;
+}
+
+/**
+ * Append an annotation to the session's spill files, if it has them.
+ * The caller must hold the session's sinks_lock.
+ *
+ * @private
+ */
+SRD_PRIV void srd_spill_add(struct srd_session *sess,
+		const struct srd_proto_data *pdata)
+{
+	static char *no_text[] = { NULL };
+	struct srd_spill_writer *w;
+	struct srd_proto_data_annotation *pda;
+	char *inst_strv[2];
+	uint8_t buf[sizeof(struct spill_record)];
+	uint64_t start, end, v64;
+	uint32_t inst, text, v32;
+	gboolean ok;
+
+	if (!(w = sess->spill))
+		return;
+
+	pda = pdata->data;
+	start = pdata->start_sample;
+	end = MAX(pdata->end_sample, start);
+	inst_strv[0] = pdata->pdo->di->inst_id;
+	inst_strv[1] = NULL;
+
+	g_mutex_lock(&w->mutex);
+	if (!w->rec) {
+		/* Disabled after a write error. */
+		g_mutex_unlock(&w->mutex);
+		return;
+	}
+
+	ok = spill_string_id(w, inst_strv, &inst);
+	ok = ok && spill_string_id(w, pda->ann_text ? pda->ann_text : no_text,
+		&text);
+
+	/* Serialize explicitly, the file layout must not depend on the ABI. */
+	v64 = GUINT64_TO_LE(start);
+	memcpy(buf + 0, &v64, 8);
+	v64 = GUINT64_TO_LE(end);
+	memcpy(buf + 8, &v64, 8);
+	v32 = GUINT32_TO_LE(inst);
+	memcpy(buf + 16, &v32, 4);
+	v32 = GUINT32_TO_LE(text);
+	memcpy(buf + 20, &v32, 4);
+	v32 = GUINT32_TO_LE((uint32_t)pda->ann_row);
+	memcpy(buf + 24, &v32, 4);
+	v32 = GUINT32_TO_LE((uint32_t)pda->ann_class);
+	memcpy(buf + 28, &v32, 4);
+	ok = ok && fwrite(buf, sizeof(buf), 1, w->rec) == 1;
+
+	if (!(w->num_records % SPILL_INDEX_STRIDE)) {
+		w->block.min_start = start;
+		w->block.max_end = end;
+	} else {
+		w->block.min_start = MIN(w->block.min_start, start);
+		w->block.max_end = MAX(w->block.max_end, end);
+	}
+	w->num_records++;
+	if (ok && !(w->num_records % SPILL_INDEX_STRIDE))
+		ok = spill_write_index(w);
+
+	if (!ok) {
+		srd_err("Cannot write spill files %s, spilling stopped.",
+			w->path);
+		spill_writer_close(w);
+	}
+	g_mutex_unlock(&w->mutex);
+}
+
+/**
+ * Flush the session's spill files, such that readers see all records.
+ *
+ * @private
+ */
+SRD_PRIV void srd_spill_flush(struct srd_session *sess)
+{
+	struct srd_spill_writer *w;
+
+	if (!(w = sess->spill))
+		return;
+
+	g_mutex_lock(&w->mutex);
+	if (w->rec) {
+		/* Strings first, records refer to them. */
+		fflush(w->str);
+		fflush(w->idx);
+		fflush(w->rec);
+	}
+	g_mutex_unlock(&w->mutex);
+}
+
+/** @private */
+SRD_PRIV void srd_spill_free(struct srd_session *sess)
+{
+	if (!sess->spill)
+		return;
+
+	srd_spill_flush(sess);
+	spill_writer_free(sess->spill);
+	sess->spill = NULL;
+}
+
+/**
+ * Write the session's annotations to spill files.
+ *
+ * Creates (or truncates) the files <path>.rec, <path>.str and
+ * <path>.idx, and appends every annotation which the session's decoders
+ * put. The files get flushed upon srd_session_send_eof(), and closed
+ * when spilling gets disabled or the session is destroyed. Use
+ * srd_spill_open() to read them back. This may be called while the
+ * session decodes, but not from an output callback.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param path The base path of the files. NULL stops spilling.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_spill_set(struct srd_session *sess, const char *path)
+{
+	struct srd_spill_writer *w;
+
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	if (sess->spill) {
+		srd_spill_flush(sess);
+		/* Decoder threads may be appending to it. */
+		g_rw_lock_writer_lock(&sess->sinks_lock);
+		w = sess->spill;
+		sess->spill = NULL;
+		g_rw_lock_writer_unlock(&sess->sinks_lock);
+		spill_writer_free(w);
+	}
+	if (!path)
+		return SRD_OK;
+
+	w = g_malloc0(sizeof(*w));
+	g_mutex_init(&w->mutex);
+	w->path = g_strdup(path);
+	w->str_ids = g_hash_table_new_full(g_str_hash, g_str_equal,
+		g_free, NULL);
+	w->rec = spill_create(path, ".rec", spill_magic_rec,
+		sizeof(struct spill_record));
+	w->str = spill_create(path, ".str", spill_magic_str, 0);
+	w->idx = spill_create(path, ".idx", spill_magic_idx,
+		SPILL_INDEX_STRIDE);
+	if (!w->rec || !w->str || !w->idx) {
+		spill_writer_free(w);
+		return SRD_ERR;
+	}
+
+	srd_dbg("Spilling annotations of session %d to %s.",
+		sess->session_id, path);
+	g_rw_lock_writer_lock(&sess->sinks_lock);
+	sess->spill = w;
+	g_rw_lock_writer_unlock(&sess->sinks_lock);
+
+	return SRD_OK;
+}
+
+/* Map a spill file, check its header, return the payload. */
+static GMappedFile *spill_map(const char *path, const char *suffix,
+		const char *magic, uint32_t *param, const uint8_t **data,
+		gsize *len)
+{
+	GMappedFile *mf;
+	GError *error;
+	char *filename;
+	const uint8_t *contents;
+	uint32_t version;
+
+	filename = g_strconcat(path, suffix, NULL);
+	error = NULL;
+	if (!(mf = g_mapped_file_new(filename, FALSE, &error))) {
+		srd_err("Cannot map spill file %s: %s.", filename,
+			error->message);
+		g_error_free(error);
+		g_free(filename);
+		return NULL;
+	}
+
+	contents = (const uint8_t *)g_mapped_file_get_contents(mf);
+	*len = g_mapped_file_get_length(mf);
+	if (*len < SPILL_HEADER_SIZE || memcmp(contents, magic, 8)) {
+		srd_err("%s is not a spill file.", filename);
+		goto err;
+	}
+	memcpy(&version, contents + 8, 4);
+	if (GUINT32_FROM_LE(version) != SPILL_VERSION) {
+		srd_err("Spill file %s has unsupported version %u.", filename,
+			GUINT32_FROM_LE(version));
+		goto err;
+	}
+	memcpy(param, contents + 12, 4);
+	*param = GUINT32_FROM_LE(*param);
+	*data = contents + SPILL_HEADER_SIZE;
+	*len -= SPILL_HEADER_SIZE;
+	g_free(filename);
+
+	return mf;
+
+err:
+	g_mapped_file_unref(mf);
+	g_free(filename);
+
+	return NULL;
+}
+
+/* Parse the string table into arrays of strings. */
+static GPtrArray *spill_strings(const uint8_t *data, gsize len)
+{
+	GPtrArray *strings, *strv;
+	const char *s, *end;
+	uint32_t n;
+	gsize pos;
+
+	strings = g_ptr_array_new_with_free_func((GDestroyNotify)g_strfreev);
+	pos = 0;
+	while (len - pos >= 4) {
+		memcpy(&n, data + pos, 4);
+		n = GUINT32_FROM_LE(n);
+		pos += 4;
+		/* An entry which is still being written ends the table. */
+		if (n > len - pos)
+			break;
+		strv = g_ptr_array_new();
+		s = (const char *)data + pos;
+		end = s + n;
+		while (s < end) {
+			g_ptr_array_add(strv, g_strndup(s, end - s));
+			s += strlen(g_ptr_array_index(strv, strv->len - 1)) + 1;
+		}
+		g_ptr_array_add(strv, NULL);
+		g_ptr_array_add(strings, g_ptr_array_free(strv, FALSE));
+		pos += n;
+	}
+
+	return strings;
+}
+
+/**
+ * Open spill files for reading.
+ *
+ * The records and the index are memory-mapped, the string table is
+ * loaded. Files which are still being written can be opened, the
+ * reader sees the records which were flushed at that point.
+ *
+ * @param path The base path of the files. Must not be NULL.
+ * @param spill Pointer which receives the reader. Must not be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_spill_open(const char *path, struct srd_spill **spill)
+{
+	struct srd_spill *sp;
+	GMappedFile *str;
+	const uint8_t *data;
+	gsize len;
+	uint32_t param;
+	uint64_t i;
+	struct srd_spill_item item;
+
+	if (!path || !spill)
+		return SRD_ERR_ARG;
+
+	sp = g_malloc0(sizeof(*sp));
+
+	if (!(sp->rec = spill_map(path, ".rec", spill_magic_rec, &param,
+			&sp->records, &len)))
+		goto err;
+	if (param != sizeof(struct spill_record)) {
+		srd_err("Spill file %s.rec has unexpected record size %u.",
+			path, param);
+		goto err;
+	}
+	sp->num_records = len / sizeof(struct spill_record);
+
+	if (!(sp->idx = spill_map(path, ".idx", spill_magic_idx, &param,
+			&sp->index, &len)))
+		goto err;
+	if (param != SPILL_INDEX_STRIDE) {
+		srd_err("Spill file %s.idx has unexpected stride %u.",
+			path, param);
+		goto err;
+	}
+	sp->num_index = MIN(len / sizeof(struct spill_index),
+		sp->num_records / SPILL_INDEX_STRIDE);
+
+	if (!(str = spill_map(path, ".str", spill_magic_str, &param,
+			&data, &len)))
+		goto err;
+	sp->strings = spill_strings(data, len);
+	g_mapped_file_unref(str);
+
+	/* Drop trailing records whose strings didn't make it to disk. */
+	for (i = sp->num_records; i > 0; i--) {
+		if (srd_spill_get(sp, i - 1, &item) == SRD_OK)
+			break;
+	}
+	sp->num_records = i;
+	sp->num_index = MIN(sp->num_index, sp->num_records / SPILL_INDEX_STRIDE);
+
+	*spill = sp;
+
+	return SRD_OK;
+
+err:
+	srd_spill_close(sp);
+
+	return SRD_ERR;
+}
+
+/**
+ * Get the number of records of a spill.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_spill_count_get(const struct srd_spill *spill,
+		uint64_t *count)
+{
+	if (!spill || !count)
+		return SRD_ERR_ARG;
+
+	*count = spill->num_records;
+
+	return SRD_OK;
+}
+
+/**
+ * Get a record of a spill.
+ *
+ * @param spill The reader. Must not be NULL.
+ * @param index The record number, in the order the decoders put them.
+ * @param item Pointer to a struct which receives the record.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_spill_get(const struct srd_spill *spill, uint64_t index,
+		struct srd_spill_item *item)
+{
+	const uint8_t *rec;
+	uint64_t v64;
+	uint32_t inst, text, v32;
+	char **inst_strv;
+
+	if (!spill || !item || index >= spill->num_records)
+		return SRD_ERR_ARG;
+
+	rec = spill->records + index * sizeof(struct spill_record);
+	memcpy(&inst, rec + 16, 4);
+	memcpy(&text, rec + 20, 4);
+	inst = GUINT32_FROM_LE(inst);
+	text = GUINT32_FROM_LE(text);
+	if (inst >= spill->strings->len || text >= spill->strings->len)
+		return SRD_ERR;
+
+	memcpy(&v64, rec + 0, 8);
+	item->start_sample = GUINT64_FROM_LE(v64);
+	memcpy(&v64, rec + 8, 8);
+	item->end_sample = GUINT64_FROM_LE(v64);
+	inst_strv = g_ptr_array_index(spill->strings, inst);
+	item->inst_id = inst_strv[0] ? inst_strv[0] : "";
+	item->ann_text = g_ptr_array_index(spill->strings, text);
+	memcpy(&v32, rec + 24, 4);
+	item->ann_row = (int32_t)GUINT32_FROM_LE(v32);
+	memcpy(&v32, rec + 28, 4);
+	item->ann_class = (int32_t)GUINT32_FROM_LE(v32);
+
+	return SRD_OK;
+}
+
+/**
+ * Get the records of a spill which overlap a range of samples.
+ *
+ * A record overlaps the range if it starts at or before end_sample and
+ * ends at or after start_sample. Records are passed in file order.
+ * Blocks of records which cannot overlap the range are skipped by means
+ * of the sparse index.
+ *
+ * @param spill The reader. Must not be NULL.
+ * @param start_sample The first sample of the range.
+ * @param end_sample The last sample of the range.
+ * @param cb The function to call per record. Must not be NULL.
+ * @param cb_data Private data for the callback function. Can be NULL.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_spill_query(const struct srd_spill *spill,
+		uint64_t start_sample, uint64_t end_sample,
+		srd_spill_callback cb, void *cb_data)
+{
+	struct srd_spill_item item;
+	uint64_t block, first, last, i, v[2];
+
+	if (!spill || !cb || start_sample > end_sample)
+		return SRD_ERR_ARG;
+
+	for (block = 0; block * SPILL_INDEX_STRIDE < spill->num_records; block++) {
+		first = block * SPILL_INDEX_STRIDE;
+		last = MIN(first + SPILL_INDEX_STRIDE, spill->num_records);
+		if (block < spill->num_index) {
+			memcpy(v, spill->index + block * sizeof(struct spill_index),
+				sizeof(v));
+			if (GUINT64_FROM_LE(v[0]) > end_sample ||
+					GUINT64_FROM_LE(v[1]) < start_sample)
+				continue;
+		}
+		for (i = first; i < last; i++) {
+			if (srd_spill_get(spill, i, &item) != SRD_OK)
+				return SRD_ERR;
+			if (item.start_sample > end_sample ||
+					item.end_sample < start_sample)
+				continue;
+			if (!cb(&item, cb_data))
+				return SRD_OK;
+		}
+	}
+
+	return SRD_OK;
+}
+
+/**
+ * Close a spill reader.
+ *
+ * @param spill The reader. May be NULL.
+ *
+ * @since 0.6.0
+ */
+SRD_API void srd_spill_close(struct srd_spill *spill)
+{
+	if (!spill)
+		return;
+
+	if (spill->rec)
+		g_mapped_file_unref(spill->rec);
+	if (spill->idx)
+		g_mapped_file_unref(spill->idx);
+	if (spill->strings)
+		g_ptr_array_free(spill->strings, TRUE);
+	g_free(spill);
+}
+
+/** @} */
@@ -0,0 +1,412 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <check.h>
+#include "irmp-main-sharedlib.h"
+#include "lib.h"
+
+#define MAX_FRAMES 8
+
+/* An IR receiver's output, active-low, one level per sample. */
+struct ir_signal {
+	uint64_t samplerate;
+	uint64_t us;
+	uint8_t *levels;
+	size_t len;
+	size_t size;
+};
+
+static struct ir_signal *ir_signal_new(uint64_t samplerate)
+{
+	struct ir_signal *sig;
+
+	sig = g_malloc0(sizeof(*sig));
+	sig->samplerate = samplerate;
+
+	return sig;
+}
+
+static void ir_signal_free(struct ir_signal *sig)
+{
+	g_free(sig->levels);
+	g_free(sig);
+}
+
+/* Rounds the end of each level to the nearest sample, without drift. */
+static void ir_signal_level(struct ir_signal *sig, int level, uint64_t us)
+{
+	size_t end;
+
+	sig->us += us;
+	end = (sig->us * sig->samplerate + 500000) / 1000000;
+	if (end > sig->size) {
+		sig->size = end + sig->samplerate / 10;
+		sig->levels = g_realloc(sig->levels, sig->size);
+	}
+	while (sig->len < end)
+		sig->levels[sig->len++] = level;
+}
+
+/* Address in the low 16 bits, command in the upper 16 bits. */
+static void ir_signal_nec(struct ir_signal *sig, uint32_t code)
+{
+	int i;
+
+	ir_signal_level(sig, 0, 9000);
+	ir_signal_level(sig, 1, 4500);
+	for (i = 0; i < 32; i++) {
+		ir_signal_level(sig, 0, 560);
+		ir_signal_level(sig, 1, (code >> i) & 1 ? 1690 : 560);
+	}
+	ir_signal_level(sig, 0, 560);
+}
+
+/* Two NEC frames, the first 100ms into the capture, 200ms apart. */
+static struct ir_signal *ir_signal_frames(uint64_t samplerate,
+	uint32_t code1, uint32_t code2)
+{
+	struct ir_signal *sig;
+
+	sig = ir_signal_new(samplerate);
+	ir_signal_level(sig, 1, 100000);
+	ir_signal_nec(sig, code1);
+	ir_signal_level(sig, 1, 300000 - sig->us);
+	ir_signal_nec(sig, code2);
+	ir_signal_level(sig, 1, 100000);
+
+	return sig;
+}
+
+/* A plane with a part of the signal, starting at bit 0. */
+static uint8_t *ir_signal_plane(const struct ir_signal *sig,
+	size_t first, size_t count)
+{
+	uint8_t *plane;
+	size_t i;
+
+	plane = g_malloc0((count + 7) / 8);
+	for (i = 0; i < count; i++)
+		plane[i / 8] |= sig->levels[first + i] << (i % 8);
+
+	return plane;
+}
+
+/*
+ * Feeds a part of the signal to the default instance, with a result
+ * buffer of one frame to also exercise resumption.
+ */
+static size_t detect_plane(const struct ir_signal *sig, size_t first,
+	size_t count, uint32_t rate_factor,
+	struct irmp_result_data *frames, size_t num_frames)
+{
+	uint8_t *plane;
+
+	plane = ir_signal_plane(sig, first, count);
+	while (num_frames < MAX_FRAMES && irmp_detect_plane(plane, first,
+			count, rate_factor, 0, &frames[num_frames], 1))
+		num_frames++;
+	g_free(plane);
+
+	return num_frames;
+}
+
+/* Feeds a whole signal to an instance, in chunks. */
+static size_t instance_detect(struct irmp_instance *inst,
+	const struct ir_signal *sig, size_t chunk,
+	struct irmp_result_data *frames)
+{
+	uint8_t *plane;
+	size_t num_frames, first, count;
+
+	irmp_instance_set_sample_rate(inst, sig->samplerate);
+	num_frames = 0;
+	for (first = 0; first < sig->len; first += count) {
+		count = MIN(chunk, sig->len - first);
+		plane = ir_signal_plane(sig, first, count);
+		num_frames += irmp_instance_detect_plane(inst, plane, first,
+			count, 0, &frames[num_frames], MAX_FRAMES - num_frames);
+		g_free(plane);
+	}
+
+	return num_frames;
+}
+
+static gboolean same_frame(const struct irmp_result_data *a,
+	const struct irmp_result_data *b)
+{
+	return a->protocol == b->protocol && a->address == b->address &&
+		a->command == b->command && a->flags == b->flags &&
+		a->start_sample == b->start_sample &&
+		a->end_sample == b->end_sample;
+}
+
+static void check_frame(const struct irmp_result_data *frame,
+	const struct irmp_result_data *expected)
+{
+	fail_unless(frame->protocol == expected->protocol,
+		"Protocol %u instead of %u.", frame->protocol,
+		expected->protocol);
+	fail_unless(frame->address == expected->address,
+		"Address 0x%x instead of 0x%x.", frame->address,
+		expected->address);
+	fail_unless(frame->command == expected->command,
+		"Command 0x%x instead of 0x%x.", frame->command,
+		expected->command);
+	fail_unless(frame->start_sample == expected->start_sample,
+		"Start %u instead of %u.", frame->start_sample,
+		expected->start_sample);
+	fail_unless(frame->end_sample == expected->end_sample,
+		"End %u instead of %u.", frame->end_sample,
+		expected->end_sample);
+}
+
+/*
+ * Check whether irmp_detect_plane() detects the same frames as feeding
+ * each tick's sample, also when frames span chunk boundaries.
+ */
+START_TEST(test_irmp_detect_plane)
+{
+	static const size_t chunk_sizes[] = { 0, 4096, 1001, 37 };
+	struct ir_signal *sig;
+	struct irmp_result_data expected[MAX_FRAMES], frames[MAX_FRAMES];
+	uint32_t rate_factor;
+	size_t num_expected, num_frames, chunk, first, count, i, j;
+
+	rate_factor = 1000000 / irmp_get_sample_rate();
+	sig = ir_signal_frames(1000000, 0xf708fb04, 0xe51aff00);
+
+	irmp_reset_state();
+	num_expected = 0;
+	for (i = 0; i < sig->len; i += rate_factor) {
+		if (!irmp_add_one_sample(sig->levels[i]))
+			continue;
+		fail_unless(num_expected < MAX_FRAMES);
+		irmp_get_result_data(&expected[num_expected++]);
+	}
+	fail_unless(num_expected == 2, "%zu frames detected.", num_expected);
+	fail_unless(expected[0].address == 0xfb04);
+	fail_unless(expected[0].command == 0x08);
+	fail_unless(expected[1].address == 0xff00);
+	fail_unless(expected[1].command == 0x1a);
+
+	for (i = 0; i < G_N_ELEMENTS(chunk_sizes); i++) {
+		chunk = chunk_sizes[i] ? chunk_sizes[i] : sig->len;
+		irmp_reset_state();
+		num_frames = 0;
+		for (first = 0; first < sig->len; first += count) {
+			count = MIN(chunk, sig->len - first);
+			num_frames = detect_plane(sig, first, count,
+				rate_factor, frames, num_frames);
+		}
+		fail_unless(num_frames == num_expected,
+			"%zu frames in chunks of %zu.", num_frames, chunk);
+		for (j = 0; j < num_frames; j++)
+			check_frame(&frames[j], &expected[j]);
+	}
+
+	ir_signal_free(sig);
+}
+END_TEST
+
+/*
+ * Check whether irmp_detect_plane() restarts detection for input
+ * after a gap, and for input which goes back in time.
+ */
+START_TEST(test_irmp_detect_plane_gap)
+{
+	struct ir_signal *sig;
+	struct irmp_result_data expected[MAX_FRAMES], frames[MAX_FRAMES];
+	uint32_t rate_factor;
+	size_t num_expected, num_frames, gap_start, gap_end;
+
+	rate_factor = 1000000 / irmp_get_sample_rate();
+	sig = ir_signal_frames(1000000, 0xf708fb04, 0xe51aff00);
+
+	irmp_reset_state();
+	num_expected = detect_plane(sig, 0, sig->len, rate_factor,
+		expected, 0);
+	fail_unless(num_expected == 2, "%zu frames detected.", num_expected);
+
+	/* Skip idle input between the frames, at an odd sample. */
+	gap_start = 200000;
+	gap_end = 250003;
+	irmp_reset_state();
+	num_frames = detect_plane(sig, 0, gap_start, rate_factor, frames, 0);
+	num_frames = detect_plane(sig, gap_end, sig->len - gap_end,
+		rate_factor, frames, num_frames);
+	fail_unless(num_frames == 2, "%zu frames after a gap.", num_frames);
+	check_frame(&frames[0], &expected[0]);
+	check_frame(&frames[1], &expected[1]);
+
+	/* Go back to the start of the capture. */
+	num_frames = detect_plane(sig, 0, sig->len, rate_factor, frames, 0);
+	fail_unless(num_frames == 2, "%zu frames on restart.", num_frames);
+	check_frame(&frames[0], &expected[0]);
+	check_frame(&frames[1], &expected[1]);
+
+	ir_signal_free(sig);
+}
+END_TEST
+
+/*
+ * Check whether instances detect frames in captures at rates which are
+ * no multiple of their tick rate, with start and end in the capture's
+ * timeline.
+ */
+START_TEST(test_irmp_instance_rates)
+{
+	static const uint64_t samplerates[] = { 12000, 25000 };
+	static const uint32_t codes[] = { 0xf708fb04, 0xe51aff00 };
+	static const uint64_t starts_ms[] = { 100, 300 };
+	struct irmp_instance *inst;
+	struct ir_signal *sig;
+	struct irmp_result_data frames[MAX_FRAMES];
+	uint64_t samplerate, rate, start, end, frame_end;
+	size_t num_frames, i, j;
+
+	inst = irmp_instance_alloc();
+	for (i = 0; i < G_N_ELEMENTS(samplerates); i++) {
+		samplerate = samplerates[i];
+		sig = ir_signal_frames(samplerate, codes[0], codes[1]);
+		num_frames = instance_detect(inst, sig, 777, frames);
+		rate = irmp_instance_get_sample_rate(inst);
+		fail_unless(rate < samplerate && samplerate % rate != 0,
+			"Rate %" PRIu64 " for %" PRIu64 ".", rate, samplerate);
+		fail_unless(num_frames == 2, "%zu frames at %" PRIu64 ".",
+			num_frames, samplerate);
+		for (j = 0; j < num_frames; j++) {
+			fail_unless(!strcmp(frames[j].protocol_name, "NEC"),
+				"Protocol %s.", frames[j].protocol_name);
+			fail_unless(frames[j].address == (codes[j] & 0xffff));
+			fail_unless(frames[j].command ==
+				((codes[j] >> 16) & 0xff));
+			/* Frames take 67.5ms, detection ends after a pause. */
+			start = frames[j].start_sample * samplerate / rate;
+			end = frames[j].end_sample * samplerate / rate;
+			frame_end = (starts_ms[j] * 10 + 675) *
+				samplerate / 10000;
+			fail_unless(start == starts_ms[j] * samplerate / 1000,
+				"Start %" PRIu64 " at %" PRIu64 ".", start,
+				samplerate);
+			fail_unless(end >= frame_end &&
+				end < frame_end + samplerate / 50,
+				"End %" PRIu64 " at %" PRIu64 ".", end,
+				samplerate);
+		}
+		ir_signal_free(sig);
+	}
+	irmp_instance_free(inst);
+}
+END_TEST
+
+#define THREAD_ROUNDS 50
+
+struct detect_thread {
+	struct irmp_instance *inst;
+	const struct ir_signal *sig;
+	const struct irmp_result_data *expected;
+	size_t num_expected;
+	size_t mismatches;
+};
+
+static gpointer detect_thread(gpointer data)
+{
+	struct detect_thread *t;
+	struct irmp_result_data frames[MAX_FRAMES];
+	size_t round, num_frames, i;
+
+	t = data;
+	for (round = 0; round < THREAD_ROUNDS; round++) {
+		num_frames = instance_detect(t->inst, t->sig, 1000 + round,
+			frames);
+		for (i = 0; i < num_frames; i++) {
+			if (!same_frame(&frames[i], &t->expected[i]))
+				break;
+		}
+		if (num_frames != t->num_expected || i < num_frames)
+			t->mismatches++;
+	}
+
+	return NULL;
+}
+
+/*
+ * Check whether instances which decode different frames on different
+ * threads at the same time detect what each one does on its own.
+ */
+START_TEST(test_irmp_instance_threads)
+{
+	struct ir_signal *sig[2];
+	struct irmp_result_data expected[2][MAX_FRAMES];
+	struct detect_thread t[2];
+	GThread *thread[2];
+	size_t i;
+
+	sig[0] = ir_signal_frames(1000000, 0xf708fb04, 0xe51aff00);
+	sig[1] = ir_signal_frames(1000000, 0x12edbf40, 0xb54a0a35);
+
+	for (i = 0; i < 2; i++) {
+		t[i].inst = irmp_instance_alloc();
+		t[i].sig = sig[i];
+		t[i].expected = expected[i];
+		t[i].num_expected = instance_detect(t[i].inst, sig[i],
+			sig[i]->len, expected[i]);
+		t[i].mismatches = 0;
+		fail_unless(t[i].num_expected == 2,
+			"%zu frames detected.", t[i].num_expected);
+	}
+	fail_unless(expected[0][0].command != expected[1][0].command);
+
+	for (i = 0; i < 2; i++)
+		thread[i] = g_thread_new("irmp", detect_thread, &t[i]);
+	for (i = 0; i < 2; i++) {
+		g_thread_join(thread[i]);
+		fail_unless(t[i].mismatches == 0, "Instance %zu: %zu of %d "
+			"rounds differ.", i, t[i].mismatches, THREAD_ROUNDS);
+		irmp_instance_free(t[i].inst);
+		ir_signal_free(sig[i]);
+	}
+}
+END_TEST
+
+Suite *suite_irmp(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("irmp");
+
+	tc = tcase_create("detect");
+	tcase_add_checked_fixture(tc, srdtest_setup, srdtest_teardown);
+	tcase_add_test(tc, test_irmp_detect_plane);
+	tcase_add_test(tc, test_irmp_detect_plane_gap);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("instance");
+	tcase_add_checked_fixture(tc, srdtest_setup, srdtest_teardown);
+	tcase_add_test(tc, test_irmp_instance_rates);
+	tcase_add_test(tc, test_irmp_instance_threads);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -27,5 +27,8 @@ Suite *suite_core(void);
 Suite *suite_decoder(void);
 Suite *suite_inst(void);
 Suite *suite_session(void);
+#ifdef HAVE_LIBIRMP
+Suite *suite_irmp(void);
+#endif
 
 #endif
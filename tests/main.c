@@ -47,6 +47,9 @@ int main(void)
 	srunner_add_suite(srunner, suite_decoder());
 	srunner_add_suite(srunner, suite_inst());
 	srunner_add_suite(srunner, suite_session());
+#ifdef HAVE_LIBIRMP
+	srunner_add_suite(srunner, suite_irmp());
+#endif
 
 	srunner_run_all(srunner, CK_VERBOSE);
 	ret = srunner_ntests_failed(srunner);
@@ -20,8 +20,12 @@
 #include <config.h>
 #include <libsigrokdecode-internal.h> /* First, to avoid compiler warning. */
 #include <libsigrokdecode.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
 #include <check.h>
 #include "lib.h"
 
@@ -260,6 +264,2518 @@ START_TEST(test_session_reset_nodata)
 }
 END_TEST
 
+/*
+ * Check whether srd_session_pipeline_set() works.
+ * If it returns != SRD_OK (or segfaults) this test will fail.
+ */
+START_TEST(test_session_pipeline_set)
+{
+	int ret;
+	struct srd_session *sess;
+
+	srd_init(NULL);
+	srd_session_new(&sess);
+	fail_unless(!sess->pipeline, "Pipeline mode is enabled by default.");
+	ret = srd_session_pipeline_set(sess, TRUE);
+	fail_unless(ret == SRD_OK, "srd_session_pipeline_set() failed: %d.", ret);
+	fail_unless(sess->pipeline, "Pipeline mode was not enabled.");
+	ret = srd_session_start(sess);
+	fail_unless(ret == SRD_OK, "srd_session_start() failed: %d.", ret);
+	ret = srd_session_send_eof(sess);
+	fail_unless(ret == SRD_OK, "srd_session_send_eof() failed: %d.", ret);
+	ret = srd_session_pipeline_set(sess, FALSE);
+	fail_unless(ret == SRD_OK, "srd_session_pipeline_set() failed: %d.", ret);
+	fail_unless(!sess->pipeline, "Pipeline mode was not disabled.");
+	srd_session_destroy(sess);
+	srd_exit();
+}
+END_TEST
+
+/*
+ * Check whether srd_session_pipeline_set() fails for bogus sessions.
+ * If it returns SRD_OK (or segfaults) this test will fail.
+ */
+START_TEST(test_session_pipeline_set_bogus)
+{
+	int ret;
+
+	srd_init(NULL);
+	ret = srd_session_pipeline_set(NULL, TRUE);
+	fail_unless(ret != SRD_OK, "srd_session_pipeline_set(NULL) worked.");
+	srd_exit();
+}
+END_TEST
+
+/*
+ * Check whether srd_session_coroutine_set() fails for bogus sessions.
+ * If it returns SRD_OK (or segfaults) this test will fail.
+ */
+START_TEST(test_session_coroutine_set_bogus)
+{
+	int ret;
+
+	srd_init(NULL);
+	ret = srd_session_coroutine_set(NULL, FALSE);
+	fail_unless(ret != SRD_OK, "srd_session_coroutine_set(NULL) worked.");
+	srd_exit();
+}
+END_TEST
+
+struct ann_rec {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	int ann_class;
+	int ann_row;
+};
+
+static void ann_collect_cb(struct srd_proto_data *pdata, void *cb_data)
+{
+	GArray *anns;
+	struct srd_proto_data_annotation *pda;
+	struct ann_rec rec;
+
+	anns = cb_data;
+	pda = pdata->data;
+	rec.start_sample = pdata->start_sample;
+	rec.end_sample = pdata->end_sample;
+	rec.ann_class = pda->ann_class;
+	rec.ann_row = pda->ann_row;
+	g_array_append_val(anns, rec);
+}
+
+/* One 8N1 frame (115200 baud at 1MHz) on an idle-high UART line. */
+static void uart_frame_put(uint8_t *plane, uint64_t num_samples,
+		uint64_t frame_start, uint8_t value)
+{
+	uint64_t s, bit;
+	int level;
+
+	for (s = frame_start; s < num_samples; s++) {
+		bit = (s - frame_start) * 115200 / 1000000;
+		if (bit >= 10)
+			break;
+		level = (bit == 0) ? 0 : (bit == 9) ? 1 : (value >> (bit - 1)) & 1;
+		if (!level)
+			plane[s / 8] &= ~(1 << (s % 8));
+	}
+}
+
+/* Idle-high UART line (115200 baud at 1MHz) with one 8N1 frame. */
+static void uart_plane_fill(uint8_t *plane, uint64_t num_samples,
+		uint64_t frame_start, uint8_t value)
+{
+	memset(plane, 0xff, (num_samples + 7) / 8);
+	uart_frame_put(plane, num_samples, frame_start, value);
+}
+
+/* Feed the plane in chunks of the given size into a prepared session. */
+static GArray *uart_session_run(struct srd_session *sess,
+		const uint8_t *plane, uint64_t num_samples, uint64_t chunk_size)
+{
+	struct srd_input_data inbuf[2];
+	GArray *anns;
+	uint64_t start, end;
+	int ret;
+
+	anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	fail_unless(srd_inst_new(sess, "uart", NULL) != NULL);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, ann_collect_cb, anns);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+
+	/* TX is not connected, keep it idle. */
+	inbuf[1].data = NULL;
+	inbuf[1].constant = 1;
+	for (start = 0; start < num_samples; start = end) {
+		end = MIN(start + chunk_size, num_samples);
+		inbuf[0].data = (uint8_t *)plane + start / 8;
+		inbuf[0].constant = 0;
+		ret = srd_session_send(sess, start, end, inbuf);
+		fail_unless(ret == SRD_OK, "srd_session_send() failed: %d.", ret);
+	}
+	srd_session_send_eof(sess);
+
+	return anns;
+}
+
+/* Decode the plane in chunks of the given size, return the annotations. */
+static GArray *uart_decode_delivery(const uint8_t *plane,
+		uint64_t num_samples, uint64_t chunk_size, int delivery)
+{
+	struct srd_session *sess;
+	struct srd_output_stats stats;
+	GArray *anns;
+	int ret;
+
+	srd_session_new(&sess);
+	ret = srd_session_output_delivery_set(sess, delivery,
+		SRD_OUTPUT_OVERFLOW_BLOCK, 0);
+	fail_unless(ret == SRD_OK, "srd_session_output_delivery_set() "
+		"failed: %d.", ret);
+	anns = uart_session_run(sess, plane, num_samples, chunk_size);
+	if (delivery == SRD_OUTPUT_DELIVERY_POLL) {
+		ret = srd_session_poll_output(sess, 0);
+		fail_unless(ret >= 0, "srd_session_poll_output() failed: %d.", ret);
+	}
+	srd_session_output_stats_get(sess, &stats);
+	fail_unless(stats.occupancy == 0, "Output left in the queue.");
+	fail_unless(stats.dropped == 0, "Output was dropped.");
+	fail_unless(stats.delivered == stats.queued, "Output was lost.");
+	srd_session_destroy(sess);
+
+	return anns;
+}
+
+static GArray *uart_decode_chunked(const uint8_t *plane,
+		uint64_t num_samples, uint64_t chunk_size)
+{
+	return uart_decode_delivery(plane, num_samples, chunk_size,
+		SRD_OUTPUT_DELIVERY_SYNC);
+}
+
+static void ann_arrays_compare(GArray *whole, GArray *other)
+{
+	struct ann_rec *a, *b;
+	guint i;
+
+	fail_unless(whole->len > 0, "No annotations for the UART frame.");
+	fail_unless(whole->len == other->len, "Annotation count differs "
+		"(%u vs %u).", whole->len, other->len);
+	for (i = 0; i < whole->len && i < other->len; i++) {
+		a = &g_array_index(whole, struct ann_rec, i);
+		b = &g_array_index(other, struct ann_rec, i);
+		fail_unless(a->start_sample == b->start_sample &&
+			a->end_sample == b->end_sample &&
+			a->ann_class == b->ann_class,
+			"Annotation %u differs.", i);
+	}
+}
+
+/*
+ * Check whether a session which is allocated on dirty memory sends and
+ * gets destroyed cleanly.
+ */
+START_TEST(test_session_new_dirty)
+{
+	uint8_t *plane, *dirty;
+	uint64_t num_samples;
+	struct srd_session *sess;
+	GArray *anns;
+	int ret;
+
+	num_samples = 16 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 4000, 0x5a);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	/* The allocator likely hands this block out again. */
+	dirty = g_malloc(sizeof(struct srd_session));
+	memset(dirty, 0xa5, sizeof(struct srd_session));
+	g_free(dirty);
+	ret = srd_session_new(&sess);
+	fail_unless(ret == SRD_OK, "srd_session_new() failed: %d.", ret);
+	fail_unless(!sess->send_views && !sess->num_send_views,
+		"Send views of a new session are set.");
+	anns = uart_session_run(sess, plane, num_samples, 1024);
+	fail_unless(anns->len > 0, "No annotations for the UART frame.");
+	srd_session_destroy(sess);
+
+	/* A session which never sends. */
+	dirty = g_malloc(sizeof(struct srd_session));
+	memset(dirty, 0xa5, sizeof(struct srd_session));
+	g_free(dirty);
+	ret = srd_session_new(&sess);
+	fail_unless(ret == SRD_OK, "srd_session_new() failed: %d.", ret);
+	srd_session_destroy(sess);
+	srd_exit();
+
+	g_array_free(anns, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+/*
+ * Check whether chunks which cannot match any condition (idle line) are
+ * skipped without changing the decoder's results.
+ */
+START_TEST(test_session_send_idle_chunks)
+{
+	uint8_t *plane;
+	uint64_t num_samples;
+	GArray *whole, *chunked;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	whole = uart_decode_chunked(plane, num_samples, num_samples);
+	chunked = uart_decode_chunked(plane, num_samples, 256);
+	srd_exit();
+
+	ann_arrays_compare(whole, chunked);
+
+	g_array_free(whole, TRUE);
+	g_array_free(chunked, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+/*
+ * Decode the plane with two UART instances, with decode() running on
+ * worker threads or as coroutines. Returns NULL if the session does
+ * not support the mode.
+ */
+static GArray *uart_decode_coroutine(const uint8_t *plane,
+		uint64_t num_samples, uint64_t chunk_size, gboolean coroutine)
+{
+	struct srd_session *sess;
+	struct srd_input_data inbuf[2];
+	GArray *anns;
+	uint64_t start, end;
+	int ret;
+
+	srd_session_new(&sess);
+	if (srd_session_coroutine_set(sess, coroutine) != SRD_OK) {
+		srd_session_destroy(sess);
+		return NULL;
+	}
+	anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	fail_unless(srd_inst_new(sess, "uart", NULL) != NULL);
+	fail_unless(srd_inst_new(sess, "uart", NULL) != NULL);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, ann_collect_cb, anns);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+
+	inbuf[1].data = NULL;
+	inbuf[1].constant = 1;
+	for (start = 0; start < num_samples; start = end) {
+		end = MIN(start + chunk_size, num_samples);
+		inbuf[0].data = (uint8_t *)plane + start / 8;
+		inbuf[0].constant = 0;
+		ret = srd_session_send(sess, start, end, inbuf);
+		fail_unless(ret == SRD_OK, "srd_session_send() failed: %d.", ret);
+	}
+	ret = srd_session_send_eof(sess);
+	fail_unless(ret == SRD_OK, "srd_session_send_eof() failed: %d.", ret);
+	srd_session_destroy(sess);
+
+	return anns;
+}
+
+/*
+ * Check whether two instances whose decode() methods are suspended at
+ * the same time as coroutines yield what worker threads yield.
+ */
+START_TEST(test_session_coroutine)
+{
+	uint8_t *plane;
+	uint64_t num_samples;
+	GArray *threads, *coros;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	threads = uart_decode_coroutine(plane, num_samples, 256, FALSE);
+	coros = uart_decode_coroutine(plane, num_samples, 256, TRUE);
+	srd_exit();
+
+	fail_unless(threads != NULL, "Threaded mode failed.");
+	/* Not all Python versions support coroutines. */
+	if (coros) {
+		ann_arrays_compare(threads, coros);
+		g_array_free(coros, TRUE);
+	}
+
+	g_array_free(threads, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+/*
+ * Check whether queued output delivery (thread and poll) passes the
+ * same annotations to the callback as synchronous delivery.
+ */
+START_TEST(test_session_output_delivery)
+{
+	uint8_t *plane;
+	uint64_t num_samples;
+	GArray *sync, *thread, *poll;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	sync = uart_decode_delivery(plane, num_samples, 1024,
+		SRD_OUTPUT_DELIVERY_SYNC);
+	thread = uart_decode_delivery(plane, num_samples, 1024,
+		SRD_OUTPUT_DELIVERY_THREAD);
+	poll = uart_decode_delivery(plane, num_samples, 1024,
+		SRD_OUTPUT_DELIVERY_POLL);
+	srd_exit();
+
+	ann_arrays_compare(sync, thread);
+	ann_arrays_compare(sync, poll);
+
+	g_array_free(sync, TRUE);
+	g_array_free(thread, TRUE);
+	g_array_free(poll, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+/*
+ * Check whether the output delivery API rejects bogus arguments.
+ * If it returns SRD_OK (or segfaults) this test will fail.
+ */
+START_TEST(test_session_output_delivery_bogus)
+{
+	int ret;
+	struct srd_session *sess;
+	struct srd_output_stats stats;
+
+	srd_init(NULL);
+	srd_session_new(&sess);
+	ret = srd_session_output_delivery_set(NULL, SRD_OUTPUT_DELIVERY_THREAD,
+		SRD_OUTPUT_OVERFLOW_DROP, 0);
+	fail_unless(ret != SRD_OK, "srd_session_output_delivery_set(NULL) worked.");
+	ret = srd_session_output_delivery_set(sess, 42,
+		SRD_OUTPUT_OVERFLOW_DROP, 0);
+	fail_unless(ret != SRD_OK, "Bogus delivery mode was accepted.");
+	ret = srd_session_output_delivery_set(sess, SRD_OUTPUT_DELIVERY_POLL,
+		42, 0);
+	fail_unless(ret != SRD_OK, "Bogus overflow policy was accepted.");
+	ret = srd_session_poll_output(sess, 0);
+	fail_unless(ret < 0, "Polling a synchronous session worked.");
+	ret = srd_session_output_stats_get(sess, NULL);
+	fail_unless(ret != SRD_OK, "srd_session_output_stats_get(NULL) worked.");
+	ret = srd_session_output_delivery_set(sess, SRD_OUTPUT_DELIVERY_POLL,
+		SRD_OUTPUT_OVERFLOW_DROP, 100);
+	fail_unless(ret == SRD_OK, "srd_session_output_delivery_set() failed.");
+	srd_session_output_stats_get(sess, &stats);
+	fail_unless(stats.capacity == 128, "Queue size was not rounded up.");
+	srd_session_destroy(sess);
+	srd_exit();
+}
+END_TEST
+
+static gboolean annstore_collect_cb(const struct srd_annstore_item *item,
+		void *cb_data)
+{
+	GArray *anns;
+	struct ann_rec rec;
+
+	anns = cb_data;
+	rec.start_sample = item->start_sample;
+	rec.end_sample = item->end_sample;
+	rec.ann_class = item->ann_class;
+	rec.ann_row = item->ann_row;
+	g_array_append_val(anns, rec);
+	fail_unless(item->ann_text && item->ann_text[0], "No annotation text.");
+
+	return TRUE;
+}
+
+/* Check query and count of one row and range against the callback's view. */
+static void annstore_check_range(struct srd_session *sess, GArray *anns,
+		int ann_row, uint64_t ss, uint64_t es)
+{
+	GArray *found;
+	struct ann_rec *a;
+	uint64_t count, expected, prev;
+	guint i;
+	int ret;
+
+	expected = 0;
+	for (i = 0; i < anns->len; i++) {
+		a = &g_array_index(anns, struct ann_rec, i);
+		if (a->ann_row == ann_row && a->start_sample <= es &&
+				a->end_sample >= ss)
+			expected++;
+	}
+
+	found = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	ret = srd_annstore_query(sess, "uart", ann_row, ss, es,
+		annstore_collect_cb, found);
+	fail_unless(ret == SRD_OK, "srd_annstore_query() failed: %d.", ret);
+	fail_unless(found->len == expected, "Query found %u of %" PRIu64
+		" annotations.", found->len, expected);
+	prev = 0;
+	for (i = 0; i < found->len; i++) {
+		a = &g_array_index(found, struct ann_rec, i);
+		fail_unless(a->start_sample >= prev, "Query is out of order.");
+		prev = a->start_sample;
+	}
+	g_array_free(found, TRUE);
+
+	ret = srd_annstore_count(sess, "uart", ann_row, ss, es, &count);
+	fail_unless(ret == SRD_OK, "srd_annstore_count() failed: %d.", ret);
+	fail_unless(count == expected, "Count is %" PRIu64 " instead of %"
+		PRIu64 ".", count, expected);
+}
+
+/* Check the summary of one row and range against the callback's view. */
+static void annstore_check_summary(struct srd_session *sess, GArray *anns,
+		int ann_row, uint64_t ss, uint64_t es, unsigned int max_buckets)
+{
+	struct srd_annstore_bucket *buckets;
+	struct ann_rec *a;
+	uint64_t total, expected, first_start, counts[64];
+	int i, num, c, dominant;
+	guint j;
+
+	expected = 0;
+	first_start = G_MAXUINT64;
+	for (j = 0; j < anns->len; j++) {
+		a = &g_array_index(anns, struct ann_rec, j);
+		if (a->ann_row == ann_row && a->start_sample >= ss &&
+				a->start_sample <= es) {
+			expected++;
+			first_start = MIN(first_start, a->start_sample);
+		}
+	}
+
+	buckets = g_malloc0(max_buckets * sizeof(*buckets));
+	num = srd_annstore_summary(sess, "uart", ann_row, ss, es, buckets,
+		max_buckets);
+	fail_unless(num >= 0, "srd_annstore_summary() failed: %d.", num);
+	fail_unless((unsigned int)num <= max_buckets, "Too many buckets.");
+
+	/* Buckets may reach beyond the range, sum up what starts within. */
+	total = 0;
+	for (i = 0; i < num; i++) {
+		fail_unless(buckets[i].count > 0, "Empty bucket returned.");
+		fail_unless(!i || buckets[i].start_sample > buckets[i - 1].end_sample,
+			"Buckets are out of order.");
+		fail_unless(buckets[i].first.start_sample <= buckets[i].last.start_sample,
+			"First and last annotation are swapped.");
+		total += buckets[i].count;
+
+		/* The most frequent class, the lowest one on ties. */
+		memset(counts, 0, sizeof(counts));
+		for (j = 0; j < anns->len; j++) {
+			a = &g_array_index(anns, struct ann_rec, j);
+			if (a->ann_row == ann_row &&
+					a->start_sample >= buckets[i].start_sample &&
+					a->start_sample <= buckets[i].end_sample)
+				counts[a->ann_class]++;
+		}
+		dominant = 0;
+		for (c = 1; c < (int)G_N_ELEMENTS(counts); c++) {
+			if (counts[c] > counts[dominant])
+				dominant = c;
+		}
+		fail_unless(buckets[i].dominant_class == dominant, "Dominant "
+			"class is %d instead of %d.", buckets[i].dominant_class,
+			dominant);
+	}
+	fail_unless(total >= expected, "Summary misses annotations.");
+	if (expected && num > 0)
+		fail_unless(buckets[0].first.start_sample <= first_start,
+			"First annotation of the range is missing.");
+	g_free(buckets);
+}
+
+/*
+ * Check whether the annotation store keeps what the callback receives,
+ * and answers overlap queries and counts accordingly.
+ */
+START_TEST(test_session_annstore)
+{
+	uint8_t *plane;
+	uint64_t num_samples, count;
+	struct srd_session *sess;
+	GArray *anns;
+	int row, ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	srd_session_new(&sess);
+	ret = srd_session_annstore_set(sess, TRUE);
+	fail_unless(ret == SRD_OK, "srd_session_annstore_set() failed.");
+	anns = uart_session_run(sess, plane, num_samples, 1024);
+	fail_unless(anns->len > 0, "No annotations for the UART frame.");
+
+	for (row = -1; row < 8; row++) {
+		annstore_check_range(sess, anns, row, 0, num_samples);
+		annstore_check_range(sess, anns, row, 40000, 40100);
+		annstore_check_range(sess, anns, row, 40087, 40087);
+		annstore_check_range(sess, anns, row, 0, 39999);
+	}
+
+	for (row = -1; row < 8; row++) {
+		annstore_check_summary(sess, anns, row, 0, num_samples - 1, 1);
+		annstore_check_summary(sess, anns, row, 0, num_samples - 1, 4);
+		annstore_check_summary(sess, anns, row, 39000, 41000, 1000);
+	}
+
+	ret = srd_annstore_count(sess, "uart", 0, 10, 5, &count);
+	fail_unless(ret != SRD_OK, "Inverted range was accepted.");
+	srd_annstore_clear(sess);
+	srd_annstore_count(sess, "uart", 0, 0, num_samples, &count);
+	fail_unless(count == 0, "Store was not cleared.");
+
+	srd_session_destroy(sess);
+	srd_exit();
+
+	g_array_free(anns, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+static gboolean spill_collect_cb(const struct srd_spill_item *item,
+		void *cb_data)
+{
+	GArray *anns;
+	struct ann_rec rec;
+
+	anns = cb_data;
+	rec.start_sample = item->start_sample;
+	rec.end_sample = item->end_sample;
+	rec.ann_class = item->ann_class;
+	rec.ann_row = item->ann_row;
+	g_array_append_val(anns, rec);
+	fail_unless(!strcmp(item->inst_id, "uart"), "Wrong instance ID.");
+	fail_unless(item->ann_text && item->ann_text[0], "No annotation text.");
+
+	return TRUE;
+}
+
+/* Check a query of the spill against the callback's view. */
+static void spill_check_range(struct srd_spill *spill, GArray *anns,
+		uint64_t ss, uint64_t es)
+{
+	GArray *found, *expected;
+	struct ann_rec *a;
+	guint i;
+	int ret;
+
+	expected = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	for (i = 0; i < anns->len; i++) {
+		a = &g_array_index(anns, struct ann_rec, i);
+		if (a->start_sample <= es && a->end_sample >= ss)
+			g_array_append_val(expected, *a);
+	}
+
+	found = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	ret = srd_spill_query(spill, ss, es, spill_collect_cb, found);
+	fail_unless(ret == SRD_OK, "srd_spill_query() failed: %d.", ret);
+	fail_unless(found->len == expected->len, "Query found %u of %u "
+		"annotations.", found->len, expected->len);
+	if (expected->len)
+		ann_arrays_compare(expected, found);
+	g_array_free(expected, TRUE);
+	g_array_free(found, TRUE);
+}
+
+/*
+ * Check whether spill files hold what the callback receives, and can
+ * be read back after the session is gone.
+ */
+START_TEST(test_session_spill)
+{
+	uint8_t *plane;
+	uint64_t num_samples, count;
+	struct srd_session *sess;
+	struct srd_spill *spill;
+	struct srd_spill_item item;
+	struct ann_rec *a;
+	GArray *anns;
+	char *path, *filename;
+	const char *suffixes[] = { ".rec", ".str", ".idx" };
+	guint i;
+	int ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+	path = g_strdup_printf("%s/srd-spill-%d", g_get_tmp_dir(), (int)getpid());
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	srd_session_new(&sess);
+	ret = srd_session_spill_set(sess, path);
+	fail_unless(ret == SRD_OK, "srd_session_spill_set() failed: %d.", ret);
+	anns = uart_session_run(sess, plane, num_samples, 1024);
+	fail_unless(anns->len > 0, "No annotations for the UART frame.");
+	srd_session_destroy(sess);
+	srd_exit();
+
+	ret = srd_spill_open(path, &spill);
+	fail_unless(ret == SRD_OK, "srd_spill_open() failed: %d.", ret);
+	srd_spill_count_get(spill, &count);
+	fail_unless(count == anns->len, "Spill has %" PRIu64 " of %u "
+		"annotations.", count, anns->len);
+	for (i = 0; i < anns->len; i++) {
+		a = &g_array_index(anns, struct ann_rec, i);
+		ret = srd_spill_get(spill, i, &item);
+		fail_unless(ret == SRD_OK, "srd_spill_get() failed: %d.", ret);
+		fail_unless(item.start_sample == a->start_sample &&
+			item.end_sample == a->end_sample &&
+			item.ann_class == a->ann_class &&
+			item.ann_row == a->ann_row, "Record %u differs.", i);
+	}
+	ret = srd_spill_get(spill, count, &item);
+	fail_unless(ret != SRD_OK, "Record past the end was returned.");
+
+	spill_check_range(spill, anns, 0, num_samples);
+	spill_check_range(spill, anns, 40000, 40100);
+	spill_check_range(spill, anns, 40087, 40087);
+	spill_check_range(spill, anns, 0, 39999);
+	srd_spill_close(spill);
+
+	for (i = 0; i < G_N_ELEMENTS(suffixes); i++) {
+		filename = g_strconcat(path, suffixes[i], NULL);
+		g_remove(filename);
+		g_free(filename);
+	}
+	ret = srd_spill_open(path, &spill);
+	fail_unless(ret != SRD_OK, "Missing spill files were opened.");
+
+	g_array_free(anns, TRUE);
+	g_free(path);
+	g_free(plane);
+}
+END_TEST
+
+static guint file_lines(const char *path)
+{
+	char *contents, *p;
+	gsize len;
+	guint lines;
+
+	fail_unless(g_file_get_contents(path, &contents, &len, NULL),
+		"Cannot read %s.", path);
+	lines = 0;
+	for (p = contents; p < contents + len; p++)
+		lines += *p == '\n';
+	fail_unless(!len || contents[len - 1] == '\n', "Truncated last line.");
+	g_free(contents);
+
+	return lines;
+}
+
+/*
+ * Check whether exporters write one line per annotation, and binary
+ * exporters the selected payload.
+ */
+START_TEST(test_session_export)
+{
+	uint8_t *plane;
+	uint64_t num_samples;
+	struct srd_session *sess;
+	struct srd_exporter *csv, *jsonl, *bin;
+	GArray *anns;
+	char *csv_path, *jsonl_path, *bin_path, *contents;
+	gsize len;
+	int ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+	csv_path = g_strdup_printf("%s/srd-export-%d.csv",
+		g_get_tmp_dir(), (int)getpid());
+	jsonl_path = g_strdup_printf("%s/srd-export-%d.jsonl",
+		g_get_tmp_dir(), (int)getpid());
+	bin_path = g_strdup_printf("%s/srd-export-%d.bin",
+		g_get_tmp_dir(), (int)getpid());
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	srd_session_new(&sess);
+	ret = srd_exporter_new(sess, SRD_EXPORT_CSV, csv_path,
+		SRD_EXPORT_FLAG_TIME | SRD_EXPORT_FLAG_HEADER, &csv);
+	fail_unless(ret == SRD_OK, "srd_exporter_new() failed: %d.", ret);
+	ret = srd_exporter_new(sess, SRD_EXPORT_JSONL, jsonl_path,
+		SRD_EXPORT_FLAG_TIME, &jsonl);
+	fail_unless(ret == SRD_OK, "srd_exporter_new() failed: %d.", ret);
+	ret = srd_exporter_new(sess, SRD_EXPORT_BINARY, bin_path, 0, &bin);
+	fail_unless(ret == SRD_OK, "srd_exporter_new() failed: %d.", ret);
+	/* RX dump only, the RX/TX dump would repeat the byte. */
+	srd_exporter_select(bin, NULL, SRD_EXPORT_ANY, 0);
+	anns = uart_session_run(sess, plane, num_samples, 1024);
+	fail_unless(anns->len > 0, "No annotations for the UART frame.");
+
+	fail_unless(file_lines(csv_path) == anns->len + 1,
+		"CSV lines don't match the annotations.");
+	fail_unless(file_lines(jsonl_path) == anns->len,
+		"JSON lines don't match the annotations.");
+	fail_unless(g_file_get_contents(bin_path, &contents, &len, NULL));
+	fail_unless(len == 1 && (uint8_t)contents[0] == 0x5a,
+		"Binary export is wrong (%u bytes).", (unsigned int)len);
+	g_free(contents);
+
+	/* Detach one exporter explicitly, the session frees the others. */
+	ret = srd_exporter_free(csv);
+	fail_unless(ret == SRD_OK, "srd_exporter_free() failed: %d.", ret);
+	srd_session_destroy(sess);
+	srd_exit();
+
+	g_remove(csv_path);
+	g_remove(jsonl_path);
+	g_remove(bin_path);
+	g_array_free(anns, TRUE);
+	g_free(csv_path);
+	g_free(jsonl_path);
+	g_free(bin_path);
+	g_free(plane);
+}
+END_TEST
+
+/* Check whether bogus exporter arguments are rejected. */
+START_TEST(test_session_export_bogus)
+{
+	struct srd_session *sess;
+	struct srd_exporter *exp;
+	int ret;
+
+	srd_init(DECODERS_TESTDIR);
+	srd_session_new(&sess);
+	ret = srd_exporter_new(NULL, SRD_EXPORT_CSV, "x.csv", 0, &exp);
+	fail_unless(ret != SRD_OK, "srd_exporter_new(NULL) worked.");
+	ret = srd_exporter_new(sess, 42, "x.csv", 0, &exp);
+	fail_unless(ret != SRD_OK, "Bogus format was accepted.");
+	ret = srd_exporter_new(sess, SRD_EXPORT_CSV, NULL, 0, &exp);
+	fail_unless(ret != SRD_OK, "NULL path was accepted.");
+	ret = srd_exporter_select(NULL, NULL, 0, 0);
+	fail_unless(ret != SRD_OK, "srd_exporter_select(NULL) worked.");
+	ret = srd_exporter_free(NULL);
+	fail_unless(ret != SRD_OK, "srd_exporter_free(NULL) worked.");
+	srd_session_destroy(sess);
+	srd_exit();
+}
+END_TEST
+
+static void midi_collect_cb(struct srd_proto_data *pdata, void *cb_data)
+{
+	if (!strcmp(pdata->pdo->di->decoder->id, "midi"))
+		ann_collect_cb(pdata, cb_data);
+}
+
+/*
+ * Check whether replaying the cached UART output into a new MIDI
+ * instance yields what the MIDI instance stacked on the UART got.
+ */
+START_TEST(test_session_pycache)
+{
+	uint8_t *plane;
+	uint64_t num_samples, start, end, records, bytes;
+	struct srd_session *sess, *replay_sess;
+	struct srd_decoder_inst *uart, *midi, *replay_midi;
+	struct srd_input_data inbuf[2];
+	GArray *live, *replayed;
+	int ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	/* MIDI timing clock, a message of its own. */
+	uart_plane_fill(plane, num_samples, 40000, 0xf8);
+	live = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	replayed = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	srd_decoder_load("midi");
+	srd_session_new(&sess);
+	uart = srd_inst_new(sess, "uart", NULL);
+	midi = srd_inst_new(sess, "midi", NULL);
+	fail_unless(uart && midi, "Cannot create instances.");
+	srd_inst_stack(sess, uart, midi);
+	ret = srd_inst_pycache_set(uart, TRUE);
+	fail_unless(ret == SRD_OK, "srd_inst_pycache_set() failed: %d.", ret);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, midi_collect_cb, live);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+	inbuf[1].data = NULL;
+	inbuf[1].constant = 1;
+	for (start = 0; start < num_samples; start = end) {
+		end = MIN(start + 1024, num_samples);
+		inbuf[0].data = plane + start / 8;
+		inbuf[0].constant = 0;
+		srd_session_send(sess, start, end, inbuf);
+	}
+	srd_session_send_eof(sess);
+
+	ret = srd_inst_pycache_size_get(uart, &records, &bytes);
+	fail_unless(ret == SRD_OK, "srd_inst_pycache_size_get() failed.");
+	fail_unless(records > 0 && bytes > 0, "Nothing was cached.");
+	ret = srd_inst_pycache_replay(uart, midi);
+	fail_unless(ret != SRD_OK, "Replay into a stacked instance worked.");
+
+	srd_session_new(&replay_sess);
+	replay_midi = srd_inst_new(replay_sess, "midi", NULL);
+	srd_pd_output_callback_add(replay_sess, SRD_OUTPUT_ANN,
+		midi_collect_cb, replayed);
+	srd_session_start(replay_sess);
+	ret = srd_inst_pycache_replay(uart, replay_midi);
+	fail_unless(ret == SRD_OK, "srd_inst_pycache_replay() failed: %d.", ret);
+	srd_session_send_eof(replay_sess);
+	ann_arrays_compare(live, replayed);
+
+	srd_inst_pycache_set(uart, FALSE);
+	ret = srd_inst_pycache_size_get(uart, &records, &bytes);
+	fail_unless(ret != SRD_OK, "Disabled cache reports a size.");
+
+	srd_session_destroy(replay_sess);
+	srd_session_destroy(sess);
+	srd_exit();
+
+	g_array_free(live, TRUE);
+	g_array_free(replayed, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+/* MIDI annotations, with the phase of the feed in which they arrived. */
+struct midi_phased {
+	GArray *anns;
+	GArray *phases;
+	gint phase;
+};
+
+static void midi_phased_cb(struct srd_proto_data *pdata, void *cb_data)
+{
+	struct midi_phased *mp;
+	gint phase;
+
+	mp = cb_data;
+	if (strcmp(pdata->pdo->di->decoder->id, "midi"))
+		return;
+	ann_collect_cb(pdata, mp->anns);
+	phase = g_atomic_int_get(&mp->phase);
+	g_array_append_val(mp->phases, phase);
+}
+
+/*
+ * Decode UART with MIDI on top, the phase is the number of the chunk
+ * being sent, or the number of chunks during EOF.
+ */
+static void uart_midi_run(const uint8_t *plane, uint64_t num_samples,
+		uint64_t chunk_size, gboolean pipeline, struct midi_phased *mp)
+{
+	struct srd_session *sess;
+	struct srd_decoder_inst *uart, *midi;
+	struct srd_input_data inbuf[2];
+	uint64_t start, end;
+	gint phase;
+	int ret;
+
+	mp->anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	mp->phases = g_array_new(FALSE, FALSE, sizeof(gint));
+	mp->phase = 0;
+
+	srd_session_new(&sess);
+	ret = srd_session_pipeline_set(sess, pipeline);
+	fail_unless(ret == SRD_OK, "srd_session_pipeline_set() failed: %d.", ret);
+	uart = srd_inst_new(sess, "uart", NULL);
+	midi = srd_inst_new(sess, "midi", NULL);
+	fail_unless(uart && midi, "Cannot create instances.");
+	srd_inst_stack(sess, uart, midi);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, midi_phased_cb, mp);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+	inbuf[1].data = NULL;
+	inbuf[1].constant = 1;
+	phase = 0;
+	for (start = 0; start < num_samples; start = end) {
+		end = MIN(start + chunk_size, num_samples);
+		inbuf[0].data = (uint8_t *)plane + start / 8;
+		inbuf[0].constant = 0;
+		g_atomic_int_set(&mp->phase, phase++);
+		ret = srd_session_send(sess, start, end, inbuf);
+		fail_unless(ret == SRD_OK, "srd_session_send() failed: %d.", ret);
+	}
+	g_atomic_int_set(&mp->phase, phase++);
+	srd_session_send_eof(sess);
+	g_atomic_int_set(&mp->phase, phase);
+	srd_session_destroy(sess);
+}
+
+/*
+ * Check whether a pipelined UART/MIDI stack yields what the synchronous
+ * stack does, in the same order, and all of it before EOF returns.
+ */
+START_TEST(test_session_pipeline)
+{
+	static const uint8_t msgs[] = {
+		0x90, 0x3c, 0x40, 0xf8, 0x80, 0x3c, 0x00,
+		0xb0, 0x07, 0x64, 0xc0, 0x05, 0xf8,
+	};
+	uint8_t *plane;
+	uint64_t num_samples, chunk_size;
+	struct midi_phased sync, pipe;
+	gint eof_phase, a, b;
+	guint i;
+
+	num_samples = 64 * 1024;
+	chunk_size = 1024;
+	eof_phase = num_samples / chunk_size;
+	plane = g_malloc(num_samples / 8);
+	memset(plane, 0xff, num_samples / 8);
+	/* Gaps between frames, some frames span chunk boundaries. */
+	for (i = 0; i < G_N_ELEMENTS(msgs); i++)
+		uart_frame_put(plane, num_samples, 2000 + i * 3500, msgs[i]);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	srd_decoder_load("midi");
+	uart_midi_run(plane, num_samples, chunk_size, FALSE, &sync);
+	uart_midi_run(plane, num_samples, chunk_size, TRUE, &pipe);
+	srd_exit();
+	ann_arrays_compare(sync.anns, pipe.anns);
+	for (i = 0; i < sync.phases->len && i < pipe.phases->len; i++) {
+		a = g_array_index(sync.phases, gint, i);
+		b = g_array_index(pipe.phases, gint, i);
+		fail_unless(b >= a, "Pipelined output %u came early.", i);
+		fail_unless(b <= eof_phase, "Pipelined output %u came after "
+			"EOF.", i);
+	}
+
+	g_array_free(sync.anns, TRUE);
+	g_array_free(sync.phases, TRUE);
+	g_array_free(pipe.anns, TRUE);
+	g_array_free(pipe.phases, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+/*
+ * Check whether the annotation store and exporters can be attached,
+ * detached and restricted while pipelined decoder threads deliver output
+ * to them.
+ */
+START_TEST(test_session_pipeline_sinks)
+{
+	static const uint8_t msgs[] = { 0x90, 0x3c, 0x40, 0x80, 0x3c, 0x00 };
+	uint8_t *plane;
+	uint64_t num_samples, start, end;
+	struct srd_session *sess;
+	struct srd_decoder_inst *uart, *midi;
+	struct srd_exporter *exp;
+	struct srd_input_data inbuf[2];
+	struct midi_phased sync, pipe;
+	char *path;
+	guint i, j;
+	int ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	memset(plane, 0xff, num_samples / 8);
+	for (i = 0; i < G_N_ELEMENTS(msgs); i++)
+		uart_frame_put(plane, num_samples, 2000 + i * 3500, msgs[i]);
+	path = g_strdup_printf("%s/srd-sinks-%d.jsonl",
+		g_get_tmp_dir(), (int)getpid());
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	srd_decoder_load("midi");
+	uart_midi_run(plane, num_samples, 1024, FALSE, &sync);
+
+	pipe.anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	pipe.phases = g_array_new(FALSE, FALSE, sizeof(gint));
+	pipe.phase = 0;
+	srd_session_new(&sess);
+	srd_session_pipeline_set(sess, TRUE);
+	uart = srd_inst_new(sess, "uart", NULL);
+	midi = srd_inst_new(sess, "midi", NULL);
+	fail_unless(uart && midi, "Cannot create instances.");
+	srd_inst_stack(sess, uart, midi);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, midi_phased_cb,
+		&pipe);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+	inbuf[1].data = NULL;
+	inbuf[1].constant = 1;
+	exp = NULL;
+	for (start = 0, i = 0; start < num_samples; start = end, i++) {
+		end = MIN(start + 1024, num_samples);
+		inbuf[0].data = plane + start / 8;
+		inbuf[0].constant = 0;
+		ret = srd_session_send(sess, start, end, inbuf);
+		fail_unless(ret == SRD_OK, "srd_session_send() failed: %d.", ret);
+		/* MIDI may still be putting output of this chunk. */
+		srd_session_annstore_set(sess, i % 2 == 0);
+		if (exp) {
+			ret = srd_exporter_free(exp);
+			fail_unless(ret == SRD_OK, "srd_exporter_free() failed.");
+			exp = NULL;
+		} else {
+			ret = srd_exporter_new(sess, SRD_EXPORT_JSONL, path, 0,
+				&exp);
+			fail_unless(ret == SRD_OK, "srd_exporter_new() failed.");
+			/* Grow the selections while MIDI puts output. */
+			for (j = 0; j < 16; j++)
+				srd_exporter_select(exp, NULL, SRD_EXPORT_ANY, j);
+		}
+	}
+	srd_session_send_eof(sess);
+	srd_session_destroy(sess);
+	srd_exit();
+
+	ann_arrays_compare(sync.anns, pipe.anns);
+
+	g_remove(path);
+	g_free(path);
+	g_array_free(sync.anns, TRUE);
+	g_array_free(sync.phases, TRUE);
+	g_array_free(pipe.anns, TRUE);
+	g_array_free(pipe.phases, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+/* I2C at 100kHz (1MHz samplerate), idle with both lines high. */
+struct i2c_planes {
+	uint8_t *scl;
+	uint8_t *sda;
+	uint64_t pos;
+};
+
+static void i2c_levels(struct i2c_planes *p, int scl, int sda)
+{
+	uint64_t end;
+
+	for (end = p->pos + 5; p->pos < end; p->pos++) {
+		if (!scl)
+			p->scl[p->pos / 8] &= ~(1 << (p->pos % 8));
+		if (!sda)
+			p->sda[p->pos / 8] &= ~(1 << (p->pos % 8));
+	}
+}
+
+static void i2c_byte(struct i2c_planes *p, uint8_t value)
+{
+	int bit, level;
+
+	for (bit = 7; bit >= -1; bit--) {
+		/* The ninth clock is the slave's ACK. */
+		level = bit >= 0 ? (value >> bit) & 1 : 0;
+		i2c_levels(p, 0, level);
+		i2c_levels(p, 1, level);
+	}
+}
+
+/* Register write of a TCA6408A at 0x20. */
+static void i2c_reg_write(struct i2c_planes *p, uint8_t reg, uint8_t value)
+{
+	i2c_levels(p, 1, 1);
+	i2c_levels(p, 1, 0);
+	i2c_byte(p, 0x20 << 1);
+	i2c_byte(p, reg);
+	i2c_byte(p, value);
+	i2c_levels(p, 0, 0);
+	i2c_levels(p, 1, 0);
+	i2c_levels(p, 1, 1);
+}
+
+struct logic_rec {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	uint8_t value;
+};
+
+static void logic_collect_cb(struct srd_proto_data *pdata, void *cb_data)
+{
+	GArray *logic;
+	struct srd_proto_data_logic *pdl;
+	struct logic_rec rec;
+
+	logic = cb_data;
+	pdl = pdata->data;
+	rec.start_sample = pdata->start_sample;
+	rec.end_sample = pdata->end_sample;
+	rec.value = pdl->data[0];
+	g_array_append_val(logic, rec);
+}
+
+static GArray *i2c_tca6408a_run(const struct i2c_planes *p,
+		uint64_t num_samples, uint64_t chunk_size, gboolean pipeline)
+{
+	struct srd_session *sess;
+	struct srd_decoder_inst *i2c, *tca;
+	struct srd_input_data inbuf[2];
+	uint64_t start, end;
+	GArray *logic;
+
+	logic = g_array_new(FALSE, FALSE, sizeof(struct logic_rec));
+	srd_session_new(&sess);
+	srd_session_pipeline_set(sess, pipeline);
+	i2c = srd_inst_new(sess, "i2c", NULL);
+	tca = srd_inst_new(sess, "tca6408a", NULL);
+	fail_unless(i2c && tca, "Cannot create instances.");
+	srd_inst_stack(sess, i2c, tca);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_LOGIC,
+		logic_collect_cb, logic);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+	for (start = 0; start < num_samples; start = end) {
+		end = MIN(start + chunk_size, num_samples);
+		inbuf[0].data = p->scl + start / 8;
+		inbuf[0].constant = 0;
+		inbuf[1].data = p->sda + start / 8;
+		inbuf[1].constant = 0;
+		srd_session_send(sess, start, end, inbuf);
+	}
+	srd_session_send_eof(sess);
+	srd_session_destroy(sess);
+
+	return logic;
+}
+
+/*
+ * Check whether a pipelined stack has the stacked PD's queue drained
+ * before its flush() runs. The TCA6408A emits logic output up to the
+ * last I2C packet it saw upon flush().
+ */
+START_TEST(test_session_pipeline_flush)
+{
+	struct i2c_planes p;
+	uint64_t num_samples, chunk_size;
+	GArray *sync, *pipe;
+	struct logic_rec *a, *b;
+	guint i;
+
+	num_samples = 64 * 1024;
+	chunk_size = 1024;
+	p.scl = g_malloc(num_samples / 8);
+	p.sda = g_malloc(num_samples / 8);
+	memset(p.scl, 0xff, num_samples / 8);
+	memset(p.sda, 0xff, num_samples / 8);
+	for (i = 0; i < 12; i++) {
+		p.pos = 1000 + i * 4500;
+		i2c_reg_write(&p, 0x01, 0x11 * i);
+	}
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("i2c");
+	srd_decoder_load("tca6408a");
+	sync = i2c_tca6408a_run(&p, num_samples, chunk_size, FALSE);
+	pipe = i2c_tca6408a_run(&p, num_samples, chunk_size, TRUE);
+	srd_exit();
+	fail_unless(sync->len > 12, "Only %u logic outputs.", sync->len);
+	fail_unless(sync->len == pipe->len, "Logic output count differs "
+		"(%u vs %u).", sync->len, pipe->len);
+	for (i = 0; i < sync->len && i < pipe->len; i++) {
+		a = &g_array_index(sync, struct logic_rec, i);
+		b = &g_array_index(pipe, struct logic_rec, i);
+		fail_unless(a->start_sample == b->start_sample &&
+			a->end_sample == b->end_sample &&
+			a->value == b->value, "Logic output %u differs.", i);
+	}
+
+	g_array_free(sync, TRUE);
+	g_array_free(pipe, TRUE);
+	g_free(p.scl);
+	g_free(p.sda);
+}
+END_TEST
+
+struct plane_source {
+	const uint8_t *plane;
+	struct srd_input_view inbuf[2];
+};
+
+static const struct srd_input_view *plane_source_get(uint64_t start_sample,
+		uint64_t end_sample, void *cb_data)
+{
+	struct plane_source *src;
+
+	(void)end_sample;
+	src = cb_data;
+	memset(src->inbuf, 0, sizeof(src->inbuf));
+	src->inbuf[0].data = src->plane;
+	src->inbuf[0].bit_offset = start_sample;
+	src->inbuf[1].data = NULL;
+	src->inbuf[1].constant = 1;
+
+	return src->inbuf;
+}
+
+/*
+ * Check whether decoding a range from a checkpoint yields what the
+ * full decode produced for that range.
+ */
+START_TEST(test_session_decode_range)
+{
+	uint8_t *plane, *frame;
+	uint64_t num_samples, samplenums[16];
+	struct srd_session *sess;
+	struct plane_source src;
+	struct ann_rec *a;
+	GArray *anns, *expected, *ranged;
+	guint i, full_len;
+	int num, ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	frame = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+	uart_plane_fill(frame, num_samples, 20000, 0xa5);
+	for (i = 0; i < num_samples / 8; i++)
+		plane[i] &= frame[i];
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	srd_session_new(&sess);
+	ret = srd_session_checkpoint_interval_set(sess, 8192);
+	fail_unless(ret == SRD_OK, "Cannot set checkpoint interval: %d.", ret);
+	anns = uart_session_run(sess, plane, num_samples, 1024);
+	full_len = anns->len;
+
+	num = srd_session_checkpoints_get(sess, samplenums,
+		G_N_ELEMENTS(samplenums));
+	fail_unless(num == (int)(num_samples / 8192), "%d checkpoints.", num);
+	for (i = 0; i < (guint)num; i++)
+		fail_unless(samplenums[i] == (i + 1) * 8192,
+			"Checkpoint %u at %" PRIu64 ".", i, samplenums[i]);
+
+	/* The callback appends the range's annotations to the array. */
+	src.plane = plane;
+	ret = srd_session_decode_range(sess, 39000, 45000, 1024,
+		plane_source_get, &src);
+	fail_unless(ret == SRD_OK, "srd_session_decode_range() failed: %d.", ret);
+
+	expected = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	ranged = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	for (i = 0; i < anns->len; i++) {
+		a = &g_array_index(anns, struct ann_rec, i);
+		if (i >= full_len)
+			g_array_append_val(ranged, *a);
+		else if (a->end_sample >= 39000 && a->end_sample <= 45000)
+			g_array_append_val(expected, *a);
+	}
+	ann_arrays_compare(expected, ranged);
+
+	/* Bogus arguments. */
+	ret = srd_session_decode_range(sess, 10, 5, 0, plane_source_get, &src);
+	fail_unless(ret != SRD_OK, "Inverted range was accepted.");
+	ret = srd_session_decode_range(sess, 0, 5, 0, NULL, NULL);
+	fail_unless(ret != SRD_OK, "Missing source was accepted.");
+
+	srd_session_checkpoint_interval_set(sess, 0);
+	num = srd_session_checkpoints_get(sess, NULL, 0);
+	fail_unless(num == 0, "Checkpoints were not dropped.");
+
+	srd_session_destroy(sess);
+	srd_exit();
+
+	g_array_free(expected, TRUE);
+	g_array_free(ranged, TRUE);
+	g_array_free(anns, TRUE);
+	g_free(frame);
+	g_free(plane);
+}
+END_TEST
+
+/* Decode the plane through the result cache in dir. */
+static GArray *uart_cached_run(const char *dir, struct plane_source *src,
+		uint64_t num_samples, int delivery, gboolean *hit)
+{
+	struct srd_session *sess;
+	GArray *anns;
+	int ret;
+
+	anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	srd_session_new(&sess);
+	ret = srd_session_result_cache_set(sess, dir);
+	fail_unless(ret == SRD_OK, "Cannot set result cache: %d.", ret);
+	ret = srd_session_output_delivery_set(sess, delivery,
+		SRD_OUTPUT_OVERFLOW_BLOCK, 0);
+	fail_unless(ret == SRD_OK, "srd_session_output_delivery_set() "
+		"failed: %d.", ret);
+	fail_unless(srd_inst_new(sess, "uart", NULL) != NULL);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, ann_collect_cb, anns);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+	ret = srd_session_decode_cached(sess, num_samples, 1024,
+		plane_source_get, src, hit);
+	fail_unless(ret == SRD_OK, "srd_session_decode_cached() failed: %d.",
+		ret);
+	/* Polled output has been stored before the frontend sees it. */
+	if (delivery == SRD_OUTPUT_DELIVERY_POLL)
+		srd_session_poll_output(sess, 0);
+	srd_session_destroy(sess);
+
+	return anns;
+}
+
+/*
+ * Check whether a second session replays the first one's output from
+ * the result cache, and whether other input misses. Output which was
+ * not yet polled when the decode finished is part of the entry.
+ */
+START_TEST(test_session_result_cache)
+{
+	uint8_t *plane;
+	uint64_t num_samples;
+	struct plane_source src;
+	GArray *decoded, *replayed, *other, *other_replayed;
+	gboolean hit;
+	char *dir, *path;
+	const char *name;
+	GDir *d;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 20000, 0x5a);
+	src.plane = plane;
+	dir = g_strdup_printf("%s/srd-rcache-%d", g_get_tmp_dir(), (int)getpid());
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+
+	decoded = uart_cached_run(dir, &src, num_samples,
+		SRD_OUTPUT_DELIVERY_SYNC, &hit);
+	fail_unless(!hit, "Empty cache was hit.");
+	replayed = uart_cached_run(dir, &src, num_samples,
+		SRD_OUTPUT_DELIVERY_SYNC, &hit);
+	fail_unless(hit, "Cache was not hit.");
+	ann_arrays_compare(decoded, replayed);
+
+	uart_plane_fill(plane, num_samples, 30000, 0xa5);
+	other = uart_cached_run(dir, &src, num_samples,
+		SRD_OUTPUT_DELIVERY_POLL, &hit);
+	fail_unless(!hit, "Other input hit the cache.");
+	fail_unless(other->len > 0, "No annotations for other input.");
+	other_replayed = uart_cached_run(dir, &src, num_samples,
+		SRD_OUTPUT_DELIVERY_SYNC, &hit);
+	fail_unless(hit, "Cache was not hit after polled delivery.");
+	ann_arrays_compare(other, other_replayed);
+
+	srd_exit();
+
+	if ((d = g_dir_open(dir, 0, NULL))) {
+		while ((name = g_dir_read_name(d))) {
+			path = g_build_filename(dir, name, NULL);
+			g_unlink(path);
+			g_free(path);
+		}
+		g_dir_close(d);
+	}
+	g_rmdir(dir);
+	g_free(dir);
+	g_array_free(decoded, TRUE);
+	g_array_free(replayed, TRUE);
+	g_array_free(other, TRUE);
+	g_array_free(other_replayed, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+struct shared_anns {
+	struct srd_decoder_inst *di[3];
+	GArray *anns[3];
+};
+
+static void shared_ann_cb(struct srd_proto_data *pdata, void *cb_data)
+{
+	struct shared_anns *sa;
+	int i;
+
+	sa = cb_data;
+	for (i = 0; i < 3; i++) {
+		if (pdata->pdo->di == sa->di[i])
+			ann_collect_cb(pdata, sa->anns[i]);
+	}
+}
+
+/*
+ * Check whether identically configured instances share one decode, and
+ * still get their own output, while a differently configured one
+ * decodes on its own.
+ */
+START_TEST(test_session_inst_sharing)
+{
+	uint8_t *plane;
+	uint64_t num_samples, start, end;
+	struct srd_session *sess;
+	struct srd_input_data inbuf[2];
+	struct shared_anns sa;
+	GHashTable *options;
+	int i, ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 20000, 0x5a);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	srd_session_new(&sess);
+	ret = srd_session_inst_sharing_set(sess, TRUE);
+	fail_unless(ret == SRD_OK, "Cannot enable sharing: %d.", ret);
+
+	sa.di[0] = srd_inst_new(sess, "uart", NULL);
+	sa.di[1] = srd_inst_new(sess, "uart", NULL);
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("baudrate"),
+		g_variant_ref_sink(g_variant_new_int64(57600)));
+	sa.di[2] = srd_inst_new(sess, "uart", options);
+	g_hash_table_destroy(options);
+	for (i = 0; i < 3; i++) {
+		fail_unless(sa.di[i] != NULL);
+		sa.anns[i] = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	}
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, shared_ann_cb, &sa);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+
+	fail_unless(sa.di[1]->shared_inst == sa.di[0], "Not shared.");
+	fail_unless(sa.di[2]->shared_inst == NULL, "Other options shared.");
+
+	inbuf[1].data = NULL;
+	inbuf[1].constant = 1;
+	for (start = 0; start < num_samples; start = end) {
+		end = MIN(start + 1024, num_samples);
+		inbuf[0].data = plane + start / 8;
+		inbuf[0].constant = 0;
+		ret = srd_session_send(sess, start, end, inbuf);
+		fail_unless(ret == SRD_OK, "srd_session_send() failed: %d.", ret);
+	}
+	srd_session_send_eof(sess);
+
+	ann_arrays_compare(sa.anns[0], sa.anns[1]);
+	fail_unless(sa.anns[2]->len > 0, "Unshared instance put nothing.");
+
+	srd_session_destroy(sess);
+	srd_exit();
+
+	for (i = 0; i < 3; i++)
+		g_array_free(sa.anns[i], TRUE);
+	g_free(plane);
+}
+END_TEST
+
+struct search_hits {
+	GArray *starts;
+	int output_type;
+};
+
+static gboolean search_collect_cb(const struct srd_search_match *match,
+		void *cb_data)
+{
+	struct search_hits *hits;
+
+	hits = cb_data;
+	fail_unless(!strcmp(match->inst_id, "uart"), "Match of %s.",
+		match->inst_id);
+	hits->output_type = match->output_type;
+	g_array_append_val(hits->starts, match->start_sample);
+
+	return TRUE;
+}
+
+static guint search_count(struct srd_session *sess, const char *inst_id,
+		const char *query, int *output_type)
+{
+	struct search_hits hits;
+	guint i, len;
+	int ret;
+
+	hits.starts = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	hits.output_type = -1;
+	ret = srd_search_query(sess, inst_id, query, 0, G_MAXUINT64,
+		search_collect_cb, &hits);
+	fail_unless(ret == SRD_OK, "srd_search_query() failed: %d.", ret);
+	for (i = 1; i < hits.starts->len; i++)
+		fail_unless(g_array_index(hits.starts, uint64_t, i - 1) <=
+			g_array_index(hits.starts, uint64_t, i),
+			"Matches of '%s' are not sorted.", query);
+	if (output_type)
+		*output_type = hits.output_type;
+	len = hits.starts->len;
+	g_array_free(hits.starts, TRUE);
+
+	return len;
+}
+
+/* Check whether searches find the annotations and Python output. */
+START_TEST(test_session_search)
+{
+	uint8_t *plane, *frame;
+	uint64_t num_samples;
+	struct srd_session *sess;
+	GArray *anns;
+	guint i, n;
+	int type, ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	frame = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+	uart_plane_fill(frame, num_samples, 20000, 0xa5);
+	for (i = 0; i < num_samples / 8; i++)
+		plane[i] &= frame[i];
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	srd_session_new(&sess);
+	ret = srd_session_search_set(sess, SRD_SEARCH_ANN | SRD_SEARCH_PYTHON);
+	fail_unless(ret == SRD_OK, "Cannot enable search: %d.", ret);
+	anns = uart_session_run(sess, plane, num_samples, 1024);
+
+	/* The data annotation's text, and the Python output's value. */
+	n = search_count(sess, NULL, "5a", &type);
+	fail_unless(n == 1 && type == SRD_OUTPUT_ANN, "'5a': %u matches.", n);
+	n = search_count(sess, "uart", "DATA 0x5A", &type);
+	fail_unless(n == 1 && type == SRD_OUTPUT_PYTHON,
+		"'DATA 0x5A': %u matches.", n);
+	n = search_count(sess, NULL, "data 90 0xa5", NULL);
+	fail_unless(n == 0, "Terms of different frames matched: %u.", n);
+
+	n = search_count(sess, NULL, "start bit", NULL);
+	fail_unless(n == 2, "'start bit': %u matches.", n);
+	n = search_count(sess, NULL, "sta*", NULL);
+	fail_unless(n >= 2, "'sta*': %u matches.", n);
+	n = search_count(sess, NULL, "nosuchtoken", NULL);
+	fail_unless(n == 0, "'nosuchtoken': %u matches.", n);
+	n = search_count(sess, "nosuchinst", "5a", NULL);
+	fail_unless(n == 0, "Other instance matched: %u.", n);
+
+	ret = srd_search_query(sess, NULL, " ", 0, 1, search_collect_cb, NULL);
+	fail_unless(ret != SRD_OK, "Empty query was accepted.");
+
+	srd_session_terminate_reset(sess);
+	n = search_count(sess, NULL, "5a", NULL);
+	fail_unless(n == 0, "Index was not cleared.");
+
+	srd_session_destroy(sess);
+	srd_exit();
+
+	g_array_free(anns, TRUE);
+	g_free(frame);
+	g_free(plane);
+}
+END_TEST
+
+static gboolean scan_collect_cb(const struct srd_scan_match *match,
+		void *cb_data)
+{
+	g_array_append_val((GArray *)cb_data, *match);
+
+	return TRUE;
+}
+
+static GArray *scan_collect(const struct srd_scan *scan, uint64_t num_samples,
+		uint64_t chunk_size, srd_sample_source source, void *source_data)
+{
+	GArray *matches;
+	int ret;
+
+	matches = g_array_new(FALSE, FALSE, sizeof(struct srd_scan_match));
+	ret = srd_scan_run(scan, 0, num_samples, chunk_size, source,
+		source_data, scan_collect_cb, matches);
+	fail_unless(ret == SRD_OK, "Scan failed: %d.", ret);
+
+	return matches;
+}
+
+/* A clock with rising edges at 8k + 4, and data bit k in [8k, 8k + 8). */
+static void serial_planes_fill(uint8_t *clk, uint8_t *data,
+		uint64_t num_samples, uint64_t first_bit, uint8_t value)
+{
+	uint64_t s, bit;
+
+	memset(clk, 0, num_samples / 8);
+	memset(data, 0, num_samples / 8);
+	for (s = 0; s < num_samples; s++) {
+		if ((s / 4) % 2)
+			clk[s / 8] |= 1 << (s % 8);
+		bit = s / 8;
+		if (bit >= first_bit && bit < first_bit + 8 &&
+				(value >> (7 - (bit - first_bit))) & 1)
+			data[s / 8] |= 1 << (s % 8);
+	}
+}
+
+struct serial_source {
+	const uint8_t *clk, *data;
+	struct srd_input_view inbuf[2];
+};
+
+static const struct srd_input_view *serial_source_get(uint64_t start_sample,
+		uint64_t end_sample, void *cb_data)
+{
+	struct serial_source *src;
+
+	(void)end_sample;
+	src = cb_data;
+	memset(src->inbuf, 0, sizeof(src->inbuf));
+	fail_unless(start_sample % 8 == 0, "Chunk is not byte aligned.");
+	src->inbuf[0].data = (uint8_t *)src->clk + start_sample / 8;
+	src->inbuf[0].constant = 0;
+	src->inbuf[1].data = (uint8_t *)src->data + start_sample / 8;
+	src->inbuf[1].constant = 0;
+
+	return src->inbuf;
+}
+
+/*
+ * Check pulse, state and serial scans against signals with known
+ * timing, with matches across chunk boundaries.
+ */
+START_TEST(test_session_scan)
+{
+	uint8_t *plane, *clk, *data;
+	uint64_t num_samples;
+	struct plane_source src;
+	struct serial_source ser;
+	struct srd_scan scan;
+	struct srd_scan_match *m;
+	GArray *matches;
+	int ret;
+
+	/* UART 0x5a: low for start bit plus bit 0, then bits 2, 5 and 7. */
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 20000, 0x5a);
+	src.plane = plane;
+
+	memset(&scan, 0, sizeof(scan));
+	scan.type = SRD_SCAN_PULSE;
+	scan.channel = 0;
+	scan.level = 0;
+	scan.max_width = 12;
+	matches = scan_collect(&scan, num_samples, 1000, plane_source_get, &src);
+	fail_unless(matches->len == 3, "%u short pulses.", matches->len);
+	g_array_free(matches, TRUE);
+
+	scan.min_width = 13;
+	scan.max_width = 0;
+	matches = scan_collect(&scan, num_samples, 1000, plane_source_get, &src);
+	fail_unless(matches->len == 1, "%u long pulses.", matches->len);
+	m = &g_array_index(matches, struct srd_scan_match, 0);
+	fail_unless(m->start_sample == 20000, "Pulse starts at %" PRIu64 ".",
+		m->start_sample);
+	g_array_free(matches, TRUE);
+
+	memset(&scan, 0, sizeof(scan));
+	scan.type = SRD_SCAN_STATE;
+	scan.state_mask = 1;
+	scan.state_value = 0;
+	matches = scan_collect(&scan, num_samples, 1000, plane_source_get, &src);
+	fail_unless(matches->len == 4, "%u low states.", matches->len);
+	g_array_free(matches, TRUE);
+
+	/* The constant channel 1 is never low. */
+	scan.state_mask = 3;
+	matches = scan_collect(&scan, num_samples, 1000, plane_source_get, &src);
+	fail_unless(matches->len == 0, "%u low states.", matches->len);
+	g_array_free(matches, TRUE);
+
+	/* 0xa5 in bits 100-107, scanned in chunks which split it. */
+	num_samples = 2048;
+	clk = g_malloc(num_samples / 8);
+	data = g_malloc(num_samples / 8);
+	serial_planes_fill(clk, data, num_samples, 100, 0xa5);
+	ser.clk = clk;
+	ser.data = data;
+
+	memset(&scan, 0, sizeof(scan));
+	scan.type = SRD_SCAN_SERIAL;
+	scan.channel = 1;
+	scan.clock_channel = 0;
+	scan.clock_edge = SRD_SCAN_EDGE_RISING;
+	scan.pattern = 0xa5;
+	scan.pattern_bits = 8;
+	matches = scan_collect(&scan, num_samples, 120, serial_source_get, &ser);
+	fail_unless(matches->len == 1, "%u serial matches.", matches->len);
+	m = &g_array_index(matches, struct srd_scan_match, 0);
+	fail_unless(m->start_sample == 804 && m->end_sample == 861,
+		"Serial match at %" PRIu64 "-%" PRIu64 ".",
+		m->start_sample, m->end_sample);
+	g_array_free(matches, TRUE);
+
+	scan.pattern_bits = 0;
+	ret = srd_scan_run(&scan, 0, num_samples, 0, serial_source_get, &ser,
+		scan_collect_cb, NULL);
+	fail_unless(ret != SRD_OK, "Empty pattern was accepted.");
+	ret = srd_scan_run(NULL, 0, num_samples, 0, serial_source_get, &ser,
+		scan_collect_cb, NULL);
+	fail_unless(ret != SRD_OK, "NULL scan was accepted.");
+
+	g_free(data);
+	g_free(clk);
+	g_free(plane);
+}
+END_TEST
+
+/* Decode a capture file of the UART plane and an idle TX channel. */
+static GArray *uart_file_run(const char *path, int format)
+{
+	struct srd_session *sess;
+	struct srd_file_source *src;
+	GArray *anns;
+	unsigned int num_channels;
+	uint64_t num_samples;
+	int ret;
+
+	ret = srd_file_source_open(path, format, 2, 0, &src);
+	fail_unless(ret == SRD_OK, "Cannot open %s: %d.", path, ret);
+	srd_file_source_info_get(src, &num_channels, &num_samples);
+	fail_unless(num_channels == 2 && num_samples == 64 * 1024,
+		"%s has %u channels, %" PRIu64 " samples.", path,
+		num_channels, num_samples);
+
+	anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	srd_session_new(&sess);
+	fail_unless(srd_inst_new(sess, "uart", NULL) != NULL);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, ann_collect_cb, anns);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+	ret = srd_session_send_file(sess, src, 0);
+	fail_unless(ret == SRD_OK, "srd_session_send_file() failed: %d.", ret);
+	srd_session_send_eof(sess);
+	srd_session_destroy(sess);
+	srd_file_source_close(src);
+
+	return anns;
+}
+
+/*
+ * Check whether bit-plane files and logic dumps decode like the same
+ * samples sent from memory.
+ */
+START_TEST(test_session_file_source)
+{
+	uint8_t *plane, *planes, *logic;
+	uint64_t num_samples, s;
+	struct srd_file_source *src;
+	GArray *expected, *anns;
+	char *planes_path, *logic_path;
+	int ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+
+	/* Channel 0 is RX, channel 1 is the idle TX line. */
+	planes = g_malloc(num_samples / 4);
+	memcpy(planes, plane, num_samples / 8);
+	memset(planes + num_samples / 8, 0xff, num_samples / 8);
+	logic = g_malloc(num_samples);
+	for (s = 0; s < num_samples; s++)
+		logic[s] = 2 | ((plane[s / 8] >> (s % 8)) & 1);
+
+	planes_path = g_strdup_printf("%s/srd-planes-%d",
+		g_get_tmp_dir(), (int)getpid());
+	logic_path = g_strdup_printf("%s/srd-logic-%d",
+		g_get_tmp_dir(), (int)getpid());
+	fail_unless(g_file_set_contents(planes_path, (const char *)planes,
+		num_samples / 4, NULL));
+	fail_unless(g_file_set_contents(logic_path, (const char *)logic,
+		num_samples, NULL));
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	expected = uart_decode_chunked(plane, num_samples, 1024);
+
+	anns = uart_file_run(planes_path, SRD_FILE_PLANES);
+	ann_arrays_compare(expected, anns);
+	g_array_free(anns, TRUE);
+
+	anns = uart_file_run(logic_path, SRD_FILE_LOGIC);
+	ann_arrays_compare(expected, anns);
+	g_array_free(anns, TRUE);
+
+	/* Too few bytes for the requested samples. */
+	ret = srd_file_source_open(planes_path, SRD_FILE_PLANES, 2,
+		num_samples * 2, &src);
+	fail_unless(ret != SRD_OK, "Short file was accepted.");
+	ret = srd_file_source_open(planes_path, SRD_FILE_PLANES, 0, 0, &src);
+	fail_unless(ret != SRD_OK, "Zero channels were accepted.");
+
+	srd_exit();
+
+	g_remove(planes_path);
+	g_remove(logic_path);
+	g_free(planes_path);
+	g_free(logic_path);
+	g_array_free(expected, TRUE);
+	g_free(logic);
+	g_free(planes);
+	g_free(plane);
+}
+END_TEST
+
+struct ring_producer {
+	struct srd_session *sess;
+	const uint8_t *plane;
+	uint64_t num_samples;
+};
+
+/* Write the RX plane and an idle TX plane into the ring, then close it. */
+static gpointer ring_produce(gpointer data)
+{
+	struct ring_producer *p;
+	uint8_t *planes[2];
+	uint64_t pos, n;
+
+	p = data;
+	for (pos = 0; pos < p->num_samples; pos += n) {
+		n = MIN(p->num_samples - pos, 1000);
+		if (srd_ring_reserve(p->sess, &n, planes) != SRD_OK)
+			break;
+		memcpy(planes[0], p->plane + pos / 8, (n + 7) / 8);
+		memset(planes[1], 0xff, (n + 7) / 8);
+		srd_ring_commit(p->sess, n);
+	}
+	srd_ring_close(p->sess);
+
+	return NULL;
+}
+
+/*
+ * Check whether streaming through a small ring decodes like sending
+ * the samples directly, and whether the retained samples can be read.
+ */
+START_TEST(test_session_ring)
+{
+	uint8_t *plane, *planes[2];
+	uint64_t num_samples, start, s;
+	struct srd_session *sess;
+	struct ring_producer producer;
+	GArray *expected, *anns;
+	GThread *thread;
+	int ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	expected = uart_decode_chunked(plane, num_samples, 1024);
+
+	anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	srd_session_new(&sess);
+	ret = srd_session_ring_set(sess, 2, 4096, 1024);
+	fail_unless(ret == SRD_OK, "Cannot set up ring: %d.", ret);
+	fail_unless(srd_inst_new(sess, "uart", NULL) != NULL);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, ann_collect_cb, anns);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+
+	producer.sess = sess;
+	producer.plane = plane;
+	producer.num_samples = num_samples;
+	thread = g_thread_new("ring-producer", ring_produce, &producer);
+	ret = srd_session_ring_run(sess, 1500);
+	g_thread_join(thread);
+	fail_unless(ret == SRD_OK, "srd_session_ring_run() failed: %d.", ret);
+	srd_session_send_eof(sess);
+	ann_arrays_compare(expected, anns);
+
+	/* The last 1024 samples are retained, from any bit on. */
+	start = num_samples - 1000;
+	planes[0] = g_malloc(125);
+	planes[1] = g_malloc(125);
+	ret = srd_ring_read(sess, start, num_samples, planes);
+	fail_unless(ret == SRD_OK, "srd_ring_read() failed: %d.", ret);
+	for (s = start; s < num_samples; s++)
+		fail_unless(((planes[0][(s - start) / 8] >> ((s - start) % 8)) & 1) ==
+			((plane[s / 8] >> (s % 8)) & 1), "Sample %" PRIu64
+			" differs.", s);
+	ret = srd_ring_read(sess, num_samples - 2048, num_samples - 1024,
+		planes);
+	fail_unless(ret != SRD_OK, "Overwritten samples were read.");
+
+	srd_session_destroy(sess);
+	srd_exit();
+
+	g_free(planes[0]);
+	g_free(planes[1]);
+	g_array_free(anns, TRUE);
+	g_array_free(expected, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+/*
+ * Check whether a chunk whose channel consists of segments, aligned
+ * and not, decodes like the contiguous plane.
+ */
+START_TEST(test_session_send_segments)
+{
+	uint8_t *plane, *shifted;
+	uint64_t num_samples, s;
+	struct srd_session *sess;
+	struct srd_input_segment segs[5];
+	struct srd_input_segments channels[2];
+	GArray *expected, *anns;
+	int ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+
+	/* Samples 10003-29999 from bit 5 of a buffer of their own. */
+	shifted = g_malloc0(num_samples / 8);
+	for (s = 10003; s < 30000; s++) {
+		if ((plane[s / 8] >> (s % 8)) & 1)
+			shifted[(s - 10003 + 5) / 8] |= 1 << ((s - 10003 + 5) % 8);
+	}
+	segs[0].data = plane;
+	segs[0].bit_offset = 0;
+	segs[0].bit_length = 10003;
+	segs[1].data = shifted;
+	segs[1].bit_offset = 5;
+	segs[1].bit_length = 30000 - 10003;
+	segs[2].data = plane;
+	segs[2].bit_offset = 30000;
+	segs[2].bit_length = 0;
+	segs[3].data = plane + 30000 / 8;
+	segs[3].bit_offset = 0;
+	segs[3].bit_length = 10001;
+	segs[4].data = plane;
+	segs[4].bit_offset = 40001;
+	segs[4].bit_length = num_samples - 40001;
+	channels[0].segments = segs;
+	channels[0].num_segments = 5;
+	channels[1].segments = NULL;
+	channels[1].constant = 1;
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	expected = uart_decode_chunked(plane, num_samples, 1024);
+
+	anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	srd_session_new(&sess);
+	fail_unless(srd_inst_new(sess, "uart", NULL) != NULL);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, ann_collect_cb, anns);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+	ret = srd_session_send_segments(sess, 0, num_samples, channels, 2);
+	fail_unless(ret == SRD_OK, "srd_session_send_segments() failed: %d.",
+		ret);
+	srd_session_send_eof(sess);
+	ann_arrays_compare(expected, anns);
+
+	/* The segments hold fewer samples than the chunk. */
+	ret = srd_session_send_segments(sess, num_samples, num_samples * 2,
+		channels, 2);
+	fail_unless(ret != SRD_OK, "Short segments were accepted.");
+
+	srd_session_destroy(sess);
+	srd_exit();
+
+	g_array_free(anns, TRUE);
+	g_array_free(expected, TRUE);
+	g_free(shifted);
+	g_free(plane);
+}
+END_TEST
+
+/*
+ * Check whether chunks which start within a byte, and channels whose
+ * samples are interleaved with others, decode in place.
+ */
+START_TEST(test_session_send_views)
+{
+	uint8_t *plane, *logic;
+	uint64_t num_samples, start, end, s;
+	struct srd_session *sess;
+	struct srd_input_view views[2];
+	struct srd_scan scan;
+	struct srd_scan_match *m;
+	struct plane_source src;
+	GArray *expected, *anns, *matches;
+	int ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+	/* One byte per sample, RX in bit 0, TX idle in bit 1. */
+	logic = g_malloc(num_samples);
+	for (s = 0; s < num_samples; s++)
+		logic[s] = 2 | ((plane[s / 8] >> (s % 8)) & 1);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	expected = uart_decode_chunked(plane, num_samples, 1024);
+
+	anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	srd_session_new(&sess);
+	fail_unless(srd_inst_new(sess, "uart", NULL) != NULL);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, ann_collect_cb, anns);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+	memset(views, 0, sizeof(views));
+	for (start = 0; start < num_samples; start = end) {
+		end = MIN(start + 1001, num_samples);
+		views[0].data = logic;
+		views[0].bit_offset = start * 8;
+		views[0].bit_stride = 8;
+		views[1].data = logic;
+		views[1].bit_offset = start * 8 + 1;
+		views[1].bit_stride = 8;
+		ret = srd_session_send_views(sess, start, end, views);
+		fail_unless(ret == SRD_OK, "srd_session_send_views() failed: %d.",
+			ret);
+	}
+	srd_session_send_eof(sess);
+	ann_arrays_compare(expected, anns);
+	srd_session_destroy(sess);
+	g_array_free(anns, TRUE);
+
+	/* Packed planes in chunks which start within a byte. */
+	src.plane = plane;
+	srd_session_new(&sess);
+	anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	fail_unless(srd_inst_new(sess, "uart", NULL) != NULL);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, ann_collect_cb, anns);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+	ret = srd_session_decode_range(sess, 0, num_samples, 999,
+		plane_source_get, &src);
+	fail_unless(ret == SRD_OK, "srd_session_decode_range() failed: %d.",
+		ret);
+	srd_session_send_eof(sess);
+	ann_arrays_compare(expected, anns);
+	srd_session_destroy(sess);
+	srd_exit();
+
+	/* The word-parallel scans see the same pulses. */
+	memset(&scan, 0, sizeof(scan));
+	scan.type = SRD_SCAN_PULSE;
+	scan.channel = 0;
+	scan.level = 0;
+	scan.min_width = 13;
+	matches = scan_collect(&scan, num_samples, 999, plane_source_get, &src);
+	fail_unless(matches->len == 1, "%u long pulses.", matches->len);
+	m = &g_array_index(matches, struct srd_scan_match, 0);
+	fail_unless(m->start_sample == 40000, "Pulse starts at %" PRIu64 ".",
+		m->start_sample);
+	g_array_free(matches, TRUE);
+
+	g_array_free(anns, TRUE);
+	g_array_free(expected, TRUE);
+	g_free(logic);
+	g_free(plane);
+}
+END_TEST
+
+/*
+ * Check the guarantees of sample buffers, and decode planes kept in
+ * one of them.
+ */
+START_TEST(test_session_sample_buffer)
+{
+	uint8_t *buf, *plane;
+	uint64_t num_samples, plane_size, i;
+	GArray *expected, *anns;
+
+	buf = srd_sample_buffer_alloc(100, 0);
+	fail_unless(buf != NULL, "Cannot allocate small buffer.");
+	fail_unless((uintptr_t)buf % SRD_SAMPLE_BUFFER_ALIGN == 0,
+		"Small buffer is not aligned.");
+	for (i = 0; i < 100 + SRD_SAMPLE_BUFFER_PADDING; i++)
+		fail_unless(buf[i] == 0, "Byte %" PRIu64 " is not zero.", i);
+	srd_sample_buffer_free(buf);
+	srd_sample_buffer_free(NULL);
+
+	/* Large enough for huge pages, with two planes. */
+	num_samples = 8 * 3 * 1024 * 1024 + 13;
+	plane_size = SRD_SAMPLE_BUFFER_PLANE_SIZE(num_samples);
+	fail_unless(plane_size % SRD_SAMPLE_BUFFER_ALIGN == 0 &&
+		plane_size >= (num_samples + 7) / 8, "Bad plane size.");
+	buf = srd_sample_buffer_alloc(2 * plane_size, SRD_SAMPLE_BUFFER_HUGETLB);
+	fail_unless(buf != NULL, "Cannot allocate large buffer.");
+	fail_unless((uintptr_t)buf % SRD_SAMPLE_BUFFER_ALIGN == 0,
+		"Large buffer is not aligned.");
+	fail_unless(buf[2 * plane_size + SRD_SAMPLE_BUFFER_PADDING - 1] == 0,
+		"Padding is not zero.");
+
+	/* Decode the second plane like one from the heap. */
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+	uart_plane_fill(buf + plane_size, num_samples, 40000, 0x5a);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	expected = uart_decode_chunked(plane, num_samples, 1024);
+	anns = uart_decode_chunked(buf + plane_size, num_samples, 4096);
+	ann_arrays_compare(expected, anns);
+	srd_exit();
+
+	srd_sample_buffer_free(buf);
+	g_array_free(anns, TRUE);
+	g_array_free(expected, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+/* Decode the UART plane at a fraction of its samplerate. */
+static GArray *uart_decode_decimated(const uint8_t *plane,
+		uint64_t num_samples, uint64_t chunk_size, unsigned int factor,
+		int policy)
+{
+	struct srd_session *sess;
+	struct srd_decoder_inst *di;
+	struct plane_source src;
+	GArray *anns;
+	int ret;
+
+	src.plane = plane;
+	srd_session_new(&sess);
+	anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	di = srd_inst_new(sess, "uart", NULL);
+	fail_unless(di != NULL);
+	ret = srd_inst_decimation_set(di, factor, policy);
+	fail_unless(ret == SRD_OK, "srd_inst_decimation_set() failed: %d.", ret);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, ann_collect_cb, anns);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+	ret = srd_session_decode_range(sess, 0, num_samples, chunk_size,
+		plane_source_get, &src);
+	fail_unless(ret == SRD_OK, "srd_session_decode_range() failed: %d.",
+		ret);
+	srd_session_send_eof(sess);
+	srd_session_destroy(sess);
+
+	return anns;
+}
+
+/*
+ * Check whether decimated input yields the same annotations, within
+ * the precision of the reduced samplerate.
+ */
+START_TEST(test_session_decimation)
+{
+	struct srd_session *sess;
+	struct srd_decoder_inst *di;
+	struct ann_rec *a, *b;
+	uint8_t *plane;
+	uint64_t num_samples;
+	GArray *expected, *anns;
+	int policy;
+	guint i;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	srd_decoder_load("spi");
+	expected = uart_decode_chunked(plane, num_samples, 1024);
+
+	/* Odd chunk sizes, so groups span chunks. */
+	for (policy = SRD_DECIMATION_MAJORITY; policy <= SRD_DECIMATION_FIRST;
+			policy++) {
+		anns = uart_decode_decimated(plane, num_samples, 999, 2, policy);
+		fail_unless(anns->len == expected->len, "Annotation count "
+			"differs (%u vs %u).", expected->len, anns->len);
+		for (i = 0; i < anns->len && i < expected->len; i++) {
+			a = &g_array_index(expected, struct ann_rec, i);
+			b = &g_array_index(anns, struct ann_rec, i);
+			fail_unless(a->ann_class == b->ann_class,
+				"Annotation %u differs.", i);
+			fail_unless(ABS((int64_t)(a->start_sample -
+				b->start_sample)) <= 6 &&
+				ABS((int64_t)(a->end_sample - b->end_sample)) <= 6,
+				"Annotation %u is at %" PRIu64 "-%" PRIu64 ", not %"
+				PRIu64 "-%" PRIu64 ".", i, b->start_sample,
+				b->end_sample, a->start_sample, a->end_sample);
+		}
+		g_array_free(anns, TRUE);
+	}
+
+	/* Factor 1 decodes all samples. */
+	anns = uart_decode_decimated(plane, num_samples, 999, 1,
+		SRD_DECIMATION_FIRST);
+	ann_arrays_compare(expected, anns);
+	g_array_free(anns, TRUE);
+
+	/* Only decoders which declare it can be decimated. */
+	srd_session_new(&sess);
+	di = srd_inst_new(sess, "spi", NULL);
+	fail_unless(di != NULL);
+	fail_unless(srd_inst_decimation_set(di, 4, SRD_DECIMATION_FIRST) !=
+		SRD_OK, "Decimated a decoder which doesn't support it.");
+	fail_unless(srd_inst_decimation_set(NULL, 4, SRD_DECIMATION_FIRST) !=
+		SRD_OK, "srd_inst_decimation_set(NULL) worked.");
+	srd_session_destroy(sess);
+	srd_exit();
+
+	g_array_free(expected, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+/*
+ * PWM with varying duty cycles, and one long pulse which spans many
+ * chunks. Returns the number of rising edges, stored in 'rising'.
+ */
+static guint pwm_plane_fill(uint8_t *plane, uint64_t num_samples,
+		uint64_t *rising, guint max_rising)
+{
+	uint64_t pos, period, high, s;
+	guint k;
+
+	memset(plane, 0, (num_samples + 7) / 8);
+	pos = 1000;
+	for (k = 0; k < max_rising; k++) {
+		period = 100 + (k * 37) % 300;
+		high = 1 + (k * 53) % (period - 1);
+		if (k == 20) {
+			high = 30000;
+			period = high + 100;
+		}
+		if (pos + period + 500 > num_samples)
+			break;
+		rising[k] = pos;
+		for (s = pos; s < pos + high; s++)
+			plane[s / 8] |= 1 << (s % 8);
+		pos += period;
+	}
+
+	return k;
+}
+
+static GArray *pulses_decode(const uint8_t *plane, uint64_t num_samples,
+		uint64_t chunk_size, const char *dec_id, GHashTable *options)
+{
+	struct srd_session *sess;
+	struct srd_decoder_inst *di;
+	struct plane_source src;
+	GArray *anns;
+	int ret;
+
+	src.plane = plane;
+	srd_session_new(&sess);
+	anns = g_array_new(FALSE, FALSE, sizeof(struct ann_rec));
+	di = srd_inst_new(sess, dec_id, options);
+	fail_unless(di != NULL);
+	srd_pd_output_callback_add(sess, SRD_OUTPUT_ANN, ann_collect_cb, anns);
+	srd_session_start(sess);
+	srd_session_metadata_set(sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(1000000));
+	ret = srd_session_decode_range(sess, 0, num_samples, chunk_size,
+		plane_source_get, &src);
+	fail_unless(ret == SRD_OK, "srd_session_decode_range() failed: %d.",
+		ret);
+	srd_session_send_eof(sess);
+	srd_session_destroy(sess);
+
+	return anns;
+}
+
+/*
+ * Check whether decoders which take pulse widths from .pulses() see
+ * all periods, also when pulses span chunks. PWM annotates the duty
+ * cycle of periods (class 0), timing the samples between rising edges
+ * (class 1).
+ */
+START_TEST(test_session_pulses)
+{
+	static const char *dec_ids[] = { "pwm", "timing" };
+	static const int ann_classes[] = { 0, 1 };
+	struct ann_rec *a;
+	uint8_t *plane;
+	uint64_t num_samples, rising[128], chunk_sizes[] = { 1000, 64 * 1024 };
+	GHashTable *options[2];
+	GArray *anns;
+	guint num_rising, i, n, c, d;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	num_rising = pwm_plane_fill(plane, num_samples, rising,
+		G_N_ELEMENTS(rising));
+	fail_unless(num_rising > 21);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("pwm");
+	srd_decoder_load("timing");
+	options[0] = NULL;
+	options[1] = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options[1], g_strdup("edge"),
+		g_variant_ref_sink(g_variant_new_string("rising")));
+	g_hash_table_insert(options[1], g_strdup("format"),
+		g_variant_ref_sink(g_variant_new_string("samples")));
+	for (d = 0; d < G_N_ELEMENTS(dec_ids); d++) {
+		for (c = 0; c < G_N_ELEMENTS(chunk_sizes); c++) {
+			anns = pulses_decode(plane, num_samples, chunk_sizes[c],
+				dec_ids[d], options[d]);
+
+			/* The period after the last rising edge is incomplete. */
+			for (i = 0, n = 0; i < anns->len; i++) {
+				a = &g_array_index(anns, struct ann_rec, i);
+				if (a->ann_class != ann_classes[d])
+					continue;
+				fail_unless(n + 1 < num_rising, "Too many periods.");
+				fail_unless(a->start_sample == rising[n] &&
+					a->end_sample == rising[n + 1],
+					"Period %u is at %" PRIu64 "-%" PRIu64 ", not %"
+					PRIu64 "-%" PRIu64 ".", n, a->start_sample,
+					a->end_sample, rising[n], rising[n + 1]);
+				n++;
+			}
+			fail_unless(n == num_rising - 1, "%s found %u of %u periods "
+				"(chunk size %" PRIu64 ").", dec_ids[d], n,
+				num_rising - 1, chunk_sizes[c]);
+			g_array_free(anns, TRUE);
+		}
+	}
+	g_hash_table_destroy(options[1]);
+	srd_exit();
+
+	g_free(plane);
+}
+END_TEST
+
+struct thread_counts {
+	gint spawned;
+	gint joined;
+};
+
+static void *test_thread_spawn(const char *name, srd_thread_func func,
+		void *data, void *cb_data)
+{
+	struct thread_counts *counts;
+
+	counts = cb_data;
+	g_atomic_int_inc(&counts->spawned);
+
+	return g_thread_new(name, func, data);
+}
+
+static void test_thread_join(void *handle, void *cb_data)
+{
+	struct thread_counts *counts;
+
+	counts = cb_data;
+	g_thread_join(handle);
+	g_atomic_int_inc(&counts->joined);
+}
+
+/*
+ * Check whether worker threads honour thread options and the thread
+ * factory without changing the decoder's results.
+ */
+START_TEST(test_session_thread_config)
+{
+	uint8_t *plane;
+	uint64_t num_samples;
+	struct srd_session *sess;
+	struct srd_thread_config config;
+	struct srd_thread_factory factory;
+	struct thread_counts counts;
+	unsigned int cpus[1];
+	GArray *sync, *pinned, *pooled;
+	int ret;
+
+	num_samples = 64 * 1024;
+	plane = g_malloc(num_samples / 8);
+	uart_plane_fill(plane, num_samples, 40000, 0x5a);
+
+	srd_init(DECODERS_TESTDIR);
+	srd_decoder_load("uart");
+	sync = uart_decode_chunked(plane, num_samples, 1024);
+
+	/* Options the host can't apply only cause warnings. */
+	memset(&config, 0, sizeof(config));
+	cpus[0] = 0;
+	config.cpus = cpus;
+	config.num_cpus = 1;
+	config.numa_node = 0;
+	config.set_numa = TRUE;
+	config.policy = SRD_THREAD_POLICY_BATCH;
+	config.name_prefix = "test-";
+	srd_session_new(&sess);
+	ret = srd_session_thread_config_set(sess, &config);
+	fail_unless(ret == SRD_OK, "srd_session_thread_config_set() failed.");
+	srd_session_output_delivery_set(sess, SRD_OUTPUT_DELIVERY_THREAD,
+		SRD_OUTPUT_OVERFLOW_BLOCK, 0);
+	pinned = uart_session_run(sess, plane, num_samples, 1024);
+	srd_session_destroy(sess);
+
+	memset(&counts, 0, sizeof(counts));
+	factory.spawn = test_thread_spawn;
+	factory.join = test_thread_join;
+	factory.cb_data = &counts;
+	srd_session_new(&sess);
+	ret = srd_session_thread_factory_set(sess, &factory);
+	fail_unless(ret == SRD_OK, "srd_session_thread_factory_set() failed.");
+	pooled = uart_session_run(sess, plane, num_samples, 1024);
+	srd_session_destroy(sess);
+	srd_exit();
+
+	fail_unless(counts.spawned > 0, "Thread factory was not used.");
+	fail_unless(counts.spawned == counts.joined, "Threads were not joined.");
+	ann_arrays_compare(sync, pinned);
+	ann_arrays_compare(sync, pooled);
+
+	g_array_free(sync, TRUE);
+	g_array_free(pinned, TRUE);
+	g_array_free(pooled, TRUE);
+	g_free(plane);
+}
+END_TEST
+
+/*
+ * Check whether the thread options API rejects bogus arguments.
+ * If it returns SRD_OK (or segfaults) this test will fail.
+ */
+START_TEST(test_session_thread_config_bogus)
+{
+	int ret;
+	struct srd_session *sess;
+	struct srd_thread_config config;
+	struct srd_thread_factory factory;
+
+	srd_init(NULL);
+	srd_session_new(&sess);
+	ret = srd_session_thread_config_set(NULL, NULL);
+	fail_unless(ret != SRD_OK, "srd_session_thread_config_set(NULL) worked.");
+	ret = srd_inst_thread_config_set(NULL, NULL);
+	fail_unless(ret != SRD_OK, "srd_inst_thread_config_set(NULL) worked.");
+	memset(&config, 0, sizeof(config));
+	config.numa_node = -1;
+	config.set_numa = TRUE;
+	ret = srd_session_thread_config_set(sess, &config);
+	fail_unless(ret != SRD_OK, "Negative NUMA node was accepted.");
+	config.set_numa = FALSE;
+	ret = srd_session_thread_config_set(sess, &config);
+	fail_unless(ret == SRD_OK, "Unset NUMA node was rejected.");
+	memset(&factory, 0, sizeof(factory));
+	factory.spawn = test_thread_spawn;
+	ret = srd_session_thread_factory_set(sess, &factory);
+	fail_unless(ret != SRD_OK, "Factory without join() was accepted.");
+	ret = srd_session_thread_factory_set(sess, NULL);
+	fail_unless(ret == SRD_OK, "Resetting the factory failed.");
+	srd_session_destroy(sess);
+	srd_exit();
+}
+END_TEST
+
 Suite *suite_session(void)
 {
 	Suite *s;
@@ -280,6 +2796,40 @@ Suite *suite_session(void)
 	tcase_add_checked_fixture(tc, srdtest_setup, srdtest_teardown);
 	tcase_add_test(tc, test_session_metadata_set);
 	tcase_add_test(tc, test_session_metadata_set_bogus);
+	tcase_add_test(tc, test_session_pipeline_set);
+	tcase_add_test(tc, test_session_pipeline_set_bogus);
+	tcase_add_test(tc, test_session_coroutine_set_bogus);
+	tcase_add_test(tc, test_session_output_delivery_bogus);
+	tcase_add_test(tc, test_session_thread_config_bogus);
+	tcase_add_test(tc, test_session_export_bogus);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("decode");
+	tcase_add_checked_fixture(tc, srdtest_setup, srdtest_teardown);
+	tcase_add_test(tc, test_session_new_dirty);
+	tcase_add_test(tc, test_session_send_idle_chunks);
+	tcase_add_test(tc, test_session_output_delivery);
+	tcase_add_test(tc, test_session_coroutine);
+	tcase_add_test(tc, test_session_thread_config);
+	tcase_add_test(tc, test_session_annstore);
+	tcase_add_test(tc, test_session_spill);
+	tcase_add_test(tc, test_session_export);
+	tcase_add_test(tc, test_session_pycache);
+	tcase_add_test(tc, test_session_pipeline);
+	tcase_add_test(tc, test_session_pipeline_sinks);
+	tcase_add_test(tc, test_session_pipeline_flush);
+	tcase_add_test(tc, test_session_decode_range);
+	tcase_add_test(tc, test_session_result_cache);
+	tcase_add_test(tc, test_session_inst_sharing);
+	tcase_add_test(tc, test_session_search);
+	tcase_add_test(tc, test_session_scan);
+	tcase_add_test(tc, test_session_file_source);
+	tcase_add_test(tc, test_session_ring);
+	tcase_add_test(tc, test_session_send_segments);
+	tcase_add_test(tc, test_session_send_views);
+	tcase_add_test(tc, test_session_sample_buffer);
+	tcase_add_test(tc, test_session_decimation);
+	tcase_add_test(tc, test_session_pulses);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("reset");
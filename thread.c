@@ -0,0 +1,567 @@
+/*
+ * This file is part of the libsigrokdecode project.
+ *
+ * Copyright (C) 2023 ALIENTEK(正点原子) <39035605@qq.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "libsigrokdecode-internal.h" /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include "libsigrokdecode.h"
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @file
+ *
+ * Creation of the library's worker threads.
+ */
+
+/**
+ * @defgroup grp_thread Worker threads
+ *
+ * Placement and scheduling of the library's worker threads.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+
+struct srd_thread {
+	/** The thread, if the library created it. */
+	GThread *gthread;
+	/** The frontend's handle, if its factory created the thread. */
+	void *handle;
+	struct srd_thread_factory factory;
+	srd_thread_func func;
+	void *data;
+	/** Options to apply in the new thread, NULL for none. */
+	struct srd_thread_config *config;
+	char *name;
+};
+
+/** @endcond */
+
+static struct srd_thread_config *thread_config_copy(
+		const struct srd_thread_config *config)
+{
+	struct srd_thread_config *copy;
+	unsigned int *cpus;
+
+	copy = g_malloc(sizeof(*copy));
+	*copy = *config;
+	copy->cpus = NULL;
+	copy->num_cpus = 0;
+	if (config->cpus && config->num_cpus) {
+		cpus = g_malloc(config->num_cpus * sizeof(*cpus));
+		memcpy(cpus, config->cpus, config->num_cpus * sizeof(*cpus));
+		copy->cpus = cpus;
+		copy->num_cpus = config->num_cpus;
+	}
+	copy->name_prefix = g_strdup(config->name_prefix);
+
+	return copy;
+}
+
+/** @private */
+SRD_PRIV void srd_thread_config_free(struct srd_thread_config *config)
+{
+	if (!config)
+		return;
+
+	g_free((void *)config->cpus);
+	g_free((void *)config->name_prefix);
+	g_free(config);
+}
+
+/* Get the CPUs of a NUMA node, as an array of guint. */
+static GArray *numa_node_cpus(int node)
+{
+	GArray *cpus;
+	guint cpu;
+#if defined(__linux__)
+	char *path, *contents, **ranges, *end;
+	guint64 first, last;
+	int i;
+
+	path = g_strdup_printf("/sys/devices/system/node/node%d/cpulist", node);
+	if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+		g_free(path);
+		return NULL;
+	}
+	g_free(path);
+
+	/* Format: "0-7,16-23". */
+	cpus = g_array_new(FALSE, FALSE, sizeof(guint));
+	ranges = g_strsplit(g_strstrip(contents), ",", 0);
+	for (i = 0; ranges[i]; i++) {
+		if (!ranges[i][0])
+			continue;
+		first = g_ascii_strtoull(ranges[i], &end, 10);
+		last = (*end == '-') ? g_ascii_strtoull(end + 1, NULL, 10) : first;
+		for (cpu = first; cpu <= last; cpu++)
+			g_array_append_val(cpus, cpu);
+	}
+	g_strfreev(ranges);
+	g_free(contents);
+#elif defined(_WIN32)
+	ULONGLONG mask;
+
+	if (node < 0 || node > 255 || !GetNumaNodeProcessorMask((UCHAR)node, &mask))
+		return NULL;
+
+	cpus = g_array_new(FALSE, FALSE, sizeof(guint));
+	for (cpu = 0; cpu < 64; cpu++) {
+		if (mask & (1ULL << cpu))
+			g_array_append_val(cpus, cpu);
+	}
+#else
+	(void)node;
+	(void)cpu;
+	cpus = NULL;
+#endif
+
+	return cpus;
+}
+
+/* The CPUs a thread may run on, NULL for no restriction. */
+static GArray *thread_cpus(const char *name,
+		const struct srd_thread_config *config)
+{
+	GArray *cpus, *node_cpus;
+	guint i, j, cpu;
+
+	cpus = NULL;
+	if (config->cpus && config->num_cpus) {
+		cpus = g_array_sized_new(FALSE, FALSE, sizeof(guint),
+			config->num_cpus);
+		for (i = 0; i < config->num_cpus; i++) {
+			cpu = config->cpus[i];
+			g_array_append_val(cpus, cpu);
+		}
+	}
+
+	if (!config->set_numa)
+		return cpus;
+
+	if (!(node_cpus = numa_node_cpus(config->numa_node))) {
+		srd_warn("%s: Cannot get the CPUs of NUMA node %d.", name,
+			config->numa_node);
+		return cpus;
+	}
+	if (!cpus)
+		return node_cpus;
+
+	/* Restrict the node's CPUs to the configured ones. */
+	for (i = 0; i < node_cpus->len; ) {
+		cpu = g_array_index(node_cpus, guint, i);
+		for (j = 0; j < cpus->len; j++) {
+			if (g_array_index(cpus, guint, j) == cpu)
+				break;
+		}
+		if (j == cpus->len)
+			g_array_remove_index(node_cpus, i);
+		else
+			i++;
+	}
+	if (!node_cpus->len) {
+		srd_warn("%s: No configured CPU is on NUMA node %d.", name,
+			config->numa_node);
+		g_array_free(node_cpus, TRUE);
+		return cpus;
+	}
+	g_array_free(cpus, TRUE);
+
+	return node_cpus;
+}
+
+static void thread_set_affinity(const char *name, GArray *cpus)
+{
+#if defined(__linux__)
+	cpu_set_t *set;
+	size_t size;
+	guint i, max;
+
+	max = 0;
+	for (i = 0; i < cpus->len; i++)
+		max = MAX(max, g_array_index(cpus, guint, i) + 1);
+
+	set = CPU_ALLOC(max);
+	size = CPU_ALLOC_SIZE(max);
+	CPU_ZERO_S(size, set);
+	for (i = 0; i < cpus->len; i++)
+		CPU_SET_S(g_array_index(cpus, guint, i), size, set);
+	if (sched_setaffinity(0, size, set) < 0)
+		srd_warn("%s: Cannot set CPU affinity: %s.", name,
+			g_strerror(errno));
+	CPU_FREE(set);
+#elif defined(_WIN32)
+	DWORD_PTR mask;
+	guint i, cpu;
+
+	mask = 0;
+	for (i = 0; i < cpus->len; i++) {
+		cpu = g_array_index(cpus, guint, i);
+		if (cpu < sizeof(mask) * 8)
+			mask |= (DWORD_PTR)1 << cpu;
+	}
+	if (!mask || !SetThreadAffinityMask(GetCurrentThread(), mask))
+		srd_warn("%s: Cannot set CPU affinity.", name);
+#else
+	(void)cpus;
+	srd_dbg("%s: CPU affinity is not supported on this platform.", name);
+#endif
+}
+
+/* Prefer the node's memory for allocations of the calling thread. */
+static void thread_set_numa_memory(const char *name, int node)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+	unsigned long *mask;
+	size_t bits, words;
+
+	bits = sizeof(*mask) * 8;
+	words = node / bits + 1;
+	mask = g_malloc0(words * sizeof(*mask));
+	mask[node / bits] = 1UL << (node % bits);
+	/* MPOL_PREFERRED, the kernel ignores the last bit of maxnode. */
+	if (syscall(SYS_set_mempolicy, 1, mask, words * bits + 1) < 0)
+		srd_warn("%s: Cannot prefer memory of NUMA node %d: %s.",
+			name, node, g_strerror(errno));
+	g_free(mask);
+#else
+	(void)node;
+	srd_dbg("%s: NUMA memory policy is not supported on this platform.",
+		name);
+#endif
+}
+
+static void thread_set_scheduling(const char *name,
+		const struct srd_thread_config *config)
+{
+#if defined(_WIN32)
+	int prio;
+
+	switch (config->policy) {
+	case SRD_THREAD_POLICY_FIFO:
+	case SRD_THREAD_POLICY_RR:
+		prio = THREAD_PRIORITY_HIGHEST;
+		break;
+	case SRD_THREAD_POLICY_BATCH:
+		prio = THREAD_PRIORITY_BELOW_NORMAL;
+		break;
+	case SRD_THREAD_POLICY_IDLE:
+		prio = THREAD_PRIORITY_IDLE;
+		break;
+	default:
+		prio = THREAD_PRIORITY_NORMAL;
+		break;
+	}
+	/* Map the nice level onto the priority classes. */
+	if (config->set_nice && config->policy <= SRD_THREAD_POLICY_OTHER) {
+		if (config->nice <= -10)
+			prio = THREAD_PRIORITY_HIGHEST;
+		else if (config->nice < 0)
+			prio = THREAD_PRIORITY_ABOVE_NORMAL;
+		else if (config->nice >= 10)
+			prio = THREAD_PRIORITY_LOWEST;
+		else if (config->nice > 0)
+			prio = THREAD_PRIORITY_BELOW_NORMAL;
+	}
+	if (config->policy == SRD_THREAD_POLICY_DEFAULT && !config->set_nice)
+		return;
+	if (!SetThreadPriority(GetCurrentThread(), prio))
+		srd_warn("%s: Cannot set thread priority.", name);
+#else
+	struct sched_param param;
+	int policy, ret;
+
+	policy = -1;
+	switch (config->policy) {
+	case SRD_THREAD_POLICY_OTHER:
+		policy = SCHED_OTHER;
+		break;
+#ifdef SCHED_BATCH
+	case SRD_THREAD_POLICY_BATCH:
+		policy = SCHED_BATCH;
+		break;
+#endif
+#ifdef SCHED_IDLE
+	case SRD_THREAD_POLICY_IDLE:
+		policy = SCHED_IDLE;
+		break;
+#endif
+	case SRD_THREAD_POLICY_FIFO:
+		policy = SCHED_FIFO;
+		break;
+	case SRD_THREAD_POLICY_RR:
+		policy = SCHED_RR;
+		break;
+	case SRD_THREAD_POLICY_DEFAULT:
+		break;
+	default:
+		srd_warn("%s: Scheduling policy %d is not supported.", name,
+			config->policy);
+		break;
+	}
+	if (policy >= 0) {
+		memset(&param, 0, sizeof(param));
+		if (policy == SCHED_FIFO || policy == SCHED_RR)
+			param.sched_priority = config->priority;
+		if ((ret = pthread_setschedparam(pthread_self(), policy, &param)))
+			srd_warn("%s: Cannot set scheduling policy: %s.", name,
+				g_strerror(ret));
+	}
+
+	if (config->set_nice) {
+#if defined(__linux__) && defined(SYS_gettid)
+		/* Linux applies nice levels per thread. */
+		if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid),
+				config->nice) < 0)
+			srd_warn("%s: Cannot set nice level %d: %s.", name,
+				config->nice, g_strerror(errno));
+#else
+		srd_dbg("%s: Per-thread nice levels are not supported on "
+			"this platform.", name);
+#endif
+	}
+#endif
+}
+
+/* Runs in the new thread, before the thread's actual function. */
+static void thread_apply(const char *name,
+		const struct srd_thread_config *config)
+{
+	GArray *cpus;
+
+	if ((cpus = thread_cpus(name, config))) {
+		thread_set_affinity(name, cpus);
+		g_array_free(cpus, TRUE);
+	}
+	if (config->set_numa)
+		thread_set_numa_memory(name, config->numa_node);
+	thread_set_scheduling(name, config);
+}
+
+static gpointer thread_main(gpointer data)
+{
+	struct srd_thread *thread;
+
+	thread = data;
+	if (thread->config)
+		thread_apply(thread->name, thread->config);
+
+	return thread->func(thread->data);
+}
+
+static void thread_free(struct srd_thread *thread)
+{
+	srd_thread_config_free(thread->config);
+	g_free(thread->name);
+	g_free(thread);
+}
+
+/**
+ * Start a worker thread.
+ *
+ * The thread runs on the frontend's thread factory if the session has
+ * one. Otherwise the library creates it and applies the instance's
+ * thread options, or the session's if the instance has none.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param di The instance the thread works for, NULL for session-wide
+ *           threads.
+ * @param name The thread name, the configured prefix gets prepended.
+ * @param func The thread's function.
+ * @param data The argument passed to func.
+ *
+ * @return The thread, or NULL upon error.
+ *
+ * @private
+ */
+SRD_PRIV struct srd_thread *srd_thread_spawn(struct srd_session *sess,
+		struct srd_decoder_inst *di, const char *name,
+		srd_thread_func func, void *data)
+{
+	struct srd_thread *thread;
+	const struct srd_thread_config *config;
+	GError *error;
+
+	config = (di && di->thread_config) ? di->thread_config : sess->thread_config;
+
+	thread = g_malloc0(sizeof(*thread));
+	thread->func = func;
+	thread->data = data;
+	if (config && config->name_prefix)
+		thread->name = g_strconcat(config->name_prefix, name, NULL);
+	else
+		thread->name = g_strdup(name);
+
+	if (sess->thread_factory.spawn) {
+		thread->factory = sess->thread_factory;
+		thread->handle = thread->factory.spawn(thread->name, func, data,
+			thread->factory.cb_data);
+		if (!thread->handle) {
+			srd_err("Thread factory failed to start thread %s.",
+				thread->name);
+			thread_free(thread);
+			return NULL;
+		}
+		return thread;
+	}
+
+	if (config)
+		thread->config = thread_config_copy(config);
+
+	error = NULL;
+	thread->gthread = g_thread_try_new(thread->name, thread_main, thread,
+		&error);
+	if (!thread->gthread) {
+		srd_err("Cannot start thread %s: %s.", thread->name,
+			error ? error->message : "unknown error");
+		if (error)
+			g_error_free(error);
+		thread_free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+/**
+ * Wait for a worker thread to return, and release it.
+ *
+ * @param thread The thread. May be NULL.
+ *
+ * @private
+ */
+SRD_PRIV void srd_thread_join(struct srd_thread *thread)
+{
+	if (!thread)
+		return;
+
+	if (thread->gthread)
+		(void)g_thread_join(thread->gthread);
+	else
+		thread->factory.join(thread->handle, thread->factory.cb_data);
+
+	thread_free(thread);
+}
+
+/**
+ * Set the options for the worker threads of a session.
+ *
+ * The options apply to the threads which run decoder instances, stacked
+ * decoders in pipeline mode, and output delivery. Threads which already
+ * run keep their options, so this should be called before
+ * srd_session_output_delivery_set() and srd_session_start().
+ *
+ * Options which the platform or the process' privileges don't support
+ * only cause a warning. No options are applied to threads which a
+ * thread factory provides.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param config The options, which are copied. NULL restores the
+ *               platform defaults.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_thread_config_set(struct srd_session *sess,
+		const struct srd_thread_config *config)
+{
+	if (!sess || (config && config->set_numa && config->numa_node < 0))
+		return SRD_ERR_ARG;
+
+	srd_thread_config_free(sess->thread_config);
+	sess->thread_config = config ? thread_config_copy(config) : NULL;
+
+	return SRD_OK;
+}
+
+/**
+ * Set the options for the worker threads of a decoder instance.
+ *
+ * Overrides the session's options, e.g. to run a decoder stack on the
+ * NUMA node which holds its sample data. In pipeline mode, stacked
+ * instances have their own worker threads and options.
+ *
+ * @param di The decoder instance. Must not be NULL.
+ * @param config The options, which are copied. NULL makes the instance
+ *               use the session's options.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_inst_thread_config_set(struct srd_decoder_inst *di,
+		const struct srd_thread_config *config)
+{
+	if (!di || (config && config->set_numa && config->numa_node < 0))
+		return SRD_ERR_ARG;
+
+	srd_thread_config_free(di->thread_config);
+	di->thread_config = config ? thread_config_copy(config) : NULL;
+
+	return SRD_OK;
+}
+
+/**
+ * Have the frontend provide the worker threads of a session.
+ *
+ * Must be called before any worker thread got started.
+ *
+ * @param sess The session. Must not be NULL.
+ * @param factory The hooks, which are copied. Both spawn and join must
+ *                be set. NULL makes the library create the threads.
+ *
+ * @return SRD_OK upon success, a (negative) error code otherwise.
+ *
+ * @since 0.6.0
+ */
+SRD_API int srd_session_thread_factory_set(struct srd_session *sess,
+		const struct srd_thread_factory *factory)
+{
+	if (!sess)
+		return SRD_ERR_ARG;
+
+	if (!factory) {
+		memset(&sess->thread_factory, 0, sizeof(sess->thread_factory));
+		return SRD_OK;
+	}
+
+	if (!factory->spawn || !factory->join)
+		return SRD_ERR_ARG;
+
+	sess->thread_factory = *factory;
+
+	return SRD_OK;
+}
+
+/** @} */
@@ -46,14 +46,6 @@ SRD_PRIV const char *output_type_name(unsigned int idx)
 	return names[MIN(idx, G_N_ELEMENTS(names) - 1)];
 }
 
-static void release_annotation(struct srd_proto_data_annotation *pda)
-{
-	if (!pda)
-		return;
-	if (pda->ann_text)
-		g_strfreev(pda->ann_text);
-}
-
 static int convert_annotation(struct srd_decoder_inst *di, PyObject *obj,
 		struct srd_proto_data *pdata)
 {
@@ -154,13 +146,6 @@ static int _annotation_rows(struct srd_decoder_inst *di, struct srd_proto_data *
 }
 
 
-static void release_logic(struct srd_proto_data_logic *pdl)
-{
-	if (!pdl)
-		return;
-	g_free((void *)pdl->data);
-}
-
 static int convert_logic(struct srd_decoder_inst *di, PyObject *obj,
 		struct srd_proto_data *pdata)
 {
@@ -237,13 +222,6 @@ err:
 	return SRD_ERR_PYTHON;
 }
 
-static void release_binary(struct srd_proto_data_binary *pdb)
-{
-	if (!pdb)
-		return;
-	g_free((void *)pdb->data);
-}
-
 static int convert_binary(struct srd_decoder_inst *di, PyObject *obj,
 		struct srd_proto_data *pdata)
 {
@@ -419,13 +397,6 @@ err:
 	return SRD_ERR_PYTHON;
 }
 
-static void release_meta(GVariant *gvar)
-{
-	if (!gvar)
-		return;
-	g_variant_unref(gvar);
-}
-
 PyDoc_STRVAR(Decoder_put_doc,
 	"Put an annotation for the specified span of samples.\n"
 	"\n"
@@ -433,47 +404,24 @@ PyDoc_STRVAR(Decoder_put_doc,
 	"Annotation data's layout depends on the output stream type."
 );
 
-static PyObject *Decoder_put(PyObject *self, PyObject *args)
+/* Put output on one output of an instance, caller holds the GIL. */
+static void put_output(struct srd_decoder_inst *di, struct srd_pd_output *pdo,
+		int output_id, uint64_t start_sample, uint64_t end_sample,
+		PyObject *py_data)
 {
 	GSList *l;
-	PyObject *py_data, *py_res;
-	struct srd_decoder_inst *di, *next_di;
-	struct srd_pd_output *pdo;
+	PyObject *py_res;
+	struct srd_decoder_inst *next_di;
 	struct srd_proto_data pdata;
 	struct srd_proto_data_annotation pda;
 	struct srd_proto_data_binary pdb;
 	struct srd_proto_data_logic pdl;
-	uint64_t start_sample, end_sample;
-	int output_id;
 	struct srd_pd_callback *cb;
-	PyGILState_STATE gstate;
-
-	py_data = NULL;
-
-	gstate = PyGILState_Ensure();
-
-	if (!(di = srd_inst_find_by_obj(NULL, self))) {
-		/* Shouldn't happen. */
-		srd_dbg("put(): self instance not found.");
-		goto err;
-	}
 
-	if (!PyArg_ParseTuple(args, "KKiO", &start_sample, &end_sample,
-		&output_id, &py_data)) {
-		/*
-		 * This throws an exception, but by returning NULL here we let
-		 * Python raise it. This results in a much better trace in
-		 * controller.c on the decode() method call.
-		 */
-		goto err;
-	}
-
-	if (!(l = g_slist_nth(di->pd_output, output_id))) {
-		srd_err("Protocol decoder %s submitted invalid output ID %d.",
-			di->decoder->name, output_id);
-		goto err;
-	}
-	pdo = l->data;
+	/* Range decodes start early, drop what ends before the range. */
+	if (end_sample < di->sess->output_from &&
+			pdo->output_type != SRD_OUTPUT_PYTHON)
+		return;
 
 	/* Upon SRD_OUTPUT_PYTHON for stacked PDs, we have a nicer log message later. */
 	if (pdo->output_type != SRD_OUTPUT_PYTHON && di->next_di != NULL) {
@@ -491,7 +439,7 @@ static PyObject *Decoder_put(PyObject *self, PyObject *args)
 	switch (pdo->output_type) {
 	case SRD_OUTPUT_ANN:
 		/* Annotations are only fed to callbacks. */
-		if ((cb = srd_pd_output_callback_find(di->sess, pdo->output_type))) {
+		if (srd_output_wanted(di->sess, pdo->output_type)) {
 			pdata.data = &pda;
 			/* Convert from PyDict to srd_proto_data_annotation. */
 			if (convert_annotation(di, py_data, &pdata) != SRD_OK) {
@@ -502,12 +450,16 @@ static PyObject *Decoder_put(PyObject *self, PyObject *args)
             _annotation_rows(di, &pdata);
 
 			Py_BEGIN_ALLOW_THREADS
-			cb->cb(&pdata, cb->cb_data);
+			srd_output_submit(di->sess, &pdata);
 			Py_END_ALLOW_THREADS
-			release_annotation(pdata.data);
 		}
 		break;
 	case SRD_OUTPUT_PYTHON:
+		/* Keep it for replays into reconfigured upper decoders. */
+		if (di->pycache)
+			srd_pycache_add(di, start_sample, end_sample, py_data);
+		if (di->sess->search)
+			srd_search_add_python(di, start_sample, end_sample, py_data);
 		for (l = di->next_di; l; l = l->next) {
 			next_di = l->data;
 			srd_spew("Instance %s put %" PRIu64 "-%" PRIu64 " %s "
@@ -515,6 +467,12 @@ static PyObject *Decoder_put(PyObject *self, PyObject *args)
 				 start_sample,
 				 end_sample, output_type_name(pdo->output_type),
 				 output_id, pdo->proto_id, next_di->inst_id);
+			if (di->sess->pipeline) {
+				/* Have the stacked PD's own worker decode it. */
+				srd_inst_pipe_push(next_di, start_sample,
+					end_sample, py_data);
+				continue;
+			}
 			if (!(py_res = PyObject_CallMethod(
 				next_di->py_inst, "decode", "KKO", start_sample,
 				end_sample, py_data))) {
@@ -533,7 +491,7 @@ static PyObject *Decoder_put(PyObject *self, PyObject *args)
 		}
 		break;
 	case SRD_OUTPUT_BINARY:
-		if ((cb = srd_pd_output_callback_find(di->sess, pdo->output_type))) {
+		if (srd_output_wanted(di->sess, pdo->output_type)) {
 			pdata.data = &pdb;
 			/* Convert from PyDict to srd_proto_data_binary. */
 			if (convert_binary(di, py_data, &pdata) != SRD_OK) {
@@ -541,13 +499,12 @@ static PyObject *Decoder_put(PyObject *self, PyObject *args)
 				break;
 			}
 			Py_BEGIN_ALLOW_THREADS
-			cb->cb(&pdata, cb->cb_data);
+			srd_output_submit(di->sess, &pdata);
 			Py_END_ALLOW_THREADS
-			release_binary(pdata.data);
 		}
 		break;
 	case SRD_OUTPUT_LOGIC:
-		if ((cb = srd_pd_output_callback_find(di->sess, pdo->output_type))) {
+		if (srd_output_wanted(di->sess, pdo->output_type)) {
 			pdata.data = &pdl;
 			/* Convert from PyDict to srd_proto_data_logic. */
 			if (convert_logic(di, py_data, &pdata) != SRD_OK) {
@@ -556,26 +513,25 @@ static PyObject *Decoder_put(PyObject *self, PyObject *args)
 			}
 			if (end_sample <= start_sample) {
 				srd_err("Ignored SRD_OUTPUT_LOGIC with invalid sample range.");
+				srd_output_release(&pdata);
 				break;
 			}
 			pdl.repeat_count = (end_sample - start_sample) - 1;
 			Py_BEGIN_ALLOW_THREADS
-			cb->cb(&pdata, cb->cb_data);
+			srd_output_submit(di->sess, &pdata);
 			Py_END_ALLOW_THREADS
-			release_logic(pdata.data);
 		}
 		break;
 	case SRD_OUTPUT_META:
-		if ((cb = srd_pd_output_callback_find(di->sess, pdo->output_type))) {
+		if (srd_output_wanted(di->sess, pdo->output_type)) {
 			/* Annotations need converting from PyObject. */
 			if (convert_meta(&pdata, py_data) != SRD_OK) {
 				/* An exception was already set up. */
 				break;
 			}
 			Py_BEGIN_ALLOW_THREADS
-			cb->cb(&pdata, cb->cb_data);
+			srd_output_submit(di->sess, &pdata);
 			Py_END_ALLOW_THREADS
-			release_meta(pdata.data);
 		}
 		break;
 	default:
@@ -583,6 +539,60 @@ static PyObject *Decoder_put(PyObject *self, PyObject *args)
 			di->decoder->name, pdo->output_type);
 		break;
 	}
+}
+
+static PyObject *Decoder_put(PyObject *self, PyObject *args)
+{
+	GSList *l, *s;
+	PyObject *py_data;
+	struct srd_decoder_inst *di, *sharer;
+	struct srd_pd_output *pdo;
+	uint64_t start_sample, end_sample;
+	int output_id;
+	PyGILState_STATE gstate;
+
+	py_data = NULL;
+
+	gstate = PyGILState_Ensure();
+
+	if (!(di = srd_inst_find_by_obj(NULL, self))) {
+		/* Shouldn't happen. */
+		srd_dbg("put(): self instance not found.");
+		goto err;
+	}
+
+	if (!PyArg_ParseTuple(args, "KKiO", &start_sample, &end_sample,
+		&output_id, &py_data)) {
+		/*
+		 * This throws an exception, but by returning NULL here we let
+		 * Python raise it. This results in a much better trace in
+		 * controller.c on the decode() method call.
+		 */
+		goto err;
+	}
+
+	if (!(l = g_slist_nth(di->pd_output, output_id))) {
+		srd_err("Protocol decoder %s submitted invalid output ID %d.",
+			di->decoder->name, output_id);
+		goto err;
+	}
+	pdo = l->data;
+
+	/* Decimated instances count samples of their decimated input. */
+	if (di->decimation > 1) {
+		start_sample *= di->decimation;
+		end_sample *= di->decimation;
+	}
+
+	put_output(di, pdo, output_id, start_sample, end_sample, py_data);
+
+	/* Identical instances registered the same outputs in start(). */
+	for (s = di->sharers; s; s = s->next) {
+		sharer = s->data;
+		if ((l = g_slist_nth(sharer->pd_output, output_id)))
+			put_output(sharer, l->data, output_id, start_sample,
+				end_sample, py_data);
+	}
 
 	PyGILState_Release(gstate);
 
@@ -735,8 +745,6 @@ static PyObject *get_current_pinvalues(const struct srd_decoder_inst *di)
 {
 	int i, ch;
 	uint8_t sample;
-	const uint8_t *sample_pos;
-	int byte_offset, bit_offset;
 	PyObject *py_pinvalues;
 	PyGILState_STATE gstate;
 
@@ -757,13 +765,8 @@ static PyObject *get_current_pinvalues(const struct srd_decoder_inst *di)
 		} else {
             
             ch = di->dec_channelmap[i];
-            if( di->inbuf[ch].data ){
-                sample_pos  = di->inbuf[ch].data + ((di->abs_cur_samplenum - di->abs_start_samplenum) / 8);
-                bit_offset  = (di->abs_cur_samplenum - di->abs_start_samplenum) % 8;
-                sample      = *sample_pos & ( 1 << bit_offset ) ? 1 : 0;
-            }
-            else
-                sample = di->inbuf[ch].constant ? 1 : 0;
+            sample = srd_plane_sample(&di->inbuf[ch],
+                di->abs_cur_samplenum - di->abs_start_samplenum);
 
 			// sample_pos = di->inbuf + ((di->abs_cur_samplenum - di->abs_start_samplenum) * di->data_unitsize);
 			// byte_offset = di->dec_channelmap[i] / 8;
@@ -1006,6 +1009,90 @@ static int set_skip_condition(struct srd_decoder_inst *di, uint64_t count)
 	return SRD_OK;
 }
 
+/*
+ * Have the instance wait for any edge on a channel. Like the above, but
+ * for .pulses(), such that chunks without edges can get skipped.
+ */
+static int set_edge_condition(struct srd_decoder_inst *di, int channel)
+{
+	struct srd_term *term;
+	GSList *term_list;
+
+	condition_list_free(di);
+	term = g_malloc(sizeof(*term));
+	term->type = SRD_TERM_EITHER_EDGE;
+	term->channel = channel;
+	term_list = g_slist_append(NULL, term);
+	di->condition_list = g_slist_append(di->condition_list, term_list);
+
+	return SRD_OK;
+}
+
+/* Wait for new samples or a termination request, return with the mutex held. */
+static void wait_new_samples(struct srd_decoder_inst *di)
+{
+	g_mutex_lock(&di->data_mutex);
+	while (!di->got_new_samples && !di->want_wait_terminate) {
+		if (di->coro) {
+			/* Coroutine mode: return to srd_inst_decode(). */
+			g_mutex_unlock(&di->data_mutex);
+			srd_coro_yield(di->coro);
+			g_mutex_lock(&di->data_mutex);
+			continue;
+		}
+		g_cond_wait(&di->got_new_samples_cond, &di->data_mutex);
+	}
+}
+
+/*
+ * Hand a fully processed chunk back to the main thread, and release the
+ * mutex. Returns FALSE if the caller must return to .decode(), with a
+ * Python exception set.
+ */
+static gboolean chunk_release(struct srd_decoder_inst *di)
+{
+	di->got_new_samples = FALSE;
+	di->handled_all_samples = TRUE;
+	di->abs_start_samplenum = 0;
+	di->abs_end_samplenum = 0;
+	di->inbuf = NULL;
+	// di->inbuflen = 0;
+
+	/* Signal the main thread that we handled all samples. */
+	g_cond_signal(&di->handled_all_samples_cond);
+
+	/*
+	 * When EOF was provided externally, communicate the
+	 * Python EOFError exception to .decode() and return
+	 * from the .wait() method call. This is motivated by
+	 * the use of Python context managers, so that .decode()
+	 * methods can "close" incompletely accumulated data
+	 * when the sample data is exhausted.
+	 */
+	if (di->communicate_eof) {
+		srd_dbg("%s: %s: Raising EOF from wait().",
+			di->inst_id, __func__);
+		g_mutex_unlock(&di->data_mutex);
+		PyErr_SetString(PyExc_EOFError, "samples exhausted");
+		return FALSE;
+	}
+
+	/*
+	 * When termination of wait() and decode() was requested,
+	 * then exit the loop after releasing the mutex.
+	 */
+	if (di->want_wait_terminate) {
+		srd_dbg("%s: %s: Will return from wait().",
+			di->inst_id, __func__);
+		g_mutex_unlock(&di->data_mutex);
+		return FALSE;
+	}
+
+	g_mutex_unlock(&di->data_mutex);
+
+	return TRUE;
+}
+
 PyDoc_STRVAR(Decoder_wait_doc,
 	"Wait for one or more conditions to occur.\n"
 	"\n"
@@ -1071,14 +1158,16 @@ static PyObject *Decoder_wait(PyObject *self, PyObject *args)
 		}
 	}
 
+	/* After a checkpoint restore, continue the pending skip. */
+	if (di->checkpoint_conditions)
+		srd_checkpoint_resume(di);
+
 	while (1) {
 
 		Py_BEGIN_ALLOW_THREADS
 
 		/* Wait for new samples to process, or termination request. */
-		g_mutex_lock(&di->data_mutex);
-		while (!di->got_new_samples && !di->want_wait_terminate)
-			g_cond_wait(&di->got_new_samples_cond, &di->data_mutex);
+		wait_new_samples(di);
 
 		/*
 		 * Check whether any of the current condition(s) match.
@@ -1122,50 +1211,257 @@ static PyObject *Decoder_wait(PyObject *self, PyObject *args)
 		}
 
 		/* No match, reset state for the next chunk. */
-		di->got_new_samples = FALSE;
-		di->handled_all_samples = TRUE;
-		di->abs_start_samplenum = 0;
-		di->abs_end_samplenum = 0;
-		di->inbuf = NULL;
-		// di->inbuflen = 0;
+		if (!chunk_release(di))
+			goto err;
+	}
 
-		/* Signal the main thread that we handled all samples. */
-		g_cond_signal(&di->handled_all_samples_cond);
+	PyGILState_Release(gstate);
 
-		/*
-		 * When EOF was provided externally, communicate the
-		 * Python EOFError exception to .decode() and return
-		 * from the .wait() method call. This is motivated by
-		 * the use of Python context managers, so that .decode()
-		 * methods can "close" incompletely accumulated data
-		 * when the sample data is exhausted.
-		 */
-		if (di->communicate_eof) {
-			srd_dbg("%s: %s: Raising EOF from wait().",
-				di->inst_id, __func__);
-			g_mutex_unlock(&di->data_mutex);
-			PyErr_SetString(PyExc_EOFError, "samples exhausted");
+	Py_RETURN_NONE;
+
+err:
+	PyGILState_Release(gstate);
+
+	return NULL;
+}
+
+PyDoc_STRVAR(Decoder_wait_chunk_doc,
+	"Return the samples of a channel up to the end of the current chunk.\n"
+	"\n"
+	"Argument: A channel index, the channel must be connected.\n"
+	"Returns: A tuple (samplenum, count, data) of the first sample's\n"
+	"number, the number of samples, and bytes which hold sample i in\n"
+	"bit (i % 8) of byte (i / 8). The samples start after the one the\n"
+	"last .wait() returned, or at sample 0, and self.samplenum is set\n"
+	"to the last of them. Waits for the next chunk if the current one\n"
+	"is exhausted. Lets decoders process whole chunks at once, e.g. in\n"
+	"a C library.\n"
+);
+
+static PyObject *Decoder_wait_chunk(PyObject *self, PyObject *args)
+{
+	struct srd_decoder_inst *di;
+	const struct srd_input_view *in;
+	PyObject *py_data, *py_samplenum, *py_ret;
+	uint64_t first, count, i, word;
+	unsigned int n, b;
+	uint8_t *p;
+	int idx;
+	PyGILState_STATE gstate;
+
+	if (!self || !args)
+		return NULL;
+
+	gstate = PyGILState_Ensure();
+
+	if (!(di = srd_inst_find_by_obj(NULL, self))) {
+		PyErr_SetString(PyExc_Exception, "decoder instance not found");
+		goto err;
+	}
+
+	if (!PyArg_ParseTuple(args, "i", &idx))
+		goto err;
+	if (idx < 0 || idx >= di->dec_num_channels ||
+			di->dec_channelmap[idx] == -1) {
+		PyErr_SetString(PyExc_IndexError, "invalid channel index");
+		goto err;
+	}
+
+	/* Like a condition-less .wait(), don't return a sample twice. */
+	first = di->abs_cur_samplenum;
+	if (first || di->condition_list)
+		first++;
+
+	while (1) {
+		Py_BEGIN_ALLOW_THREADS
+		wait_new_samples(di);
+		Py_END_ALLOW_THREADS
+
+		if (!di->want_wait_terminate && first < di->abs_end_samplenum)
+			break;
+		if (!chunk_release(di))
 			goto err;
+	}
+
+	first = MAX(first, di->abs_start_samplenum);
+	count = di->abs_end_samplenum - first;
+	in = &di->inbuf[di->dec_channelmap[idx]];
+	if ((py_data = PyBytes_FromStringAndSize(NULL, (count + 7) / 8))) {
+		p = (uint8_t *)PyBytes_AsString(py_data);
+		for (i = 0; i < count; i += 64) {
+			n = MIN(count - i, 64);
+			word = srd_plane_word(in, first - di->abs_start_samplenum + i,
+				n);
+			for (b = 0; b < n; b += 8)
+				p[(i + b) / 8] = word >> b;
 		}
+	}
 
-		/*
-		 * When termination of wait() and decode() was requested,
-		 * then exit the loop after releasing the mutex.
-		 */
+	/* The last sample is the current one, a skip continues after it. */
+	di->abs_cur_samplenum = di->abs_end_samplenum - 1;
+	update_old_pins_array(di);
+	set_skip_condition(di, 1);
+	g_mutex_unlock(&di->data_mutex);
+	if (!py_data)
+		goto err;
+
+	py_samplenum = PyLong_FromUnsignedLongLong(di->abs_cur_samplenum);
+	PyObject_SetAttrString(di->py_inst, "samplenum", py_samplenum);
+	Py_DECREF(py_samplenum);
+	PyObject_SetAttrString(di->py_inst, "matched", Py_None);
+
+	py_ret = Py_BuildValue("(KKN)", (unsigned long long)first,
+		(unsigned long long)count, py_data);
+
+	PyGILState_Release(gstate);
+
+	return py_ret;
+
+err:
+	PyGILState_Release(gstate);
+
+	return NULL;
+}
+
+PyDoc_STRVAR(Decoder_pulses_doc,
+	"Return the lengths of the next pulses on a channel.\n"
+	"\n"
+	"Arguments: A channel index, the channel must be connected, and the\n"
+	"maximum number of pulses.\n"
+	"Returns: A tuple (level, runs) of the first pulse's level, and an\n"
+	"array('Q') of the lengths of consecutive runs of one level, in\n"
+	"samples. The first run starts at self.samplenum (sample 0 before\n"
+	"the first .wait()), every run ends at an edge. self.samplenum is\n"
+	"set to the last edge, where the next call continues. Returns when\n"
+	"max_count runs are complete, or at the end of a chunk or of the\n"
+	"samples after at least one run, waits for further chunks before\n"
+	"that. Lets decoders which only care about pulse widths handle\n"
+	"many edges per call.\n"
+);
+
+static PyObject *Decoder_pulses(PyObject *self, PyObject *args)
+{
+	struct srd_decoder_inst *di;
+	const struct srd_input_view *in;
+	PyObject *py_mod, *py_data, *py_runs, *py_samplenum, *py_ret;
+	GArray *runs;
+	uint64_t pos, run_start, edge, run, i, j, len;
+	Py_ssize_t max_count;
+	int idx, level, cur;
+	PyGILState_STATE gstate;
+
+	if (!self || !args)
+		return NULL;
+
+	gstate = PyGILState_Ensure();
+
+	if (!(di = srd_inst_find_by_obj(NULL, self))) {
+		PyErr_SetString(PyExc_Exception, "decoder instance not found");
+		goto err;
+	}
+
+	if (!PyArg_ParseTuple(args, "in", &idx, &max_count))
+		goto err;
+	if (idx < 0 || idx >= di->dec_num_channels ||
+			di->dec_channelmap[idx] == -1) {
+		PyErr_SetString(PyExc_IndexError, "invalid channel index");
+		goto err;
+	}
+	if (max_count < 1) {
+		PyErr_SetString(PyExc_ValueError, "invalid pulse count");
+		goto err;
+	}
+
+	/* Chunks without an edge need not wake us up. */
+	g_mutex_lock(&di->data_mutex);
+	set_edge_condition(di, idx);
+	g_mutex_unlock(&di->data_mutex);
+
+	runs = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	pos = run_start = di->abs_cur_samplenum;
+	level = cur = -1;
+
+	while (1) {
+		Py_BEGIN_ALLOW_THREADS
+		wait_new_samples(di);
+		Py_END_ALLOW_THREADS
+
+		/* Return the complete runs, EOF is raised by the next call. */
 		if (di->want_wait_terminate) {
-			srd_dbg("%s: %s: Will return from wait().",
-				di->inst_id, __func__);
-			g_mutex_unlock(&di->data_mutex);
-			goto err;
+			if (di->communicate_eof && runs->len)
+				break;
+			chunk_release(di);
+			goto err_runs;
+		}
+		if (pos >= di->abs_end_samplenum) {
+			if (!chunk_release(di))
+				goto err_runs;
+			continue;
 		}
 
-		g_mutex_unlock(&di->data_mutex);
+		/* Skipped chunks kept the level, the run continues. */
+		pos = MAX(pos, di->abs_start_samplenum);
+		in = &di->inbuf[di->dec_channelmap[idx]];
+		i = pos - di->abs_start_samplenum;
+		len = di->abs_end_samplenum - di->abs_start_samplenum;
+		if (level < 0)
+			level = cur = srd_plane_sample(in, i);
+
+		while (runs->len < (guint)max_count) {
+			j = srd_plane_find_value(in, i, len, cur ^ 1);
+			if (j == len)
+				break;
+			edge = di->abs_start_samplenum + j;
+			run = edge - run_start;
+			g_array_append_val(runs, run);
+			run_start = edge;
+			cur ^= 1;
+			i = j;
+		}
+		/* Don't hold back complete runs until the next chunk. */
+		if (runs->len)
+			break;
+
+		/* The last run continues in the next chunk. */
+		di->abs_cur_samplenum = di->abs_end_samplenum - 1;
+		update_old_pins_array(di);
+		pos = di->abs_end_samplenum;
+		if (!chunk_release(di))
+			goto err_runs;
 	}
 
+	/* The last edge is the current sample, like after .wait(). */
+	di->abs_cur_samplenum = run_start;
+	if (di->inbuf)
+		update_old_pins_array(di);
+	g_mutex_unlock(&di->data_mutex);
+
+	py_samplenum = PyLong_FromUnsignedLongLong(di->abs_cur_samplenum);
+	PyObject_SetAttrString(di->py_inst, "samplenum", py_samplenum);
+	Py_DECREF(py_samplenum);
+	PyObject_SetAttrString(di->py_inst, "matched", Py_None);
+
+	py_runs = NULL;
+	py_data = PyBytes_FromStringAndSize((const char *)runs->data,
+		runs->len * sizeof(uint64_t));
+	g_array_free(runs, TRUE);
+	if (py_data && (py_mod = PyImport_ImportModule("array"))) {
+		py_runs = PyObject_CallMethod(py_mod, "array", "sO", "Q",
+			py_data);
+		Py_DECREF(py_mod);
+	}
+	Py_XDECREF(py_data);
+	if (!py_runs)
+		goto err;
+
+	py_ret = Py_BuildValue("(iN)", level, py_runs);
+
 	PyGILState_Release(gstate);
 
-	Py_RETURN_NONE;
+	return py_ret;
 
+err_runs:
+	g_array_free(runs, TRUE);
 err:
 	PyGILState_Release(gstate);
 
@@ -1251,6 +1547,14 @@ static PyMethodDef Decoder_methods[] = {
 	  Decoder_wait, METH_VARARGS,
 	  Decoder_wait_doc,
 	},
+	{ "wait_chunk",
+	  Decoder_wait_chunk, METH_VARARGS,
+	  Decoder_wait_chunk_doc,
+	},
+	{ "pulses",
+	  Decoder_pulses, METH_VARARGS,
+	  Decoder_pulses_doc,
+	},
 	{ "has_channel",
 	  Decoder_has_channel, METH_VARARGS,
 	  Decoder_has_channel_doc,